@@ -35,8 +35,75 @@
 *       -10: Continuation long frame
 *       -11: End long frame (last chunk of data)
 *  
-*   As conclusion, 11-bits message IDs fix perfectly with our purpose and is enough. In any case, CAN is able to send other types of
-*   messages as remote frames, so, in the future, if it is needed to make more differences, it can be used the 29-bits message IDs.
+*   The chunks of a long frame carry a segmentation header in their first data bytes. The first byte of every chunk has the 2 low bits
+*   of a per-transfer sequence counter and the chunk number (6 bits); the first chunk also has the whole sequence counter and the total
+*   length of the PDU. In this way the chunks are placed by their number, duplicated ones are ignored, and if the end frame arrives with
+*   chunks missing, the receiver sends a NACK control frame asking only for them. Control frames are individual frames whose first byte
+*   is 0, which is not a valid Modbus function code:
+*
+*       -Beginning long frame: [tag|chunk 0] [sequence] [total length] [5 data bytes]
+*       -Continuation and end long frames: [tag|chunk] [7 data bytes]
+*       -NACK: [0] [1] [tag] [bitmap of the missing chunks, 5 bytes]
+*
+*   By default the chunks are sent back to back, as fast as the bus goes, so a receiver has to drain its receive FIFO as fast as they
+*   arrive. If MODBUS_CAN_FLOW_CONTROL is defined, the receiver paces the long frames sent to it, as in ISO 15765-2: it answers the 
+*   first chunk with a FLOW control frame with a block size (the chunks which can be sent before the next FLOW frame, 0 for all of 
+*   them) and a minimum separation time between chunks (Modbus_CAN_SetFlowControl()), and the sender waits for it after each block.
+*   A fast receiver announces 0 and 0 and takes the chunks at full speed; a slow one announces what its FIFO and its processing
+*   can take, instead of the worst case fixed delay of MODBUS_CAN_TX_DELAYED for every receiver:
+*
+*       -FLOW: [0] [4] [tag] [block size] [minimum separation time, coded as in ISO 15765-2]
+*
+*   If MODBUS_CAN_FD is defined, CAN FD frames of up to 64 bytes are used (MAX_FRAME), with the data phase at a faster bit rate, so
+*   the long frames need much less chunks: a read of 125 registers (252 bytes) needs 5 chunks instead of 37. The segmentation is the 
+*   same; as CAN FD frames longer than 8 bytes have fixed lengths, the chunks are padded with zeros (the total length tells where the 
+*   PDU finishes) and a PDU is only sent as individual frame if its length is a valid frame length. The CAN controller must support
+*   CAN FD; the Stellaris ones do not.
+*
+*   As conclusion, 11-bits message IDs fix perfectly with our purpose and is enough. Nevertheless, if MODBUS_CAN_EXTENDED_ID is defined,
+*   29-bits message IDs are used, which also carry a priority, a transaction ID and the function code:
+*
+*       -Bits 28-26: priority (the lower, the sooner it wins the arbitration)
+*       -Bits 25-24: frame type
+*       -Bit 23: request/answer bit
+*       -Bits 22-16: transaction ID, the slave answers with the one of the request
+*       -Bits 15-8: function code (first byte of the PDU)
+*       -Bits 7-0: slave
+*
+*   In this way, the master only takes the answers of the transaction in course, so a late answer of a previous request, which already
+*   timed out, does not arrive to the application, and the frames can be classified without reading their data.
+*   The priority is the class of the request given by the application of the master (MODBUS_CAN_PRIORITY_URGENT, _DEFAULT or 
+*   _BACKGROUND), and the slave answers with the one of the request, so an urgent request to a high slave number and its answer win
+*   the arbitration against the chunks of a bulk poll of a low one. The 11-bits message IDs have no room for it: there, the individual
+*   frames already win against the chunks of the long frames, and between two individual frames the lower slave number wins.
+*
+*   The frames are received through a FIFO of message objects (MODBUS_CAN_RX_FIFO_FIRST to MODBUS_CAN_RX_FIFO_LAST) chained until the 
+*   end of the buffer, so the chunks sent back to back at full bit rate are kept by the CAN controller until the interruption drains 
+*   them in order. The slave has another FIFO for the broadcasts.
+*   The master waits a fixed turnaround after a broadcast request. If MODBUS_CAN_BROADCAST_ACK is defined, each slave sends a DONE
+*   control frame once it has processed a broadcast, and the master finishes the turnaround when all the slaves given to
+*   Modbus_CAN_SetBroadcastSlaves() have sent it; the turnaround timeout is still the limit if some of them do not answer.
+*   A group poll reads the same registers of a range of slaves with only one request: the master sends a broadcast with the user 
+*   defined function code MODBUS_CAN_GROUP, the range and the read inside, and each slave of the range answers the read as if it
+*   were an unicast request. The answers are individual frames which are sent at about the same time, so the arbitration sends them
+*   one after the other without any gap, ordered by slave number, and the master collects them in one transaction.
+*   If MODBUS_CAN_PUBLISH is defined (only with 29-bits message IDs), a slave can publish blocks of up to 4 registers (or 64 coils) in auto-answer
+*   message objects (Modbus_Slave_Publish()); the master asks one with a remote frame (Modbus_Read_Snapshot()), and the CAN controller
+*   of the slave answers it with the data of the message object, without any interruption, so neither Modbus_CAN_Controller() nor
+*   the APP layer of the slave take part. The message ID carries the user defined function code MODBUS_CAN_PUBLISHED and the block
+*   in the transaction ID, so the master tells the answer from the ones of its requests. The slave refreshes the blocks when its
+*   application updates the registers (Modbus_Slave_Refresh()) and after each write of the master; the block is a snapshot of the
+*   registers at that moment.
+*   A published block can also be in change of state mode (Modbus_Slave_Change_Of_State()): the slave sends it alone, as a data
+*   frame with the same message ID, when a register changes more than a deadband from the value sent last time, or when a heartbeat
+*   interval expires without any change. The master keeps the last value of each block which it receives, pushed or asked, in a
+*   cache which its application reads without any traffic in the bus (Modbus_Read_Cache()).
+*   If MODBUS_CAN_SCHEDULE is defined too, the periodic data can go in a time-triggered schedule: the master broadcasts a reference
+*   control frame (MODBUS_CAN_CTRL_REFERENCE) at the start of each cycle (Modbus_Set_Schedule()), and each slave sends a published
+*   block in its own transmit window, a fixed time after the reference (Modbus_Slave_Schedule()). The reference and the periodic
+*   data have the highest priority (MODBUS_CAN_PRIORITY_SCHEDULE), and the master only starts its requests in the free window at
+*   the end of the cycle, so a frame of the schedule only waits, at most, for the frame which is in the bus.
+*   Both the master and the slaves should be built with the same message ID mode.
 *   
 *   The elements and functions that are explained in this module, instead of the module CAN Master or CAN Slave, are common between
 *   the master and slaves, therefore, it is not needed to make a distinction and are used in the same way in both parts.
@@ -44,19 +111,345 @@
 */
 /** @{ */
 #include "stdint.h"
+#include "inc/hw_types.h"
+#include "driverlib/can.h"
 
 //! As a board can have different CAN modules, we specify which one we want.
 #define MODBUS_CAN CAN0_BASE
 //! Following the Modbus specifications the maximum of PDU should be 256.
 #define MAX_PDU 256
-//! CAN only can send chunks of 8 bytes.
+#ifdef MODBUS_CAN_FD
+#ifndef MSG_OBJ_FD_FORMAT
+#error "MODBUS_CAN_FD needs a CAN driver with CAN FD support (MSG_OBJ_FD_FORMAT, MSG_OBJ_BIT_RATE_SWITCH and CANDataBitTimingSet)"
+#endif
+//! CAN FD can send frames of 64 bytes.
+#define MAX_FRAME 64
+//! Flags of the message objects to send CAN FD frames with the data phase at the fast bit rate.
+#define MODBUS_CAN_FD_FLAGS (MSG_OBJ_FD_FORMAT | MSG_OBJ_BIT_RATE_SWITCH)
+//! Length of the CAN FD frame needed to carry _length_ bytes; above 8 bytes only 12, 16, 20, 24, 32, 48 and 64 are possible.
+#define MODBUS_CAN_FRAME_LENGTH(length) (((length) <= 8) ? (length) : ((length) <= 12) ? 12 : ((length) <= 16) ? 16 : \
+                                         ((length) <= 20) ? 20 : ((length) <= 24) ? 24 : ((length) <= 32) ? 32 : \
+                                         ((length) <= 48) ? 48 : 64)
+#else
+//! CAN only can send frames of 8 bytes.
 #define MAX_FRAME 8
+//! Flags of the message objects to send classic CAN frames.
+#define MODBUS_CAN_FD_FLAGS MSG_OBJ_NO_FLAGS
+//! Length of the CAN frame needed to carry _length_ bytes.
+#define MODBUS_CAN_FRAME_LENGTH(length) (length)
+#endif
+//! If a PDU of _length_ bytes is sent as an individual frame: it has to fit in a frame without padding, as its length is the one of the frame.
+#define MODBUS_CAN_INDIVIDUAL(length) (((length) <= MAX_FRAME) && (MODBUS_CAN_FRAME_LENGTH(length) == (length)))
+//! Message object used to send control frames; as it is the lowest one, it goes before the mailboxes.
+#define MODBUS_CAN_CTRL_OBJ 1
+//! First message object used as transmission mailbox.
+#define MODBUS_CAN_TX_FIRST_OBJ 2
+//! Last message object used as transmission mailbox; up to 15 chunks are queued at once in the objects 2-16.
+#define MODBUS_CAN_TX_LAST_OBJ 16
+
+//! Bytes of the segmentation header in the first chunk of a long frame (chunk byte, sequence counter and total length).
+#define MODBUS_CAN_FIRST_HEADER 3
+//! Bytes of the segmentation header in the rest of chunks of a long frame (chunk byte).
+#define MODBUS_CAN_CHUNK_HEADER 1
+//! Position of the sequence counter bits (tag) in the chunk byte.
+#define MODBUS_CAN_TAG_SHIFT 6
+//! Bits of the sequence counter carried in the chunk byte.
+#define MODBUS_CAN_TAG_MASK 0x3
+//! Bits of the chunk number in the chunk byte.
+#define MODBUS_CAN_CHUNK_MASK 0x3F
+//! Maximum number of chunks of a long frame; it is limited by the bitmap of the NACK (5 bytes).
+#define MODBUS_CAN_MAX_CHUNKS 40
+//! Position of the first data byte of a chunk inside the PDU.
+#define MODBUS_CAN_CHUNK_OFFSET(chunk) ((chunk) ? ((MAX_FRAME - MODBUS_CAN_FIRST_HEADER) + \
+                                        ((chunk) - 1) * (MAX_FRAME - MODBUS_CAN_CHUNK_HEADER)) : 0)
+//! Number of chunks needed to send a long frame of _length_ bytes.
+#define MODBUS_CAN_CHUNKS(length) (((length) <= (MAX_FRAME - MODBUS_CAN_FIRST_HEADER)) ? 1 : \
+                                   (1 + ((length) - (MAX_FRAME - MODBUS_CAN_FIRST_HEADER) + (MAX_FRAME - MODBUS_CAN_CHUNK_HEADER) - 1) / \
+                                   (MAX_FRAME - MODBUS_CAN_CHUNK_HEADER)))
+//! Bitmap with the _chunks_ first chunks marked.
+#define MODBUS_CAN_ALL_CHUNKS(chunks) ((((uint64_t)1) << (chunks)) - 1)
+//! Frame type (2 bits of the header) of the Individual Frame.
+#define MODBUS_CAN_INDIVIDUAL_FRAME 0x0
+//! Frame type (2 bits of the header) of the Beginning Long Frame.
+#define MODBUS_CAN_BEGIN_FRAME 0x1
+//! Frame type (2 bits of the header) of the Continuation Long Frame.
+#define MODBUS_CAN_CONTINUATION_FRAME 0x2
+//! Frame type (2 bits of the header) of the End Long Frame.
+#define MODBUS_CAN_END_FRAME 0x3
+//! Priority of the requests sent by the master (extended message IDs).
+#define MODBUS_CAN_PRIORITY_DEFAULT 4
+//! Priority of the urgent requests of the master, as an emergency stop (extended message IDs).
+#define MODBUS_CAN_PRIORITY_URGENT 1
+//! Priority of the background requests of the master, as the polling (extended message IDs).
+#define MODBUS_CAN_PRIORITY_BACKGROUND 6
+
+#ifdef MODBUS_CAN_EXTENDED_ID
+//! Position of the frame type in the message ID.
+#define MODBUS_CAN_TYPE_SHIFT 24
+//! Position of the request/answer bit in the message ID.
+#define MODBUS_CAN_REQUEST_SHIFT 23
+//! Position of the priority in the message ID.
+#define MODBUS_CAN_PRIORITY_SHIFT 26
+//! Position of the transaction ID in the message ID.
+#define MODBUS_CAN_TXN_SHIFT 16
+//! Bits of the transaction ID.
+#define MODBUS_CAN_TXN_MASK 0x7F
+//! Message ID built from its fields.
+#define MODBUS_CAN_ID(type, request, priority, txn, function, slave) \
+        ((((unsigned long)(priority) & 0x7) << MODBUS_CAN_PRIORITY_SHIFT) | (((unsigned long)(type) & 0x3) << MODBUS_CAN_TYPE_SHIFT) | \
+         (((unsigned long)(request) & 0x1) << MODBUS_CAN_REQUEST_SHIFT) | \
+         (((unsigned long)(txn) & MODBUS_CAN_TXN_MASK) << MODBUS_CAN_TXN_SHIFT) | \
+         (((unsigned long)(function) & 0xFF) << 8) | ((unsigned long)(slave) & 0xFF))
+//! Transaction ID of a message ID.
+#define MODBUS_CAN_ID_TXN(id) (((id) >> MODBUS_CAN_TXN_SHIFT) & MODBUS_CAN_TXN_MASK)
+//! Function code of a message ID.
+#define MODBUS_CAN_ID_FUNCTION(id) (((id) >> 8) & 0xFF)
+//! Priority of a message ID.
+#define MODBUS_CAN_ID_PRIORITY(id) (((id) >> MODBUS_CAN_PRIORITY_SHIFT) & 0x7)
+//! Mask of the slaves to receive the requests: request/answer bit and slave.
+#define MODBUS_CAN_REQUEST_MASK ((1UL << MODBUS_CAN_REQUEST_SHIFT) | 0xFF)
+//! Flags of the message objects to send with 29-bits message IDs.
+#define MODBUS_CAN_ID_FLAGS MSG_OBJ_EXTENDED_ID
+//! Flags of the message objects to receive only 29-bits message IDs.
+#define MODBUS_CAN_FILTER_FLAGS (MSG_OBJ_EXTENDED_ID | MSG_OBJ_USE_EXT_FILTER)
+#else
+//! Position of the frame type in the message ID.
+#define MODBUS_CAN_TYPE_SHIFT 9
+//! Position of the request/answer bit in the message ID.
+#define MODBUS_CAN_REQUEST_SHIFT 8
+//! Message ID built from its fields; with 11-bits message IDs only the frame type, the request/answer bit and the slave are used.
+#define MODBUS_CAN_ID(type, request, priority, txn, function, slave) \
+        ((((unsigned long)(type) & 0x3) << MODBUS_CAN_TYPE_SHIFT) | (((unsigned long)(request) & 0x1) << MODBUS_CAN_REQUEST_SHIFT) | \
+         ((unsigned long)(slave) & 0xFF))
+//! Transaction ID of a message ID; there is not with 11-bits message IDs.
+#define MODBUS_CAN_ID_TXN(id) 0
+//! Priority of a message ID; there is not with 11-bits message IDs.
+#define MODBUS_CAN_ID_PRIORITY(id) MODBUS_CAN_PRIORITY_DEFAULT
+//! Mask of the slaves to receive the requests: request/answer bit and slave.
+#define MODBUS_CAN_REQUEST_MASK 0x1FF
+//! Flags of the message objects to send with 11-bits message IDs.
+#define MODBUS_CAN_ID_FLAGS MSG_OBJ_NO_FLAGS
+//! Flags of the message objects to receive 11-bits message IDs.
+#define MODBUS_CAN_FILTER_FLAGS MSG_OBJ_NO_FLAGS
+#endif
+//! Frame type of a message ID.
+#define MODBUS_CAN_ID_TYPE(id) (((id) >> MODBUS_CAN_TYPE_SHIFT) & 0x3)
+//! Request/answer bit of a message ID.
+#define MODBUS_CAN_ID_REQUEST(id) (((id) >> MODBUS_CAN_REQUEST_SHIFT) & 0x1)
+//! Slave of a message ID.
+#define MODBUS_CAN_ID_SLAVE(id) ((id) & 0xFF)
+//! Mask of the master to receive the answers: only the request/answer bit, as all the answers share the receive FIFO; the slave
+//! and the transaction ID are checked by software.
+#define MODBUS_CAN_ANSWER_MASK (1UL << MODBUS_CAN_REQUEST_SHIFT)
+//! First message object of the receive FIFO; the message objects until MODBUS_CAN_RX_FIFO_LAST are chained.
+#define MODBUS_CAN_RX_FIFO_FIRST 17
+//! Last message object of the receive FIFO, the end of the buffer.
+#define MODBUS_CAN_RX_FIFO_LAST 24
+//! Bits of the message objects from _first_ to _last_ in the CAN_STS_NEWDAT status.
+#define MODBUS_CAN_RX_FIFO_BITS(first, last) ((0xFFFFFFFFUL >> (32 - ((last) - (first) + 1))) << ((first) - 1))
+//! Maximum number of NACKs sent for the same long frame; after that, it is dropped and the master timeout will act.
+#define MODBUS_CAN_NACK_RETRIES 3
+//! First byte of the control frames; the function code 0 does not exist in Modbus.
+#define MODBUS_CAN_CTRL 0x00
+//! Control frame to ask for the missing chunks of a long frame.
+#define MODBUS_CAN_CTRL_NACK 0x01
+//! Length of the NACK control frame; the bitmap of the missing chunks has 5 bytes, also with CAN FD.
+#define MODBUS_CAN_NACK_LENGTH 8
+//! Control frame of a slave which has processed a broadcast request (MODBUS_CAN_BROADCAST_ACK): [0] [2] [function code].
+#define MODBUS_CAN_CTRL_DONE 0x02
+//! Length of the DONE control frame.
+#define MODBUS_CAN_DONE_LENGTH 3
+#ifdef MODBUS_CAN_FLOW_CONTROL
+#ifdef MODBUS_CAN_TX_DELAYED
+#error "MODBUS_CAN_FLOW_CONTROL paces the chunks as the receiver asks, it replaces the fixed delay of MODBUS_CAN_TX_DELAYED"
+#endif
+//! Control frame of the receiver of a long frame which allows the next block of chunks: [0] [4] [tag] [block size] [STmin].
+#define MODBUS_CAN_CTRL_FLOW 0x04
+//! Length of the FLOW control frame.
+#define MODBUS_CAN_FLOW_LENGTH 5
+//! Cycles which the sender waits for a FLOW control frame (N_Bs, 100 ms at 40 MHz); then, the long frame is dropped.
+#define MODBUS_CAN_FLOW_TIMEOUT 4000000
+//! Minimum separation time (STmin) of a FLOW control frame in cycles: 0x00-0x7F are milliseconds, 0xF1-0xF9 are 100-900 
+//! microseconds and the reserved values are taken as the longest one, 127 ms.
+#define MODBUS_CAN_STMIN_CYCLES(stmin) (((stmin) <= 0x7F) ? ((SysCtlClockGet() / 1000) * (stmin)) : \
+                                        (((stmin) >= 0xF1) && ((stmin) <= 0xF9)) ? ((SysCtlClockGet() / 10000) * ((stmin) - 0xF0)) : \
+                                        ((SysCtlClockGet() / 1000) * 0x7F))
+#endif
+//! Function code of the group poll, a user defined one: [0x41] [first slave] [last slave] [function code 3 or 4] [address, 2 bytes]
+//! [quantity, 2 bytes]. It is sent as a broadcast, and the slaves from the first to the last one answer the read inside.
+#define MODBUS_CAN_GROUP 0x41
+//! Length of the group poll request.
+#define MODBUS_CAN_GROUP_LENGTH 8
+//! Bytes of the group poll request before the read inside: function code, first and last slave.
+#define MODBUS_CAN_GROUP_HEADER 3
+//! Maximum number of slaves of a group poll.
+#define MODBUS_CAN_GROUP_MAX 32
+#ifdef MODBUS_CAN_PUBLISH
+#ifndef MODBUS_CAN_EXTENDED_ID
+#error "MODBUS_CAN_PUBLISH needs MODBUS_CAN_EXTENDED_ID: the answers of the remote frames are told apart by the function code of the message ID"
+#endif
+//! Function code carried in the message ID of the published blocks, a user defined one; it is never the first byte of a PDU.
+#define MODBUS_CAN_PUBLISHED 0x42
+//! Blocks which a slave can publish, each one in its own message object.
+#define MODBUS_CAN_PUBLISH_BLOCKS 4
+//! Most registers of a published block: a classic frame, as there are not remote frames in CAN FD.
+#define MODBUS_CAN_PUBLISH_REGISTERS 4
+//! Most coils or discrete inputs of a published block, packed as in the answer of a read.
+#define MODBUS_CAN_PUBLISH_COILS 64
+//! Message ID of the block _block_ of the slave _slave_, the one of the remote frame of the master and of the answer of the slave.
+#define MODBUS_CAN_PUBLISH_ID(block, slave) MODBUS_CAN_ID(MODBUS_CAN_INDIVIDUAL_FRAME, 0, MODBUS_CAN_PRIORITY_DEFAULT, block, \
+                                                          MODBUS_CAN_PUBLISHED, slave)
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+#ifndef MODBUS_CAN_PUBLISH
+#error "MODBUS_CAN_SCHEDULE needs MODBUS_CAN_PUBLISH: the periodic data of the slaves are their published blocks"
+#endif
+//! Control frame of the master which starts a cycle of the schedule: [MODBUS_CAN_CTRL, MODBUS_CAN_CTRL_REFERENCE, cycle].
+#define MODBUS_CAN_CTRL_REFERENCE 0x03
+//! Length of the reference frame.
+#define MODBUS_CAN_REFERENCE_LENGTH 3
+//! Priority of the reference frames and of the periodic data of the schedule, above the urgent requests.
+#define MODBUS_CAN_PRIORITY_SCHEDULE 0
+//! Message ID of the reference frame of the cycle _cycle_, a broadcast.
+#define MODBUS_CAN_REFERENCE_ID(cycle) MODBUS_CAN_ID(MODBUS_CAN_INDIVIDUAL_FRAME, 1, MODBUS_CAN_PRIORITY_SCHEDULE, cycle, \
+                                                     MODBUS_CAN_CTRL, 0)
+//! Message ID of the block _block_ of the slave _slave_ sent in its transmit window.
+#define MODBUS_CAN_SCHEDULE_ID(block, slave) MODBUS_CAN_ID(MODBUS_CAN_INDIVIDUAL_FRAME, 0, MODBUS_CAN_PRIORITY_SCHEDULE, block, \
+                                                           MODBUS_CAN_PUBLISHED, slave)
+#endif
 
-//!Possible bit rate ranges implemented
+//! Possible results when a chunk of a long frame is reassembled.
+enum Modbus_CAN_Reassembly_Result
+{
+      MODBUS_CAN_REASSEMBLY_PENDING,    //!< The long frame is not complete yet
+      MODBUS_CAN_REASSEMBLY_DONE,       //!< All the chunks were received
+      MODBUS_CAN_REASSEMBLY_MISSING     //!< The end frame was received but some chunks are missing
+};
+
+//! Incoming PDU and the state of its reassembly.
+struct Modbus_CAN_Input
+{
+      unsigned char *pdu;               //!< Input data; it is swapped with the buffer of the APP layer when it is handed over
+      unsigned char buffer[MAX_PDU];    //!< Storage of a buffer for the input data, _pdu_ may point to other one
+      unsigned char length;             //!< Input data length
+      unsigned char index;              //!< Amount of data already received
+      uint64_t map;                     //!< Chunks of the incoming long frame already received, one bit per chunk
+      unsigned char seq;                //!< Sequence counter of the incoming long frame
+      unsigned char tag;                //!< Low bits of the sequence counter carried by every chunk of the incoming long frame
+      unsigned char total;              //!< Total length of the incoming long frame, 0 while the first chunk is not received
+      unsigned char chunks;             //!< Number of chunks of the incoming long frame, 0 while it is not known
+      unsigned char nacks;              //!< Number of NACKs sent for the incoming long frame
+      unsigned char txn;                //!< Transaction ID of the incoming request, for its NACK and FLOW frames and its answer (slave)
+      unsigned char priority;           //!< Priority of the incoming request, used as _txn_ (slave)
+#ifdef MODBUS_CAN_FLOW_CONTROL
+      unsigned char flow;               //!< Chunks received since the last FLOW control frame was sent
+      unsigned char flow_pending;       //!< 1 if the FLOW control frame waits for the control message object
+#endif
+      unsigned char active;             //!< If a long frame is being reassembled (1) or it was already completed (2)
+};
+
+//! Standard bit rates; the value is the bit rate in Kbps, so any other one can be given as (enum Modbus_CAN_BitRate)Kbps.
 enum Modbus_CAN_BitRate
 {
-      MODBUS_100KBPS,   //! Bit rate of 100 Kbps
-      MODBUS_1MBPS      //! Bit rate of 1 Mbps
+      MODBUS_100KBPS = 100,     //! Bit rate of 100 Kbps
+      MODBUS_125KBPS = 125,     //! Bit rate of 125 Kbps
+      MODBUS_250KBPS = 250,     //! Bit rate of 250 Kbps
+      MODBUS_500KBPS = 500,     //! Bit rate of 500 Kbps
+      MODBUS_800KBPS = 800,     //! Bit rate of 800 Kbps
+      MODBUS_1MBPS = 1000       //! Bit rate of 1 Mbps
+};
+
+#ifndef MODBUS_CAN_CLOCK
+//! Clock of the CAN controller, in Hz; the one of the Stellaris runs from the system clock.
+#define MODBUS_CAN_CLOCK SysCtlClockGet()
+#endif
+//! Maximum error of the bit rate got from the CAN clock, in parts per 10000 (0.5 %, within the oscillator tolerance of CAN).
+#define MODBUS_CAN_BIT_TOLERANCE 50
+//! Fewest time quanta in a bit; 4 are only chosen for the fast data phase of CAN FD, the nominal bit rates get more if possible.
+#define MODBUS_CAN_TQ_MIN 4
+//! Most time quanta in a bit: Sync + Prop + Phase1 up to 16, Phase2 up to 8.
+#define MODBUS_CAN_TQ_MAX 24
+//! Largest quantum prescaler of the CAN controller (with the baud rate prescaler extension).
+#define MODBUS_CAN_PRESCALER_MAX 1024
+//! Sample point sought by the bit timing, in parts per 1000 (87.5 %, the one recommended by CiA).
+#define MODBUS_CAN_SAMPLE_POINT 875
+#ifdef MODBUS_CAN_FD
+//! Bit rate of the data phase of the CAN FD frames, in Kbps; if the CAN clock does not give it, the data phase goes at the nominal one.
+#define MODBUS_CAN_FD_DATA_RATE 2000
+#endif
+//! Transfer time of a byte at 1 Kbps, in cycles; the delay and the guessed timeouts divide it by the bit rate in Kbps.
+#define MODBUS_CAN_TRANSFER_TIME 933333000UL
+//! Process time of a byte, in cycles; it does not depend on the bit rate.
+#define MODBUS_CAN_PROCESS_TIME (900000UL * 4)
+
+//! Cycles waited after a bus-off before the CAN controller is initialised again; doubled after each bus-off without a transfer done.
+#define MODBUS_CAN_RESTART_DELAY 100000
+//! Maximum number of times the restart delay is doubled.
+#define MODBUS_CAN_BACKOFF_MAX 6
+//! Cycles given to the CAN controller to leave the bus-off state after a restart (master); if it does not, it is restarted again.
+#define MODBUS_CAN_RECOVERY_TIMEOUT 4000000
+
+//! States of the CAN controller; the bus can be used while the state is lower than MODBUS_CAN_BUS_OFF.
+enum Modbus_CAN_BusState
+{
+      MODBUS_CAN_BUS_ACTIVE,            //!< Error counters below the warning level
+      MODBUS_CAN_BUS_WARNING,           //!< An error counter reached the warning level (96)
+      MODBUS_CAN_BUS_PASSIVE,           //!< An error counter reached the error passive level (128)
+      MODBUS_CAN_BUS_OFF,               //!< Bus-off, waiting to initialise the CAN controller again
+      MODBUS_CAN_BUS_RECOVERING         //!< Initialised again, waiting for the 128 sequences of 11 recessive bits
+};
+
+//! Bus-health counters, they are never reset.
+struct Modbus_CAN_Health
+{
+      enum Modbus_CAN_BusState state;   //!< Current state of the CAN controller
+      unsigned long bus_off;            //!< Times the bus-off state was entered
+      unsigned long passive;            //!< Times the error passive level was entered
+      unsigned long warning;            //!< Times the warning level was entered
+      unsigned long frame_errors;       //!< Error frames seen (stuff, form, ack, bit and CRC errors)
+      unsigned long restarts;           //!< Times the CAN controller was initialised again
+      unsigned long recoveries;         //!< Times the bus was usable again after a bus-off
+      unsigned long replays;            //!< Transfers sent again or dropped because of a bus-off
+      unsigned long last_recovery;      //!< Cycles from the last bus-off to the recovery, only measured by the master
+      unsigned long max_recovery;       //!< Longest recovery, in cycles, only measured by the master
+      unsigned char backoff;            //!< Bus-offs since the last transfer done, the restart delay is doubled for each one
+};
+
+//! Buckets of the latency histogram of struct Modbus_CAN_Stats.
+#define MODBUS_CAN_STATS_BUCKETS 16
+//! Upper limit of the first bucket of the latency histogram, in cycles (51.2 us at 40 MHz); each next bucket doubles it.
+#define MODBUS_CAN_STATS_UNIT 2048
+//! Slaves with their own retry and timeout counters, from the number 0; the higher numbers share the last entry.
+#define MODBUS_CAN_STATS_SLAVES 248
+//! Entry of a slave in the retry and timeout counters of struct Modbus_CAN_Stats.
+#define MODBUS_CAN_STATS_SLAVE(slave) (((slave) < MODBUS_CAN_STATS_SLAVES) ? (slave) : (MODBUS_CAN_STATS_SLAVES - 1))
+
+/**
+*   @brief Traffic counters of the CAN layer, they are never reset.
+*
+*   The counters are written from the interruptions of the CAN layer, the CAN interruption and the timers of the node, which have
+*   the same priority and so never interrupt each other, and from the main loop only with those interruptions disabled
+*   (Modbus_CAN_Lock()): the frames sent from there, the retries and the frames taken by Modbus_CAN_CallBack(). So the updates are
+*   plain increments, and Modbus_CAN_GetStats() copies all the counters at the same instant.
+*/
+struct Modbus_CAN_Stats
+{
+      unsigned long frames_sent;        //!< Frames sent, data and control frames; the chunks sent again after a NACK count again
+      unsigned long bytes_sent;         //!< Data bytes of the frames sent, the padding of the CAN FD frames included
+      unsigned long frames_received;    //!< Frames taken from the receive FIFOs, also the ones which are ignored
+      unsigned long bytes_received;     //!< Data bytes of the frames received
+      unsigned long overruns;           //!< Frames lost because the receive FIFO was full (data lost flag)
+      unsigned long lec[8];             //!< Errors of the bus by last error code: CAN_STATUS_LEC_STUFF, FORM, ACK, BIT1, BIT0 and CRC
+      unsigned long reassembly_aborts;  //!< Long frames dropped before being complete: too long, too many NACKs or replaced by other
+#ifdef MODBUS_CAN_FLOW_CONTROL
+      unsigned long flow_timeouts;      //!< Long frames sent which were dropped because the receiver did not send its FLOW control frame
+#endif
+#if MODBUS_MASTER
+      unsigned long answers;            //!< Answers received, the ones counted in _latency_
+      unsigned long latency[MODBUS_CAN_STATS_BUCKETS]; //!< Times from the request sent to the answer complete; the bucket i > 0 counts the ones from MODBUS_CAN_STATS_UNIT << (i - 1) to MODBUS_CAN_STATS_UNIT << i cycles, the last one also the longer ones
+      uint16_t retries[MODBUS_CAN_STATS_SLAVES];       //!< Requests sent again by slave number, after a timeout or a wrong answer
+      uint16_t timeouts[MODBUS_CAN_STATS_SLAVES];      //!< Unicast timeouts by slave number
+#endif
 };
 /** @} */
 //////////////////////////////////////////////////MASTER/////////////////////////////////////////////////////////////////
@@ -82,7 +475,12 @@ enum Modbus_CAN_BitRate
 *   something was wrong and master will try to send again the request. The values of the timeouts will be explained deeply in the proper 
 *   functions.
 * 
-*   Additionaly, to understand the code, it has to be kept in my mind that master works following the next behaviour according to the Modbus 
+*   The master is able to keep requests to different slaves in flight at the same time, up to MODBUS_CAN_SLOTS. Each request in flight 
+*   uses a slot, which has its own receive message object, timeout and state. Only one request per slave is in flight, as the answers 
+*   of a slave are recognised by its number, and the requests are sent in order: if the first request of the FIFO is for a slave which
+*   is busy, it waits. A broadcast request waits until all slots are free and no request is sent during its turnaround.
+*
+*   Additionaly, to understand the code, it has to be kept in my mind that each request follows the next behaviour according to the Modbus 
 *   specifications:
 *
 *   @image html images/masterstates.jpg
@@ -102,13 +500,108 @@ enum Modbus_MainState
     MODBUS_ERROR           //!< Error process state
 };
 
+//! Maximum number of requests in flight at the same time, each one to a different slave.
+#define MODBUS_CAN_SLOTS 4
+#ifdef MODBUS_CAN_FLOW_CONTROL
+//! Timer of the flow control of the long frames sent (Modbus_CAN_FlowHandler()): the separation time or the wait for a FLOW frame.
+#define MODBUS_CAN_FLOW_TIMER TIMER0_BASE
+#endif
+//! Cycles between two ticks of the timer used for the unicast timeouts.
+#define MODBUS_CAN_TIMER_TICK 100000
+//! Default minimum unicast timeout, in cycles (10 ms at 40 MHz). It can be changed with Modbus_CAN_SetTimeoutLimits().
+#define MODBUS_CAN_RTO_MIN 400000
+//! Default maximum unicast timeout, in cycles (1 s at 40 MHz). It can be changed with Modbus_CAN_SetTimeoutLimits().
+#define MODBUS_CAN_RTO_MAX 40000000
+//! Entries of the table of response times; each one is used by a slave and a function code.
+#define MODBUS_CAN_RTT_ENTRIES 32
+
+//! Response time learned for a slave and a function code, in cycles.
+struct Modbus_CAN_Rtt
+{
+    unsigned char slave;                 //!< Slave of the entry
+    unsigned char function;              //!< Function code of the entry
+    unsigned char samples;               //!< Answers measured, up to 255; the entry is empty if it is 0
+    unsigned long srtt;                  //!< Smoothed response time
+    unsigned long rttvar;                //!< Smoothed deviation of the response time
+};
+
+//! Request in flight; the slot is free if _slave_ is 0.
+struct Modbus_CAN_Slot
+{
+    unsigned char slave;                 //!< Slave which is asked
+    unsigned char txn;                   //!< Sequence counter of the request, it is also the transaction ID in the extended message IDs
+    enum Modbus_MainState state;         //!< State of the request: MODBUS_WAITREPLY, MODBUS_PROCESSING or MODBUS_ERROR
+    unsigned char attempts;              //!< Sending attempts already done
+    unsigned char complete_reception;    //!< If the whole answer was received
+    unsigned long ticks;                 //!< Timer ticks left to the unicast timeout, 0 if it is not running
+    unsigned char function;              //!< Function code of the request
+    unsigned long sent;                  //!< Time when the request was sent, in cycles
+    unsigned char replay;                //!< 1 if it has to be sent again after a bus-off without counting an attempt, 2 once it was
+    unsigned char priority;              //!< Priority of the request (extended message IDs)
+    struct Modbus_CAN_Input input;       //!< Answer of the slave
+};
+
+//! Group poll in course; there is not if _last_ is 0.
+struct Modbus_CAN_Group
+{
+    unsigned char first;                 //!< First slave asked
+    unsigned char last;                  //!< Last slave asked
+    unsigned char left;                  //!< Answers not received yet
+    unsigned long sent;                  //!< Time when the request was sent, in cycles
+    unsigned long latest;                //!< Time from the request to the last answer received, in cycles
+    unsigned char length[MODBUS_CAN_GROUP_MAX];            //!< Length of the answer of each slave, from _first_; 0 if it did not arrive
+    unsigned char answer[MODBUS_CAN_GROUP_MAX][MAX_FRAME]; //!< Answer of each slave, always an individual frame
+    unsigned char *pdu;                  //!< Answer handed over to the APP layer; it is swapped with the buffer of the APP layer
+    unsigned char buffer[MAX_PDU];       //!< Storage of a buffer for _pdu_
+};
+
+#ifdef MODBUS_CAN_PUBLISH
+#ifdef MODBUS_CAN_SCHEDULE
+//! Published blocks which can be asked at the same time; each one uses a message object from MODBUS_CAN_SNAPSHOT_FIRST.
+#define MODBUS_CAN_SNAPSHOTS 7
+//! Message object of the reference frames of the schedule, after the ones of the snapshots.
+#define MODBUS_CAN_REFERENCE_OBJ 32
+//! Timer of the cycles of the schedule, with its interruption (Modbus_CAN_CycleHandler()).
+#define MODBUS_CAN_CYCLE_TIMER TIMER3_BASE
+#else
+//! Published blocks which can be asked at the same time; each one uses a message object from MODBUS_CAN_SNAPSHOT_FIRST.
+#define MODBUS_CAN_SNAPSHOTS 8
+#endif
+//! Message object of the remote frame of the first snapshot; the answers arrive through the receive FIFO, which goes before.
+#define MODBUS_CAN_SNAPSHOT_FIRST 25
+
+//! Published block asked with a remote frame; the entry is free if _slave_ is 0.
+struct Modbus_CAN_Snapshot
+{
+    unsigned char slave;                 //!< Slave asked
+    unsigned char block;                 //!< Block asked
+    unsigned char length;                //!< Length of the answer, 0 while it has not arrived
+    unsigned long sent;                  //!< Time when the remote frame was sent, in cycles
+    unsigned char data[8];               //!< Answer of the slave, the registers in big endian
+};
+
+//! Blocks kept in the cache of the published blocks; when it is full, the one updated longest ago is replaced.
+#define MODBUS_CAN_CACHE 32
+
+//! Last value received of a published block, pushed by the slave or asked with a remote frame; the entry is free if _slave_ is 0.
+struct Modbus_CAN_Cache
+{
+    unsigned char slave;                 //!< Slave which published the block
+    unsigned char block;                 //!< Block
+    unsigned char length;                //!< Length of the block
+    unsigned long updated;               //!< Time when the block was received, in cycles
+    unsigned char data[8];               //!< The block
+};
+#endif
+
 /////////////////////////////////////////////MASTER PROTOTYPES//////////////////////////////////////////////
 /**
 *    @brief CAN Initialisation function.
 *
 *    This is the function to initialise the CAN module. The system and some variables used for Modbus are also initialised.
-*    The message object 1 would be set up for transfers in the function made to send data.
-*    The message object 17 will be put as receive message object for unicast requests.
+*    The message object MODBUS_CAN_CTRL_OBJ (1) sends the control frames and the message objects MODBUS_CAN_TX_FIRST_OBJ to
+*    MODBUS_CAN_TX_LAST_OBJ (2-16) are the transmission mailboxes, loaded in the function made to send data.
+*    The message objects of the receive FIFO (17-24) will be put as receive message objects for the answers of all slots.
 *    CAN message's IDs(11-bit) in Modbus will be compound by a header(3 bits) and a slave number (8 bits)
 *    Modbus header frames in CAN as was previously mentioned are as follows:
 *
@@ -129,75 +622,112 @@ void Modbus_CAN_Init(enum Modbus_CAN_BitRate bit_rate, unsigned char attempts);
 /**
 *     @brief Function to send information.
 *
-*     This function is called when the master wants to send data. The messages in CAN are built up as 8 bytes as maximum, so, this function
-*     will process all data sending chunks of 8 bytes. That makes to have some kind of control to know which chunk is expected, therefore,
-*     there are 4 types of messages with the following different headers in the message ID, in this way it can be known when the big messages 
-*     start and when they finish:
+*     This function is called when the master wants to send data. The messages in CAN are built up as MAX_FRAME bytes as maximum, so,
+*     this function will process all data sending chunks of MAX_FRAME bytes; the segmentation header takes the first bytes of each chunk,
+*     so a chunk carries 7 data bytes (5 the first one) with classic CAN. That makes to have some kind of control to know which chunk is
+*     expected, therefore, there are 4 types of messages with the following different headers in the message ID, in this way it can be
+*     known when the big messages start and when they finish:
 *
 *               -001: Individual Frame + request bit
 *               -011: Beginning Long Frame + request bit
 *               -101: Continuation Long Frame + request bit
 *               -111: End Long Frame + request bit
 *
-*     The rest of the message ID will be the slave number. 
-*     When the function splits up all the data and sends the last chunk, the timer is set up to be triggered if a complete reception does 
-*     not arrive.
+*     The rest of the message ID will be the slave number. An unicast request uses the slot of the slave if it is being sent again,
+*     or a free one; Modbus_CAN_Ready() should be checked before.
+*     The PDU is copied and the first chunks are queued in the transmission mailboxes by Modbus_CAN_TxRefill(), the rest of them are 
+*     queued from Modbus_CAN_IntHandler() when the mailboxes are sent, so the function returns without waiting for the bus. Before the
+*     first chunk is queued, the slot waits for the answer and the timer is set up to be triggered if a complete reception does not
+*     arrive, so a fast answer is not dropped.
+*     If MODBUS_CAN_TX_DELAYED is defined, the old behaviour is kept: only the first mailbox, MODBUS_CAN_TX_FIRST_OBJ, is used and
+*     Modbus_CAN_Delay() is called between chunks.
 *     @param mb_req_pdu The information to be sent.
 *     @param slave The number of the slave who will receive the data.
 *     @param pdu_length The amount of data to be sent.
 *     @param amount_guess A guess of the amount of data (in bytes) that will pass through the bus.
+*     @param priority Priority of the message IDs of the request and its NACKs (extended message IDs), MODBUS_CAN_PRIORITY_DEFAULT 
+*     unless it is urgent or background.
+*     A broadcast which is a group poll (MODBUS_CAN_GROUP) puts the master in _MODBUS_WAITREPLY_ until all the slaves of the group
+*     have answered or the group timeout expires, see Modbus_CAN_GroupTimeout().
+*     @return The slot used by the request, or MODBUS_CAN_SLOTS if it is a broadcast or a group poll.
 *     @note Slave number is supposed to be right.
-*     @sa CANMessageSet, Modbus_CAN_ReceptionConfiguration, Modbus_CAN_Delay, Modbus_SetMainState, Modbus_CAN_UnicastTimeout, Modbus_CAN_BroadcastTimeout
+*     @sa Modbus_CAN_TxRefill, Modbus_CAN_ReceptionConfiguration, Modbus_CAN_Delay, Modbus_SetMainState, Modbus_CAN_UnicastTimeout, Modbus_CAN_BroadcastTimeout
 */
-void Modbus_CAN_FixOutput(unsigned char *mb_req_pdu, unsigned char slave, unsigned char pdu_length, uint16_t amount_guess);
+unsigned char Modbus_CAN_FixOutput(unsigned char *mb_req_pdu, unsigned char slave, unsigned char pdu_length, uint16_t amount_guess,
+                                   unsigned char priority);
+
+/**
+*     @brief Function to know if a request can be sent.
+*
+*     A request can be sent if the mailboxes are free and the master is not in the turnaround of a broadcast. Moreover, an unicast 
+*     request needs a free slot and that the slave has not another request in flight, and a broadcast request needs all slots free.
+*     If the time-triggered schedule runs (MODBUS_CAN_SCHEDULE), it also has to be in the free window of the cycle.
+*     @param slave The number of the slave who will receive the request.
+*     @return <b>1</b> if the request can be sent, or <b>0</b> if it has to wait.
+*     @sa Modbus_CAN_FixOutput, Modbus_App_FIFOSend
+*/
+unsigned char Modbus_CAN_Ready(unsigned char slave);
 
 /**
 *     @brief Function to configure the message object to receive data.
 * 
-*     This function is called when the master wants to send data to a particular slave and receive an answer. In such way, it is configured 
-*     the receive message object (num. 17). It is set up with the ID equal to the number of the slave, because it is expected the message 
-*     from the slave we send data. The mask is put to receive all messages from that slave which are responses (request bit=0), independently
-*     of the other two bits of the header, which indicates the type of frame as was explained previously.
-*     @param slave The number of the slave from whom it will be received the data.
+*     This function is called when the master wants to send data to a particular slave and receive an answer. The reception of the 
+*     slot is reset; the answers of all slots arrive through the receive FIFO, which is set up once in Modbus_CAN_Init() to receive all
+*     the messages which are responses (request bit=0). Modbus_CAN_CallBack() gives each one to the slot of its slave and, with extended 
+*     message IDs, only if it has the transaction ID of the request.
+*     @param slot The slot of the request, which has already the slave and the transaction ID.
 *     @note Slave number is supposed to be right.
-*     @sa CANMessageSet, Modbus_CAN_FixOutput
+*     @sa Modbus_CAN_FixOutput, Modbus_CAN_CallBack
 */
-void Modbus_CAN_ReceptionConfiguration(unsigned char slave);
+void Modbus_CAN_ReceptionConfiguration(unsigned char slot);
 
-/** 
-*    @brief Function to acknowledge if a forward is needed.
+/**
+*   @brief Function to get the state of a request in flight.
+*
+*   @param slot The slot of the request.
+*   @return The state of the request; MODBUS_IDLE if the slot is free.
+*   @sa Modbus_CAN_SetSlotState, Modbus_GetMainState
+*/
+enum Modbus_MainState Modbus_CAN_GetSlotState(unsigned char slot);
+
+/**
+*   @brief Function to set the state of a request in flight.
 *
-*    This function is called to know if a resend should be done. After get the proper value, the forward flag is cleared.
-*    A resend has to be done if an unicast timeout was triggered with a reception not completed.
-*    @note A resend is always possible as much as the maximum number of forward attempts is not achieved.
-*    @return <b>0</b> If it is not needed a forward, or <b>1</b> if it is needed.
+*   It is used by the APP layer when an answer is processed: MODBUS_ERROR to send the request again, or MODBUS_IDLE to free the slot.
+*   @param slot The slot of the request.
+*   @param state The new state of the request.
+*   @sa Modbus_CAN_GetSlotState, Modbus_App_Manage_CallBack
 */
-unsigned char Modbus_CAN_GetForwardFlag(void);
+void Modbus_CAN_SetSlotState(unsigned char slot, enum Modbus_MainState state);
 
 /**
 *   @brief Function to reset the number of sending attempts.
 *
 *   This function is called when there is a completely new transmission. So, the actual number of sending attempts has to be
 *   reset.
+*   @param slot The slot of the request.
 */
-void Modbus_CAN_Reset_Attempt(void);
+void Modbus_CAN_Reset_Attempt(unsigned char slot);
 
 /**
 *   @brief Function to repeat a request.
 * 
 *   This function checks if it is possible to send a request again, probably because an error.
-*   If it is possible, _modbus_forward_flag_ is marked, if it is not possible because
-*   it was already achieved the maximum number of attempts, then it is notified to APP layer to discard this request.
-*   @sa Modbus_App_No_Response
+*   If it is possible, the request is sent again from the APP layer using the same slot, if it is not possible because
+*   it was already achieved the maximum number of attempts, then it is notified to APP layer to discard this request and the slot
+*   is freed.
+*   @param slot The slot of the request.
+*   @sa Modbus_App_Resend, Modbus_App_No_Response
 */
-void Modbus_CAN_Repeat_Request(void);
+void Modbus_CAN_Repeat_Request(unsigned char slot);
 
 /**
-*   @brief This function is used to change the master state in case a timeout shows up.
+*   @brief This function is used to change the master state in case the broadcast timeout shows up.
 * 
-*   This function is called when one timeout is trigered. If the timeout was the unicast timeout,
-*   then, it is marked as _MODBUS_ERROR_, to lately, try to resend the request. If it was the broadcast timeout, it is assumed all slaves
-*   received the broadcast message, then is passed to _MODBUS_IDLE_ to deal with the next request.
+*   This function is called when the broadcast timeout is trigered. It is assumed all slaves received the broadcast message, then is
+*   passed to _MODBUS_IDLE_ to deal with the next request. If it is the timeout of a group poll, the slaves which did not answer are
+*   given up and the answers are processed (_MODBUS_PROCESSING_). The unicast timeouts only change the state of their slot to
+*   _MODBUS_ERROR_.
 *   @sa Modbus_GetMainState, Modbus_SetMainState, Modbus_CAN_Error_Management
 */
 void Modbus_CAN_Timeouts(void);
@@ -205,33 +735,35 @@ void Modbus_CAN_Timeouts(void);
 /**
 *    @brief Function to handle the unicast timeout interruption.
 * 
-*    This function is triggered to handle the timeout interruption when the timer
-*    was configured with the unicast time value. If the completely reception was not processed, then
-*    it is called to _Modbus_CAN_Timeouts_. If the reception was processed nothing happens.
-*    @sa TimerIntClear, Modbus_CAN_Timeouts
+*    This function is triggered at every tick of the timer used for the unicast timeouts (MODBUS_CAN_TIMER_TICK cycles). The ticks left 
+*    of each slot waiting for an answer are decreased; when they arrive at 0 and the reception was not completed, the slot is marked as
+*    _MODBUS_ERROR_. The timer is never stopped, as its ticks are also the time base used to measure the response times.
+*    After a bus-off, it also counts the delay to call Modbus_CAN_Restart().
+*    @sa TimerIntClear, Modbus_CAN_BusStatus
 */
 void Modbus_CAN_UnicastTimeoutHandler(void);
 
 /**
 *    @brief Function to configure the unicast timeout value.
 *
-*    This function is called when an unicast request has to be made; Timer is set up with the value indicated in _modbus_unicast_timeout_, 
-*    which will depend on the CAN bit rate range chosen and a guess of the amount data which will pass through the bus in both the request
-*    as in the answer.
-*    The unicast timeout value is compounded by:
+*    This function is called when an unicast request has to be made; The slot waits the ticks of the value indicated in 
+*    _modbus_unicast_timeout_, which is derived from the response times learned for the slave and the function code of the request,
+*    as TCP does: smoothed response time + 4 * smoothed deviation.
+*    If nothing was learned yet, the value depends on the CAN bit rate range chosen and a guess of the amount data which will pass 
+*    through the bus in both the request as in the answer:
+*
+*              -(amount_guess * MODBUS_CAN_TRANSFER_TIME / Kbps) = Transfer time; It represents how much time is needed to transfer
+*                      _amount_guess_ bytes through the bus at the bit rate chosen: 933333 cycles per byte at 1Mbps, 10 times more at 100 Kbps.
+*              -(amount_guess * MODBUS_CAN_PROCESS_TIME) = Process time; It represents how much time is necessary to process _amount_guess_ bytes.
 *
-*              -(amount_guess * 933333) = Transfer time; It represents how much time is needed to transfer _amount_guess_ bytes through a bus working at
-*                      1Mbps. In addition, if it is working at 1 Kbps, for example, transfer time will be 10 times higher.
-*              -(900000 * amount_guess * 4) = Process time; It represents how much time is necessary to process _amount_guess_ bytes.
-*              -((modbus_attempts-1) * 8000) = Congestion avoidance; It simulates a congestion avoidance regulator, as more attempts are done, 
-*                      more the master will wait.
+*    Congestion avoidance: the value is doubled in each new attempt. At last, it is kept between the limits of 
+*    Modbus_CAN_SetTimeoutLimits().
 *
+*    @param slot The slot of the request.
 *    @param amount_guess A guess of the amount data that will pass through the bus in this transfer.
-*    @warning Timeout value is not needed to be as high as it is right now, but as it is used serial port and a terminal for debugging,
-*    then, value has to be that high. It is more than known that showing stuff on screen is slower than CPU.
-*    @sa TimerLoadSet, TimerEnable, Modbus_SetBitRate
+*    @sa Modbus_CAN_RttSample, Modbus_CAN_SetBitRate
 */
-void Modbus_CAN_UnicastTimeout(uint16_t amount_guess);
+void Modbus_CAN_UnicastTimeout(unsigned char slot, uint16_t amount_guess);
 
 /**
 *       @brief Function to handle the broadcast timeout interruption.
@@ -251,32 +783,156 @@ void Modbus_CAN_BroadcastTimeoutHandler(void);
 *       pass through the bus in the request.
 *       The broadcast timeout is compounded by:
 *
-*               -(amount_guess * 933333) = Transfer time; It represents how much time is needed to transfer _amount_guess_ bytes through a 
-*                       bus working at 1Mbps. In addition, if it is working at 1 Kbps, for example, transfer time will be 10 times higher.
-*               -(900000 * amount_guess * 4) = Process time; It represents how much time is necessary to process _amount_guess_ bytes.
+*               -(amount_guess * MODBUS_CAN_TRANSFER_TIME / Kbps) = Transfer time; It represents how much time is needed to transfer
+*                       _amount_guess_ bytes through the bus at the bit rate chosen: 933333 cycles per byte at 1Mbps, 10 times more at 100 Kbps.
+*               -(amount_guess * MODBUS_CAN_PROCESS_TIME) = Process time; It represents how much time is necessary to process _amount_guess_ bytes.
 *
 *       @note The broadcast timeout is multiplied by two to be sure that data is able to stay in the bus enough time to be listened by
 *       all slaves, and also, to wait slaves to process the request.
 *       @param amount_guess A guess of the amount data that will pass through the bus in this transfer.
-*       @sa TimerLoadSet, TimerEnable, Modbus_SetBitRate
+*       @sa TimerLoadSet, TimerEnable, Modbus_CAN_SetBitRate
 */
 void Modbus_CAN_BroadcastTimeout(uint16_t amount_guess);
 
 /**
 *       @brief Function to disable the unicast timeout.
 *
-*       This function is called to disable the unicast timeout when a complete answer was received.
-*       @sa TimerDisable
+*       This function is called to disable the unicast timeout of a slot when a complete answer was received. The time since the
+*       request was sent is learned as a response time of the slave and the function code, unless the request was sent more than once,
+*       because it is not known which of the attempts is answered (Karn's algorithm).
+*       @param slot The slot of the request.
+*       @sa Modbus_CAN_RttSample
+*/
+void Modbus_CAN_RemoveTimeout(unsigned char slot);
+
+/**
+*       @brief Function to learn a response time.
+*
+*       The smoothed response time and deviation of the slave and the function code are updated as TCP does (RFC 6298):
+*       rttvar = 3/4 rttvar + 1/4 |srtt - sample|, srtt = 7/8 srtt + 1/8 sample. The first sample sets srtt = sample and
+*       rttvar = sample / 2. The table has MODBUS_CAN_RTT_ENTRIES entries; if the entry is used by other slave and function code, it 
+*       is overwritten.
+*       @param slave The number of the slave.
+*       @param function The function code of the request.
+*       @param sample The response time measured, in cycles.
+*/
+void Modbus_CAN_RttSample(unsigned char slave, unsigned char function, unsigned long sample);
+
+/**
+*       @brief Function to inspect the response time learned for a slave and a function code.
+*
+*       @param slave The number of the slave.
+*       @param function The function code.
+*       @param rtt Where the entry is copied, if it exists.
+*       @return 1 if a response time was learned, 0 otherwise.
+*/
+unsigned char Modbus_CAN_GetRtt(unsigned char slave, unsigned char function, struct Modbus_CAN_Rtt *rtt);
+
+/**
+*       @brief Function to set the limits of the unicast timeout.
+*
+*       Whatever is learned, the unicast timeout will not be lower than _floor_ nor higher than _ceiling_. By default, they are
+*       MODBUS_CAN_RTO_MIN and MODBUS_CAN_RTO_MAX.
+*       @param floor The minimum unicast timeout, in cycles.
+*       @param ceiling The maximum unicast timeout, in cycles; it is raised to _floor_ if it is lower.
+*/
+void Modbus_CAN_SetTimeoutLimits(unsigned long floor, unsigned long ceiling);
+
+#ifdef MODBUS_CAN_BROADCAST_ACK
+/**
+*       @brief Function to set the slaves which acknowledge the broadcast requests.
+*
+*       After a broadcast request, the turnaround finishes as soon as all these slaves have sent their DONE control frame, or else
+*       when the broadcast timeout expires. With no slaves (the default), the broadcast timeout is always waited. It is used from 
+*       the next broadcast request.
+*       @param slaves The numbers of the slaves, from 1 to 247.
+*       @param count Number of slaves.
+*       @sa Modbus_CAN_BroadcastTimeout
+*/
+void Modbus_CAN_SetBroadcastSlaves(const unsigned char *slaves, unsigned char count);
+#endif
+
+/**
+*       @brief Function to configure the timeout of a group poll.
+*
+*       The timer of the broadcast timeout is used, as there is no broadcast in course. The group poll learns the response time of
+*       each slave of the group as an unicast request does, in the entry of its first slave and MODBUS_CAN_GROUP: the time until the
+*       last answer divided by the number of answers, also when some slaves did not answer. The group timeout is the one of an 
+*       unicast request with such a response time, multiplied by the number of slaves, or the guess of Modbus_CAN_UnicastTimeout()
+*       if nothing was learned yet; it is kept between the limits of Modbus_CAN_SetTimeoutLimits().
+*       @param amount_guess A guess of the amount data that will pass through the bus, with the answers of all the slaves.
+*       @sa Modbus_CAN_RttSample, Modbus_CAN_Timeouts
+*/
+void Modbus_CAN_GroupTimeout(uint16_t amount_guess);
+
+/**
+*       @brief Function to transfer receive data from CAN Layer to APP Layer
+*
+*       This function is called when there was a complete reception in a slot and it is desired to transfer the data
+*       from the CAN layer to the APP layer to be processed. The data is not copied: the buffer of the slot is swapped with the one
+*       of the APP layer, which will be used for the next answer of the slot.
+*       @param slot The slot of the request.
+*       @sa Modbus_App_Msg_Swap
 */
-void Modbus_CAN_RemoveTimeout(void);
+void Modbus_CAN_to_App(unsigned char slot);
 
-//DEPRECATED:
-unsigned char Debug_Timeout(void);
-unsigned char getIndex(void);
-unsigned char getbu(void);
-uint16_t getboo(void);
-unsigned char getAttempts(void);
-void setbu(void);
+#ifdef MODBUS_CAN_PUBLISH
+/**
+*       @brief Function to ask a published block of a slave.
+*
+*       A remote frame with the message ID of the block (MODBUS_CAN_PUBLISH_ID) is sent at once from the message object of a free
+*       snapshot entry, without going through the requests in flight: the CAN controller of the slave answers it. When the answer
+*       arrives, Modbus_CAN_Controller() hands it to Modbus_App_Snapshot_CallBack() and the entry is free again. If the block is
+*       already being asked, the remote frame is sent again from its entry. An entry not answered during the maximum unicast timeout
+*       (Modbus_CAN_SetTimeoutLimits()) is handed over with length 0 and dropped; it is not asked again.
+*       @param slave The slave, from 1 to 247.
+*       @param block The block, from 0 to MODBUS_CAN_PUBLISH_BLOCKS - 1.
+*       @param length Length of the block, in bytes.
+*       @return The snapshot entry, or MODBUS_CAN_SNAPSHOTS if there is not a free one or the bus is off.
+*       @sa Modbus_CAN_Controller
+*/
+unsigned char Modbus_CAN_Snapshot(unsigned char slave, unsigned char block, unsigned char length);
+
+/**
+*       @brief Function to read the cache of the published blocks.
+*
+*       The cache keeps the last value received of each block, the ones pushed by the slaves in change of state mode and the answers
+*       to Modbus_CAN_Snapshot(); it is updated from Modbus_CAN_CallBack(), so the interruptions of the CAN layer are disabled while
+*       it is read.
+*       @param slave The slave.
+*       @param block The block.
+*       @param data Where the block is copied, 8 bytes.
+*       @param age Where the time since the block was received, in cycles, is stored.
+*       @return The length of the block, or 0 if it is not in the cache.
+*/
+unsigned char Modbus_CAN_GetCache(unsigned char slave, unsigned char block, unsigned char *data, unsigned long *age);
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+/**
+*       @brief Function to start or stop the time-triggered schedule.
+*
+*       The timer MODBUS_CAN_CYCLE_TIMER starts a cycle every _cycle_ cycles, and Modbus_CAN_CycleHandler() broadcasts the reference
+*       frame. The slaves send their periodic data in their windows from the reference on; Modbus_CAN_Ready() and the requests sent
+*       again only go from _free_ cycles after the reference on, so the beginning of the cycle is kept for the schedule. The reads
+*       of Modbus_CAN_Snapshot() are not held back. A request which is started in the free window may last until the next 
+*       cycle; the frames of the schedule win the arbitration to it, but the reference frame is sent after the chunks of the master
+*       which are already in the mailboxes. The first cycle starts at once: its reference frame is loaded here, with the
+*       interruptions of the CAN layer disabled, and not through Modbus_CAN_CycleHandler().
+*       @param cycle Length of the cycle, in cycles of the system clock; 0 stops the schedule.
+*       @param free Start of the free window, in cycles from the reference; it should be after the windows of all the slaves.
+*       @sa Modbus_CAN_SetWindow
+*/
+void Modbus_CAN_Schedule(unsigned long cycle, unsigned long free);
+
+/**
+*       @brief Function to handle the interruption of the cycles of the schedule.
+*
+*       It broadcasts the reference frame through the message object MODBUS_CAN_REFERENCE_OBJ, with the number of the cycle, and 
+*       it takes the time of the start of the cycle for the free window.
+*       @sa Modbus_CAN_Schedule
+*/
+void Modbus_CAN_CycleHandler(void);
+#endif
 /** @} */
 #elif MODBUS_SLAVE
 #undef MODBUS_MASTER
@@ -317,14 +973,77 @@ enum Modbus_MainState
     MODBUS_ERROR           //!< Process error reply
 };
 
+//! First message object of the receive FIFO of the broadcasts; the unicasts use the FIFO from MODBUS_CAN_RX_FIFO_FIRST.
+#define MODBUS_CAN_RX_BROADCAST_FIRST 25
+#ifdef MODBUS_CAN_PUBLISH
+//! Last message object of the receive FIFO of the broadcasts; the 4 last ones are the published blocks.
+#define MODBUS_CAN_RX_BROADCAST_LAST 28
+//! Message object of the published block 0, the block i is in the message object MODBUS_CAN_PUBLISH_FIRST + i.
+#define MODBUS_CAN_PUBLISH_FIRST 29
+//! Timer which measures the heartbeats of the blocks in change of state mode; it runs free, without interruption.
+#define MODBUS_CAN_PUSH_TIMER TIMER0_BASE
+#ifdef MODBUS_CAN_SCHEDULE
+//! Timer of the transmit window of the schedule, started by each reference frame (Modbus_CAN_WindowHandler()).
+#define MODBUS_CAN_WINDOW_TIMER TIMER1_BASE
+
+//! Transmit window of the slave in the time-triggered schedule.
+struct Modbus_CAN_Window
+{
+    unsigned char enabled;               //!< 1 if the block is sent in the window
+    unsigned char block;                 //!< Published block which is sent
+    unsigned long offset;                //!< Start of the window, in cycles from the reception of the reference frame
+    unsigned long sent;                  //!< Windows in which the block was sent
+    unsigned long missed;                //!< Windows missed because the control message object had a frame waiting
+};
+#endif
+
+//! Change of state mode of a published block.
+struct Modbus_CAN_Push
+{
+    unsigned char enabled;               //!< 1 if the block is sent when it changes
+    unsigned char pending;               //!< 1 if it has to be sent, when the control message object is free
+    uint16_t deadband;                   //!< Change of a register which sends the block, more than it; 0 for any change
+    unsigned long heartbeat;             //!< Cycles without sending the block after which it is sent anyway; 0 for never
+    unsigned long sent;                  //!< Time when the block was sent last time, in cycles of MODBUS_CAN_PUSH_TIMER
+    unsigned char data[8];               //!< Block sent last time, the reference of the deadband
+};
+#else
+//! Last message object of the receive FIFO of the broadcasts.
+#define MODBUS_CAN_RX_BROADCAST_LAST 32
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+//! Timer of the flow control of the long answers (Modbus_CAN_FlowHandler()): the separation time or the wait for a FLOW frame.
+#define MODBUS_CAN_FLOW_TIMER TIMER2_BASE
+#endif
+//! Number of reassembly contexts, one for each stream of requests.
+#define MODBUS_CAN_STREAMS 2
+//! Reassembly context of the unicast requests.
+#define MODBUS_CAN_UNICAST 0
+//! Reassembly context of the broadcast requests.
+#define MODBUS_CAN_BROADCAST 1
+//! Number of complete requests which can wait to be processed by Modbus_CAN_Controller().
+#define MODBUS_CAN_QUEUE 4
+
+//! Complete request waiting to be processed.
+struct Modbus_CAN_Request
+{
+      unsigned char *pdu;         //!< Request data; it is swapped with the buffer of the APP layer when it is handed over
+      unsigned char length;       //!< Request data length
+      unsigned char txn;          //!< Transaction ID of the request (extended message IDs)
+      unsigned char priority;     //!< Priority of the request (extended message IDs)
+      unsigned char broadcast;    //!< If the request is a broadcast
+};
+
 ////////////////////////////////////////////////////////SLAVE PROTOTYPES//////////////////////////////////////////////////
 
 /**
 *       @brief CAN Initialisation.
 *
 *       This is the function to initialise the CAN module. The system and some CAN variables are also initialised.
-*       The message object 1 would be set up in the function to send data.
-*       The message objects 17 and 18 will be configured as receive message object for unicast and broadcast requests respectively.
+*       The message object MODBUS_CAN_CTRL_OBJ (1) sends the control frames and the message objects MODBUS_CAN_TX_FIRST_OBJ to
+*       MODBUS_CAN_TX_LAST_OBJ (2-16) are the transmission mailboxes, loaded in the function to send data.
+*       The message objects 17-24 and 25-32 will be configured as receive FIFOs for unicast and broadcast requests respectively
+*       (25-28 if MODBUS_CAN_PUBLISH is defined, the 29-32 being the published blocks).
 *       CAN message IDs(11-bits) in Modbus will be compounded by a header(3 bits) and a slave number (8 bits).
 *       Modbus header frames in CAN will be built up by three bits, as was previously mentioned:
 *
@@ -343,10 +1062,11 @@ void Modbus_CAN_Init(enum Modbus_CAN_BitRate bit_rate, unsigned char slave);
 /**
 *       @brief Function to send information.
 *
-*       This function is called when the slave wants to send data. The messages in CAN are built up as 8 bytes as maximum, so, this function
-*       will process all data sending chunks of 8 bytes. That makes to have some kind of control to know which chunk is expected, therefore,
-*       there are 4 types of messages with the following different headers in the message ID, in this way it can be known when the big messages
-*       start and when they finish.
+*       This function is called when the slave wants to send data. The messages in CAN are built up as MAX_FRAME bytes as maximum, so,
+*       this function will process all data sending chunks of MAX_FRAME bytes; the segmentation header takes the first bytes of each
+*       chunk, so a chunk carries 7 data bytes (5 the first one) with classic CAN. That makes to have some kind of control to know which
+*       chunk is expected, therefore, there are 4 types of messages with the following different headers in the message ID, in this way
+*       it can be known when the big messages start and when they finish.
 *
 *               -000: Individual Frame + request bit
 *               -010: Beginning Long Frame + request bit
@@ -354,19 +1074,22 @@ void Modbus_CAN_Init(enum Modbus_CAN_BitRate bit_rate, unsigned char slave);
 *               -110: End Long Frame + request bit
 *
 *       The rest of the message's ID will be the slave number itself as the master is waiting frames from this slave.
+*       The PDU is copied and the first chunks are queued in the transmission mailboxes by Modbus_CAN_TxRefill(), the rest of them are 
+*       queued from Modbus_CAN_IntHandler() when the mailboxes are sent. If MODBUS_CAN_TX_DELAYED is defined, only the first mailbox,
+*       MODBUS_CAN_TX_FIRST_OBJ, is used and Modbus_CAN_Delay() is called between chunks.
 *       There is no timeout in the slave, if the data does not arrive, the master will send the request again.
 *       @param mb_req_pdu The information to be sent.
 *       @param pdu_length The amount of data to be sent.
-*       @sa CANMessageSet, Modbus_CAN_Delay, Modbus_SetMainState
+*       @sa Modbus_CAN_TxRefill, Modbus_CAN_Delay, Modbus_SetMainState
 */
 void Modbus_CAN_FixOutput(unsigned char *mb_req_pdu, unsigned char pdu_length);
 
 /**
 *       @brief Function to configure receive message objects.
 *
-*       This function is called to configure the receive message objects. One is set up as unicast receive message object
-*       with the ID equal to the number of the slave (message object 17). The other one is set up as a broadcast receive message object 
-*       with the ID equal to 0, which represent a broadcast request (message object 18) according to the Modbus specification.
+*       This function is called to configure the receive message objects. One FIFO is set up to receive unicast requests
+*       with the ID equal to the number of the slave (message objects 17-24). The other one is set up to receive broadcast requests 
+*       with the ID equal to 0, which represent a broadcast request (message objects 25-32) according to the Modbus specification.
 *       The mask is set to accept all matched messages taking into account the request/answer bit and the 8-bits that represent the slave
 *       number.
 *       @sa CANMessageSet, Modbus_CAN_ReceptionConfiguration, Modbus_CAN_Delay, Modbus_SetMainState
@@ -376,12 +1099,81 @@ void Modbus_CAN_ReceptionConfiguration();
 /**
 *       @brief Function to get the broadcast flag.
 *
-*       This function return the value of the broadcast flag. Such a flag is activated when a broadcast arrived, it is useful to know it
-*       to prepare a reply or not.
+*       This function return the value of the broadcast flag. Such a flag is activated when the request handed over to the APP layer is a
+*       broadcast, it is useful to know it to prepare a reply or not.
 *       @return <b>1</b> if the reception is a broadcast request or <b>0</b> if the reception is an unicast request.
 */
 unsigned char Modbus_CAN_BroadCast_Get(void);
 
+/**
+*       @brief Function to transfer receive data from CAN Layer to APP Layer
+*
+*       This function is called when there was a complete reception and it is desired to transfer the data
+*       from the CAN layer to the APP layer to be processed. The oldest request of the queue is handed over, and its broadcast flag,
+*       transaction ID and priority are kept for the answer. The data is not copied: the buffer of the request is swapped with the one of
+*       the APP layer, which stays in the queue entry for a next request. The request leaves the queue in Modbus_CAN_Controller().
+*       A group poll (MODBUS_CAN_GROUP) is handed over as the unicast read inside, if the slave is in the group.
+*       @return <b>1</b> if the request was handed over, or <b>0</b> if it is a group poll to other slaves.
+*       @sa Modbus_App_Msg_Swap
+*/
+unsigned char Modbus_CAN_to_App(void);
+
+#ifdef MODBUS_CAN_PUBLISH
+/**
+*       @brief Function to publish a block of data.
+*
+*       The data is put in the message object of the block as an auto-answer one (MSG_OBJ_TYPE_RXTX_REMOTE), with the message ID
+*       MODBUS_CAN_PUBLISH_ID: the CAN controller answers the remote frames of the master with it, without any interruption. The
+*       data is also kept to set the message object up again after a bus-off. The message object is only written if the data 
+*       changed; a remote frame which arrives while it is written may not be answered. If the block is in change of state mode and 
+*       a register changed more than the deadband, the block is also sent from Modbus_CAN_Controller().
+*       @param block The block, from 0 to MODBUS_CAN_PUBLISH_BLOCKS - 1.
+*       @param data The data, the registers in big endian or the coils packed as in the answer of a read.
+*       @param length Length of the data, up to 8 bytes; 0 to stop publishing the block.
+*       @sa CANMessageSet, Modbus_CAN_ReceptionConfiguration, Modbus_CAN_ChangeOfState
+*/
+void Modbus_CAN_Publish(unsigned char block, const unsigned char *data, unsigned char length);
+
+/**
+*       @brief Function to set the change of state mode of a published block.
+*
+*       In change of state mode, the block is sent as a data frame with its message ID (MODBUS_CAN_PUBLISH_ID) through the control
+*       message object, without being asked, when a register changes more than _deadband_ from the value sent last time or when 
+*       _heartbeat_ cycles go by without sending it. The block is sent at once when the mode is enabled. Modbus_CAN_Controller()
+*       sends it as soon as the control message object has no frame waiting, so a NACK or a DONE frame is never overwritten.
+*       @param block The block, from 0 to MODBUS_CAN_PUBLISH_BLOCKS - 1.
+*       @param enable 1 to send the block when it changes, 0 to only answer the remote frames.
+*       @param deadband Change of a register which sends the block, more than it; 0 for any change. The blocks of coils are sent
+*       at any change of a byte.
+*       @param heartbeat Cycles of the system clock without sending the block after which it is sent anyway; 0 for never.
+*       @sa Modbus_CAN_Publish, Modbus_CAN_SendControl
+*/
+void Modbus_CAN_ChangeOfState(unsigned char block, unsigned char enable, uint16_t deadband, unsigned long heartbeat);
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+/**
+*       @brief Function to set the transmit window of the slave in the time-triggered schedule.
+*
+*       Each reference frame of the master starts the timer MODBUS_CAN_WINDOW_TIMER from Modbus_CAN_CallBack(), and, _offset_ cycles
+*       later, Modbus_CAN_WindowHandler() sends the block with the priority of the schedule (MODBUS_CAN_SCHEDULE_ID). The windows of 
+*       the slaves should not overlap, with room for one frame each.
+*       @param block The published block, from 0 to MODBUS_CAN_PUBLISH_BLOCKS - 1.
+*       @param enable 1 to send the block in the window, 0 to stop it.
+*       @param offset Start of the window, in cycles of the system clock from the reference frame; at least 1.
+*       @sa Modbus_CAN_Schedule
+*/
+void Modbus_CAN_SetWindow(unsigned char block, unsigned char enable, unsigned long offset);
+
+/**
+*       @brief Function to handle the interruption of the transmit window.
+*
+*       The block of the window is sent through the control message object if it has no frame waiting; otherwise, the window is
+*       missed, and counted in struct Modbus_CAN_Window.
+*       @sa Modbus_CAN_SetWindow, Modbus_CAN_SendControl
+*/
+void Modbus_CAN_WindowHandler(void);
+#endif
+
 /** @} */
 #endif
 
@@ -398,33 +1190,225 @@ unsigned char Modbus_CAN_BroadCast_Get(void);
 *       @brief CAN Interrupt Handler.
 *       @ingroup CAN
 *
-*       This is the CAN interrupt handler. First, it checks the CAN status, if something went wrong in the communication as acks, etc.
-*       the timeout and resending method will fix that, so they are not taken into account. If the proper CAN node enters into a Bus Off 
-*       state, error passive level or warning level, then, it is stopped for security, although in a Bus Off state CAN is disabled automatically.
-*       Secondly, it checks if there was a complete transmission. In such a case, it is notified activating the proper flag. It should be 
-*       only one notification regarding the transmission. Such an interruption should be configured when the last output chunk is sent.
-*       Last thing to check is the reception data, if there was an unicast reception then the incoming data is placed by message object 17. 
-*       In the broadcast case, data will be handled by message object 18 in the slave and it will not be handled by the master as this one 
-*       does not receive broadcast messages. The incoming data is processed in Modbus_CAN_CallBack().
-*       @sa CANIntStatus, CANStatusGet, CANIntClear, Modbus_CAN_CallBack
+*       This is the CAN interrupt handler. First, it checks the CAN status with Modbus_CAN_BusStatus(), if something went wrong in the 
+*       communication as acks, etc. the timeout and resending method will fix that, so they are only counted. If the proper CAN node 
+*       enters into a Bus Off state, the recovery is started instead of stopping the node.
+*       Secondly, it checks the transmission mailboxes (message objects 2-16). Only the last loaded mailbox raises the interruption, and as
+*       lower message objects are sent first, it means that the whole window was sent. If there are chunks left, the mailboxes are refilled
+*       with Modbus_CAN_TxRefill(), otherwise the complete transmission is notified activating the proper flag.
+*       Last thing to check is the reception data, if there was an unicast reception then the incoming data is placed in the receive FIFO
+*       (message objects 17-24). In the broadcast case, data will be handled by the message objects 25-32 in the slave and it will not be
+*       handled by the master as this one does not receive broadcast messages. The incoming data is processed in Modbus_CAN_CallBack().
+*       @sa CANIntStatus, CANStatusGet, CANIntClear, Modbus_CAN_CallBack, Modbus_CAN_TxRefill, Modbus_CAN_BusStatus
 */
 void Modbus_CAN_IntHandler(void);
 
+/**
+*       @brief Function to follow the state of the CAN controller.
+*       @ingroup CAN
+*
+*       This function is called from Modbus_CAN_IntHandler() with the CAN status. The error frames, warning and error passive levels
+*       are only counted, the node keeps working. When the Bus Off state is entered:
+*
+*       - The transfer being sent is flushed. The master marks the requests waiting for an answer to be sent again without counting an
+*         attempt (a broadcast is lost) and keeps the new requests in the FIFO; the slave drops the request or answer in course, and the 
+*         master will ask again.
+*       - After MODBUS_CAN_RESTART_DELAY cycles, doubled for each bus-off without a transfer done in between (up to 
+*         MODBUS_CAN_BACKOFF_MAX times), the CAN controller is initialised again with Modbus_CAN_Restart(). 
+*       - When the CAN controller leaves the Bus Off state, the master sends again the requests and goes on with the FIFO.
+*
+*       @param status The CAN status, as given by CANStatusGet().
+*       @sa Modbus_CAN_GetHealth, Modbus_CAN_Restart
+*/
+void Modbus_CAN_BusStatus(unsigned long status);
+
+/**
+*       @brief Function to initialise again the CAN controller after a bus-off.
+*       @ingroup CAN
+*
+*       The CAN module is initialised and set up as in Modbus_CAN_Init(), and enabled, so it starts the bus-off recovery: it waits for
+*       128 sequences of 11 recessive bits. The master calls it from Modbus_CAN_UnicastTimeoutHandler() and, if the CAN controller
+*       does not leave the Bus Off state in MODBUS_CAN_RECOVERY_TIMEOUT cycles, it is called again; the slave calls it from 
+*       Modbus_CAN_Controller().
+*       @sa CANInit, CANSetBitTiming, CANEnable
+*/
+void Modbus_CAN_Restart(void);
+
+/**
+*       @brief Function to inspect the bus-health counters.
+*       @ingroup CAN
+*
+*       @param health Where the counters are copied.
+*/
+void Modbus_CAN_GetHealth(struct Modbus_CAN_Health *health);
+
+/**
+*       @brief Function to inspect the traffic counters.
+*       @ingroup CAN
+*
+*       The counters are copied with the interruptions of the CAN layer disabled, all at the same instant, see struct Modbus_CAN_Stats.
+*       @param stats Where the counters are copied.
+*/
+void Modbus_CAN_GetStats(struct Modbus_CAN_Stats *stats);
+
+/**
+*       @brief Function to queue output chunks in the transmission mailboxes.
+*       @ingroup CAN
+*
+*       This function loads the next chunks of the output PDU in the message objects from MODBUS_CAN_TX_FIRST_OBJ to _last_obj_, 
+*       with the header of each chunk built as it is explained in Modbus_CAN_FixOutput(). The CAN controller sends first the lower message 
+*       objects, so the chunks go through the bus in order and back to back. Only the last loaded message object has the transmission 
+*       interruption enabled, when it arrives the mailboxes are free to be refilled from Modbus_CAN_IntHandler().
+*       The chunks still pending are marked in a bitmap, lower chunks are loaded first. In this way, the chunks asked again by a NACK are
+*       loaded in the same way.
+*       If MODBUS_CAN_FLOW_CONTROL is defined, nothing is loaded while the receiver has to send a FLOW control frame, only one chunk
+*       is loaded if it asked for a separation time, and the loading stops at the end of the block.
+*       @param last_obj Last message object which can be used; MODBUS_CAN_TX_LAST_OBJ to use all the mailboxes.
+*       @note It has to be called from the interruptions of the CAN layer, or with them disabled.
+*       @sa CANMessageSet, Modbus_CAN_FixOutput, Modbus_CAN_IntHandler, Modbus_CAN_BuildChunk
+*/
+void Modbus_CAN_TxRefill(unsigned char last_obj);
+
+/**
+*       @brief Function to build one chunk of a PDU.
+*       @ingroup CAN
+*
+*       This function builds the data of the chunk number _chunk_. If the PDU fits in one frame, it is copied as it is (Individual Frame).
+*       Otherwise, the segmentation header is put before the data: the chunk byte (2 low bits of _seq_ + chunk number) and, in the first 
+*       chunk, the sequence counter and the total length.
+*       @param pdu The PDU to be sent.
+*       @param length The length of the PDU.
+*       @param seq The sequence counter of the transfer.
+*       @param chunk The number of the chunk.
+*       @param frame Where the chunk is built; at least MAX_FRAME bytes.
+*       @return The length of the chunk.
+*/
+unsigned char Modbus_CAN_BuildChunk(unsigned char *pdu, unsigned char length, unsigned char seq, unsigned char chunk, unsigned char *frame);
+
+/**
+*       @brief Function to reassemble the chunks of a long frame.
+*       @ingroup CAN
+*
+*       This function places a received chunk in the input PDU according to its chunk number. A new transfer is started if the tag of 
+*       the sequence counter changes, or if a first chunk with other sequence counter arrives. Duplicated chunks are ignored and the 
+*       chunks which do not fit in the PDU drop the transfer. The long frame is complete when the first chunk (total length) and all 
+*       the chunks were received, in any order.
+*       @param header The frame type (2 bits of the header): 01 beginning, 10 continuation or 11 end.
+*       @param frame The data of the received frame.
+*       @param frame_length The length of the received frame.
+*       @return <b>MODBUS_CAN_REASSEMBLY_DONE</b> if the long frame is complete, <b>MODBUS_CAN_REASSEMBLY_MISSING</b> if it was the end 
+*       frame but some chunks are missing, or <b>MODBUS_CAN_REASSEMBLY_PENDING</b> otherwise.
+*       @sa Modbus_CAN_CallBack, Modbus_CAN_Nack
+*/
+unsigned char Modbus_CAN_Reassembly(unsigned char header, unsigned char *frame, unsigned char frame_length);
+
+/**
+*       @brief Function to ask for the missing chunks of a long frame.
+*       @ingroup CAN
+*
+*       This function sends a NACK control frame with the bitmap of the chunks not received yet. If MODBUS_CAN_NACK_RETRIES NACKs were 
+*       already sent for the same transfer, it is dropped; in such a case the master timeout will make the whole request to be sent again.
+*       @sa Modbus_CAN_SendControl, Modbus_CAN_Reassembly
+*/
+void Modbus_CAN_Nack(void);
+
+/**
+*       @brief Function to send a control frame.
+*       @ingroup CAN
+*
+*       This function sends a control frame through the message object MODBUS_CAN_CTRL_OBJ, which is not used by the mailboxes.
+*       @param id The message ID of the frame, built with MODBUS_CAN_ID.
+*       @param ctrl The control frame; its first byte should be MODBUS_CAN_CTRL.
+*       @param length The length of the control frame.
+*       @sa CANMessageSet
+*/
+void Modbus_CAN_SendControl(unsigned long id, unsigned char *ctrl, unsigned char length);
+
+/**
+*       @brief Function to process a received control frame.
+*       @ingroup CAN
+*
+*       This function is called when an individual frame starting by MODBUS_CAN_CTRL arrives. For a NACK, if the tag belongs to the long 
+*       frame which was sent, the chunks asked are marked to be loaded again in the mailboxes, and also the end chunk, so the receiver 
+*       checks again the transfer when it arrives. For a FLOW frame (MODBUS_CAN_FLOW_CONTROL) of the long frame which is waiting for
+*       it, the block size and the separation time are taken and the next chunks are loaded.
+*       @param ctrl The control frame.
+*       @param length The length of the control frame.
+*       @sa Modbus_CAN_TxRefill
+*/
+void Modbus_CAN_Control(unsigned char *ctrl, unsigned char length);
+#ifdef MODBUS_CAN_FLOW_CONTROL
+
+/**
+*       @brief Function to set the flow control which this node asks for the long frames sent to it.
+*       @ingroup CAN
+*
+*       The values are sent in the FLOW control frames of Modbus_CAN_FlowControl(). The broadcasts are not paced, as several
+*       receivers could not agree on them.
+*       @param block_size Chunks sent between two FLOW control frames, 0 to send all of them after the first one.
+*       @param stmin Minimum separation time between chunks, coded as in ISO 15765-2 (MODBUS_CAN_STMIN_CYCLES), 0 for back to back.
+*/
+void Modbus_CAN_SetFlowControl(unsigned char block_size, unsigned char stmin);
+
+/**
+*       @brief Function to allow the next block of chunks of the incoming long frame.
+*       @ingroup CAN
+*
+*       This function is called for each chunk received of a long frame which is not complete yet. It sends a FLOW control frame,
+*       through the same message ID as a NACK, after the first chunk and then after each block of chunks; the count starts again
+*       when a NACK is sent. If the control message object still has a frame waiting, the FLOW frame is not written over it: it
+*       is sent from Modbus_CAN_Controller() when the object is free, as the sender waits for it.
+*       @param chunk The number of the chunk received.
+*       @sa Modbus_CAN_SetFlowControl, Modbus_CAN_SendControl
+*/
+void Modbus_CAN_FlowControl(unsigned char chunk);
+
+/**
+*       @brief Function to handle the interruption of the flow control timer.
+*       @ingroup CAN
+*
+*       If the sender waits for a FLOW control frame, the receiver did not send it in MODBUS_CAN_FLOW_TIMEOUT cycles: the long
+*       frame is dropped and counted, and the master timeout will make the request to be sent again. Otherwise, the separation
+*       time has passed and the next chunk is loaded.
+*       @sa Modbus_CAN_TxRefill
+*/
+void Modbus_CAN_FlowHandler(void);
+#endif
+
 /**
 *       @brief Function to set up the bit rate and time, and delays.
 *       @ingroup CAN
 *
-*       This function initialise the bit timing parameters depending on the bit time range chosen. 
-*       Also, depending on the former, it is configure the delay used between transmission. The value of that delay was chosen in the same
-*       way than the timeouts.
+*       This function initialise the bit timing parameters for the bit rate chosen, solved by Modbus_CAN_BitTiming() from the CAN
+*       clock (MODBUS_CAN_CLOCK). Also, depending on the former, it is configure the delay used between transmission and the per byte
+*       time of the guessed timeouts: MODBUS_CAN_TRANSFER_TIME divided by the bit rate plus MODBUS_CAN_PROCESS_TIME. With CAN FD, the
+*       data phase goes at MODBUS_CAN_FD_DATA_RATE, or at the nominal bit rate if the clock does not give it.
 *       
-*       The bit rate of the bus depends on the values stored in the struct _tCANBitClkParms_, the maximum in CAN is 1MBPS. It is only 
-*       implemented 1 KBPS and 1 MBPS. If it is desired others ranges, the proper values from the former struct has to be calculated.
-*       @note If the range selected is not implemented, it stalls as it is impossible to establish communication without specifying a range.
-*       @sa Modbus_CAN_Error_Management
+*       The maximum in CAN is 1MBPS. Any bit rate can be given, in Kbps, as (enum Modbus_CAN_BitRate)Kbps.
+*       @note If the CAN clock can not give the bit rate within MODBUS_CAN_BIT_TOLERANCE, it stalls as it is impossible to establish 
+*       communication with the rest of nodes.
+*       @sa Modbus_CAN_Error_Management, Modbus_CAN_BitTiming
 */
 void Modbus_CAN_SetBitRate(enum Modbus_CAN_BitRate bit_rate);
 
+/**
+*       @brief Function to solve the bit timing of a bit rate.
+*       @ingroup CAN
+*
+*       It looks for the quantum prescaler and the number of time quanta of the bit (MODBUS_CAN_TQ_MIN to MODBUS_CAN_TQ_MAX) whose bit
+*       rate is the closest one to the one asked. Between the equally close ones, it takes the one whose sample point is the closest to
+*       MODBUS_CAN_SAMPLE_POINT, and then the one with more time quanta, as the resynchronisation is finer. Phase2 is what is left after
+*       the sample point, from 1 to 8 time quanta, and the SJW is as long as Phase2, up to 4.
+*       
+*       For example, with a clock of 8 MHz: 1 Mbps is 8 time quanta of 1 clock (7 + 1), and 100 Kbps is 16 time quanta of 5 clocks
+*       (14 + 2).
+*       @param can_clock Clock of the CAN controller, in Hz.
+*       @param bit_rate Bit rate, in bits per second.
+*       @param bit_clk Where the bit timing is stored.
+*       @return 1 if the bit rate got is within MODBUS_CAN_BIT_TOLERANCE of the one asked, 0 if not (_bit_clk_ has the closest one).
+*/
+unsigned char Modbus_CAN_BitTiming(unsigned long can_clock, unsigned long bit_rate, tCANBitClkParms *bit_clk);
+
 /**
 *       @brief Function to obtain the actual state of the master/slave.
 *       @ingroup CAN
@@ -451,13 +1435,16 @@ void Modbus_SetMainState(enum Modbus_MainState state);
 *       @brief Function to process the received information.
 *       @ingroup CAN
 *
-*       This function is called when the master/slave receives data. If there is new data in the specific message object(it should be 
-*       if we are in this function), it is checked if data is according to one of the possible header frames.
-*       Depending on the received header, it is processed in one way or other. The destinations are always the expected ones
-*       because the receive message objects were configured either to receive a concrete slave when the function Modbus_CAN_ReceptionConfiguration()
-*       was called in the master, or to receive from the master always in the case of the slave.
-*       In the slave, if the reception is a broadcast request it is looked in the message object num.18 instead of the num.17 and it is 
-*       raised a flag to notify such a request.
+*       This function is called when the master/slave receives data. The receive FIFO is drained in order, from the lowest message object
+*       with new data, until there is no new data left; then, for each frame, it is checked if data is according to one of the possible 
+*       header frames. Depending on the received header, it is processed in one way or other. In the master, each answer goes to the
+*       slot of its slave (and transaction ID, with extended message IDs), each one with its own reassembly; the rest are ignored.
+*       In the slave, the broadcast requests are received in their own FIFO and reassembled in their own context, so a broadcast can 
+*       arrive in the middle of a long unicast request. The complete requests are queued, marked as broadcasts or not; the slave stops 
+*       draining when the queue is full, and the frames left wait in the FIFO until Modbus_CAN_Controller() has processed a request.
+*       As the chunks are placed by their number, the order is only important to detect the end of a long frame.
+*       The chunks of long frames are placed by Modbus_CAN_Reassembly(), and if the end frame arrives with chunks missing, they are asked 
+*       again with Modbus_CAN_Nack() (never for broadcasts). Individual frames starting by MODBUS_CAN_CTRL go to Modbus_CAN_Control().
 *       @result <b>1</b> If there was a successful complete reception, or <b>0</b> if there was some error.
 *       @sa CANMessageGet, CANStatusGet, Modbus_CAN_ReceptionConfiguration, Modbus_SetMainState
 */
@@ -468,12 +1455,15 @@ void Modbus_CAN_CallBack();
 *       @ingroup CAN
 *
 *       This function is used to handle the behaviour of the master/slave following the diagrams of the Modbus
-*       specification. Depending on the status of the master/slave, an action or other will be taken.
+*       specification. Depending on the status of the master/slave, an action or other will be taken. In the master, every slot is 
+*       checked and, after that, the next request of the FIFO is sent if it is possible; the answers of a group poll are handed over
+*       to the APP layer one by one, in the order of the slave numbers, when it finishes. In the slave, the oldest queued request is 
+*       processed and answered, and then the frames waiting in the receive FIFOs are drained.
 *
 *       @return <b>Master</b>: <b>0</b> if there are no more communications, or <b>1</b> if there are still pending communications.
 *       @return <b>Slave</b>: <b>1</b> if a message was sent to APP layer, or <b>0</b> if not.
 *       
-*       @sa Modbus_GetMainState, Modbus_CAN_GetForwardFlag, Modbus_App_Send, Modbus_App_FIFOSend
+*       @sa Modbus_GetMainState, Modbus_CAN_GetSlotState, Modbus_App_Resend, Modbus_App_FIFOSend
 *       @sa Modbus_App_Manage_CallBack, Modbus_CAN_Repeat_Request, Modbus_SetMainState, Modbus_CAN_to_App
 */
 unsigned char Modbus_CAN_Controller(void);
@@ -482,29 +1472,21 @@ unsigned char Modbus_CAN_Controller(void);
 *       @brief Function to make a delay.
 *       @ingroup CAN
 *
-*       This function is called between transfers to make a delay between them. In this way,
+*       This function is called between transfers to make a delay between them when MODBUS_CAN_TX_DELAYED is defined. In this way,
 *       the data will arrive at the destination more slowly and not all at once, avoiding lost data.
+*       @note By default the chunks are queued in the mailboxes and sent back to back, so the delay is not used.
 *       @sa SysCtlDelay
 */
 void Modbus_CAN_Delay(void);
 
-/**
-*       @brief Function to transfer receive data from CAN Layer to APP Layer
-*       @ingroup CAN
-*
-*       This function is called when there was a complete reception and it is desired to transfer the data
-*       from the CAN layer to the APP layer to be processed.
-*       @sa Modbus_App_L_Msg_Set, Modbus_App_Receive_Char
-*/
-void Modbus_CAN_to_App(void);
-
 /**
 *       @brief Function to manage errors.
 *       @ingroup CAN
 *
 *       This function manage the errors depending on the type of each one, for now there is only one error handled:
 *
-*       - <b>110</b>: Important error, the application becomes blocked for security.
+*       - <b>110</b>: Important error, the application becomes blocked for security. The CAN bus errors do not use it any more, they
+*         are recovered by Modbus_CAN_BusStatus().
 *
 *       @param error Number of the error.
 */
@@ -523,11 +1505,5 @@ static inline void ledOn(void);
 *       Function to turn off the led.
 */
 static inline void ledOff(void);
-
-//DEBUG
-//unsigned char * getOutput();
-unsigned char * getInput();
-unsigned char Debug_Transmission(void);
-unsigned char Debug_Reception(void);
 #endif
 #endif
\ No newline at end of file
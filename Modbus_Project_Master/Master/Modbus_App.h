@@ -11,8 +11,6 @@
 #if OSL_Mode
 	#include "Modbus_OSL.h"        
 	#undef CAN_Mode
-        void Modbus_Master_Init(enum Modbus_Comm_Modes Com_Mode, enum Baud Baudrate,
-                    unsigned char Attempts, enum Modbus_OSL_Modes Mode);
 #elif CAN_Mode
 	#include "Modbus_CAN.h"       
 	#undef OSL_Mode
@@ -26,17 +24,44 @@ enum Modbus_Comm_Modes
     MODBUS_CAN_MODE,    //!< CAN communication
     CDEFAULT       //!< Serial communication
 };
+
+#if OSL_Mode
+void Modbus_Master_Init(enum Modbus_Comm_Modes Com_Mode, enum Baud Baudrate,
+                        unsigned char Attempts, enum Modbus_OSL_Modes Mode);
+#endif
+
+//! Priority classes of the requests, see Modbus_Set_Priority().
+enum Modbus_Priority
+{
+    MODBUS_PRIORITY_NORMAL,      //!< Default class
+    MODBUS_PRIORITY_URGENT,      //!< Control requests, as an emergency stop: they go before the rest and win the CAN arbitration
+    MODBUS_PRIORITY_BACKGROUND   //!< Polling: it loses the CAN arbitration against the rest
+};
+
+//! Size of the buffers of the incoming messages swapped between App and the CAN/OSL layers; a whole RTU frame fits.
+#define MODBUS_APP_MSG_SIZE 256
 //! @}
               
 unsigned char Modbus_Master_Communication (void);//inside is different, header the same
+#if CAN_Mode
+void Modbus_App_Manage_CallBack (unsigned char slot);//one per request in flight
+void Modbus_App_Resend(unsigned char slot);
+void Modbus_App_No_Response(unsigned char slot);
+void Modbus_App_Group_CallBack (unsigned char Slave);//one per slave of a group poll
+void Modbus_App_Group_No_Response(unsigned char Slave);
+#ifdef MODBUS_CAN_PUBLISH
+void Modbus_App_Snapshot_CallBack(unsigned char entry, unsigned char *data, unsigned char length);//one per published block asked
+#endif
+#else
 void Modbus_App_Manage_CallBack (void);//inside different, same header
+void Modbus_App_No_Response(void);
+#endif
 unsigned char Modbus_App_Enqueue_Or_Send(void);//inside different, same header
 void Modbus_App_Send(void);//inside different, same header
-void Modbus_App_Receive_Char (unsigned char Msg,unsigned char i);
-void Modbus_App_L_Msg_Set(unsigned char Index);
-void Modbus_App_No_Response(void);
+unsigned char *Modbus_App_Msg_Swap(unsigned char *Buffer, unsigned char Offset, unsigned char Length);
 unsigned char Modbus_Get_Error (struct Modbus_FIFO_E_Item *Error);
 unsigned char Modbus_App_FIFOSend(void);
+void Modbus_Set_Priority (enum Modbus_Priority Priority);
 
 unsigned char Modbus_Read_Coils (unsigned char Slave, uint16_t Adress, 
                                  uint16_t Coils, unsigned char *Response);
@@ -58,4 +83,21 @@ unsigned char Modbus_Read_Write_M_Registers (unsigned char Slave, uint16_t R_Adr
                                              uint16_t R_Registers, uint16_t *Response,
                                              uint16_t W_Adress, uint16_t W_Registers,
                                              uint16_t *Value);
+#if CAN_Mode
+unsigned char Modbus_Read_Group_Registers (unsigned char First, unsigned char Last, unsigned char Function,
+                                           uint16_t Adress, uint16_t Registers, uint16_t *Response);
+#ifdef MODBUS_CAN_PUBLISH
+unsigned char Modbus_Read_Snapshot (unsigned char Slave, unsigned char Block, uint16_t Registers, uint16_t *Response);
+unsigned char Modbus_Read_Cache (unsigned char Slave, unsigned char Block, uint16_t Registers, uint16_t *Response,
+                                 unsigned long Max_Age);
+unsigned char Modbus_Read_Cache_Coils (unsigned char Slave, unsigned char Block, uint16_t Coils, unsigned char *Response,
+                                       unsigned long Max_Age);
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+unsigned char Modbus_Set_Schedule (unsigned long Cycle, unsigned long Free);
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+unsigned char Modbus_Set_Flow_Control (unsigned char Block_Size, unsigned char STmin);
+#endif
+#endif
 #endif // __Modbus_App_H__
\ No newline at end of file
@@ -22,49 +22,147 @@
 static  enum Modbus_MainState modbus_master_state;
 //! Variable used to store the maximum attempts to send data
 static  unsigned char modbus_max_attempts;
-//! Variable used to store how many attempts are already done
-static  unsigned char modbus_attempts;
-//! Variable used to store if data needs to be resent
-static  unsigned char modbus_forward_flag;
 //! Variable used to store if a complete transmission was done
 static  unsigned char modbus_complete_transmission;
-//! Variable used to store if a complete reception was done
-static  unsigned char modbus_complete_reception;
 //!Variable used to store the timeout for broadcast
 static  unsigned long modbus_broadcast_timeout;
 //!Variable used to store the timeout for unicast requests
 static  unsigned long modbus_unicast_timeout;
-//!Variable to index the incoming data
-static unsigned char modbus_index;
-//! Input data
-static unsigned char input_pdu[MAX_PDU];
-//! Input data buffer
-static  unsigned char input_pdu_buffer[MAX_FRAME];
-//! Input data length
-static unsigned char input_length;
-//! Waiting time in cycles*3 between sendings
+//! Requests in flight, one per slot
+static struct Modbus_CAN_Slot modbus_slots[MODBUS_CAN_SLOTS];
+//! Slot of the last frame received
+static struct Modbus_CAN_Slot *rx_slot;
+//! Answer which is being reassembled; the one of _rx_slot_
+static struct Modbus_CAN_Input *input;
+//! Response times learned, by slave and function code
+static struct Modbus_CAN_Rtt modbus_rtt[MODBUS_CAN_RTT_ENTRIES];
+//! Minimum unicast timeout, in cycles
+static unsigned long modbus_rto_min;
+//! Maximum unicast timeout, in cycles
+static unsigned long modbus_rto_max;
+//! Ticks of the timer of the unicast timeouts since the initialisation; it is the time base
+static volatile unsigned long modbus_ticks;
+//! Bus-health counters and state of the CAN controller
+static struct Modbus_CAN_Health modbus_health;
+//! Ticks left to initialise again the CAN controller, or to give up waiting for its recovery; 0 if it is not running
+static unsigned long modbus_restart_ticks;
+//! Time when the bus-off state was entered, in cycles
+static unsigned long modbus_bus_off_since;
+//! Waiting time in cycles*3 between sendings; only used if MODBUS_CAN_TX_DELAYED is defined
 static unsigned long modbus_delay;
+//! Output data; copy of the PDU which is being sent through the mailboxes
+static unsigned char output_pdu[MAX_PDU];
+//! Output data length
+static unsigned char output_length;
+//! Chunks of the output PDU waiting to be loaded into a mailbox, one bit per chunk
+static uint64_t output_map;
+//! Number of chunks of the output PDU
+static unsigned char output_chunks;
+//! Sequence counter of the output long frames
+static unsigned char output_seq;
+//! Variable used to store if there are mailboxes waiting to be sent
+static unsigned char output_busy;
+//! Variable used to store if the chunks are paced by Modbus_CAN_FixOutput (MODBUS_CAN_TX_DELAYED)
+static unsigned char output_paced;
+//! Slave number used to build the IDs of the output frames
+static unsigned char output_slave;
+//! Priority used to build the IDs of the output frames (extended message IDs)
+static unsigned char output_priority;
+//! Frames loaded in the mailboxes since the last TXOK interruption
+static unsigned char output_window;
+//! Data bytes of the frames loaded in the mailboxes since the last TXOK interruption
+static unsigned long output_window_bytes;
+#ifdef MODBUS_CAN_FLOW_CONTROL
+//! Chunks of the output which can still be loaded before waiting for a FLOW control frame of the slave; 0 for all of them
+static unsigned char output_block;
+//! Block size of the last FLOW control frame of the slave, used again for the chunks asked by a NACK
+static unsigned char output_block_size;
+//! Separation time between chunks asked by the slave, in cycles; 0 to send them back to back
+static unsigned long output_stmin;
+//! 1 while the output waits for a FLOW control frame of the slave
+static unsigned char output_flow_wait;
+//! Block size asked for the long answers of the slaves
+static unsigned char modbus_flow_bs;
+//! Separation time asked for the long answers of the slaves, coded as in ISO 15765-2
+static unsigned char modbus_flow_stmin;
+#endif
+//! Traffic counters
+static struct Modbus_CAN_Stats modbus_stats;
+//! Traffic counters as they are after the initialisation
+static const struct Modbus_CAN_Stats modbus_stats_none;
+#ifdef MODBUS_CAN_BROADCAST_ACK
+//! Slaves which acknowledge the broadcast requests, one bit per slave number
+static unsigned char modbus_broadcast_slaves[32];
+//! Number of slaves which acknowledge the broadcast requests
+static unsigned char modbus_broadcast_count;
+//! Slaves which have not acknowledged the broadcast request in course yet, one bit per slave number
+static unsigned char modbus_broadcast_pending[32];
+//! Number of slaves which have not acknowledged the broadcast request in course yet
+static unsigned char modbus_broadcast_left;
+#endif
+//! Group poll in course
+static struct Modbus_CAN_Group modbus_group;
+#ifdef MODBUS_CAN_PUBLISH
+//! Published blocks asked with a remote frame
+static struct Modbus_CAN_Snapshot modbus_snapshots[MODBUS_CAN_SNAPSHOTS];
+//! Last value received of the published blocks
+static struct Modbus_CAN_Cache modbus_cache[MODBUS_CAN_CACHE];
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+//! Length of the cycle of the schedule, in cycles; 0 if it does not run
+static unsigned long modbus_cycle;
+//! Start of the free window of the cycle, in cycles from the reference
+static unsigned long modbus_free;
+//! Time of the last reference frame, in cycles
+static volatile unsigned long modbus_cycle_start;
+//! Number of the cycle, sent in the reference frame
+static unsigned char modbus_cycle_count;
+#endif
 
 //-CAN
 //!Variable used to store the bit rate range of the communications
 static enum  Modbus_CAN_BitRate modbus_bit_rate;
 //! Variable used to store both bit time and rate information
 static tCANBitClkParms modbus_canbit;
+#ifdef MODBUS_CAN_FD
+//! Bit time of the data phase of the CAN FD frames
+static tCANBitClkParms modbus_canbit_data;
+#endif
 //! Receive Message Object
 static  tCANMsgObject RxObject;
+//! Data of the last frame taken from the receive FIFO
+static unsigned char modbus_rx_frame[MAX_FRAME];
 //! Transmit Message Object
 static  tCANMsgObject TxObject;
 //! @}
 
-//FOR DEBUGGING:
-// Output data length; NOT NEEDED
-//static  unsigned char output_length;
-// Output data; NOT NEEDED
-//static  unsigned char output_pdu[MAX_PDU];
-static unsigned char modbus_timeout;
-
-static unsigned char buu = 0;
-static uint16_t boo = 0;
+static unsigned char Modbus_CAN_FindSlot(unsigned char slave);
+static struct Modbus_CAN_Rtt *Modbus_CAN_FindRtt(unsigned char slave, unsigned char function);
+static unsigned long Modbus_CAN_Now(void);
+static void Modbus_CAN_Setup(void);
+static void Modbus_CAN_Lock(void);
+static void Modbus_CAN_Unlock(void);
+static void Modbus_CAN_Frame(unsigned char slot);
+static unsigned char Modbus_CAN_StatsBucket(unsigned long cycles);
+#ifdef MODBUS_CAN_BROADCAST_ACK
+static unsigned char Modbus_CAN_BroadcastDone(void);
+#endif
+static unsigned char Modbus_CAN_GroupAnswer(void);
+static void Modbus_CAN_GroupToApp(void);
+static void Modbus_CAN_GroupRtt(unsigned char answers);
+static unsigned long Modbus_CAN_Guess(uint16_t amount_guess);
+#ifdef MODBUS_CAN_PUBLISH
+static unsigned char Modbus_CAN_SnapshotAnswer(void);
+static unsigned char Modbus_CAN_SnapshotToApp(void);
+static void Modbus_CAN_CacheStore(void);
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+static unsigned char Modbus_CAN_FreeWindow(void);
+static void Modbus_CAN_Reference(void);
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+static void Modbus_CAN_FlowSend(unsigned char slot);
+#endif
 
 void Modbus_CAN_IntHandler(void)
 {
@@ -75,53 +173,48 @@ void Modbus_CAN_IntHandler(void)
     {             
        //some "errors" occurred
         can_sts_status = CANStatusGet(MODBUS_CAN, CAN_STS_CONTROL);  
-        switch(can_sts_status)
-        {
-                //error processing, bus-off state, etc.
-                case CAN_STATUS_BUS_OFF:
-                case CAN_STATUS_EWARN:
-                case CAN_STATUS_EPASS: 
-                                      //RESET SHOULD BE DONE
-                                      Modbus_CAN_Error_Management(110);
-                                      break;
-                case CAN_STATUS_RXOK:                                       
-                case CAN_STATUS_TXOK: /*ALL OK*/
-                                      break;
-                case CAN_STATUS_LEC_MSK:                  
-                case CAN_STATUS_LEC_STUFF:
-                case CAN_STATUS_LEC_FORM:
-                case CAN_STATUS_LEC_BIT1:
-                case CAN_STATUS_LEC_BIT0:                                      
-                case CAN_STATUS_LEC_ACK:
-                case CAN_STATUS_LEC_CRC: /*CAN ERROR FRAME, NO PROBLEM, TIMEOUT WILL BE TRIGGERED*/
-                                        break;
-                default:             
-                                        break;
-        }            
+        //CAN ERROR FRAMES, NO PROBLEM, TIMEOUT WILL BE TRIGGERED; the bus-off state is recovered
+        Modbus_CAN_BusStatus(can_sts_status);
         CANIntClear(MODBUS_CAN, can_status);
     }
-    else if(can_status >= 1 && can_status <= 16)
+    else if(can_status >= MODBUS_CAN_TX_FIRST_OBJ && can_status <= MODBUS_CAN_TX_LAST_OBJ)
     {
-        //LAST SENDING message object should have the interruption pending, so last data was sent             
-        CANIntClear(MODBUS_CAN, can_status);//clear interruption        
-        // I should notify in some way that I sent the data correctly       
-        modbus_complete_transmission = 1;                
+        //LAST LOADED message object should have the interruption pending, so the whole window was sent
+        CANIntClear(MODBUS_CAN, can_status);//clear interruption
+        modbus_stats.frames_sent += output_window;
+        modbus_stats.bytes_sent += output_window_bytes;
+        output_window = 0;
+        output_window_bytes = 0;
+        if(output_map)
+        {
+            //the mailboxes are free again, next window of chunks
+#ifdef MODBUS_CAN_FLOW_CONTROL
+            if(output_stmin && !output_flow_wait)
+            {
+                //the slave asked for a separation time, Modbus_CAN_FlowHandler() loads the next chunk
+                TimerLoadSet(MODBUS_CAN_FLOW_TIMER, TIMER_A, output_stmin);
+                TimerEnable(MODBUS_CAN_FLOW_TIMER, TIMER_A);
+            }
+            else
+#endif
+            if(!output_paced)
+                Modbus_CAN_TxRefill(MODBUS_CAN_TX_LAST_OBJ);
+        }
+        else
+        {
+            // I should notify in some way that I sent the data correctly
+            output_busy = 0;
+            modbus_complete_transmission = 1;
+            //the bus works, the next bus-off starts again with the shortest restart delay
+            modbus_health.backoff = 0;
+        }
     }
-    else if(can_status == 17) // Message 17 should be the first one to have an interruption
+    else if(can_status >= MODBUS_CAN_RX_FIFO_FIRST && can_status <= MODBUS_CAN_RX_FIFO_LAST) // receive FIFO, answers of all slots
     {        
         //I process the received data:                                      
-         buu = 1;     //DEBUGGGGGGGGGGGGGGGGG
-         if(!modbus_complete_reception)
-         {     
-             ledOn();
-             Modbus_CAN_CallBack();                                                    
-             ledOff();             
-         }                         
-    }
-    else if(can_status == 18)
-    {
-        //NO BROADCAST RESPONSE SHOULD BE RECEIVED in the master!        
-        //Modbus_CAN_CallBack();
+         ledOn();
+         Modbus_CAN_CallBack();                                                    
+         ledOff();             
     }
     else
     {
@@ -132,17 +225,75 @@ void Modbus_CAN_IntHandler(void)
 
 void Modbus_CAN_Init(enum Modbus_CAN_BitRate bit_rate, unsigned char attempts)
 {                
+        unsigned char slot;
         Modbus_SetMainState(MODBUS_INITIAL);
         /////////////////Variables///////////
 	modbus_max_attempts = attempts;
         modbus_bit_rate = bit_rate;
         Modbus_CAN_SetBitRate(bit_rate);         
-        modbus_forward_flag = 0;                
-        modbus_attempts = 1;  
-        modbus_index = 0;
+        for(slot = 0; slot < MODBUS_CAN_SLOTS; slot++)
+        {
+            modbus_slots[slot].slave = 0;
+            modbus_slots[slot].state = MODBUS_IDLE;
+            modbus_slots[slot].attempts = 1;
+            modbus_slots[slot].complete_reception = 0;
+            modbus_slots[slot].ticks = 0;
+            modbus_slots[slot].input.index = 0;
+            modbus_slots[slot].input.active = 0;
+            modbus_slots[slot].input.pdu = modbus_slots[slot].input.buffer;
+            modbus_slots[slot].replay = 0;
+        }
+        rx_slot = &modbus_slots[0];
+        input = &rx_slot->input;
+        for(slot = 0; slot < MODBUS_CAN_RTT_ENTRIES; slot++)
+        {
+            modbus_rtt[slot].samples = 0;
+        }
+        modbus_rto_min = MODBUS_CAN_RTO_MIN;
+        modbus_rto_max = MODBUS_CAN_RTO_MAX;
+        modbus_ticks = 0;
+        modbus_health.state = MODBUS_CAN_BUS_ACTIVE;
+        modbus_health.bus_off = 0;
+        modbus_health.passive = 0;
+        modbus_health.warning = 0;
+        modbus_health.frame_errors = 0;
+        modbus_health.restarts = 0;
+        modbus_health.recoveries = 0;
+        modbus_health.replays = 0;
+        modbus_health.last_recovery = 0;
+        modbus_health.max_recovery = 0;
+        modbus_health.backoff = 0;
+        modbus_restart_ticks = 0;
         modbus_complete_transmission = 0;
-        modbus_complete_reception = 0;
-        modbus_timeout = 0; // DEBUGGGGGGGGGGGGGGGGGGGGG
+        output_length = 0;
+        output_map = 0;
+        output_seq = 0;
+        output_busy = 0;
+        output_paced = 0;
+        output_window = 0;
+        output_window_bytes = 0;
+#ifdef MODBUS_CAN_FLOW_CONTROL
+        output_flow_wait = 0;
+        modbus_flow_bs = 0;
+        modbus_flow_stmin = 0;
+#endif
+        modbus_group.last = 0;
+        modbus_group.pdu = modbus_group.buffer;
+#ifdef MODBUS_CAN_PUBLISH
+        for(slot = 0; slot < MODBUS_CAN_SNAPSHOTS; slot++)
+        {
+            modbus_snapshots[slot].slave = 0;
+        }
+        for(slot = 0; slot < MODBUS_CAN_CACHE; slot++)
+        {
+            modbus_cache[slot].slave = 0;
+        }
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+        modbus_cycle = 0;
+        modbus_cycle_count = 0;
+#endif
+        modbus_stats = modbus_stats_none;
 	//CAN ENABLING	
         SysCtlPeripheralEnable(SYSCTL_PERIPH_GPIOD);      
         //I enable the pins to be used as CAN pins
@@ -152,18 +303,30 @@ void Modbus_CAN_Init(enum Modbus_CAN_BitRate bit_rate, unsigned char attempts)
         SysCtlPeripheralEnable(SYSCTL_PERIPH_TIMER1);
         SysCtlPeripheralEnable(SYSCTL_PERIPH_TIMER2);
         IntMasterEnable();
-        TimerConfigure(TIMER1_BASE, TIMER_CFG_ONE_SHOT);                
+        //TIMER1 gives the ticks of the unicast timeouts of all slots, and the time to measure the response times
+        TimerConfigure(TIMER1_BASE, TIMER_CFG_PERIODIC);                
+        TimerLoadSet(TIMER1_BASE, TIMER_A, MODBUS_CAN_TIMER_TICK);
         TimerConfigure(TIMER2_BASE, TIMER_CFG_ONE_SHOT);                        
         IntEnable(INT_TIMER1A);
         IntEnable(INT_TIMER2A);
         TimerIntEnable(TIMER1_BASE, TIMER_TIMA_TIMEOUT);
         TimerIntEnable(TIMER2_BASE, TIMER_TIMA_TIMEOUT);        
-        //Init CAN Module
-        CANInit(MODBUS_CAN);
-        //Set bit timing
-        CANSetBitTiming(MODBUS_CAN, &modbus_canbit);               
-        //ENABLING CAN INTERRUPTIONS        
-        CANIntEnable(MODBUS_CAN, CAN_INT_ERROR |CAN_INT_STATUS | CAN_INT_MASTER);       
+        TimerEnable(TIMER1_BASE, TIMER_A);
+#ifdef MODBUS_CAN_SCHEDULE
+        //TIMER3 starts the cycles of the schedule, once Modbus_CAN_Schedule() gives their length
+        SysCtlPeripheralEnable(SYSCTL_PERIPH_TIMER3);
+        TimerConfigure(MODBUS_CAN_CYCLE_TIMER, TIMER_CFG_PERIODIC);
+        IntEnable(INT_TIMER3A);
+        TimerIntEnable(MODBUS_CAN_CYCLE_TIMER, TIMER_TIMA_TIMEOUT);
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+        //TIMER0 paces the long requests as the slaves ask, and waits for their FLOW control frames
+        SysCtlPeripheralEnable(SYSCTL_PERIPH_TIMER0);
+        TimerConfigure(MODBUS_CAN_FLOW_TIMER, TIMER_CFG_ONE_SHOT);
+        IntEnable(INT_TIMER0A);
+        TimerIntEnable(MODBUS_CAN_FLOW_TIMER, TIMER_TIMA_TIMEOUT);
+#endif
+        Modbus_CAN_Setup();
         IntEnable(INT_CAN0);
         //LED STARTING
         SysCtlPeripheralEnable(SYSCTL_PERIPH_GPIOF);
@@ -187,238 +350,658 @@ void Modbus_SetMainState(enum Modbus_MainState state)
 
 void Modbus_CAN_SetBitRate(enum Modbus_CAN_BitRate bit_rate)
 {
-      switch(bit_rate)
+      unsigned long kbps = (unsigned long)bit_rate;
+      if(!kbps || !Modbus_CAN_BitTiming(MODBUS_CAN_CLOCK, kbps * 1000, &modbus_canbit))
       {
-            case MODBUS_100KBPS:
-                          modbus_canbit.ulSyncPropPhase1Seg = 5;      //3 *tq; following the example from the microcontroller's pdf
-                          modbus_canbit.ulPhase2Seg = 4;
-                          modbus_canbit.ulSJW = 4;
-                          modbus_canbit.ulQuantumPrescaler = 8;
-                          /*(4000000/3) * 0.07 *10 = 9333333 ("TRANSFER TIME"); 
-                             900000 * 4 = process time
-                          */
-                          modbus_delay = 9333333 + 900000*4; // 10 times slower THAN 1MBPS
-                          break;
-            case MODBUS_1MBPS:
-                          modbus_canbit.ulSyncPropPhase1Seg = 5;      //3 *tq; following the example from the microcontroller's pdf
-                          modbus_canbit.ulPhase2Seg = 2;
-                          modbus_canbit.ulSJW = 2;
-                          modbus_canbit.ulQuantumPrescaler = 1;
-                          /*(4000000/3) * 0.07 = 933333 ("TRANSFER TIME"); 
-                            900000*4 = process time
-                          */
-                          modbus_delay = 933333 + 900000*4;
-                          break;
-            default : Modbus_CAN_Error_Management(110); break;
+            Modbus_CAN_Error_Management(110);
+            return;
       }
+#ifdef MODBUS_CAN_FD
+      //data phase faster than the nominal bit rate; at the nominal one if the CAN clock does not give it
+      if((kbps >= MODBUS_CAN_FD_DATA_RATE) || 
+         !Modbus_CAN_BitTiming(MODBUS_CAN_CLOCK, MODBUS_CAN_FD_DATA_RATE * 1000UL, &modbus_canbit_data))
+            modbus_canbit_data = modbus_canbit;
+#endif
+      //transfer time of a byte ("TRANSFER TIME", 10 times longer at 100 Kbps than at 1 Mbps) + process time
+      modbus_delay = (MODBUS_CAN_TRANSFER_TIME / kbps) + MODBUS_CAN_PROCESS_TIME;
 }
 
-void Modbus_CAN_FixOutput(unsigned char *mb_req_pdu, unsigned char slave, unsigned char pdu_length, uint16_t amount_guess)
-{
-        unsigned char aux_length;
-        unsigned char local_output[8];        
-        int i, iterations, objNumber;// index;// OUTPUT_PDU IS NOT NEEDED, ONLY IN DEBUG
-        uint16_t registerr;               
-            //init variables            
-            objNumber = 1;    
-            iterations = 0;  
-            aux_length = pdu_length;
-            registerr = 0x000;
-            //index = 0;            
-            //storing in global variables
-            //output_length = pdu_length;
-            modbus_complete_transmission = 0;                 
+unsigned char Modbus_CAN_BitTiming(unsigned long can_clock, unsigned long bit_rate, tCANBitClkParms *bit_clk)
+{
+      unsigned long tq, prescaler, phase2, error, sample;
+      unsigned long best_error = 0xFFFFFFFF, best_sample = 0xFFFFFFFF;
+      //from the most time quanta, so the finer timing is kept when two of them are equally good
+      for(tq = MODBUS_CAN_TQ_MAX; tq >= MODBUS_CAN_TQ_MIN; tq--)
+      {
+            //the closest prescaler for this number of time quanta
+            prescaler = (can_clock + ((bit_rate * tq) / 2)) / (bit_rate * tq);
+            if(!prescaler)
+                prescaler = 1;
+            if(prescaler > MODBUS_CAN_PRESCALER_MAX)
+                continue;
+            error = can_clock / (prescaler * tq);
+            error = (error > bit_rate) ? (error - bit_rate) : (bit_rate - error);
+            //Phase2 is what is left after the sample point, Sync + Prop + Phase1 up to 16 time quanta
+            phase2 = tq - (((tq * MODBUS_CAN_SAMPLE_POINT) + 500) / 1000);
+            if(!phase2)
+                phase2 = 1;
+            if((tq - phase2) > 16)
+                phase2 = tq - 16;
+            sample = ((tq - phase2) * 1000) / tq;
+            sample = (sample > MODBUS_CAN_SAMPLE_POINT) ? (sample - MODBUS_CAN_SAMPLE_POINT) : (MODBUS_CAN_SAMPLE_POINT - sample);
+            if((error < best_error) || ((error == best_error) && (sample < best_sample)))
+            {
+                best_error = error;
+                best_sample = sample;
+                bit_clk->ulSyncPropPhase1Seg = tq - phase2;
+                bit_clk->ulPhase2Seg = phase2;
+                bit_clk->ulSJW = (phase2 < 4) ? phase2 : 4;
+                bit_clk->ulQuantumPrescaler = prescaler;
+            }
+      }
+      return best_error <= (((bit_rate / 100) * MODBUS_CAN_BIT_TOLERANCE) / 100);
+}
+
+unsigned char Modbus_CAN_FixOutput(unsigned char *mb_req_pdu, unsigned char slave, unsigned char pdu_length, uint16_t amount_guess,
+                                   unsigned char priority)
+{
+        unsigned int i;
+        unsigned char slot = MODBUS_CAN_SLOTS;
+            //the mailboxes must not be refilled while the new output is being prepared
+            Modbus_CAN_Lock();
+#ifdef MODBUS_CAN_FLOW_CONTROL
+            //the flow control timer of the output before neither paces nor drops the new one
+            TimerDisable(MODBUS_CAN_FLOW_TIMER, TIMER_A);
+            TimerIntClear(MODBUS_CAN_FLOW_TIMER, TIMER_TIMA_TIMEOUT);
+#endif
+            modbus_complete_transmission = 0;
             //TURN ON LED
             ledOn();
+            //new transfer, also new transaction ID in the extended message IDs
+            output_seq++;
             if(slave)
-                Modbus_CAN_ReceptionConfiguration(slave);
+            {
+                slot = Modbus_CAN_FindSlot(slave);
+                if(modbus_slots[slot].slave != slave) //new request, not a resend
+                {
+                    modbus_slots[slot].slave = slave;
+                    modbus_slots[slot].attempts = 1;
+                    modbus_slots[slot].replay = 0;
+                }
+                modbus_slots[slot].txn = output_seq;
+                modbus_slots[slot].function = mb_req_pdu[0];
+                modbus_slots[slot].priority = priority;
+                Modbus_CAN_ReceptionConfiguration(slot);
+            }
+            else if(mb_req_pdu[0] == MODBUS_CAN_GROUP)
+            {
+                //group poll, the answers can arrive as soon as the request is sent
+                modbus_group.first = mb_req_pdu[1];
+                modbus_group.last = mb_req_pdu[2];
+                modbus_group.left = modbus_group.last - modbus_group.first + 1;
+                for(i = 0; i < modbus_group.left; i++)
+                    modbus_group.length[i] = 0;
+                Modbus_SetMainState(MODBUS_WAITREPLY);
+            }
+#ifdef MODBUS_CAN_BROADCAST_ACK
             else
-                modbus_complete_reception = 0;            
+            {
+                //the acknowledgements can arrive as soon as the request is sent
+                for(i = 0; i < sizeof(modbus_broadcast_pending); i++)
+                    modbus_broadcast_pending[i] = modbus_broadcast_slaves[i];
+                modbus_broadcast_left = modbus_broadcast_count;
+            }
+#endif
+            //the PDU is copied, so the APP layer can build the next one while this is still being sent
+            for(i=0; i < pdu_length; i++)
+            {
+                output_pdu[i] = mb_req_pdu[i];
+            }
+            output_length = pdu_length;
+            output_chunks = MODBUS_CAN_INDIVIDUAL(pdu_length) ? 1 : MODBUS_CAN_CHUNKS(pdu_length);
+            output_map = MODBUS_CAN_ALL_CHUNKS(output_chunks);
+            output_slave = slave;
+            output_priority = priority;
+            //It is checked if is an unicast or a broadcast, and it is put the timers; before the first chunk goes out, as the answer 
+            //can arrive as soon as the interruptions of the CAN layer are enabled again
+            if(slave) //unicast
+            {
+                  modbus_slots[slot].state = MODBUS_WAITREPLY;
+                  modbus_slots[slot].sent = Modbus_CAN_Now();
+                  Modbus_CAN_UnicastTimeout(slot, amount_guess);
+            }
+            else if(output_pdu[0] == MODBUS_CAN_GROUP)
+            {
+                  modbus_group.sent = Modbus_CAN_Now();
+                  Modbus_CAN_GroupTimeout(amount_guess);
+            }
+            else//slave == 0
+            {
+                  Modbus_SetMainState(MODBUS_TURNAROUND);
+                  Modbus_CAN_BroadcastTimeout(amount_guess);
+            }
+#ifdef MODBUS_CAN_TX_DELAYED
+            output_paced = 1;
+            //only one mailbox, waiting a fixed time between chunks
+            Modbus_CAN_TxRefill(MODBUS_CAN_TX_FIRST_OBJ);
+            Modbus_CAN_Unlock();
+            while(output_map)
+            {
+                Modbus_CAN_Delay();
+                Modbus_CAN_Lock();
+                Modbus_CAN_TxRefill(MODBUS_CAN_TX_FIRST_OBJ);
+                Modbus_CAN_Unlock();
+            }
+            output_paced = 0;
+#else
+#ifdef MODBUS_CAN_FLOW_CONTROL
+            //an unicast long frame waits for the FLOW control frame of the slave after its first chunk; the broadcasts are not paced
+            output_flow_wait = 0;
+            output_stmin = 0;
+            output_block_size = 0;
+            output_block = (slave && !MODBUS_CAN_INDIVIDUAL(pdu_length)) ? 1 : 0;
+#endif
+            //first window of chunks, the rest are queued from the TXOK interruption
+            Modbus_CAN_TxRefill(MODBUS_CAN_TX_LAST_OBJ);
+            Modbus_CAN_Unlock();
+#endif
+            //TURN OFF LED
+            ledOff();
+            return slot;
+}
+
+unsigned char Modbus_CAN_Ready(unsigned char slave)
+{
+        unsigned char slot;
+            //while the bus is off, the requests wait in the FIFO
+            if((Modbus_GetMainState() != MODBUS_IDLE) || output_busy || (modbus_health.state >= MODBUS_CAN_BUS_OFF))
+                return 0;
+#ifdef MODBUS_CAN_SCHEDULE
+            if(!Modbus_CAN_FreeWindow())
+                return 0;
+#endif
+            if(!slave) //broadcast, all slots have to be free
+            {
+                for(slot = 0; slot < MODBUS_CAN_SLOTS; slot++)
+                {
+                    if(modbus_slots[slot].slave)
+                        return 0;
+                }
+                return 1;
+            }
+            slot = Modbus_CAN_FindSlot(slave);
+            return (slot < MODBUS_CAN_SLOTS) && (modbus_slots[slot].slave != slave);
+}
+
+//! \brief Function to find the slot of a slave.
+//!
+//! \param slave The number of the slave.
+//! \return The slot which has a request to the slave, or else the first free slot, or MODBUS_CAN_SLOTS if all are busy.
+static unsigned char Modbus_CAN_FindSlot(unsigned char slave)
+{
+        unsigned char slot, free_slot = MODBUS_CAN_SLOTS;
+            for(slot = 0; slot < MODBUS_CAN_SLOTS; slot++)
+            {
+                if(modbus_slots[slot].slave == slave)
+                    return slot;
+                if(!modbus_slots[slot].slave && (free_slot == MODBUS_CAN_SLOTS))
+                    free_slot = slot;
+            }
+            return free_slot;
+}
+
+void Modbus_CAN_TxRefill(unsigned char last_obj)
+{
+        unsigned char chunk, objNumber, type;
+        unsigned char local_output[MAX_FRAME];
             //body:
             // 001 + 00000000(slave)= Individual Frame (1)
             // 011 + slave = Beginning Long Frame (3)
             // 101 + slave = Continuation Long Frame (5)
             // 111 + slave = End Long Frame (7)
-            TxObject.ulMsgIDMask = 0x000;//It's not used mask, I send all messages without filtering                                                             
-            while(aux_length) // != 0 true
-            {                
-                if(aux_length <= MAX_FRAME) //ONE FRAME OR THE LAST LONG ONE
-                {                    
-                    registerr=0x7; // if I do not enter in the below statement, I mark the frame as End Long Frame                    
-                    if(pdu_length <= MAX_FRAME) //I send an Individual Frame, so I will leave soon
-                    {              
-                          registerr = 0x1;                               
-                    }                    
-                    TxObject.ulFlags = MSG_OBJ_TX_INT_ENABLE;
-                    TxObject.ulMsgID = ((registerr << 8) | slave);                    
-                    TxObject.ulMsgLen = aux_length;      
-                    /* It's the last frame so:
-                       Maximum size to send - remainder + i
-                    */                      
-                    for(i=0; i < aux_length; i++)
-                    {
-                        local_output[i] = mb_req_pdu[i + (iterations * MAX_FRAME)]; 
-                        //output_pdu[index++] = local_output[i];                        
-                    }                                              
-                    aux_length -= aux_length;// it should be 0 now                        
-                    //It is checked if is an unicast or a broadcast, and it is put the timers
-                    if(slave) //unicast
-                    {
-                          Modbus_SetMainState(MODBUS_WAITREPLY);
-                          Modbus_CAN_UnicastTimeout(amount_guess);
-                    }
-                    else//slave == 0
-                    {
-                          Modbus_SetMainState(MODBUS_TURNAROUND);
-                          Modbus_CAN_BroadcastTimeout(amount_guess);
-                    }
-                    //TURN OFF LED
-                    ledOff();
+            TxObject.ulMsgIDMask = 0x000;//It's not used mask, I send all messages without filtering
+            TxObject.pucMsgData = local_output;
+            objNumber = MODBUS_CAN_TX_FIRST_OBJ;
+#ifdef MODBUS_CAN_FLOW_CONTROL
+            //the slave paces the long frame: nothing is loaded until its FLOW control frame, and one chunk at a time if it asked for
+            //a separation time
+            if(output_flow_wait)
+                return;
+            if(output_stmin)
+                last_obj = MODBUS_CAN_TX_FIRST_OBJ;
+#endif
+            while(output_map && (objNumber <= last_obj))
+            {
+                //the lowest chunk still pending goes first
+                for(chunk = 0; !(output_map & ((uint64_t)1 << chunk)); chunk++);
+                output_map &= ~((uint64_t)1 << chunk);
+#ifdef MODBUS_CAN_FLOW_CONTROL
+                if(output_block && !--output_block && output_map)
+                {
+                    //end of the block, the last chunk loaded until the slave allows the next block
+                    output_flow_wait = 1;
+                    last_obj = objNumber;
+                    TimerLoadSet(MODBUS_CAN_FLOW_TIMER, TIMER_A, MODBUS_CAN_FLOW_TIMEOUT);
+                    TimerEnable(MODBUS_CAN_FLOW_TIMER, TIMER_A);
                 }
-                else //division needed because it's > 8
+#endif
+                if(MODBUS_CAN_INDIVIDUAL(output_length)) //I send an Individual Frame
+                    type = MODBUS_CAN_INDIVIDUAL_FRAME;
+                else if(chunk == 0) // first Long Frame
+                    type = MODBUS_CAN_BEGIN_FRAME;
+                else if(chunk == (output_chunks - 1)) // last Long Frame
+                    type = MODBUS_CAN_END_FRAME;
+                else //if not the first nor the last Long Frame, it's a continuation
+                    type = MODBUS_CAN_CONTINUATION_FRAME;
+                TxObject.ulMsgID = MODBUS_CAN_ID(type, 1, output_priority, output_seq, output_pdu[0], output_slave);
+                TxObject.ulMsgLen = Modbus_CAN_BuildChunk(output_pdu, output_length, output_seq, chunk, local_output);
+                // Lower message objects are sent first, so only the last loaded one needs the TXOK interruption
+                if(!output_map || (objNumber == last_obj))
+                    TxObject.ulFlags = MSG_OBJ_TX_INT_ENABLE | MODBUS_CAN_ID_FLAGS | MODBUS_CAN_FD_FLAGS;
+                else
+                    TxObject.ulFlags = MSG_OBJ_NO_FLAGS | MODBUS_CAN_ID_FLAGS | MODBUS_CAN_FD_FLAGS;
+                //counted when the TXOK interruption of the window arrives
+                output_window++;
+                output_window_bytes += TxObject.ulMsgLen;
+                CANMessageSet(MODBUS_CAN, objNumber, &TxObject, MSG_OBJ_TYPE_TX);
+                output_busy = 1;
+                objNumber++;
+            }
+}
+
+unsigned char Modbus_CAN_BuildChunk(unsigned char *pdu, unsigned char length, unsigned char seq, unsigned char chunk, unsigned char *frame)
+{
+        unsigned char i;
+        uint16_t offset;
+            if(MODBUS_CAN_INDIVIDUAL(length)) //Individual Frame, it is sent as it is
+            {
+                for(i=0; i < length; i++)
+                {
+                    frame[i] = pdu[i];
+                }
+                return length;
+            }
+            // chunk byte: 2 low bits of the sequence counter + chunk number
+            frame[0] = ((seq & MODBUS_CAN_TAG_MASK) << MODBUS_CAN_TAG_SHIFT) | chunk;
+            i = MODBUS_CAN_CHUNK_HEADER;
+            if(chunk == 0)
+            {
+                // first chunk: sequence counter + total length
+                frame[1] = seq;
+                frame[2] = length;
+                i = MODBUS_CAN_FIRST_HEADER;
+            }
+            for(offset = MODBUS_CAN_CHUNK_OFFSET(chunk); (i < MAX_FRAME) && (offset < length); i++, offset++)
+            {
+                frame[i] = pdu[offset];
+            }
+            // CAN FD frames have fixed lengths, the rest is padded
+            for(offset = MODBUS_CAN_FRAME_LENGTH(i); i < offset; i++)
+            {
+                frame[i] = 0;
+            }
+            return i;
+}
+
+unsigned char Modbus_CAN_Reassembly(unsigned char header, unsigned char *frame, unsigned char frame_length)
+{
+        unsigned char tag, chunk, i;
+        uint16_t offset;
+            if(frame_length < MODBUS_CAN_CHUNK_HEADER)
+                return MODBUS_CAN_REASSEMBLY_PENDING;
+            tag = frame[0] >> MODBUS_CAN_TAG_SHIFT;
+            chunk = frame[0] & MODBUS_CAN_CHUNK_MASK;
+            if(chunk >= MODBUS_CAN_MAX_CHUNKS)
+                return MODBUS_CAN_REASSEMBLY_PENDING;
+            // a new transfer starts if the tag changes or a first chunk comes with other sequence counter
+            if(!input->active || (tag != input->tag) || ((chunk == 0) && input->total && (frame[1] != input->seq)))
+            {
+                if((input->active == 1) && input->map)
+                    modbus_stats.reassembly_aborts++; //the long frame in course is replaced before being complete
+                input->active = 1;
+                input->tag = tag;
+                input->map = 0;
+                input->total = 0;
+                input->chunks = 0;
+                input->nacks = 0;
+                input->index = 0;
+#ifdef MODBUS_CAN_FLOW_CONTROL
+                input->flow = 0;
+                input->flow_pending = 0;
+#endif
+            }
+            else if(input->active == 2)
+            {
+                // chunk sent again of a transfer already completed
+                return MODBUS_CAN_REASSEMBLY_PENDING;
+            }
+            i = MODBUS_CAN_CHUNK_HEADER;
+            if(chunk == 0)
+            {
+                if(frame_length < MODBUS_CAN_FIRST_HEADER)
+                    return MODBUS_CAN_REASSEMBLY_PENDING;
+                input->seq = frame[1];
+                input->total = frame[2];
+                input->chunks = MODBUS_CAN_CHUNKS(input->total);
+                i = MODBUS_CAN_FIRST_HEADER;
+            }
+            else if((header == MODBUS_CAN_END_FRAME) && !input->total)
+            {
+                // first chunk lost, the end one tells how many chunks there are
+                input->chunks = chunk + 1;
+            }
+            offset = MODBUS_CAN_CHUNK_OFFSET(chunk);
+            if((offset + (frame_length - i)) > MAX_PDU)
+            {
+                // it does not fit in the PDU, the transfer is dropped
+                input->active = 0;
+                modbus_stats.reassembly_aborts++;
+                return MODBUS_CAN_REASSEMBLY_PENDING;
+            }
+            if(!(input->map & ((uint64_t)1 << chunk))) //duplicated chunks are ignored
+            {
+                input->index += frame_length - i;
+                for(; i < frame_length; i++)
                 {
-                    //if not the first Long Frame, it's a continuation
-                    registerr = 0x5;
-                    // first Long Frame
-                    if(aux_length == pdu_length)
-                    {
-                        registerr = 0x3;
-                    }
-                    TxObject.ulMsgID = ((registerr << 8) | slave);
-                    // not the last frame, so I do NOT use INTERRUPTIONS
-                    TxObject.ulFlags = MSG_OBJ_NO_FLAGS;
-                    TxObject.ulMsgLen = MAX_FRAME;
-                    for(i=0; i < MAX_FRAME; i++)
-                    {
-                        local_output[i] = mb_req_pdu[i + (iterations * MAX_FRAME)];
-                        //output_pdu[index++] = local_output[i];                        
-                    }
-                    aux_length -= MAX_FRAME;
-                    iterations++;
+                    input->pdu[offset++] = frame[i];
                 }
-                TxObject.pucMsgData = local_output;
-                CANMessageSet(MODBUS_CAN, objNumber, &TxObject, MSG_OBJ_TYPE_TX);                    
-                // If is not the last frame
-                if(aux_length)               
-                    Modbus_CAN_Delay();                
-            }                       
-}
-
-void Modbus_CAN_ReceptionConfiguration(unsigned char slave)
-{
-        int objNumber = 17;        
-        modbus_complete_reception = 0;
-       //RECEPTION MESSAGE OBJECT num.17          
-        //I will receive all types of answer from the concrete slave
-        RxObject.ulMsgID = slave; //xx0+ 0000+ 0000
-        RxObject.ulMsgIDMask = 0x1FF;        
-        RxObject.ulFlags = MSG_OBJ_USE_ID_FILTER | MSG_OBJ_RX_INT_ENABLE;
-        RxObject.pucMsgData = &input_pdu_buffer[0];
-        CANMessageSet(MODBUS_CAN, objNumber, &RxObject, MSG_OBJ_TYPE_RX);    
+                input->map |= (uint64_t)1 << chunk;
+            }
+            if(input->total && (input->map == MODBUS_CAN_ALL_CHUNKS(input->chunks)))
+            {
+                input->active = 2; //completed, its chunks sent again are ignored
+                input->length = input->total;
+                return MODBUS_CAN_REASSEMBLY_DONE;
+            }
+            if(header == MODBUS_CAN_END_FRAME)
+                return MODBUS_CAN_REASSEMBLY_MISSING;
+            return MODBUS_CAN_REASSEMBLY_PENDING;
+}
+
+void Modbus_CAN_Nack(void)
+{
+        unsigned char i;
+        uint64_t missing;
+        unsigned char ctrl[MODBUS_CAN_NACK_LENGTH];
+            if(++input->nacks > MODBUS_CAN_NACK_RETRIES)
+            {
+                // the transfer is dropped, the timeout will make the request to be sent again
+                input->active = 0;
+                modbus_stats.reassembly_aborts++;
+                return;
+            }
+            missing = MODBUS_CAN_ALL_CHUNKS(input->chunks) & ~input->map;
+            ctrl[0] = MODBUS_CAN_CTRL;
+            ctrl[1] = MODBUS_CAN_CTRL_NACK;
+            ctrl[2] = input->tag;
+            for(i = 0; i < (MODBUS_CAN_NACK_LENGTH - 3); i++)
+            {
+                ctrl[3 + i] = (unsigned char)(missing >> (8 * i));
+            }
+            // 001 + slave, it goes to the slave which is answering
+            Modbus_CAN_SendControl(MODBUS_CAN_ID(MODBUS_CAN_INDIVIDUAL_FRAME, 1, rx_slot->priority, rx_slot->txn, MODBUS_CAN_CTRL, rx_slot->slave), 
+                                   ctrl, MODBUS_CAN_NACK_LENGTH);
+#ifdef MODBUS_CAN_FLOW_CONTROL
+            // the chunks sent again come in blocks too
+            input->flow = 0;
+#endif
+}
+
+void Modbus_CAN_SendControl(unsigned long id, unsigned char *ctrl, unsigned char length)
+{
+        tCANMsgObject CtrlObject;
+            CtrlObject.ulMsgID = id;
+            CtrlObject.ulMsgIDMask = 0x000;
+            CtrlObject.ulFlags = MSG_OBJ_NO_FLAGS | MODBUS_CAN_ID_FLAGS | MODBUS_CAN_FD_FLAGS;
+            CtrlObject.ulMsgLen = length;
+            CtrlObject.pucMsgData = ctrl;
+            CANMessageSet(MODBUS_CAN, MODBUS_CAN_CTRL_OBJ, &CtrlObject, MSG_OBJ_TYPE_TX);
+            //it has no TXOK interruption, it is counted when it is loaded
+            modbus_stats.frames_sent++;
+            modbus_stats.bytes_sent += length;
+}
+
+void Modbus_CAN_Control(unsigned char *ctrl, unsigned char length)
+{
+        unsigned char i;
+        uint64_t missing;
+            if(length < 3)
+                return;
+            switch(ctrl[1])
+            {
+                case MODBUS_CAN_CTRL_NACK:
+                        // only the output long frame which is being sent can be retransmitted
+                        if(MODBUS_CAN_INDIVIDUAL(output_length) || (ctrl[2] != (output_seq & MODBUS_CAN_TAG_MASK)))
+                            break;
+                        missing = 0;
+                        for(i = 3; (i < length) && (i < MODBUS_CAN_NACK_LENGTH); i++)
+                        {
+                            missing |= (uint64_t)ctrl[i] << (8 * (i - 3));
+                        }
+                        // the end chunk is always sent again, so the receiver checks the transfer again
+                        missing |= (uint64_t)1 << (output_chunks - 1);
+                        output_map |= missing & MODBUS_CAN_ALL_CHUNKS(output_chunks);
+#ifdef MODBUS_CAN_FLOW_CONTROL
+                        output_block = output_block_size;
+#endif
+                        if(!output_busy)
+                            Modbus_CAN_TxRefill(MODBUS_CAN_TX_LAST_OBJ);
+                        break;
+#ifdef MODBUS_CAN_FLOW_CONTROL
+                case MODBUS_CAN_CTRL_FLOW:
+                        // only the output long frame which waits for it
+                        if(!output_flow_wait || (length < MODBUS_CAN_FLOW_LENGTH) || (ctrl[2] != (output_seq & MODBUS_CAN_TAG_MASK)))
+                            break;
+                        TimerDisable(MODBUS_CAN_FLOW_TIMER, TIMER_A);
+                        TimerIntClear(MODBUS_CAN_FLOW_TIMER, TIMER_TIMA_TIMEOUT);
+                        output_flow_wait = 0;
+                        output_block_size = ctrl[3];
+                        output_block = ctrl[3];
+                        output_stmin = MODBUS_CAN_STMIN_CYCLES(ctrl[4]);
+                        // the first chunk of the block goes at once, the separation time is kept between the next ones
+                        Modbus_CAN_TxRefill(MODBUS_CAN_TX_LAST_OBJ);
+                        break;
+#endif
+                default: //unknown control frames are ignored
+                        break;
+            }
+}
+
+void Modbus_CAN_ReceptionConfiguration(unsigned char slot)
+{
+        struct Modbus_CAN_Slot *modbus_slot = &modbus_slots[slot];
+        modbus_slot->complete_reception = 0;
+        modbus_slot->input.active = 0;
+        //The receive FIFO is shared by all slots, Modbus_CAN_CallBack finds the slot of each answer
         //No broadcast receive message object is needed
 }
 
 void Modbus_CAN_CallBack(void)
 {
-    // I am expecting for xx0 | slave because the mask of the message object was 1FF;    
-    int i, numObj;
-    uint32_t new_data, mask;
-    numObj = 17;
-    mask = 0x10000;
-    new_data = CANStatusGet(MODBUS_CAN, CAN_STS_NEWDAT);      
-    if(( (new_data & mask) >> (numObj-1) ) == 1)
-    {                                             
-        CANMessageGet(MODBUS_CAN, numObj, &RxObject, true); // I DO CLEAN THE INTERRUPTION                
-        //header should be 000
-        if( (RxObject.ulMsgID & 0x700) == 0x000) //Individual Frame
+    unsigned char obj, slot;
+    uint32_t new_data;
+    //The FIFO is drained in order, from the lowest message object, until no frame is left
+    while((new_data = (CANStatusGet(MODBUS_CAN, CAN_STS_NEWDAT) & MODBUS_CAN_RX_FIFO_BITS(MODBUS_CAN_RX_FIFO_FIRST, MODBUS_CAN_RX_FIFO_LAST))))
+    {
+      for(obj = MODBUS_CAN_RX_FIFO_FIRST; obj <= MODBUS_CAN_RX_FIFO_LAST; obj++)
+      {
+        if(!(new_data & (1UL << (obj - 1))))
+            continue;
+        RxObject.pucMsgData = &modbus_rx_frame[0];
+        CANMessageGet(MODBUS_CAN, obj, &RxObject, true); // I DO CLEAN THE INTERRUPTION                
+        modbus_stats.frames_received++;
+        modbus_stats.bytes_received += RxObject.ulMsgLen;
+        if(RxObject.ulFlags & MSG_OBJ_DATA_LOST)
+            modbus_stats.overruns++;
+#ifdef MODBUS_CAN_BROADCAST_ACK
+        if(Modbus_CAN_BroadcastDone())
+            continue;
+#endif
+#ifdef MODBUS_CAN_PUBLISH
+        if(Modbus_CAN_SnapshotAnswer())
+            continue;
+#endif
+        if(modbus_group.last && Modbus_CAN_GroupAnswer())
+            continue;
+        //the answer goes to the slot of its slave
+        slot = Modbus_CAN_FindSlot(MODBUS_CAN_ID_SLAVE(RxObject.ulMsgID));
+        if((slot == MODBUS_CAN_SLOTS) || !modbus_slots[slot].slave)
+            continue; // the slave is not asked
+#ifdef MODBUS_CAN_EXTENDED_ID
+        if(MODBUS_CAN_ID_TXN(RxObject.ulMsgID) != (modbus_slots[slot].txn & MODBUS_CAN_TXN_MASK))
+            continue; // late answer of a previous request
+#endif
+        Modbus_CAN_Frame(slot);
+      }
+    }
+}
+
+//! \brief Function to process a received frame.
+//!
+//! The frame in _RxObject_ is an answer of the slave of the slot; it is processed as it is explained in Modbus_CAN_CallBack().
+//! \param slot The slot of the slave.
+static void Modbus_CAN_Frame(unsigned char slot)
+{
+    // I am expecting for xx0 | slave
+    unsigned int i;
+    rx_slot = &modbus_slots[slot];
+    input = &rx_slot->input;
+    if(rx_slot->complete_reception || (rx_slot->state != MODBUS_WAITREPLY))
+        return; // the answer was already received or the request is not waiting anymore
+    //header should be 000
+    if( (MODBUS_CAN_ID_TYPE(RxObject.ulMsgID) == MODBUS_CAN_INDIVIDUAL_FRAME) && !MODBUS_CAN_ID_REQUEST(RxObject.ulMsgID)) //Individual Frame
+    {
+          if((RxObject.ulMsgLen > 1) && (RxObject.pucMsgData[0] == MODBUS_CAN_CTRL))
+          {
+                // function code 0 does not exist, so it is a control frame from the slave; only for the output which is being sent
+                if(rx_slot->slave == output_slave)
+                    Modbus_CAN_Control(RxObject.pucMsgData, RxObject.ulMsgLen);
+                return;
+          }
+          // an individual frame ends the long frame in course, its chunk map must not complete it over the buffer swapped with the APP layer
+          if(input->active)
+          {
+                if((input->active == 1) && input->map)
+                    modbus_stats.reassembly_aborts++;
+                input->active = 0;
+                input->map = 0;
+          }
+          input->length = RxObject.ulMsgLen;
+          input->index = input->length;                          
+          for(i=0; i < RxObject.ulMsgLen; i++)
+          {
+                input->pdu[i] = RxObject.pucMsgData[i];
+          }                              
+          rx_slot->complete_reception = 1;
+          Modbus_CAN_RemoveTimeout(slot);
+    }
+    // I CATCH OUT THE BEGINNING, CONTINUATION AND END LONG FRAMES
+    else if(!MODBUS_CAN_ID_REQUEST(RxObject.ulMsgID))
+    {
+        switch(Modbus_CAN_Reassembly(MODBUS_CAN_ID_TYPE(RxObject.ulMsgID), RxObject.pucMsgData, RxObject.ulMsgLen))
         {
-              modbus_complete_reception = 1;
-              Modbus_CAN_RemoveTimeout();
-              input_length = RxObject.ulMsgLen;
-              modbus_index = input_length;                          
-              for(i=0; i < RxObject.ulMsgLen; i++)
-              {
-                    input_pdu[i] = RxObject.pucMsgData[i];
-              }                              
-              boo = 1;
+            case MODBUS_CAN_REASSEMBLY_DONE:
+                    rx_slot->complete_reception = 1;
+                    Modbus_CAN_RemoveTimeout(slot);
+                    break;
+            case MODBUS_CAN_REASSEMBLY_MISSING:
+                    // END LONG FRAME, but some chunks were lost
+                    Modbus_CAN_Nack();
+                    break;
+            default:
+#ifdef MODBUS_CAN_FLOW_CONTROL
+                    // a chunk of a long answer in course, the slave may wait for the next block
+                    if(RxObject.ulMsgLen && (input->active == 1))
+                        Modbus_CAN_FlowControl(RxObject.pucMsgData[0] & MODBUS_CAN_CHUNK_MASK);
+#endif
+                    break;
         }
-        //header should be 010
-        else if( (RxObject.ulMsgID & 0x700) == 0x200) // Beginning Long Frame
-        {              
-              for(i=0; i < RxObject.ulMsgLen; i++)
-              {
-                    input_pdu[i] = RxObject.pucMsgData[i];
-              }              
-              modbus_index = RxObject.ulMsgLen;                 
-              boo = 1;
-        }        
-        // I CATCH OUT THE CONTINUATION LONG FRAMES and the END ONES                
-        else if( ( (RxObject.ulMsgID & 0x700) == 0x400) || ( (RxObject.ulMsgID & 0x700) == 0x600) )
-        {
-            for(i=0; i < RxObject.ulMsgLen; i++)
-            {
-                input_pdu[modbus_index + i] = RxObject.pucMsgData[i];
-            }            
-            modbus_index += RxObject.ulMsgLen;                    
-            //END LONG FRAME
-            if( (RxObject.ulMsgID & 0x700) == 0x600)
-            {                  
-                  modbus_complete_reception = 1;                     
-                  Modbus_CAN_RemoveTimeout();                  
-                  input_length = modbus_index;                        
-            }
-            boo = 0;
-         }
-         else
-         {
-             // IT WAS EXPECTED A CONTINUATION OR AN END;IT SHOULD NOT ENTER HERE
-             Modbus_SetMainState(MODBUS_ERROR);
-         }                          
-      }         
-      else
-      {     // IT WAS EXPECTED NEW DATA; IT SHOULD NOT ENTER HERE
-            Modbus_SetMainState(MODBUS_ERROR);
-      }                
+     }
+     else
+     {
+         // IT WAS EXPECTED AN ANSWER;IT SHOULD NOT ENTER HERE
+         rx_slot->state = MODBUS_ERROR;
+     }                          
 }
 
 unsigned char Modbus_CAN_Controller(void)
 {
-	 switch(Modbus_GetMainState())
-	 {
-	 	 case MODBUS_IDLE:
-                                 // Is it needed to resend?
-                                 if(Modbus_CAN_GetForwardFlag())
-                                 {
-                                        Modbus_App_Send(); //From APP layer I send again the Output data
-                                 }
-                                 else
-                                 {
-                                   //If forward is not needed and there are messages left in the FIFO, the next one is sent.
-                                   // If there are no messages left in the FIFO, it's returned 0.
-                                   if(Modbus_App_FIFOSend())
-                                     return 0;
-                                 }
-                                 break;
-	 	 case MODBUS_WAITREPLY:
+        unsigned char slot, pending = 0;
+            for(slot = 0; slot < MODBUS_CAN_SLOTS; slot++)
+            {
+                 switch(modbus_slots[slot].state)
+                 {
+                     case MODBUS_WAITREPLY:
                                    //I am waiting an answer, if there is already one, it's processed
-                                   if(modbus_complete_reception)
+                                   if(modbus_slots[slot].complete_reception)
                                    {
-                                          modbus_complete_reception = 0;
-                                          Modbus_SetMainState(MODBUS_PROCESSING);
-                                          Modbus_CAN_to_App();
-                                          Modbus_App_Manage_CallBack();                                         
+                                          modbus_slots[slot].state = MODBUS_PROCESSING;
+                                          Modbus_CAN_to_App(slot);
+                                          Modbus_App_Manage_CallBack(slot);
+                                          if(modbus_slots[slot].state == MODBUS_IDLE)
+                                              modbus_slots[slot].slave = 0; //answer done, the slot is free
                                    }                                                                   
-                                    break;
-                 case MODBUS_TURNAROUND: /* NOTHING, I JUST WAIT FOR BROADCAST TIMEOUT*/
-                                    break;
-	 	 case MODBUS_ERROR:	 		 	
-	 		          // Wrong answer, forward flag activated
-	 		          // If max. attempts is achieved, we forget & pass to IDLE
-                                    Modbus_CAN_Repeat_Request();                                    
-                                    Modbus_SetMainState(MODBUS_IDLE);	 		        
-                                    break;
-	 }
-         return 1;
+                                   break;
+                     case MODBUS_ERROR:
+                                   // Wrong answer or timeout, it is sent again when the mailboxes are free
+                                   // If max. attempts is achieved, we forget & the slot is freed
+                                   // After a bus-off, it is sent again without counting an attempt
+#ifdef MODBUS_CAN_SCHEDULE
+                                   if(!Modbus_CAN_FreeWindow())
+                                       break;
+#endif
+                                   if((Modbus_GetMainState() == MODBUS_IDLE) && !output_busy && (modbus_health.state < MODBUS_CAN_BUS_OFF))
+                                   {
+                                       if(modbus_slots[slot].replay == 1)
+                                       {
+                                           modbus_slots[slot].replay = 2;
+                                           modbus_health.replays++;
+                                           Modbus_App_Resend(slot);
+                                       }
+                                       else
+                                           Modbus_CAN_Repeat_Request(slot);
+                                   }
+                                   break;
+                     default:
+                                   break;
+                 }
+#ifdef MODBUS_CAN_FLOW_CONTROL
+                 //a FLOW control frame which found the control message object busy
+                 if(modbus_slots[slot].input.flow_pending)
+                 {
+                     Modbus_CAN_Lock();
+                     Modbus_CAN_FlowSend(slot);
+                     Modbus_CAN_Unlock();
+                 }
+#endif
+                 if(modbus_slots[slot].slave)
+                     pending = 1;
+            }
+#ifdef MODBUS_CAN_PUBLISH
+            if(Modbus_CAN_SnapshotToApp())
+                pending = 1;
+#endif
+            switch(Modbus_GetMainState())
+            {
+                 case MODBUS_IDLE:
+                                 //If there are messages left in the FIFO, the next one is sent if possible.
+                                 // If there are no messages left in the FIFO nor requests in flight, it's returned 0.
+                                 // While the bus is off, the FIFO waits for the recovery.
+                                 if(modbus_health.state >= MODBUS_CAN_BUS_OFF)
+                                     break;
+                                 if(Modbus_App_FIFOSend() && !pending)
+                                     return 0;
+                                 break;
+                 case MODBUS_TURNAROUND: /* NOTHING, I JUST WAIT FOR BROADCAST TIMEOUT OR THE ACKNOWLEDGEMENTS*/
+                                 break;
+                 case MODBUS_PROCESSING:
+                                 //the group poll finished, by its last answer or by its timeout
+                                 Modbus_CAN_GroupToApp();
+                                 break;
+                 default:
+                                 break;
+            }
+            return 1;
 }
 
 void Modbus_CAN_Delay(void)
@@ -426,46 +1009,70 @@ void Modbus_CAN_Delay(void)
     SysCtlDelay(modbus_delay);
 }
 
-unsigned char Modbus_CAN_GetForwardFlag(void)
+enum Modbus_MainState Modbus_CAN_GetSlotState(unsigned char slot)
 {
-	unsigned char result;
-	result = modbus_forward_flag;
-	modbus_forward_flag = 0;
-	return result;
+    return modbus_slots[slot].state;
 }
 
-void Modbus_CAN_Reset_Attempt(void)
+void Modbus_CAN_SetSlotState(unsigned char slot, enum Modbus_MainState state)
 {
-	modbus_attempts = 1;
+    modbus_slots[slot].state = state;
+}
+
+void Modbus_CAN_Reset_Attempt(unsigned char slot)
+{
+	modbus_slots[slot].attempts = 1;
 }
 
 
-void Modbus_CAN_Repeat_Request(void)
+void Modbus_CAN_Repeat_Request(unsigned char slot)
 {
-  if(modbus_attempts < modbus_max_attempts)
+  if(modbus_slots[slot].attempts < modbus_max_attempts)
   {
-      //I resend, so I activate the flag
-      modbus_attempts++;
-      modbus_forward_flag = 1;
+      //I resend in the same slot
+      modbus_slots[slot].attempts++;
+      Modbus_CAN_Lock();
+      modbus_stats.retries[MODBUS_CAN_STATS_SLAVE(modbus_slots[slot].slave)]++;
+      Modbus_CAN_Unlock();
+      Modbus_App_Resend(slot);
   }
   else
   {     
       // I cannot resend, so I forget
-      Modbus_App_No_Response();
-      modbus_attempts = 1;
+      Modbus_App_No_Response(slot);
+      modbus_slots[slot].attempts = 1;
+      modbus_slots[slot].state = MODBUS_IDLE;
+      modbus_slots[slot].slave = 0;
   }
 }
 
 void Modbus_CAN_Timeouts(void)
 {
+  unsigned char i, answers;
   switch(Modbus_GetMainState())
   {
-    case MODBUS_WAITREPLY:          
-          Modbus_SetMainState(MODBUS_ERROR);
-          break;
     case MODBUS_TURNAROUND:
           Modbus_SetMainState(MODBUS_IDLE);
           break;
+    case MODBUS_WAITREPLY:
+          //group poll, the slaves which did not answer are given up
+          answers = 0;
+          for(i = 0; i <= (modbus_group.last - modbus_group.first); i++)
+          {
+                if(!modbus_group.length[i])
+                      modbus_stats.timeouts[MODBUS_CAN_STATS_SLAVE(modbus_group.first + i)]++;
+                else
+                      answers++;
+          }
+          //the response time is learned from the ones which answered, so a slave which is off does not keep the guess
+          if(answers)
+                Modbus_CAN_GroupRtt(answers);
+          Modbus_SetMainState(MODBUS_PROCESSING);
+          break;
+    case MODBUS_IDLE:
+    case MODBUS_PROCESSING:
+          //the acknowledgements or the answers of a group poll finished it while the interruption was pending
+          break;
     default:
           Modbus_CAN_Error_Management(110);
   }
@@ -473,37 +1080,140 @@ void Modbus_CAN_Timeouts(void)
 
 void Modbus_CAN_UnicastTimeoutHandler(void)
 {            
-    if(!modbus_complete_reception)
-    {        
-        Modbus_CAN_Timeouts();
-        modbus_timeout = 1; //DEBUGGGGGGGGGGGGGGGGGGGGGGGGG
-    }    
+    unsigned char slot;
     TimerIntClear(TIMER1_BASE, TIMER_TIMA_TIMEOUT);
+    modbus_ticks++;
+    if(modbus_restart_ticks && !--modbus_restart_ticks)
+    {
+        //restart delay after a bus-off, or the CAN controller did not recover in time
+        Modbus_CAN_Restart();
+    }
+    for(slot = 0; slot < MODBUS_CAN_SLOTS; slot++)
+    {
+        if(!modbus_slots[slot].ticks)
+            continue;
+        if(!--modbus_slots[slot].ticks && !modbus_slots[slot].complete_reception && (modbus_slots[slot].state == MODBUS_WAITREPLY))
+        {        
+            modbus_slots[slot].state = MODBUS_ERROR;
+            modbus_stats.timeouts[MODBUS_CAN_STATS_SLAVE(modbus_slots[slot].slave)]++;
+        }    
+    }
 }
 
-void Modbus_CAN_UnicastTimeout(uint16_t amount_guess)
+void Modbus_CAN_UnicastTimeout(unsigned char slot, uint16_t amount_guess)
 {
-   switch(modbus_bit_rate)
+   struct Modbus_CAN_Rtt *rtt;
+   unsigned char backoff;
+   rtt = Modbus_CAN_FindRtt(modbus_slots[slot].slave, modbus_slots[slot].function);
+   if(rtt->samples && (rtt->slave == modbus_slots[slot].slave) && (rtt->function == modbus_slots[slot].function))
+   {
+         // learned response time: smoothed mean + 4 times the smoothed deviation
+         modbus_unicast_timeout = rtt->srtt + (4 * rtt->rttvar);
+   }
+   else
+   {
+         // nothing learned yet for this slave and function, a guess from the amount of data
+         modbus_unicast_timeout = Modbus_CAN_Guess(amount_guess);
+   }
+   // CONGESTION AVOIDANCE: the timeout is doubled in each new attempt
+   for(backoff = 1; (backoff < modbus_slots[slot].attempts) && (modbus_unicast_timeout < modbus_rto_max); backoff++)
    {
-         case MODBUS_100KBPS:    
-                          /*
-                             (amount_guess * 9333333) = TRANSFER TIME
-                             (900000 * amount_guess * 4) = PROCESS TIME
-                             ((modbus_attempts-1) * 8000) = CONGESTION AVOIDANCE
-                          */  
-                          modbus_unicast_timeout = (amount_guess * 9333333) + (900000 * amount_guess * 4) + ((modbus_attempts-1) * 8000);                                                    
-                          break;
-                          
-         case MODBUS_1MBPS: /*
-                             (amount_guess * 933333) = TRANSFER TIME
-                             (900000 * amount_guess * 4) = PROCESS TIME
-                             ((modbus_attempts-1) * 8000) = CONGESTION AVOIDANCE
-                            */                         
-                          modbus_unicast_timeout = (amount_guess * 933333) + (900000 * amount_guess * 4) + ((modbus_attempts-1) * 8000);
-                          break;     
+         //clamped before doubling, so it cannot wrap around
+         if(modbus_unicast_timeout > (modbus_rto_max / 2))
+               modbus_unicast_timeout = modbus_rto_max;
+         else
+               modbus_unicast_timeout <<= 1;
    }
-   TimerLoadSet(TIMER1_BASE, TIMER_A, modbus_unicast_timeout);      
-   TimerEnable(TIMER1_BASE, TIMER_A);
+   if(modbus_unicast_timeout < modbus_rto_min)
+         modbus_unicast_timeout = modbus_rto_min;
+   if(modbus_unicast_timeout > modbus_rto_max)
+         modbus_unicast_timeout = modbus_rto_max;
+   //the timer is shared by all slots, the timeout is counted in ticks
+   modbus_slots[slot].ticks = (modbus_unicast_timeout / MODBUS_CAN_TIMER_TICK) + 1;
+}
+
+//! \brief Function to guess a timeout from the amount of data, when no response time was learned.
+//!
+//! \param amount_guess A guess of the amount data that will pass through the bus.
+//! \return The timeout, in cycles, up to the maximum unicast timeout.
+static unsigned long Modbus_CAN_Guess(uint16_t amount_guess)
+{
+   //transfer time + process time of a byte at the bit rate chosen
+   unsigned long per_byte = modbus_delay;
+   if(amount_guess > (modbus_rto_max / per_byte))
+         return modbus_rto_max;
+   return amount_guess * per_byte;
+}
+
+void Modbus_CAN_RttSample(unsigned char slave, unsigned char function, unsigned long sample)
+{
+   struct Modbus_CAN_Rtt *rtt;
+   unsigned long error;
+   rtt = Modbus_CAN_FindRtt(slave, function);
+   if(!rtt->samples || (rtt->slave != slave) || (rtt->function != function))
+   {
+         // first sample, or the entry was used by other slave and function
+         rtt->slave = slave;
+         rtt->function = function;
+         rtt->srtt = sample;
+         rtt->rttvar = sample / 2;
+         rtt->samples = 1;
+         return;
+   }
+   error = (sample > rtt->srtt) ? (sample - rtt->srtt) : (rtt->srtt - sample);
+   // rttvar = 3/4 rttvar + 1/4 |srtt - sample|, srtt = 7/8 srtt + 1/8 sample
+   rtt->rttvar = rtt->rttvar - (rtt->rttvar / 4) + (error / 4);
+   rtt->srtt = rtt->srtt - (rtt->srtt / 8) + (sample / 8);
+   if(rtt->samples < 255)
+         rtt->samples++;
+}
+
+unsigned char Modbus_CAN_GetRtt(unsigned char slave, unsigned char function, struct Modbus_CAN_Rtt *rtt)
+{
+   struct Modbus_CAN_Rtt *entry;
+   entry = Modbus_CAN_FindRtt(slave, function);
+   if(!entry->samples || (entry->slave != slave) || (entry->function != function))
+         return 0;
+   *rtt = *entry;
+   return 1;
+}
+
+void Modbus_CAN_SetTimeoutLimits(unsigned long floor, unsigned long ceiling)
+{
+   modbus_rto_min = floor;
+   modbus_rto_max = (ceiling > floor) ? ceiling : floor;
+}
+
+//! \brief Function to find the entry of the table of response times of a slave and a function code.
+//!
+//! The entry is chosen by a hash of both; it may be used by other slave and function, so it has to be checked.
+//! \param slave The number of the slave.
+//! \param function The function code.
+//! \return The entry of the table.
+static struct Modbus_CAN_Rtt *Modbus_CAN_FindRtt(unsigned char slave, unsigned char function)
+{
+   return &modbus_rtt[((slave * 7) + function) % MODBUS_CAN_RTT_ENTRIES];
+}
+
+//! \brief Function to get the time since the initialisation, in cycles.
+//!
+//! It is made with the ticks of the timer of the unicast timeouts and the value of such a timer.
+//! \return The time in cycles; it wraps around, so only differences are meaningful.
+static unsigned long Modbus_CAN_Now(void)
+{
+   unsigned long ticks, value;
+   do
+   {
+         ticks = modbus_ticks;
+         value = TimerValueGet(TIMER1_BASE, TIMER_A);
+         // the tick interruption may be pending if this is called from other interruption
+         if(TimerIntStatus(TIMER1_BASE, false) & TIMER_TIMA_TIMEOUT)
+         {
+               ticks++;
+               value = TimerValueGet(TIMER1_BASE, TIMER_A);
+         }
+   } while(ticks < modbus_ticks);
+   return (ticks * MODBUS_CAN_TIMER_TICK) + (MODBUS_CAN_TIMER_TICK - value);
 }
 
 void Modbus_CAN_BroadcastTimeoutHandler(void)
@@ -512,106 +1222,639 @@ void Modbus_CAN_BroadcastTimeoutHandler(void)
         TimerIntClear(TIMER2_BASE, TIMER_TIMA_TIMEOUT);
 }
 
-void Modbus_CAN_BroadcastTimeout(uint16_t amount_guess)
+#ifdef MODBUS_CAN_BROADCAST_ACK
+void Modbus_CAN_SetBroadcastSlaves(const unsigned char *slaves, unsigned char count)
 {
-   switch(modbus_bit_rate)
+   unsigned char i;
+   for(i = 0; i < sizeof(modbus_broadcast_slaves); i++)
+         modbus_broadcast_slaves[i] = 0;
+   modbus_broadcast_count = 0;
+   for(i = 0; i < count; i++)
    {
-         case MODBUS_100KBPS:                          
-                          modbus_broadcast_timeout = ((amount_guess * 9333333) + (900000 * amount_guess * 4)) * 2;
-                          break;
-         case MODBUS_1MBPS:                          
-                          modbus_broadcast_timeout = ((amount_guess * 933333) + (900000 * amount_guess * 4)) * 2;
-                          break;    
+         if(!slaves[i] || (slaves[i] > 247) || (modbus_broadcast_slaves[slaves[i] >> 3] & (1 << (slaves[i] & 7))))
+               continue; //not valid or repeated
+         modbus_broadcast_slaves[slaves[i] >> 3] |= 1 << (slaves[i] & 7);
+         modbus_broadcast_count++;
    }
-   TimerLoadSet(TIMER2_BASE, TIMER_A, modbus_broadcast_timeout);      
-   TimerEnable(TIMER2_BASE, TIMER_A);      
 }
 
-void Modbus_CAN_RemoveTimeout(void)
+//! \brief Function to take the DONE control frame of a slave after a broadcast request.
+//!
+//! The frame in _RxObject_ is checked; if it is the DONE of a slave which was expected, it is marked and, if it was the last one, the 
+//! broadcast timeout is stopped and the turnaround finishes.
+//! \return 1 if it was a DONE control frame, 0 if it has to be processed as an answer.
+static unsigned char Modbus_CAN_BroadcastDone(void)
 {
-   //Disable Unicast Timer
-   modbus_timeout = 0;//DEBUGGGGGGGGGGGGGGGGGGGGGGGGGGGGG
-   TimerDisable(TIMER1_BASE, TIMER_A); 
+   unsigned char slave;
+   if((MODBUS_CAN_ID_TYPE(RxObject.ulMsgID) != MODBUS_CAN_INDIVIDUAL_FRAME) || (RxObject.ulMsgLen < MODBUS_CAN_DONE_LENGTH) ||
+      (RxObject.pucMsgData[0] != MODBUS_CAN_CTRL) || (RxObject.pucMsgData[1] != MODBUS_CAN_CTRL_DONE))
+         return 0;
+   slave = MODBUS_CAN_ID_SLAVE(RxObject.ulMsgID);
+   //only for the broadcast in course; with 11-bits message IDs only its function code tells it
+   if((Modbus_GetMainState() != MODBUS_TURNAROUND) || output_slave || (RxObject.pucMsgData[2] != output_pdu[0]))
+         return 1;
+#ifdef MODBUS_CAN_EXTENDED_ID
+   if(MODBUS_CAN_ID_TXN(RxObject.ulMsgID) != (output_seq & MODBUS_CAN_TXN_MASK))
+         return 1;
+#endif
+   if(!(modbus_broadcast_pending[slave >> 3] & (1 << (slave & 7))))
+         return 1; //not expected or repeated
+   modbus_broadcast_pending[slave >> 3] &= ~(1 << (slave & 7));
+   if(!--modbus_broadcast_left)
+   {
+         TimerDisable(TIMER2_BASE, TIMER_A);
+         TimerIntClear(TIMER2_BASE, TIMER_TIMA_TIMEOUT);
+         Modbus_SetMainState(MODBUS_IDLE);
+   }
+   return 1;
 }
+#endif
 
-void Modbus_CAN_to_App(void)
-{        
-	//This is used to store the message length and the data
-	int index;                
-        Modbus_App_L_Msg_Set(input_length);        
-        for(index = 0; index < input_length; index++)
-        {
-                Modbus_App_Receive_Char(input_pdu[index], index);
-        }         
+void Modbus_CAN_GroupTimeout(uint16_t amount_guess)
+{
+   struct Modbus_CAN_Rtt *rtt;
+   unsigned long timeout;
+   unsigned char slaves = modbus_group.last - modbus_group.first + 1;
+   rtt = Modbus_CAN_FindRtt(modbus_group.first, MODBUS_CAN_GROUP);
+   if(rtt->samples && (rtt->slave == modbus_group.first) && (rtt->function == MODBUS_CAN_GROUP))
+   {
+         // learned response time of each slave, as an unicast request
+         timeout = rtt->srtt + (4 * rtt->rttvar);
+         timeout = (timeout > (modbus_rto_max / slaves)) ? modbus_rto_max : (timeout * slaves);
+   }
+   else
+         timeout = Modbus_CAN_Guess(amount_guess);
+   if(timeout < modbus_rto_min)
+         timeout = modbus_rto_min;
+   TimerLoadSet(TIMER2_BASE, TIMER_A, timeout);
+   TimerEnable(TIMER2_BASE, TIMER_A);
 }
 
-void Modbus_CAN_Error_Management(unsigned char error)
+//! \brief Function to take the answer of a slave to the group poll in course.
+//!
+//! The frame in _RxObject_ is kept if it is the first individual answer of a slave of the group (with its transaction ID, with 
+//! extended message IDs); when the last one arrives, the group timeout is stopped, the response time is learned and the answers
+//! are processed from Modbus_CAN_Controller().
+//! \return 1 if it was a frame of a slave of the group, 0 if it has to be processed as an answer of a slot.
+static unsigned char Modbus_CAN_GroupAnswer(void)
 {
-        switch(error)
-        {             
-              case 110: while(1){} 
-                        break;
-              default: while(1){} 
-                     break;
-        }
+   unsigned char slave, i;
+   unsigned long sample;
+   slave = MODBUS_CAN_ID_SLAVE(RxObject.ulMsgID);
+   if((slave < modbus_group.first) || (slave > modbus_group.last))
+         return 0;
+   //the slots are free during the group poll, so the rest of frames of these slaves are late ones
+   if((Modbus_GetMainState() != MODBUS_WAITREPLY) || (MODBUS_CAN_ID_TYPE(RxObject.ulMsgID) != MODBUS_CAN_INDIVIDUAL_FRAME) ||
+      MODBUS_CAN_ID_REQUEST(RxObject.ulMsgID) || !RxObject.ulMsgLen || (RxObject.pucMsgData[0] == MODBUS_CAN_CTRL))
+         return 1;
+#ifdef MODBUS_CAN_EXTENDED_ID
+   if(MODBUS_CAN_ID_TXN(RxObject.ulMsgID) != (output_seq & MODBUS_CAN_TXN_MASK))
+         return 1;
+#endif
+   slave -= modbus_group.first;
+   if(modbus_group.length[slave])
+         return 1; //repeated
+   for(i = 0; i < RxObject.ulMsgLen; i++)
+         modbus_group.answer[slave][i] = RxObject.pucMsgData[i];
+   modbus_group.length[slave] = RxObject.ulMsgLen;
+   sample = Modbus_CAN_Now() - modbus_group.sent;
+   modbus_group.latest = sample;
+   modbus_stats.answers++;
+   modbus_stats.latency[Modbus_CAN_StatsBucket(sample)]++;
+   if(!--modbus_group.left)
+   {
+         TimerDisable(TIMER2_BASE, TIMER_A);
+         TimerIntClear(TIMER2_BASE, TIMER_TIMA_TIMEOUT);
+         Modbus_CAN_GroupRtt(modbus_group.last - modbus_group.first + 1);
+         Modbus_SetMainState(MODBUS_PROCESSING);
+   }
+   return 1;
 }
 
-static inline void ledOn(void)
+//! \brief Function to learn the response time of the group poll in course.
+//!
+//! The sample is the time of the latest answer divided by the answers received, the time per slave which answered, both when
+//! all of them answered and at the group timeout; Modbus_CAN_GroupTimeout() multiplies it by the slaves of the group.
+//! \param answers The number of slaves which answered, at least 1.
+static void Modbus_CAN_GroupRtt(unsigned char answers)
 {
-        GPIOPinWrite(GPIO_PORTF_BASE, GPIO_PIN_0 , GPIO_PIN_0);
+   Modbus_CAN_RttSample(modbus_group.first, MODBUS_CAN_GROUP, modbus_group.latest / answers);
 }
 
-static inline void ledOff(void)
+//! \brief Function to hand over the answers of the group poll to the APP layer.
+//!
+//! Each answer is copied into the buffer of the group, which is swapped with the one of the APP layer, in the order of the slave
+//! numbers; the slaves which did not answer are notified as such. Then, the master is ready for the next request.
+//! \sa Modbus_App_Group_CallBack, Modbus_App_Group_No_Response
+static void Modbus_CAN_GroupToApp(void)
 {
-        GPIOPinWrite(GPIO_PORTF_BASE, GPIO_PIN_0 , ~GPIO_PIN_0);
+   unsigned char slave, i;
+   for(slave = 0; slave <= (modbus_group.last - modbus_group.first); slave++)
+   {
+         if(!modbus_group.length[slave])
+         {
+               Modbus_App_Group_No_Response(modbus_group.first + slave);
+               continue;
+         }
+         for(i = 0; i < modbus_group.length[slave]; i++)
+               modbus_group.pdu[i] = modbus_group.answer[slave][i];
+         modbus_group.pdu = Modbus_App_Msg_Swap(modbus_group.pdu, 0, modbus_group.length[slave]);
+         Modbus_App_Group_CallBack(modbus_group.first + slave);
+   }
+   //the late answers are ignored from now on
+   modbus_group.last = 0;
+   Modbus_SetMainState(MODBUS_IDLE);
 }
 
-//////DEBUGGG
-unsigned char Debug_Transmission(void)
+#ifdef MODBUS_CAN_PUBLISH
+unsigned char Modbus_CAN_Snapshot(unsigned char slave, unsigned char block, unsigned char length)
 {
-  return modbus_complete_transmission;
+   tCANMsgObject RemoteObject;
+   unsigned char entry, found = MODBUS_CAN_SNAPSHOTS;
+   if(modbus_health.state >= MODBUS_CAN_BUS_OFF)
+         return MODBUS_CAN_SNAPSHOTS;
+   for(entry = 0; entry < MODBUS_CAN_SNAPSHOTS; entry++)
+   {
+         if((modbus_snapshots[entry].slave == slave) && (modbus_snapshots[entry].block == block))
+         {
+               found = entry; //the same block is being asked, it is asked again
+               break;
+         }
+         if(!modbus_snapshots[entry].slave && (found == MODBUS_CAN_SNAPSHOTS))
+               found = entry;
+   }
+   if(found == MODBUS_CAN_SNAPSHOTS)
+         return MODBUS_CAN_SNAPSHOTS;
+   // the answer arrives through the receive FIFO; the entry is taken before, as it may arrive at once
+   modbus_snapshots[found].length = 0;
+   modbus_snapshots[found].block = block;
+   modbus_snapshots[found].sent = Modbus_CAN_Now();
+   modbus_snapshots[found].slave = slave;
+   RemoteObject.ulMsgID = MODBUS_CAN_PUBLISH_ID(block, slave);
+   RemoteObject.ulMsgIDMask = 0;
+   RemoteObject.ulFlags = MSG_OBJ_EXTENDED_ID;
+   RemoteObject.ulMsgLen = length;
+   RemoteObject.pucMsgData = 0;
+   // the message objects are loaded from the interruptions too
+   Modbus_CAN_Lock();
+   CANMessageSet(MODBUS_CAN, MODBUS_CAN_SNAPSHOT_FIRST + found, &RemoteObject, MSG_OBJ_TYPE_TX_REMOTE);
+   modbus_stats.frames_sent++;
+   Modbus_CAN_Unlock();
+   return found;
 }
 
-unsigned char Debug_Reception(void)
+//! \brief Function to take a published block sent by a slave.
+//!
+//! The frame in _RxObject_ updates the cache, and it is kept in its snapshot entry if it is the first answer to it; the blocks
+//! pushed by the slaves in change of state mode, and the answers to the entries which are not asked anymore, only go to the cache.
+//! \return 1 if it was a published block, 0 if it has to be processed as an answer of a slot.
+static unsigned char Modbus_CAN_SnapshotAnswer(void)
 {
-  return modbus_complete_reception;
+   unsigned char entry, i;
+   unsigned long sample;
+   if((MODBUS_CAN_ID_FUNCTION(RxObject.ulMsgID) != MODBUS_CAN_PUBLISHED) || MODBUS_CAN_ID_REQUEST(RxObject.ulMsgID) ||
+      (MODBUS_CAN_ID_TYPE(RxObject.ulMsgID) != MODBUS_CAN_INDIVIDUAL_FRAME))
+         return 0;
+   if(RxObject.ulMsgLen)
+         Modbus_CAN_CacheStore();
+   for(entry = 0; entry < MODBUS_CAN_SNAPSHOTS; entry++)
+   {
+         if((modbus_snapshots[entry].slave != MODBUS_CAN_ID_SLAVE(RxObject.ulMsgID)) || modbus_snapshots[entry].length ||
+            (modbus_snapshots[entry].block != MODBUS_CAN_ID_TXN(RxObject.ulMsgID)) || !RxObject.ulMsgLen)
+               continue;
+         for(i = 0; (i < RxObject.ulMsgLen) && (i < 8); i++)
+               modbus_snapshots[entry].data[i] = RxObject.pucMsgData[i];
+         sample = Modbus_CAN_Now() - modbus_snapshots[entry].sent;
+         modbus_stats.answers++;
+         modbus_stats.latency[Modbus_CAN_StatsBucket(sample)]++;
+         modbus_snapshots[entry].length = i;
+         break;
+   }
+   return 1;
 }
 
-unsigned char * getInput()
+//! \brief Function to keep a published block in the cache.
+//!
+//! The frame in _RxObject_ replaces the entry of its slave and block; if it has none, it takes a free entry or, if there is not
+//! any, the one updated longest ago.
+static void Modbus_CAN_CacheStore(void)
 {
-    return input_pdu;
+   unsigned char entry, found = MODBUS_CAN_CACHE, i;
+   unsigned char slave = MODBUS_CAN_ID_SLAVE(RxObject.ulMsgID), block = MODBUS_CAN_ID_TXN(RxObject.ulMsgID);
+   unsigned long now = Modbus_CAN_Now(), age, oldest = 0;
+   for(entry = 0; entry < MODBUS_CAN_CACHE; entry++)
+   {
+         if((modbus_cache[entry].slave == slave) && (modbus_cache[entry].block == block))
+         {
+               found = entry;
+               break;
+         }
+         age = modbus_cache[entry].slave ? (now - modbus_cache[entry].updated) : 0xFFFFFFFF; //a free entry goes first
+         if((found == MODBUS_CAN_CACHE) || (age > oldest))
+         {
+               found = entry;
+               oldest = age;
+         }
+   }
+   for(i = 0; (i < RxObject.ulMsgLen) && (i < 8); i++)
+         modbus_cache[found].data[i] = RxObject.pucMsgData[i];
+   modbus_cache[found].length = i;
+   modbus_cache[found].updated = now;
+   modbus_cache[found].block = block;
+   modbus_cache[found].slave = slave;
 }
 
-/*unsigned char * getOutput()
+unsigned char Modbus_CAN_GetCache(unsigned char slave, unsigned char block, unsigned char *data, unsigned long *age)
 {
-    return output_pdu;
-}*/
+   unsigned char entry, i, length = 0;
+   Modbus_CAN_Lock();
+   for(entry = 0; entry < MODBUS_CAN_CACHE; entry++)
+   {
+         if((modbus_cache[entry].slave != slave) || (modbus_cache[entry].block != block))
+               continue;
+         length = modbus_cache[entry].length;
+         for(i = 0; i < length; i++)
+               data[i] = modbus_cache[entry].data[i];
+         *age = Modbus_CAN_Now() - modbus_cache[entry].updated;
+         break;
+   }
+   Modbus_CAN_Unlock();
+   return length;
+}
 
-unsigned char Debug_Timeout(void)
+//! \brief Function to hand over the answers of the published blocks to the APP layer.
+//!
+//! The entries with an answer, or pending longer than the maximum unicast timeout, are handed over to
+//! Modbus_App_Snapshot_CallBack() and freed.
+//! \return 1 if some entry is still waiting for its answer.
+static unsigned char Modbus_CAN_SnapshotToApp(void)
 {
-    return modbus_timeout;
+   unsigned char entry, pending = 0;
+   for(entry = 0; entry < MODBUS_CAN_SNAPSHOTS; entry++)
+   {
+         if(!modbus_snapshots[entry].slave)
+               continue;
+         if(modbus_snapshots[entry].length)
+               Modbus_App_Snapshot_CallBack(entry, modbus_snapshots[entry].data, modbus_snapshots[entry].length);
+         else if((Modbus_CAN_Now() - modbus_snapshots[entry].sent) > modbus_rto_max)
+               Modbus_App_Snapshot_CallBack(entry, modbus_snapshots[entry].data, 0);
+         else
+         {
+               pending = 1;
+               continue;
+         }
+         modbus_snapshots[entry].slave = 0;
+   }
+   return pending;
+}
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+void Modbus_CAN_Schedule(unsigned long cycle, unsigned long free)
+{
+   Modbus_CAN_Lock();
+   TimerDisable(MODBUS_CAN_CYCLE_TIMER, TIMER_A);
+   TimerIntClear(MODBUS_CAN_CYCLE_TIMER, TIMER_TIMA_TIMEOUT);
+   modbus_free = free;
+   modbus_cycle = cycle;
+   if(cycle)
+   {
+         TimerLoadSet(MODBUS_CAN_CYCLE_TIMER, TIMER_A, cycle);
+         TimerEnable(MODBUS_CAN_CYCLE_TIMER, TIMER_A);
+         //the first cycle starts at once
+         Modbus_CAN_Reference();
+   }
+   Modbus_CAN_Unlock();
 }
 
-unsigned char getbu(void)
+void Modbus_CAN_CycleHandler(void)
 {
-    return buu;
+   TimerIntClear(MODBUS_CAN_CYCLE_TIMER, TIMER_TIMA_TIMEOUT);
+   Modbus_CAN_Reference();
 }
 
-void setbu(void)
+//! \brief Function to start a cycle of the schedule, broadcasting its reference frame.
+//!
+//! It is called from the cycle timer interruption, or from the main loop with the interruptions of the CAN layer disabled.
+static void Modbus_CAN_Reference(void)
 {
-      buu = 0;
+   tCANMsgObject ReferenceObject;
+   unsigned char reference[MODBUS_CAN_REFERENCE_LENGTH];
+   modbus_cycle_start = Modbus_CAN_Now();
+   if(modbus_health.state >= MODBUS_CAN_BUS_OFF)
+         return;
+   modbus_cycle_count++;
+   reference[0] = MODBUS_CAN_CTRL;
+   reference[1] = MODBUS_CAN_CTRL_REFERENCE;
+   reference[2] = modbus_cycle_count;
+   ReferenceObject.ulMsgID = MODBUS_CAN_REFERENCE_ID(modbus_cycle_count);
+   ReferenceObject.ulMsgIDMask = 0x000;
+   ReferenceObject.ulFlags = MSG_OBJ_NO_FLAGS | MODBUS_CAN_ID_FLAGS | MODBUS_CAN_FD_FLAGS;
+   ReferenceObject.ulMsgLen = MODBUS_CAN_REFERENCE_LENGTH;
+   ReferenceObject.pucMsgData = reference;
+   //a reference which did not win the bus in a whole cycle is replaced by the new one
+   CANMessageSet(MODBUS_CAN, MODBUS_CAN_REFERENCE_OBJ, &ReferenceObject, MSG_OBJ_TYPE_TX);
+   modbus_stats.frames_sent++;
+   modbus_stats.bytes_sent += MODBUS_CAN_REFERENCE_LENGTH;
 }
 
-unsigned char getIndex(void)
+//! \brief Function to know if the current time is in the free window of the cycle of the schedule.
+//!
+//! \return 1 if the schedule does not run or it is in the free window, 0 if it is in the windows of the slaves.
+static unsigned char Modbus_CAN_FreeWindow(void)
 {
-    return modbus_index;
+   if(!modbus_cycle)
+         return 1;
+   return (Modbus_CAN_Now() - modbus_cycle_start) >= modbus_free;
 }
-unsigned char getAttempts(void)
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+void Modbus_CAN_SetFlowControl(unsigned char block_size, unsigned char stmin)
 {
-    return modbus_attempts;
+   modbus_flow_bs = block_size;
+   modbus_flow_stmin = stmin;
 }
-uint16_t getboo(void)
+
+void Modbus_CAN_FlowControl(unsigned char chunk)
 {
-    return boo;
+   //the first chunk is answered at once, and then each block of chunks
+   if(chunk && (!modbus_flow_bs || (++input->flow < modbus_flow_bs)))
+         return;
+   input->flow = 0;
+   input->flow_pending = 1;
+   Modbus_CAN_FlowSend(rx_slot - modbus_slots);
+}
+
+//! \brief Function to send the FLOW control frame waiting in a slot.
+//!
+//! The answers of several slaves can be reassembled at the same time, so the control message object can still have the FLOW
+//! frame of other slot; then it is left pending for the next call. It is called from the CAN interruption, or from the main
+//! loop with the interruptions of the CAN layer disabled.
+//! \param slot The slot of the slave.
+static void Modbus_CAN_FlowSend(unsigned char slot)
+{
+   unsigned char ctrl[MODBUS_CAN_FLOW_LENGTH];
+   struct Modbus_CAN_Slot *flow_slot = &modbus_slots[slot];
+   if((flow_slot->state != MODBUS_WAITREPLY) || flow_slot->complete_reception || (flow_slot->input.active != 1))
+   {
+         flow_slot->input.flow_pending = 0; //the answer is not being reassembled anymore
+         return;
+   }
+   if(CANStatusGet(MODBUS_CAN, CAN_STS_TXREQUEST) & (1UL << (MODBUS_CAN_CTRL_OBJ - 1)))
+         return;
+   flow_slot->input.flow_pending = 0;
+   ctrl[0] = MODBUS_CAN_CTRL;
+   ctrl[1] = MODBUS_CAN_CTRL_FLOW;
+   ctrl[2] = flow_slot->input.tag;
+   ctrl[3] = modbus_flow_bs;
+   ctrl[4] = modbus_flow_stmin;
+   //as a NACK, it goes to the slave which is answering
+   Modbus_CAN_SendControl(MODBUS_CAN_ID(MODBUS_CAN_INDIVIDUAL_FRAME, 1, flow_slot->priority, flow_slot->txn, MODBUS_CAN_CTRL, flow_slot->slave),
+                          ctrl, MODBUS_CAN_FLOW_LENGTH);
 }
+
+void Modbus_CAN_FlowHandler(void)
+{
+   TimerIntClear(MODBUS_CAN_FLOW_TIMER, TIMER_TIMA_TIMEOUT);
+   if(output_flow_wait)
+   {
+         //the slave did not allow the next block: the request is dropped, its unicast timeout will send it again
+         output_flow_wait = 0;
+         output_map = 0;
+         output_busy = 0;
+         modbus_stats.flow_timeouts++;
+   }
+   else if(output_map)
+         Modbus_CAN_TxRefill(MODBUS_CAN_TX_FIRST_OBJ);
+}
+#endif
+
+void Modbus_CAN_BroadcastTimeout(uint16_t amount_guess)
+{
+   //(TRANSFER TIME + PROCESS TIME) * 2
+   modbus_broadcast_timeout = (amount_guess * modbus_delay) * 2;
+   TimerLoadSet(TIMER2_BASE, TIMER_A, modbus_broadcast_timeout);      
+   TimerEnable(TIMER2_BASE, TIMER_A);      
+}
+
+void Modbus_CAN_RemoveTimeout(unsigned char slot)
+{
+   unsigned long sample;
+   sample = Modbus_CAN_Now() - modbus_slots[slot].sent;
+   modbus_stats.answers++;
+   modbus_stats.latency[Modbus_CAN_StatsBucket(sample)]++;
+   // the response time is learned, except for the answers of requests sent again (also after a bus-off), as it is not known which one is answered
+   if((modbus_slots[slot].attempts == 1) && !modbus_slots[slot].replay)
+       Modbus_CAN_RttSample(modbus_slots[slot].slave, modbus_slots[slot].function, sample);
+   //Stop the unicast timeout of the slot, the timer keeps running as it is also the time base
+   modbus_slots[slot].ticks = 0;
+}
+
+//! \brief Function to find the bucket of the latency histogram of a time.
+//!
+//! \param cycles The time, in cycles.
+//! \return The bucket: 0 below MODBUS_CAN_STATS_UNIT cycles, and one more each time the time doubles, up to the last one.
+static unsigned char Modbus_CAN_StatsBucket(unsigned long cycles)
+{
+   unsigned char bucket = 0;
+   cycles /= MODBUS_CAN_STATS_UNIT;
+   while(cycles && (bucket < (MODBUS_CAN_STATS_BUCKETS - 1)))
+   {
+         cycles >>= 1;
+         bucket++;
+   }
+   return bucket;
+}
+
+void Modbus_CAN_to_App(unsigned char slot)
+{        
+        struct Modbus_CAN_Input *answer = &modbus_slots[slot].input;
+        //The buffer is handed over to APP, its previous one will receive the next answer of the slot
+        answer->pdu = Modbus_App_Msg_Swap(answer->pdu, 0, answer->length);
+}
+
+void Modbus_CAN_BusStatus(unsigned long status)
+{
+        unsigned char slot;
+        switch(modbus_health.state)
+        {
+              case MODBUS_CAN_BUS_OFF:
+                        //the CAN controller is stopped until the restart
+                        return;
+              case MODBUS_CAN_BUS_RECOVERING:
+                        //the recovery sequence also gives bit errors, it is not finished until the bus-off bit is cleared
+                        if(status & CAN_STATUS_BUS_OFF)
+                            return;
+                        modbus_health.recoveries++;
+                        modbus_health.last_recovery = Modbus_CAN_Now() - modbus_bus_off_since;
+                        if(modbus_health.last_recovery > modbus_health.max_recovery)
+                            modbus_health.max_recovery = modbus_health.last_recovery;
+                        modbus_restart_ticks = 0;
+                        //the slots marked in the bus-off and the FIFO are sent again from Modbus_CAN_Controller
+                        modbus_health.state = MODBUS_CAN_BUS_ACTIVE;
+                        break;
+              default:
+                        break;
+        }
+        if(status & CAN_STATUS_BUS_OFF)
+        {
+              modbus_health.state = MODBUS_CAN_BUS_OFF;
+              modbus_health.bus_off++;
+              modbus_bus_off_since = Modbus_CAN_Now();
+              //the output is flushed, the mailboxes are cleared when the CAN controller is initialised again
+              output_map = 0;
+              output_busy = 0;
+              output_window = 0;
+              output_window_bytes = 0;
+#ifdef MODBUS_CAN_FLOW_CONTROL
+              output_flow_wait = 0;
+              TimerDisable(MODBUS_CAN_FLOW_TIMER, TIMER_A);
+#endif
+              modbus_complete_transmission = 0;
+              for(slot = 0; slot < MODBUS_CAN_SLOTS; slot++)
+              {
+                  if(modbus_slots[slot].slave && (modbus_slots[slot].state == MODBUS_WAITREPLY) && !modbus_slots[slot].complete_reception)
+                  {
+                      //the request is sent again after the recovery, it does not count as an attempt
+                      modbus_slots[slot].ticks = 0;
+                      modbus_slots[slot].input.active = 0;
+                      modbus_slots[slot].input.index = 0;
+                      modbus_slots[slot].replay = 1;
+                      modbus_slots[slot].state = MODBUS_ERROR;
+                  }
+              }
+              modbus_restart_ticks = ((MODBUS_CAN_RESTART_DELAY << modbus_health.backoff) / MODBUS_CAN_TIMER_TICK) + 1;
+              if(modbus_health.backoff < MODBUS_CAN_BACKOFF_MAX)
+                  modbus_health.backoff++;
+              return;
+        }
+        if(((status & CAN_STATUS_LEC_MSK) != CAN_STATUS_LEC_NONE) && ((status & CAN_STATUS_LEC_MSK) != CAN_STATUS_LEC_MSK))
+        {
+              modbus_health.frame_errors++;
+              modbus_stats.lec[status & CAN_STATUS_LEC_MSK]++;
+        }
+        if(status & CAN_STATUS_EPASS)
+        {
+              if(modbus_health.state != MODBUS_CAN_BUS_PASSIVE)
+                  modbus_health.passive++;
+              modbus_health.state = MODBUS_CAN_BUS_PASSIVE;
+        }
+        else if(status & CAN_STATUS_EWARN)
+        {
+              if(modbus_health.state != MODBUS_CAN_BUS_WARNING)
+                  modbus_health.warning++;
+              modbus_health.state = MODBUS_CAN_BUS_WARNING;
+        }
+        else
+              modbus_health.state = MODBUS_CAN_BUS_ACTIVE;
+}
+
+void Modbus_CAN_Restart(void)
+{
+        modbus_health.restarts++;
+        Modbus_CAN_Lock();
+        Modbus_CAN_Setup();
+        //the recovery sequence starts when it is enabled
+        CANEnable(MODBUS_CAN);
+        modbus_health.state = MODBUS_CAN_BUS_RECOVERING;
+        //if it does not recover in time, it is restarted again
+        modbus_restart_ticks = (MODBUS_CAN_RECOVERY_TIMEOUT / MODBUS_CAN_TIMER_TICK) + 1;
+        Modbus_CAN_Unlock();
+}
+
+void Modbus_CAN_GetHealth(struct Modbus_CAN_Health *health)
+{
+        *health = modbus_health;
+}
+
+void Modbus_CAN_GetStats(struct Modbus_CAN_Stats *stats)
+{
+        Modbus_CAN_Lock();
+        *stats = modbus_stats;
+        Modbus_CAN_Unlock();
+}
+
+//! \brief Function to keep the interruptions of the CAN layer out while the main loop loads message objects.
+//!
+//! The CAN interruption and the timer interruptions which load message objects or count the traffic are disabled: the unicast
+//! timer (it restarts the CAN controller after a bus-off), the broadcast timer, the flow control timer and the cycle timer of
+//! the schedule. They have the same priority, so they never interrupt each other.
+static void Modbus_CAN_Lock(void)
+{
+        IntDisable(INT_CAN0);
+        IntDisable(INT_TIMER1A);
+        IntDisable(INT_TIMER2A);
+#ifdef MODBUS_CAN_FLOW_CONTROL
+        IntDisable(INT_TIMER0A);
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+        IntDisable(INT_TIMER3A);
+#endif
+}
+
+//! \brief Function to let the interruptions disabled by Modbus_CAN_Lock() in again.
+static void Modbus_CAN_Unlock(void)
+{
+#ifdef MODBUS_CAN_SCHEDULE
+        IntEnable(INT_TIMER3A);
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+        IntEnable(INT_TIMER0A);
+#endif
+        IntEnable(INT_TIMER2A);
+        IntEnable(INT_TIMER1A);
+        IntEnable(INT_CAN0);
+}
+
+//! \brief Function to set up the CAN module.
+//!
+//! The CAN module is initialised, so all the message objects are cleared, and the bit timing, the interruptions and the receive
+//! FIFO are set up.
+static void Modbus_CAN_Setup(void)
+{
+        unsigned char obj;
+        //Init CAN Module
+        CANInit(MODBUS_CAN);
+        //Set bit timing
+        CANSetBitTiming(MODBUS_CAN, &modbus_canbit);               
+#ifdef MODBUS_CAN_FD
+        //Set bit timing of the data phase
+        CANDataBitTimingSet(MODBUS_CAN, &modbus_canbit_data);
+#endif
+        //ENABLING CAN INTERRUPTIONS        
+        CANIntEnable(MODBUS_CAN, CAN_INT_ERROR |CAN_INT_STATUS | CAN_INT_MASTER);       
+        //RECEIVE FIFO: all the answers (request bit = 0) of all slaves, xx0 + xxxxxxxx
+        RxObject.ulMsgID = MODBUS_CAN_ID(0, 0, 0, 0, 0, 0);
+        RxObject.ulMsgIDMask = MODBUS_CAN_ANSWER_MASK;
+        RxObject.pucMsgData = &modbus_rx_frame[0];
+        for(obj = MODBUS_CAN_RX_FIFO_FIRST; obj <= MODBUS_CAN_RX_FIFO_LAST; obj++)
+        {
+            //all the message objects but the last one are chained, the last one is the end of the buffer
+            RxObject.ulFlags = MSG_OBJ_USE_ID_FILTER | MSG_OBJ_RX_INT_ENABLE | MODBUS_CAN_FILTER_FLAGS;
+            if(obj < MODBUS_CAN_RX_FIFO_LAST)
+                RxObject.ulFlags |= MSG_OBJ_FIFO;
+            CANMessageSet(MODBUS_CAN, obj, &RxObject, MSG_OBJ_TYPE_RX);
+        }
+}
+
+void Modbus_CAN_Error_Management(unsigned char error)
+{
+        switch(error)
+        {             
+              case 110: while(1){} 
+                        break;
+              default: while(1){} 
+                     break;
+        }
+}
+
+static inline void ledOn(void)
+{
+        GPIOPinWrite(GPIO_PORTF_BASE, GPIO_PIN_0 , GPIO_PIN_0);
+}
+
+static inline void ledOff(void)
+{
+        GPIOPinWrite(GPIO_PORTF_BASE, GPIO_PIN_0 , ~GPIO_PIN_0);
+}
+
 #endif
\ No newline at end of file
@@ -30,6 +30,7 @@
 void Modbus_FIFO_Init (struct Modbus_FIFO_s *Modbus_FIFO_Ptr)
 {
   Modbus_FIFO_Ptr->Items = Modbus_FIFO_Ptr->Head = Modbus_FIFO_Ptr->Tail = 0;
+  Modbus_FIFO_Ptr->Urgent = 0;
 }
 
 //! \brief Check whether the Request FIFO is empty or not
@@ -80,6 +81,32 @@ unsigned char Modbus_FIFO_Enqueue (struct Modbus_FIFO_s *Modbus_FIFO_Ptr, struct
   return 0;
 }
 
+//! \brief Add one item/request to the Request FIFO before the ordinary ones
+//!
+//! The request is placed after the ones already added with this function and before the rest, so it is removed before them.
+//! Only the items added with this function are moved, one position back. If the FIFO is full, such an action is not done and it
+//! is returned the value 1.
+//! \param *Modbus_FIFO_Ptr Request FIFO pointer
+//! \param *Item Request FIFO item pointer
+//! \return 0 No errors
+//! \return 1 FIFO is full, item is not added
+//! \sa struct Modbus_FIFO_s, struct Modbus_FIFO_Item, Modbus_FIFO_Enqueue
+unsigned char Modbus_FIFO_Enqueue_First (struct Modbus_FIFO_s *Modbus_FIFO_Ptr, struct Modbus_FIFO_Item *Item)
+{
+  unsigned char i;
+
+  if (Modbus_FIFO_Full(Modbus_FIFO_Ptr))
+    return 1;
+
+  Modbus_FIFO_Ptr->Items++;
+  Modbus_FIFO_Ptr->Tail = (Modbus_FIFO_Ptr->Tail + MAX_ITEMS - 1) % MAX_ITEMS;
+  for (i = 0; i < Modbus_FIFO_Ptr->Urgent; i++)
+    Modbus_FIFO_Ptr->Buffer[(Modbus_FIFO_Ptr->Tail + i) % MAX_ITEMS] = Modbus_FIFO_Ptr->Buffer[(Modbus_FIFO_Ptr->Tail + i + 1) % MAX_ITEMS];
+  Modbus_FIFO_Ptr->Buffer[(Modbus_FIFO_Ptr->Tail + i) % MAX_ITEMS] = *Item;
+  Modbus_FIFO_Ptr->Urgent++;
+  return 0;
+}
+
 //! \brief Remove an item from the Request FIFO
 //!
 //! Remove an item/request from the Request FIFO and the item's information is set into an item struct.
@@ -95,8 +122,76 @@ unsigned char Modbus_FIFO_Dequeue (struct Modbus_FIFO_s *Modbus_FIFO_Ptr, struct
     return 0;  
 	
   Modbus_FIFO_Ptr->Items--;
+  if (Modbus_FIFO_Ptr->Urgent)
+    Modbus_FIFO_Ptr->Urgent--;
+
+  *Item = Modbus_FIFO_Ptr->Buffer[Modbus_FIFO_Ptr->Tail];
+  Modbus_FIFO_Ptr->Tail = (Modbus_FIFO_Ptr->Tail + 1) % MAX_ITEMS;
+  return 1;
+}
+
+//! \brief Read the first item of the Request FIFO without removing it
+//!
+//! The information of the item/request which would be removed next is set into an item struct.
+//! If the FIFO is empty such an action is not done and it is returned 0.
+//! \param *Modbus_FIFO_Ptr Request FIFO pointer
+//! \param *Item Request FIFO item pointer
+//! \return 0 FIFO was empty
+//! \return 1 No errors
+//! \sa struct Modbus_FIFO_s, struct Modbus_FIFO_Item, Modbus_FIFO_Dequeue
+unsigned char Modbus_FIFO_Peek (struct Modbus_FIFO_s *Modbus_FIFO_Ptr, struct Modbus_FIFO_Item *Item)
+{
+  if (Modbus_FIFO_Empty(Modbus_FIFO_Ptr))
+    return 0;
 
   *Item = Modbus_FIFO_Ptr->Buffer[Modbus_FIFO_Ptr->Tail];
+  return 1;
+}
+
+//! \brief Read an item of the Request FIFO without removing it
+//!
+//! The information of the item/request at _Position_ from the first one (0 is the one Modbus_FIFO_Peek reads) is set into an
+//! item struct. If there are not so many items such an action is not done and it is returned 0.
+//! \param *Modbus_FIFO_Ptr Request FIFO pointer
+//! \param Position Position of the item, from the first one
+//! \param *Item Request FIFO item pointer
+//! \return 0 There is no item at that position
+//! \return 1 No errors
+//! \sa struct Modbus_FIFO_s, struct Modbus_FIFO_Item, Modbus_FIFO_Peek, Modbus_FIFO_Dequeue_At
+unsigned char Modbus_FIFO_Peek_At (struct Modbus_FIFO_s *Modbus_FIFO_Ptr, unsigned char Position, struct Modbus_FIFO_Item *Item)
+{
+  if (Position >= Modbus_FIFO_Ptr->Items)
+    return 0;
+
+  *Item = Modbus_FIFO_Ptr->Buffer[(Modbus_FIFO_Ptr->Tail + Position) % MAX_ITEMS];
+  return 1;
+}
+
+//! \brief Remove an item from the middle of the Request FIFO
+//!
+//! Remove the item/request at _Position_ from the first one and the item's information is set into an item struct. The items
+//! before it are moved one position back, so the rest keep their order. If there are not so many items such an action is not
+//! done and it is returned 0.
+//! \param *Modbus_FIFO_Ptr Request FIFO pointer
+//! \param Position Position of the item, from the first one
+//! \param *Item Request FIFO item pointer
+//! \return 0 There is no item at that position, item was not removed
+//! \return 1 No errors
+//! \sa struct Modbus_FIFO_s, struct Modbus_FIFO_Item, Modbus_FIFO_Dequeue, Modbus_FIFO_Peek_At
+unsigned char Modbus_FIFO_Dequeue_At (struct Modbus_FIFO_s *Modbus_FIFO_Ptr, unsigned char Position, struct Modbus_FIFO_Item *Item)
+{
+  unsigned char i;
+
+  if (Position >= Modbus_FIFO_Ptr->Items)
+    return 0;
+
+  Modbus_FIFO_Ptr->Items--;
+  if (Position < Modbus_FIFO_Ptr->Urgent)
+    Modbus_FIFO_Ptr->Urgent--;
+
+  *Item = Modbus_FIFO_Ptr->Buffer[(Modbus_FIFO_Ptr->Tail + Position) % MAX_ITEMS];
+  for (i = Position; i > 0; i--)
+    Modbus_FIFO_Ptr->Buffer[(Modbus_FIFO_Ptr->Tail + i) % MAX_ITEMS] = Modbus_FIFO_Ptr->Buffer[(Modbus_FIFO_Ptr->Tail + i - 1) % MAX_ITEMS];
   Modbus_FIFO_Ptr->Tail = (Modbus_FIFO_Ptr->Tail + 1) % MAX_ITEMS;
   return 1;
 }
@@ -26,6 +26,7 @@ struct Modbus_FIFO_Item
 {
   unsigned char Slave;              //!< The slave which will receive the request
   unsigned char Function;           //!< Modbus public function code
+  unsigned char Priority;           //!< Priority class (enum Modbus_Priority)
   union Modbus_FIFO_Par Data[6];    //!< Request data
 };
 
@@ -42,6 +43,7 @@ struct Modbus_FIFO_s
   unsigned char Items;                        //!< Number of items in the FIFO
   unsigned char Head;                         //!< Head index
   unsigned char  Tail;                        //!< Tail index
+  unsigned char Urgent;                       //!< Number of items from the tail added with Modbus_FIFO_Enqueue_First
   struct Modbus_FIFO_Item Buffer[MAX_ITEMS];  //!< Request petitions list
 };
 
@@ -60,8 +62,16 @@ unsigned char Modbus_FIFO_Empty (struct Modbus_FIFO_s *Modbus_FIFO_Ptr);
 
 unsigned char Modbus_FIFO_Enqueue (struct Modbus_FIFO_s *Modbus_FIFO_Ptr, 
                                    struct Modbus_FIFO_Item *Item);
+unsigned char Modbus_FIFO_Enqueue_First (struct Modbus_FIFO_s *Modbus_FIFO_Ptr, 
+                                         struct Modbus_FIFO_Item *Item);
 unsigned char Modbus_FIFO_Dequeue (struct Modbus_FIFO_s *Modbus_FIFO_Ptr, 
                                    struct Modbus_FIFO_Item *Item);
+unsigned char Modbus_FIFO_Peek (struct Modbus_FIFO_s *Modbus_FIFO_Ptr, 
+                                struct Modbus_FIFO_Item *Item);
+unsigned char Modbus_FIFO_Peek_At (struct Modbus_FIFO_s *Modbus_FIFO_Ptr, unsigned char Position,
+                                   struct Modbus_FIFO_Item *Item);
+unsigned char Modbus_FIFO_Dequeue_At (struct Modbus_FIFO_s *Modbus_FIFO_Ptr, unsigned char Position,
+                                      struct Modbus_FIFO_Item *Item);
 
 void Modbus_FIFO_E_Init (struct Modbus_FIFO_Errors *Modbus_FIFO_Ptr);
 unsigned char Modbus_FIFO_E_Enqueue (struct Modbus_FIFO_Errors *Modbus_FIFO_Ptr, 
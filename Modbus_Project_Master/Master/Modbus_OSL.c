@@ -31,6 +31,7 @@
 #include "inc/hw_types.h"
 #include "driverlib/gpio.h"
 #include "driverlib/interrupt.h"
+#include "driverlib/sysctl.h"
 #include "driverlib/uart.h"
 #include "driverlib/timer.h"
 #include "Modbus_App.h"
@@ -86,6 +87,23 @@ static unsigned char Modbus_OSL_Expected_Slave;
 static unsigned char Modbus_OSL_Req_ADU[256];
 //! Longitud del mensaje de Salida del Master.
 static unsigned char Modbus_OSL_L_Req_ADU;
+#ifdef MODBUS_OSL_RTU_FIFO
+//! \brief 1 si la cola FIFO de la UART está habilitada y se vacía por
+//! ráfagas; sólo por encima de MODBUS_OSL_RTU_FIFO_CHAR_BAUD, por debajo se
+//! recibe carácter a carácter como sin _MODBUS_OSL_RTU_FIFO_.
+static unsigned char Modbus_OSL_FIFO;
+#endif
+#ifdef MODBUS_OSL_TX_INTERRUPT
+//! \brief Cola circular de transmisión, que vacía la interrupción de
+//! transmisión de la UART; sus índices de 8 bits dan la vuelta solos.
+static unsigned char Modbus_OSL_TX_Buffer[256];
+//! Índice de la cola de transmisión donde se escribe el siguiente carácter.
+static unsigned char Modbus_OSL_TX_Head;
+//! Índice de la cola de transmisión del siguiente carácter a enviar.
+static volatile unsigned char Modbus_OSL_TX_Tail;
+//! Nº de caracteres de la cola de transmisión pendientes de enviar.
+static volatile uint16_t Modbus_OSL_TX_Count;
+#endif
 
 // Para los distintos estados de los diagramas de Master y RTU.
 
@@ -110,6 +128,11 @@ unsigned char Modbus_OSL_Resend(void);
 static unsigned char Modbus_OSL_Processing_Msg(void);
 static void Modbus_OSL_RTU_to_App (void);
 static void Modbus_OSL_Send (unsigned char *mb_req_pdu, unsigned char L_pdu);
+static void Modbus_OSL_Sent (unsigned char Chars);
+#ifdef MODBUS_OSL_TX_INTERRUPT
+static void Modbus_OSL_TX_Fill (void);
+static void Modbus_OSL_Transmit (void);
+#endif
 
 //*****************************************************************************
 //! \defgroup OSL_Var Gestión de Variables 
@@ -413,9 +436,24 @@ void Modbus_OSL_Init (enum Baud Baudrate, enum Modbus_OSL_Modes Mode,unsigned ch
         break;
     }
     
+#ifdef MODBUS_OSL_RTU_FIFO
+    // Mantiene la cola FIFO de la UART y la vacía por ráfagas: la
+    // interrupción salta al llegar a 12 caracteres o por Timeout de recepción.
+    // Hasta MODBUS_OSL_RTU_FIFO_CHAR_BAUD el Timeout de recepción dura más
+    // que 1,5T, así que se desactiva para recibir carácter a carácter.
+    Modbus_OSL_FIFO=(Modbus_OSL_Baudrate>MODBUS_OSL_RTU_FIFO_CHAR_BAUD);
+    if(Modbus_OSL_FIFO)
+    {
+      UARTFIFOLevelSet(UART1_BASE, UART_FIFO_TX1_8, UART_FIFO_RX6_8);
+      UARTFIFOEnable(UART1_BASE);
+    }
+    else
+      UARTFIFODisable(UART1_BASE);
+#else
     // Desactiva la cola FIFO de la UART para que las interrupciones salten por
     // cada carácter recibido.
     UARTFIFODisable(UART1_BASE);
+#endif
     
     // Habilita el puerto GPIO usado para el LED1.
     SYSCTL_RCGC2_R = SYSCTL_RCGC2_GPIOF;
@@ -431,8 +469,28 @@ void Modbus_OSL_Init (enum Baud Baudrate, enum Modbus_OSL_Modes Mode,unsigned ch
     Modbus_OSL_Set_Timeout_B (Modbus_OSL_Baudrate);
     Modbus_OSL_Set_Timeout_R (Modbus_OSL_Baudrate);
     
+#ifdef MODBUS_OSL_RTU_FIFO
+    // Habilita la interrupción de la UART, con la cola FIFO para Recepción y
+    // Timeout de recepción, ya que los errores de paridad se leen con cada
+    // carácter; sin ella para Recepción y error de paridad.
+    UARTIntDisable(UART1_BASE, UART_INT_RT | UART_INT_PE);
+    if(Modbus_OSL_FIFO)
+      UARTIntEnable(UART1_BASE, UART_INT_RX | UART_INT_RT);
+    else
+      UARTIntEnable(UART1_BASE, UART_INT_RX | UART_INT_PE);
+#else
     // Habilita la interrupción de la UART, para Recepción y error de paridad.
     UARTIntEnable(UART1_BASE, UART_INT_RX | UART_INT_PE);
+#endif
+#ifdef MODBUS_OSL_TX_INTERRUPT
+    // Y para Transmisión, que salta al vaciarse la cola FIFO de la UART hasta
+    // su nivel; se borra la que pueda haber quedado pendiente.
+    Modbus_OSL_TX_Head=0;
+    Modbus_OSL_TX_Tail=0;
+    Modbus_OSL_TX_Count=0;
+    UARTIntClear(UART1_BASE, UART_INT_TX);
+    UARTIntEnable(UART1_BASE, UART_INT_TX);
+#endif
     IntEnable(INT_UART1);
     
     // Activa la Interrupción por desborde del Timer 2.
@@ -461,11 +519,43 @@ void Modbus_OSL_Init (enum Baud Baudrate, enum Modbus_OSL_Modes Mode,unsigned ch
 //! __NOTA__:También se aceptan caracteres en estado ERROR por si salta la
 //! interrupción de Respuesta mientras se está recibiendo un mensaje para acabar
 //! de recibirlo. Como el estado es ERROR el mensaje será descartado igualmente.
+//!
+//! Con _MODBUS_OSL_RTU_FIFO_, por encima de MODBUS_OSL_RTU_FIFO_CHAR_BAUD, la
+//! interrupción salta por ráfagas de caracteres y los lee
+//! _Modbus_OSL_RTU_UART_FIFO_, sin encender el LED1; fuera de WAITREPLY y
+//! ERROR se descarta la cola entera.
 //! \sa Modbus_OSL_Frame_Set, Modbus_OSL_Mode, Modbus_OSL_RTU_UART
+//! \sa Modbus_OSL_RTU_UART_FIFO
 void UART1IntHandler(void)
 {
     unsigned long ulStatus;
     
+#ifdef MODBUS_OSL_TX_INTERRUPT
+    // La interrupción de Transmisión se atiende aparte; si no hay otra causa
+    // no se ha recibido nada.
+    ulStatus = UARTIntStatus(UART1_BASE, true);
+    if(ulStatus & UART_INT_TX)
+    {
+      UARTIntClear(UART1_BASE, UART_INT_TX);
+      Modbus_OSL_Transmit();
+      if(ulStatus==UART_INT_TX)
+        return;
+    }
+#endif
+#ifdef MODBUS_OSL_RTU_FIFO
+    if(Modbus_OSL_FIFO)
+    {
+      ulStatus = UARTIntStatus(UART1_BASE, true);
+      UARTIntClear(UART1_BASE, ulStatus);
+      if(Modbus_OSL_MainState_Get()==MODBUS_OSL_WAITREPLY 
+         || Modbus_OSL_MainState_Get()==MODBUS_OSL_ERROR)
+        Modbus_OSL_RTU_UART_FIFO((ulStatus & UART_INT_RT) != 0);
+      else
+        while(UARTCharsAvail(UART1_BASE))
+          UARTCharGetNonBlocking(UART1_BASE);
+      return;
+    }
+#endif
     // Enciende el Led1.
     GPIO_PORTF_DATA_R |= 0x01;        
     
@@ -618,7 +708,7 @@ void Modbus_OSL_Repeat_Request (void)
 //! \brief Resetea la cuenta de Intentos de envío de un Mensaje.
 //! 
 //! \sa Modbus_OSL_Attempt, Modbus_App_Manage_CallBack
-void Modbus_OSL__Attempt (void)
+void Modbus_OSL_Reset_Attempt (void)
 {
   Modbus_OSL_Attempt=1;
 }
@@ -709,22 +799,23 @@ static unsigned char Modbus_OSL_Processing_Msg(void)
 //! \brief Envía un Mensaje entrante Correcto a Modbus App.
 //! 
 //! Cuando se ha comprobado completamente la corrección de un mensaje entrante
-//! se envía al módulo Modbus App para procesar la información contenida. Se
-//! utilizan las funciones _Modbus_App_Receive_Char_ y _Modbus_OSL_RTU_Char_Get_ 
-//! para evitar la necesidad de guardar una copia del mensaje en el propio 
-//! Módulo OSL. Del mismo modo se envía también la longitud del mensaje enviado
-//! a App (no la longitud original del mensaje, sin CRC ni Nº de Slave).
-//! \sa Modbus_App_Receive_Char, Modbus_OSL_RTU_Char_Get
-//! \sa Modbus_App_L_Msg_Set, Modbus_OSL_RTU_L_Msg_Get 
+//! se envía al módulo Modbus App para procesar la información contenida. El
+//! mensaje no se copia: mediante _Modbus_App_Msg_Swap_ se intercambia el 
+//! vector de la trama completa de RTU por el vector que tenía App, que RTU
+//! utilizará para recibir. Del mismo modo se envía también la longitud del 
+//! mensaje enviado a App (no la longitud original del mensaje, sin CRC ni Nº
+//! de Slave).
+//! \sa Modbus_App_Msg_Swap, Modbus_OSL_RTU_Msg_Get, Modbus_OSL_RTU_Msg_Set
+//! \sa Modbus_OSL_RTU_L_Msg_Get 
 static void Modbus_OSL_RTU_to_App (void)
 {
-  unsigned char i;
-  
   // El primer carácter no se envía por ser el Nº Slave, ademas, por éste motivo
   // se disminuye la longitud del mensaje en 1. El CRC ya ha sido considerado. 
-  for(i=1;i<Modbus_OSL_RTU_L_Msg_Get();i++)
-      Modbus_App_Receive_Char (Modbus_OSL_RTU_Char_Get(i),i-1);
-  Modbus_App_L_Msg_Set(Modbus_OSL_RTU_L_Msg_Get()-1);
+  // No debe completarse otra trama mientras se intercambian los vectores.
+  IntMasterDisable();
+  Modbus_OSL_RTU_Msg_Set(Modbus_App_Msg_Swap(Modbus_OSL_RTU_Msg_Get(), 1,
+                                             Modbus_OSL_RTU_L_Msg_Get()-1));
+  IntMasterEnable();
 }
 
 //! \brief Leer Mensaje Entrante Completo.
@@ -818,11 +909,17 @@ unsigned char Modbus_OSL_Receive_CallBack(void)
 //! envia el mensaje mediante _Modbus_OSL_Send_. Se configura y se activa el 
 //! Timer 2 en función de si es una petición a un Slave (Unicast) o una petición
 //! BroadCast para activar el Timeout pertinente.
+//!
+//! Con _MODBUS_OSL_TX_INTERRUPT_ la función vuelve en cuanto el mensaje está
+//! en la cola de transmisión; el estado principal pasa ya a WAITREPLY o DELAY
+//! para no enviar otra petición, y 3,5T y el Timeout se arrancan al salir el
+//! último carácter (_Modbus_OSL_Transmit_).
 //! \param *mb_req_pdu Puntero al vector con el Mensaje de Salida de App (PDU)
 //! \param Slave Nº de Slave de la petición.
 //! \param L_pdu Longitud del Mensaje de Salida de App
 //! \sa Modbus_App_Send, Modbus_OSL_RTU_Mount_ADU, Modbus_OSL_L_Req_ADU
 //! \sa Modbus_OSL_Send, Modbus_OSL_BroadCast_Timeout, Modbus_OSL_Response_Timeout 
+//! \sa Modbus_OSL_Sent, Modbus_OSL_Transmit
 void Modbus_OSL_Output (unsigned char *mb_req_pdu, unsigned char Slave, unsigned char L_pdu)
 { 
   switch (Modbus_OSL_Mode) 
@@ -842,13 +939,29 @@ void Modbus_OSL_Output (unsigned char *mb_req_pdu, unsigned char Slave, unsigned
   // Guardar el Nº de Slave al que se realiza la petición para sólo comprobar
   // las respuestas que vengan de dicho Slave y enviar.
   Modbus_OSL_Expected_Slave=Slave;
+#ifdef MODBUS_OSL_TX_INTERRUPT
+  Modbus_OSL_MainState=Slave ? MODBUS_OSL_WAITREPLY : MODBUS_OSL_DELAY;
   Modbus_OSL_Send(Modbus_OSL_Req_ADU, Modbus_OSL_L_Req_ADU);
-  
+#else
+  Modbus_OSL_Send(Modbus_OSL_Req_ADU, Modbus_OSL_L_Req_ADU);
+  Modbus_OSL_Sent(0);
+#endif
+}
+
+//! \brief Arranca los tiempos que cuentan desde el final del Mensaje.
+//!
+//! En RTU activa el Timer 0 para volver a IDLE cuando desborde 3,5T después
+//! del bit de stop del último carácter, que acabará tras _Chars_ caracteres,
+//! y activa el Timer 2 con el Timeout de BroadCast o de Respuesta.
+//! \param Chars Caracteres que aún están saliendo por la UART.
+//! \sa Modbus_OSL_RTU_Emission_End, Modbus_OSL_BroadCast_Timeout
+//! \sa Modbus_OSL_Response_Timeout
+static void Modbus_OSL_Sent (unsigned char Chars)
+{
   if (Modbus_OSL_Mode==MODBUS_OSL_MODE_RTU)
   {
     // En RTU se activa el Timer 0 para volver a IDLE cuando desborde.
-    TimerLoadSet(TIMER0_BASE, TIMER_A, Modbus_OSL_RTU_Get_Timeout_35());
-    TimerEnable(TIMER0_BASE, TIMER_A); 
+    Modbus_OSL_RTU_Emission_End(Chars);
   }
  
   // Si la petición es de BroadCast
@@ -869,25 +982,93 @@ void Modbus_OSL_Output (unsigned char *mb_req_pdu, unsigned char Slave, unsigned
 //! Enciende el LED1 de comunicaciones y envía secuencialmente el número de 
 //! caracteres indicado del vector señalado en los parámetros. Al terminar 
 //! apaga el LED de comunicaciones.
+//!
+//! Con _MODBUS_OSL_TX_INTERRUPT_ copia el mensaje en la cola de transmisión,
+//! llena la cola FIFO de la UART y vuelve; el resto lo envía la interrupción
+//! de Transmisión, que apaga el LED1 al final.
 //! \param *mb_req_adu Puntero al vector con el Mensaje de Salida completo(ADU)
 //! \param L_adu Longitud del Mensaje de Salida Completo.
-//! \sa Modbus_OSL_Output
+//! \sa Modbus_OSL_Output, Modbus_OSL_TX_Fill, Modbus_OSL_Transmit
 static void Modbus_OSL_Send (unsigned char *mb_req_adu, unsigned char L_adu)
 {
-  char i;
+  unsigned char i;
 
   // Enciende el LED1.
   GPIO_PORTF_DATA_R |= 0x01;
   
+#ifdef MODBUS_OSL_TX_INTERRUPT
+  for (i=0;i<L_adu;i++)
+  {
+    Modbus_OSL_TX_Buffer[Modbus_OSL_TX_Head++]=mb_req_adu[i];
+  }
+  // La interrupción de Transmisión no debe llenar la cola FIFO a la vez.
+  IntDisable(INT_UART1);
+  Modbus_OSL_TX_Count+=L_adu;
+  Modbus_OSL_TX_Fill();
+  IntEnable(INT_UART1);
+#else
   for (i=0;i<L_adu;i++)
   { 
     UARTCharPut(UART1_BASE,mb_req_adu[i]);
     //Debug_OSL_OutChar++;
   } 
   //Debug_OSL_OutMsg++;
+#ifdef MODBUS_OSL_RTU_FIFO
+  // Con la cola FIFO los últimos caracteres aún están saliendo; se espera a
+  // que acabe el último para contar 3,5T desde su final.
+  while(UARTBusy(UART1_BASE))
+  {
+  }
+#endif
   
   // Apaga el LED1.
   GPIO_PORTF_DATA_R &= ~(0x01);
+#endif
+}
+
+#ifdef MODBUS_OSL_TX_INTERRUPT
+//! \brief Pasa caracteres de la cola de transmisión a la cola FIFO de la UART.
+//!
+//! Escribe caracteres mientras queden en la cola de transmisión y haya sitio
+//! en la cola FIFO de la UART.
+//! \sa Modbus_OSL_TX_Buffer, Modbus_OSL_TX_Count
+static void Modbus_OSL_TX_Fill (void)
+{
+  while(Modbus_OSL_TX_Count && UARTSpaceAvail(UART1_BASE))
+  {
+    UARTCharPutNonBlocking(UART1_BASE, Modbus_OSL_TX_Buffer[Modbus_OSL_TX_Tail++]);
+    Modbus_OSL_TX_Count--;
+  }
+}
+
+//! \brief Función para la interrupción de Transmisión de la UART.
+//!
+//! La interrupción salta cuando la cola FIFO de la UART baja hasta su nivel
+//! (o se vacía el registro de transmisión, sin cola FIFO), justo cuando un
+//! carácter pasa al registro de desplazamiento. Si quedan caracteres en la
+//! cola de transmisión se vuelve a llenar la cola FIFO, que saltará de nuevo
+//! al bajar. Si no, esta es la última: salen aún los caracteres del nivel y
+//! el que se está desplazando, y con ellos se arrancan 3,5T y el Timeout
+//! desde el bit de stop del último carácter. Se apaga el LED1.
+//! \sa Modbus_OSL_TX_Fill, Modbus_OSL_Sent, MODBUS_OSL_TX_LEVEL
+static void Modbus_OSL_Transmit (void)
+{
+  if(Modbus_OSL_TX_Count)
+  {
+    Modbus_OSL_TX_Fill();
+  }
+  else if(Modbus_OSL_State_Get()==MODBUS_OSL_RTU_EMISSION)
+  {
+    // Sólo al final de un mensaje propio: en EMISSION hasta que desborde 3,5T.
+#ifdef MODBUS_OSL_RTU_FIFO
+    Modbus_OSL_Sent(Modbus_OSL_FIFO ? MODBUS_OSL_TX_LEVEL+1 : 1);
+#else
+    Modbus_OSL_Sent(MODBUS_OSL_TX_LEVEL+1);
+#endif
+    // Apaga el LED1.
+    GPIO_PORTF_DATA_R &= ~(0x01);
+  }
 }
+#endif
 //! @}
 #endif
\ No newline at end of file
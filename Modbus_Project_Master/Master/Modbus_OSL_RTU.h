@@ -8,15 +8,36 @@
 void Modbus_OSL_RTU_Mount_ADU (unsigned char *mb_pdu,unsigned char Slave,
                                unsigned char L_pdu, unsigned char *mb_adu);
 unsigned char Modbus_OSL_RTU_Control_CRC(void);
+void Modbus_OSL_RTU_CRC_Init (void);
+uint16_t Modbus_OSL_RTU_CRC (uint16_t CRC, const unsigned char *Msg, uint16_t L);
+#ifdef MODBUS_OSL_RTU_CRC_BENCH
+unsigned long Modbus_OSL_RTU_CRC_Cycles (void);
+#endif
 
 void Modbus_OSL_RTU_Init (void); 
 void Modbus_OSL_RTU_15T (void);
 void Modbus_OSL_RTU_35T (void);
+void Modbus_OSL_RTU_Emission_End (unsigned char Chars);
 void Modbus_OSL_RTU_UART(void);
+#ifdef MODBUS_OSL_RTU_FIFO
+//! \brief Caracteres leídos en cada interrupción por nivel de la cola FIFO de
+//! recepción (UART_FIFO_RX6_8, 12 caracteres): uno menos, para que quede
+//! siempre uno y salte la interrupción por Timeout de recepción al final de
+//! la trama.
+#define MODBUS_OSL_RTU_FIFO_BURST 11
+//! \brief Baudrate máximo con el que se recibe carácter a carácter, sin la
+//! cola FIFO: hasta él el Timeout de recepción de la UART (32 bits) dura más
+//! que 1,5T, y un silencio de más de 1,5T dentro de una ráfaga no lo haría
+//! saltar. Por encima 1,5T es fijo, 750 us, y dura más que 32 bits.
+#define MODBUS_OSL_RTU_FIFO_CHAR_BAUD 38400
+void Modbus_OSL_RTU_UART_FIFO(unsigned char Timeout);
+#endif
 
 uint32_t Modbus_OSL_RTU_Get_Timeout_35 (void);
 unsigned char Modbus_OSL_RTU_Char_Get(unsigned char i);
 unsigned char Modbus_OSL_RTU_L_Msg_Get(void);
+unsigned char *Modbus_OSL_RTU_Msg_Get(void);
+void Modbus_OSL_RTU_Msg_Set(unsigned char *Msg);
 
 #endif // __Modbus_OSL_H__
 #endif
\ No newline at end of file
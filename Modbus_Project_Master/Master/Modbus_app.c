@@ -69,14 +69,34 @@ static struct Modbus_FIFO_Item Modbus_App_Request;
 static struct Modbus_FIFO_Item Modbus_App_Actual_Req;
 //! It stores temporary a request to add it later into the Error FIFO
 static struct Modbus_FIFO_E_Item Modbus_App_Error_Msg;
-//! Array to store the incoming PDU
-static unsigned char Modbus_App_Msg[MAX_PDU];
+//! Buffer of App for the incoming messages; it is swapped with the ones of the CAN/OSL layers
+static unsigned char Modbus_App_Msg_Buffer[MODBUS_APP_MSG_SIZE];
+//! Buffer which holds the incoming message; it is given back in the next swap
+static unsigned char *Modbus_App_Msg_Base = Modbus_App_Msg_Buffer;
+//! Incoming PDU, inside _Modbus_App_Msg_Base_
+static unsigned char *Modbus_App_Msg = Modbus_App_Msg_Buffer;
 //! Incoming message length
 static unsigned char Modbus_App_L_Msg;
 //! Array to store the outcoming PDU
 static unsigned char Modbus_App_Req_pdu[MAX_PDU];
 //! Outcoming message length
 static unsigned char Modbus_App_L_Req_pdu;
+//! Priority class of the next requests
+static enum Modbus_Priority Modbus_App_Priority;
+#if CAN_Mode
+//! Priority of the CAN message IDs of each class of request (enum Modbus_Priority).
+static const unsigned char Modbus_App_CAN_Priority[] = { MODBUS_CAN_PRIORITY_DEFAULT, MODBUS_CAN_PRIORITY_URGENT, 
+                                                          MODBUS_CAN_PRIORITY_BACKGROUND };
+//! \brief Requests in flight, one per slot of the CAN layer; in this way, each answer is
+//! checked against its own request.
+static struct Modbus_FIFO_Item Modbus_App_Slot_Req[MODBUS_CAN_SLOTS];
+//! Group poll in course; each answer is checked against it.
+static struct Modbus_FIFO_Item Modbus_App_Group_Req;
+#ifdef MODBUS_CAN_PUBLISH
+//! Reads of published blocks in course, one per snapshot entry of the CAN layer.
+static struct Modbus_FIFO_Item Modbus_App_Snapshot_Req[MODBUS_CAN_SNAPSHOTS];
+#endif
+#endif
 //! Modbus communication mode. Only Serial & CAN communication.
 enum Modbus_Comm_Modes Modbus_Comm_Mode;// = MODBUS_CANN; //WATCH OUT WITH THISS!!!!!!!!!!!!!!!!!
 
@@ -103,6 +123,11 @@ static void Modbus_App_Write_M_Coils(void);
 static void Modbus_App_Write_M_Registers(void);
 static void Modbus_App_Mask_Write_Register(void);
 static void Modbus_App_Read_Write_M_Registers(void);
+#if CAN_Mode
+static void Modbus_App_Group_Request(void);
+#endif
+static unsigned char Modbus_App_First(void);
+static unsigned char Modbus_App_Enqueue(void);
 
 /**
 *   @defgroup App_Control Application Control for the Communication Mode: OSL/CAN
@@ -123,13 +148,14 @@ static void Modbus_App_Read_Write_M_Registers(void);
 //! \param Com_Mode Modo de Comunicación de Modbus.
 //! \param Baudrate  Baudrate de las comunicaciones
 //! \param Attempts  Numero Máximo de Intentos de Envío antes de descartar
-//! \param OSL_Mode  Mode RTU/ASCII de la comunicación Serie.
+//! \param Mode  Mode RTU/ASCII de la comunicación Serie.
 //! \sa Modbus_FIFO_Init, Modbus_FIFO_E_Init, Modbus_OSL_Init, Modbus_CAN_Init
 void Modbus_Master_Init(enum Modbus_Comm_Modes Com_Mode, enum Baud Baudrate, 
-                        unsigned char Attempts, enum Modbus_OSL_Modes OSL_Mode)
+                        unsigned char Attempts, enum Modbus_OSL_Modes Mode)
 { 
   Modbus_FIFO_Init(&Modbus_FIFO_Tx);
   Modbus_FIFO_E_Init(&Modbus_FIFO_Error);
+  Modbus_App_Priority = MODBUS_PRIORITY_NORMAL;
   
   if (Com_Mode == CDEFAULT) 
     Modbus_Comm_Mode=MODBUS_SERIAL;
@@ -137,7 +163,7 @@ void Modbus_Master_Init(enum Modbus_Comm_Modes Com_Mode, enum Baud Baudrate,
   switch(Modbus_Comm_Mode)  
   {
     case (MODBUS_SERIAL):
-      Modbus_OSL_Init(Baudrate,OSL_Mode, Attempts);  
+      Modbus_OSL_Init(Baudrate,Mode, Attempts);  
       break;
       /* Other communications do not use this Init function*/
     default:  
@@ -278,14 +304,15 @@ void Modbus_App_Manage_CallBack (void)
 //! \sa Modbus_FIFO_Enqueue, Modbus_App_Send
 unsigned char Modbus_App_Enqueue_Or_Send(void)
 {
-  if(Modbus_OSL_MainState_Get()==MODBUS_OSL_IDLE && Modbus_FIFO_Empty(&Modbus_FIFO_Tx))
+  Modbus_App_Request.Priority=Modbus_App_Priority;
+  if(Modbus_OSL_MainState_Get()==MODBUS_OSL_IDLE && Modbus_App_First())
   {
     Modbus_App_Actual_Req=Modbus_App_Request;
     Modbus_App_Send();
   }
   else
   {
-    if(Modbus_FIFO_Enqueue(&Modbus_FIFO_Tx,&Modbus_App_Request))
+    if(Modbus_App_Enqueue())
       return 1;
   }
   return 0;
@@ -357,6 +384,7 @@ unsigned char Modbus_Master_Init(enum Modbus_CAN_BitRate bit_rate, unsigned char
               Modbus_Comm_Mode = MODBUS_CAN_MODE;  
               Modbus_FIFO_Init(&Modbus_FIFO_Tx);
               Modbus_FIFO_E_Init(&Modbus_FIFO_Error);
+              Modbus_App_Priority = MODBUS_PRIORITY_NORMAL;
               Modbus_CAN_Init(bit_rate, attempts);  
               return 1;
           }
@@ -393,16 +421,19 @@ unsigned char Modbus_Master_Communication (void)///
 *   @ingroup App_Control
 * 
 *   It is checked the data correctness depending on the function number of a response
-*   from the expected Slave. If the request was a read, the data is stored in the destination vector.
+*   from the expected Slave; each slot of the CAN layer has its own request, so the answers of different slaves are managed
+*   independently. If the request was a read, the data is stored in the destination vector.
 *   If the function is discarded because of a data error, the status is changed to ERROR to activate the
 *   forward flag. If the answer is an exception, the request and its answer are enqueued in the Error FIFO, after that,
 *   the status is switched to IDLE to continue with the rest of petitions.
+*   @param slot The slot of the request which was answered.
 *   @sa Modbus_App_Read_Single_Bits_CallBack, Modbus_App_Read_Registers_CallBack
 *   @sa Modbus_App_Write_CallBack, Modbus_App_Mask_Write_CallBack
 *   @sa Modbus_CAN_Reset_Attempt, Modbus_FIFO_E_Enqueue, Modbus_OSL_Reset_Attempt
 */
-void Modbus_App_Manage_CallBack (void)///
+void Modbus_App_Manage_CallBack (unsigned char slot)///
 {
+  Modbus_App_Actual_Req = Modbus_App_Slot_Req[slot];
   //If the response is normal and the function is the waited one, then it is managed.
   if( Modbus_App_Msg[0] == Modbus_App_Actual_Req.Function)
   {
@@ -425,23 +456,23 @@ void Modbus_App_Manage_CallBack (void)///
      {
         case 1:
           if(Modbus_App_Read_Single_Bits_CallBack())
-        	  Modbus_SetMainState(MODBUS_ERROR);
+        	  Modbus_CAN_SetSlotState(slot, MODBUS_ERROR);
           break;
         case 2:
           if(Modbus_App_Read_Registers_CallBack())
-        	  Modbus_SetMainState(MODBUS_ERROR);
+        	  Modbus_CAN_SetSlotState(slot, MODBUS_ERROR);
           break;
         case 3:
           if(Modbus_App_Write_CallBack())
-        	  Modbus_SetMainState(MODBUS_ERROR);
+        	  Modbus_CAN_SetSlotState(slot, MODBUS_ERROR);
           break;
         case 22:
           if(Modbus_App_Mask_Write_CallBack())
-        	  Modbus_SetMainState(MODBUS_ERROR);
+        	  Modbus_CAN_SetSlotState(slot, MODBUS_ERROR);
           break;
         case 23:
           if(Modbus_App_Read_Write_M_Registers_CallBack())
-        	  Modbus_SetMainState(MODBUS_ERROR);
+        	  Modbus_CAN_SetSlotState(slot, MODBUS_ERROR);
           break;
         default:
           Modbus_CAN_Error_Management(10);
@@ -452,11 +483,11 @@ void Modbus_App_Manage_CallBack (void)///
       * If the data was correct the next request is handle
       */
 
-     if(Modbus_GetMainState() != MODBUS_ERROR)
+     if(Modbus_CAN_GetSlotState(slot) != MODBUS_ERROR)
      {
        /* Correct answer, next request */
-       Modbus_CAN_Reset_Attempt();
-       Modbus_SetMainState(MODBUS_IDLE);       
+       Modbus_CAN_Reset_Attempt(slot);
+       Modbus_CAN_SetSlotState(slot, MODBUS_IDLE);       
      }
   }
   // Exception or unexpected function
@@ -464,7 +495,7 @@ void Modbus_App_Manage_CallBack (void)///
   {
     //Status is changed to ERROR to manage the error.
 	//If at the end of the next statements the error continues being ERROR a resend will be done
-	  Modbus_SetMainState(MODBUS_ERROR);
+	  Modbus_CAN_SetSlotState(slot, MODBUS_ERROR);
     //If the answer is the expected exception
     if(Modbus_App_Msg[0] == Modbus_App_Actual_Req.Function | 128)
     {
@@ -479,8 +510,8 @@ void Modbus_App_Manage_CallBack (void)///
         Modbus_FIFO_E_Enqueue(&Modbus_FIFO_Error,&Modbus_App_Error_Msg);
 
         /*Number of deliveries reseted; next request can be handle*/
-        Modbus_CAN_Reset_Attempt();
-        Modbus_SetMainState(MODBUS_IDLE);
+        Modbus_CAN_Reset_Attempt(slot);
+        Modbus_CAN_SetSlotState(slot, MODBUS_IDLE);
       }
     }
   }
@@ -490,22 +521,24 @@ void Modbus_App_Manage_CallBack (void)///
 *   @brief Enqueue or Send a request.
 *   @ingroup App_Exchange
 *
-*   This function is called from user Modbus functions. This one sends a request directly if the
-*   Request FIFO is empty and the communications are not occupied, otherwise, the petition is enqueued to send it later.
+*   This function is called from user Modbus functions. This one sends a request directly if no request of the
+*   Request FIFO has to go before it (see Modbus_Set_Priority()) and the CAN layer is ready to send it, otherwise, the petition 
+*   is enqueued to send it later.
 *   return 1 The Request FIFO is full and the petition cannot be enqueued.
 *   return 0 Everything ok
-*   @sa Modbus_FIFO_Enqueue, Modbus_App_Send
+*   @sa Modbus_FIFO_Enqueue, Modbus_FIFO_Enqueue_First, Modbus_App_Send
 */
 unsigned char Modbus_App_Enqueue_Or_Send(void)///
 {
-  if(Modbus_GetMainState() == MODBUS_IDLE && Modbus_FIFO_Empty(&Modbus_FIFO_Tx))
+  Modbus_App_Request.Priority = Modbus_App_Priority;
+  if(Modbus_App_First() && Modbus_CAN_Ready(Modbus_App_Request.Slave))
   {
     Modbus_App_Actual_Req = Modbus_App_Request;
     Modbus_App_Send();
   }
   else
   {
-    if(Modbus_FIFO_Enqueue(&Modbus_FIFO_Tx,&Modbus_App_Request))
+    if(Modbus_App_Enqueue())
       return 1;
   }
   return 0;
@@ -517,18 +550,21 @@ unsigned char Modbus_App_Enqueue_Or_Send(void)///
 *
 *   The request stored in _Modbus_App_Actual_Req_ is sent; This function builds
 *   the message depending on the type of Modbus function. To send it is used
-*   _Modbus_CAN_Fix_Output_.
+*   _Modbus_CAN_Fix_Output_, and the request is kept in the slot used by it.
 *   @sa struct Modbus_FIFO_Item, Modbus_CAN_Fix_Output, Modbus_OSL_Output, Modbus_App_Standard_Request
 *   @sa Modbus_App_Write_M_Coils, Modbus_App_Write_M_Registers
 *   @sa Modbus_App_Mask_Write_Register, Modbus_App_Read_Write_M_Registers
 */
 void Modbus_App_Send(void)///
 {
-  unsigned char Request;
+  unsigned char Request, slot;
   //a guess of the number of bytes that will be receive as answer, just for the CAN timeout
   uint16_t data_amount_to_wait;
   
-  if(Modbus_App_Actual_Req.Function==1 || Modbus_App_Actual_Req.Function==2 ||
+  //a read to the slave 0 is a group poll, Modbus_Read_Group_Registers
+  if(Modbus_App_Actual_Req.Slave==0 && (Modbus_App_Actual_Req.Function==3 || Modbus_App_Actual_Req.Function==4))
+    Request=MODBUS_CAN_GROUP;
+  else if(Modbus_App_Actual_Req.Function==1 || Modbus_App_Actual_Req.Function==2 ||
      Modbus_App_Actual_Req.Function==3 || Modbus_App_Actual_Req.Function==4 ||
      Modbus_App_Actual_Req.Function==5 || Modbus_App_Actual_Req.Function==6)
     Request=1 ;
@@ -537,6 +573,12 @@ void Modbus_App_Send(void)///
 
   switch(Request)
   {
+      case MODBUS_CAN_GROUP:
+        Modbus_App_Group_Request();
+        //the answers of all the slaves of the group
+        data_amount_to_wait = (Modbus_App_Actual_Req.Data[4].UC - Modbus_App_Actual_Req.Data[3].UC + 1) *
+                              ((Modbus_App_Actual_Req.Data[1].UI2 * 2) + 2) + MODBUS_CAN_GROUP_LENGTH;
+        break;
       case 1:
         Modbus_App_Standard_Request();
         //If I ask for 112 coils, I will receive 14 "extra" bytes
@@ -568,9 +610,126 @@ void Modbus_App_Send(void)///
         Modbus_CAN_Error_Management(20);
         break;
   }
-  Modbus_CAN_FixOutput(Modbus_App_Req_pdu,Modbus_App_Actual_Req.Slave,Modbus_App_L_Req_pdu, data_amount_to_wait);
+  slot = Modbus_CAN_FixOutput(Modbus_App_Req_pdu,Modbus_App_Actual_Req.Slave,Modbus_App_L_Req_pdu, data_amount_to_wait,
+                              Modbus_App_CAN_Priority[Modbus_App_Actual_Req.Priority]);
+  if(slot < MODBUS_CAN_SLOTS)
+    Modbus_App_Slot_Req[slot] = Modbus_App_Actual_Req;
+  else if(Request == MODBUS_CAN_GROUP)
+    Modbus_App_Group_Req = Modbus_App_Actual_Req;
+}
+
+/**
+*   @brief Send again a request.
+*   @ingroup App_Exchange
+*
+*   The request of a slot is sent again, because its answer was wrong or did not arrive. 
+*   @param slot The slot of the request.
+*   @sa Modbus_App_Send, Modbus_CAN_Repeat_Request
+*/
+void Modbus_App_Resend(unsigned char slot)
+{
+  Modbus_App_Actual_Req = Modbus_App_Slot_Req[slot];
+  Modbus_App_Send();
+}
+
+/**
+*   @brief No answer; It enqueues the request in the Error FIFO.
+*   @ingroup App_Control 
+*
+*   If this function is activated means that the maximum number of sendings of the request of a slot was exceeded without achieving
+*   any answer. Therefore, the proper request is enqueued as an exception message, the difference is that in the "answer" field of 
+*   the message is stored [0,0].
+*   @param slot The slot of the request.
+*   @sa Modbus_FIFO_E_Enqueue, Modbus_CAN_Repeat_Request
+*/
+void Modbus_App_No_Response(unsigned char slot)
+{
+  Modbus_App_Error_Msg.Request=Modbus_App_Slot_Req[slot];  
+  Modbus_App_Error_Msg.Response[0]=0;
+  Modbus_App_Error_Msg.Response[1]=0;
+  Modbus_FIFO_E_Enqueue(&Modbus_FIFO_Error,&Modbus_App_Error_Msg);
+}
+
+/**
+*   @brief Received answer of a slave to a group poll.
+*   @ingroup App_Control
+*
+*   The answer is checked as the one of a read of registers and stored in the block of the slave in the destination vector. A group
+*   poll is not sent again: if the answer is an exception or its data is wrong, the request, with the number of the slave, is 
+*   enqueued in the Error FIFO with the exception or [0,0] respectively.
+*   @param Slave The slave which answered.
+*   @sa Modbus_Read_Group_Registers, Modbus_App_Read_Registers_CallBack, Modbus_CAN_Controller
+*/
+void Modbus_App_Group_CallBack (unsigned char Slave)
+{
+  Modbus_App_Actual_Req = Modbus_App_Group_Req;
+  Modbus_App_Actual_Req.Slave = Slave;
+  //the registers of each slave follow the ones of the previous slave
+  Modbus_App_Actual_Req.Data[2].PUI2 += (Slave - Modbus_App_Group_Req.Data[3].UC) * Modbus_App_Group_Req.Data[1].UI2;
+  if(Modbus_App_Msg[0] == Modbus_App_Actual_Req.Function && !Modbus_App_Read_Registers_CallBack())
+    return;
+  Modbus_App_Error_Msg.Request=Modbus_App_Actual_Req;
+  if(Modbus_App_Msg[0] == (Modbus_App_Actual_Req.Function | 128) && Modbus_App_L_Msg==2)
+  {
+    Modbus_App_Error_Msg.Response[0]=Modbus_App_Msg[0];
+    Modbus_App_Error_Msg.Response[1]=Modbus_App_Msg[1];
+  }
+  else
+  {
+    Modbus_App_Error_Msg.Response[0]=0;
+    Modbus_App_Error_Msg.Response[1]=0;
+  }
+  Modbus_FIFO_E_Enqueue(&Modbus_FIFO_Error,&Modbus_App_Error_Msg);
+}
+
+/**
+*   @brief No answer of a slave to a group poll; It enqueues the request in the Error FIFO.
+*   @ingroup App_Control 
+*
+*   The group poll is enqueued with the number of the slave which did not answer and [0,0] in the "answer" field; its registers
+*   in the destination vector are not written.
+*   @param Slave The slave which did not answer.
+*   @sa Modbus_FIFO_E_Enqueue, Modbus_CAN_Timeouts
+*/
+void Modbus_App_Group_No_Response(unsigned char Slave)
+{
+  Modbus_App_Error_Msg.Request=Modbus_App_Group_Req;
+  Modbus_App_Error_Msg.Request.Slave=Slave;
+  Modbus_App_Error_Msg.Response[0]=0;
+  Modbus_App_Error_Msg.Response[1]=0;
+  Modbus_FIFO_E_Enqueue(&Modbus_FIFO_Error,&Modbus_App_Error_Msg);
+}
+
+#ifdef MODBUS_CAN_PUBLISH
+/**
+*   @brief Answer of a slave to the read of a published block.
+*   @ingroup App_Control
+*
+*   The registers, in big endian, are stored in the destination vector of the read. If the slave did not answer, or the block is
+*   shorter than the registers asked, the read (function MODBUS_CAN_PUBLISHED, with the block in Data[0]) is enqueued in the Error
+*   FIFO with [0,0] in the "answer" field; it is not sent again.
+*   @param entry The snapshot entry of the CAN layer.
+*   @param data The block.
+*   @param length Length of the block, 0 if the slave did not answer.
+*   @sa Modbus_Read_Snapshot, Modbus_CAN_Controller
+*/
+void Modbus_App_Snapshot_CallBack(unsigned char entry, unsigned char *data, unsigned char length)
+{
+  unsigned char i;
+  struct Modbus_FIFO_Item *Req = &Modbus_App_Snapshot_Req[entry];
+  if(length >= 2*Req->Data[1].UI2)
+  {
+    for(i=0; i<Req->Data[1].UI2; i++)
+      Req->Data[2].PUI2[i]=((uint16_t)data[2*i]<<8) | data[2*i+1];
+    return;
+  }
+  Modbus_App_Error_Msg.Request=*Req;
+  Modbus_App_Error_Msg.Response[0]=0;
+  Modbus_App_Error_Msg.Response[1]=0;
+  Modbus_FIFO_E_Enqueue(&Modbus_FIFO_Error,&Modbus_App_Error_Msg);
 }
 #endif
+#endif
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////SEPARATION ENDING////////////////////////////////////////////////////////////////////////
@@ -610,6 +769,7 @@ unsigned char Modbus_Get_Error (struct Modbus_FIFO_E_Item *Error)
 *   stored [0,0].
 *   @sa Modbus_FIFO_E_Enqueue, Modbus_OSL_Repeat_Request, Modbus_CAN_Repeat_Request
 */
+#if !CAN_Mode
 void Modbus_App_No_Response(void)
 {
   Modbus_App_Error_Msg.Request=Modbus_App_Actual_Req;  
@@ -617,6 +777,7 @@ void Modbus_App_No_Response(void)
   Modbus_App_Error_Msg.Response[1]=0;
   Modbus_FIFO_E_Enqueue(&Modbus_FIFO_Error,&Modbus_App_Error_Msg);
 }
+#endif
 
 /**
 *   @defgroup App_Exchange Interconnection between OSL/CAN Layer and App Layer
@@ -631,12 +792,36 @@ void Modbus_App_No_Response(void)
 *   @brief It gets and sends a petition from the request FIFO if it is not empty.
 *   @ingroup App_Exchange
 *
-*   @return 0 It has sent a request from the queue
+*   In CAN, the first request in the queue whose slave is not busy is sent, so the requests to other slaves do not wait behind
+*   the ones to a busy slave; the order of the queue (the urgent requests first) is kept among the rest. A broadcast waits for all
+*   the slots, so neither it nor the requests after it are passed over. All of them wait while the CAN layer is not ready to send
+*   (there is not a free slot, the bus is off...).
+*   @return 0 It has sent a request from the queue, or the requests have to wait
 *   @return 1 Empty queue, there is no requests to be sent
-*   @sa Modbus_FIFO_Dequeue, Modbus_App_Send
+*   @sa Modbus_FIFO_Dequeue, Modbus_FIFO_Peek_At, Modbus_FIFO_Dequeue_At, Modbus_App_Send, Modbus_CAN_Ready
 */
 unsigned char Modbus_App_FIFOSend(void)
 {
+#if CAN_Mode
+  struct Modbus_FIFO_Item Next;
+  unsigned char Position;
+
+  if (Modbus_FIFO_Empty(&Modbus_FIFO_Tx))
+    return 1;
+  for (Position = 0; Modbus_FIFO_Peek_At(&Modbus_FIFO_Tx,Position,&Next); Position++)
+  {
+    if (Modbus_CAN_Ready(Next.Slave))
+    {
+      Modbus_FIFO_Dequeue_At(&Modbus_FIFO_Tx,Position,&Modbus_App_Actual_Req);
+      Modbus_App_Send();
+      return 0;
+    }
+    // a broadcast goes after all the requests before it and before all the ones after it
+    if (!Next.Slave)
+      break;
+  }
+  return 0;
+#else
   // La función devuelve 1 si ha desencolado y entra en el "if"
   if (Modbus_FIFO_Dequeue(&Modbus_FIFO_Tx,&Modbus_App_Actual_Req))
   {
@@ -644,37 +829,61 @@ unsigned char Modbus_App_FIFOSend(void)
     return 0;
   }
   return 1;
+#endif
 }
 
-/**   
-*   @brief It receives a char from another module.
+/**
+*   @brief If no request of the Request FIFO has to be sent before _Modbus_App_Request_.
 *   @ingroup App_Exchange
 *
-*   It allows to store chars in some position of the vector _Modbus_App_Msg_; It is used in _Modbus_OSL_RTU_to_App(which also uses
-*   _Modbus_OSL_RTU_Char_Get_) and in _Modbus_CAN_to_App to transfer messages from RTU to App through OSL layer without connecting them;
-*   Also to transfer from CAN to App.
-*   @param Msg Char value to be stored in _Modbus_App_Msg_
-*   @param i Vector index where to store the char
-*   @sa Modbus_App_Msg, Modbus_OSL_RTU_to_App, Modbus_OSL_RTU_Char_Get
+*   An urgent request only waits for the urgent ones enqueued before it; the rest wait for the whole FIFO.
+*   @return 1 It can be sent now
+*   @return 0 It has to be enqueued
+*   @sa Modbus_App_Enqueue, Modbus_Set_Priority
 */
-void Modbus_App_Receive_Char (unsigned char Msg, unsigned char i)
+static unsigned char Modbus_App_First(void)
 {
-    Modbus_App_Msg[i]=Msg;
-  
+  if(Modbus_App_Request.Priority == MODBUS_PRIORITY_URGENT)
+    return (Modbus_FIFO_Tx.Urgent == 0);
+  return Modbus_FIFO_Empty(&Modbus_FIFO_Tx);
+}
+
+/**
+*   @brief It enqueues _Modbus_App_Request_ in the Request FIFO.
+*   @ingroup App_Exchange
+*
+*   The urgent requests go after the urgent ones already enqueued but before the rest.
+*   @return 1 The Request FIFO is full
+*   @return 0 Everything ok
+*   @sa Modbus_FIFO_Enqueue, Modbus_FIFO_Enqueue_First, Modbus_Set_Priority
+*/
+static unsigned char Modbus_App_Enqueue(void)
+{
+  if(Modbus_App_Request.Priority == MODBUS_PRIORITY_URGENT)
+    return Modbus_FIFO_Enqueue_First(&Modbus_FIFO_Tx,&Modbus_App_Request);
+  return Modbus_FIFO_Enqueue(&Modbus_FIFO_Tx,&Modbus_App_Request);
 }
 
-/** 
-*   @brief It receives the message length.
+/**   
+*   @brief It receives an incoming PDU from another module.
 *   @ingroup App_Exchange
 *
-*   It is used in _Modbus_OSL_RTU_to_App_ and _Modbus_CAN_to_App_ to send from OSL/CAN the length 
-*   of the correct incoming message to App.
-*   @param Index Length message value
-*   @sa Modbus_App_Msg, Modbus_App_L_Msg, Modbus_OSL_RTU_to_App
+*   It is used in _Modbus_OSL_RTU_to_App_ and in _Modbus_CAN_to_App_ to hand over a complete incoming message without copying it:
+*   the buffer where the CAN/OSL layer received it becomes _Modbus_App_Msg_, and the buffer which App had is given back to be used
+*   in the next reception. All the buffers swapped have MODBUS_APP_MSG_SIZE bytes.
+*   @param Buffer Buffer with the incoming message
+*   @param Offset Position of the PDU in _Buffer_ (the RTU frames start with the slave number)
+*   @param Length Length of the PDU
+*   @return The previous buffer of App, which now belongs to the caller
+*   @sa Modbus_App_Msg, Modbus_App_L_Msg, Modbus_OSL_RTU_to_App, Modbus_CAN_to_App
 */
-void Modbus_App_L_Msg_Set(unsigned char Index)
+unsigned char *Modbus_App_Msg_Swap(unsigned char *Buffer, unsigned char Offset, unsigned char Length)
 {
-  Modbus_App_L_Msg=Index;
+  unsigned char *Previous = Modbus_App_Msg_Base;
+  Modbus_App_Msg_Base = Buffer;
+  Modbus_App_Msg = Buffer + Offset;
+  Modbus_App_L_Msg = Length;
+  return Previous;
 }
 
 /**
@@ -706,6 +915,22 @@ void Modbus_App_L_Msg_Set(unsigned char Index)
 */
 //! @{
 
+/**
+*   @brief Set the priority class of the next requests.
+*
+*   The class is kept until it is changed, and it goes with each request, also when it is sent again. The urgent requests, as an
+*   emergency stop, are sent before the ones waiting in the Request FIFO (but after the urgent ones enqueued before). In CAN, with 
+*   extended message IDs, the class is the priority of the message IDs of the request and of its answer, so an urgent request wins
+*   the arbitration against the traffic of the rest, whatever the slave numbers are, and a background one loses it; the 11-bits
+*   message IDs have no room for it.
+*   @param Priority The class: MODBUS_PRIORITY_NORMAL (default), MODBUS_PRIORITY_URGENT or MODBUS_PRIORITY_BACKGROUND
+*   @sa Modbus_App_Enqueue_Or_Send, Modbus_CAN_FixOutput
+*/
+void Modbus_Set_Priority (enum Modbus_Priority Priority)
+{
+  Modbus_App_Priority = Priority;
+}
+
 /**
 *   @brief Read multiple Coils.
 *
@@ -833,6 +1058,183 @@ unsigned char Modbus_Read_I_Registers (unsigned char Slave, uint16_t Adress,
   } 
 }
 
+#if CAN_Mode
+/**
+*   @brief Read the same Registers of a group of slaves (CAN).
+*
+*   It reads the same continuous Holding (function 3) or Input (function 4) registers from the slaves _First_ to _Last_ with only
+*   one request, a group poll (MODBUS_CAN_GROUP), which is sent as a broadcast; each slave of the group answers it as a normal read,
+*   and the answers are ordered by the CAN arbitration. The answer of each slave has to fit in one frame: up to 3 registers, or 5, 
+*   7, 9, 11, 15, 23 or 31 with CAN FD. The read of the slave _First_ + i is stored from _Response_[i * _Registers_]. The slaves 
+*   which do not answer, or answer an exception, are notified one by one in the Error FIFO (see Modbus_App_Group_CallBack()); the
+*   group poll is not sent again. All the slaves of the group have to be built with the group poll.
+*   @param First First slave of the group.
+*   @param Last Last slave of the group, up to MODBUS_CAN_GROUP_MAX slaves.
+*   @param Function 3 for Holding Registers, 4 for Input Registers
+*   @param Adress Initial address of the read
+*   @param Registers Amount of Registers to be read from each slave
+*   @param *Response Pointer to where the reads will be stored, _Registers_ per slave
+*   @return 0 Correct request
+*   @return 1 It cannot be enqueued or wrong parameters
+*   @sa Modbus_App_Enqueue_Or_Send, Modbus_App_Request, Modbus_App_Group_Request
+*/
+unsigned char Modbus_Read_Group_Registers (unsigned char First, unsigned char Last, unsigned char Function,
+                                           uint16_t Adress, uint16_t Registers, uint16_t *Response)
+{
+  if(First==0 || Last>247 || First>Last || (Last-First)>=MODBUS_CAN_GROUP_MAX || (Function!=3 && Function!=4) ||
+     Registers==0 || !MODBUS_CAN_INDIVIDUAL(2+2*(long)Registers) || ((long)Adress+(long)Registers)>65535)
+      return 1;
+  else
+  {
+    Modbus_App_Request.Slave=0;
+    Modbus_App_Request.Function=Function;
+    Modbus_App_Request.Data[0].UI2=Adress;
+    Modbus_App_Request.Data[1].UI2=Registers;
+    Modbus_App_Request.Data[2].PUI2=Response;
+    Modbus_App_Request.Data[3].UC=First;
+    Modbus_App_Request.Data[4].UC=Last;
+
+    if(Modbus_App_Enqueue_Or_Send())
+      return 1;
+
+    return 0;
+  }
+}
+
+#ifdef MODBUS_CAN_PUBLISH
+/**
+*   @brief Read a block published by a slave (CAN).
+*
+*   The block _Block_ which the slave publishes with Modbus_Slave_Publish() is asked with a remote frame: the CAN controller of the
+*   slave answers it alone, so the read does not wait for the slave to process it. It does not go through the Request FIFO nor 
+*   takes a slot of the CAN layer, it is sent at once. The registers are stored in _Response_ when Modbus_Master_Communication() 
+*   finds the answer; if the slave does not answer, the read is notified in the Error FIFO (see Modbus_App_Snapshot_CallBack()).
+*   @param Slave The slave which publishes the block.
+*   @param Block The block, from 0 to MODBUS_CAN_PUBLISH_BLOCKS - 1.
+*   @param Registers Amount of Registers of the block to be read, up to MODBUS_CAN_PUBLISH_REGISTERS.
+*   @param *Response Pointer to where the registers will be stored
+*   @return 0 Correct request
+*   @return 1 Wrong parameters, or there is no free snapshot entry (MODBUS_CAN_SNAPSHOTS)
+*   @sa Modbus_CAN_Snapshot
+*/
+unsigned char Modbus_Read_Snapshot (unsigned char Slave, unsigned char Block, uint16_t Registers, uint16_t *Response)
+{
+  unsigned char entry;
+  if(Slave==0 || Slave>247 || Block>=MODBUS_CAN_PUBLISH_BLOCKS || Registers==0 || Registers>MODBUS_CAN_PUBLISH_REGISTERS)
+      return 1;
+  entry=Modbus_CAN_Snapshot(Slave, Block, 2*Registers);
+  if(entry==MODBUS_CAN_SNAPSHOTS)
+      return 1;
+  Modbus_App_Snapshot_Req[entry].Slave=Slave;
+  Modbus_App_Snapshot_Req[entry].Function=MODBUS_CAN_PUBLISHED;
+  Modbus_App_Snapshot_Req[entry].Priority=Modbus_App_Priority;
+  Modbus_App_Snapshot_Req[entry].Data[0].UC=Block;
+  Modbus_App_Snapshot_Req[entry].Data[1].UI2=Registers;
+  Modbus_App_Snapshot_Req[entry].Data[2].PUI2=Response;
+  return 0;
+}
+
+/**
+*   @brief Read the Registers of a published block from the cache (CAN).
+*
+*   The master keeps the last value received of each published block, the ones which the slaves in change of state mode send
+*   when their registers change (Modbus_Slave_Change_Of_State()) and the answers to Modbus_Read_Snapshot(); this read does not
+*   send anything, so it does not wait for the bus.
+*   @param Slave The slave which publishes the block.
+*   @param Block The block, from 0 to MODBUS_CAN_PUBLISH_BLOCKS - 1.
+*   @param Registers Amount of Registers of the block to be read, up to MODBUS_CAN_PUBLISH_REGISTERS.
+*   @param *Response Pointer to where the registers will be stored
+*   @param Max_Age Oldest value accepted, in cycles since it was received (for example, a bit more than the heartbeat of the
+*   block); 0 for any age.
+*   @return 0 Correct read
+*   @return 1 The block is not in the cache, it is older than _Max_Age_ or it is shorter than _Registers_
+*   @sa Modbus_CAN_GetCache
+*/
+unsigned char Modbus_Read_Cache (unsigned char Slave, unsigned char Block, uint16_t Registers, uint16_t *Response,
+                                 unsigned long Max_Age)
+{
+  unsigned char Data[8], i;
+  unsigned long Age;
+  if(Registers==0 || Registers>MODBUS_CAN_PUBLISH_REGISTERS || Modbus_CAN_GetCache(Slave, Block, Data, &Age)<2*Registers ||
+     (Max_Age && Age>Max_Age))
+    return 1;
+  for(i=0; i<Registers; i++)
+    Response[i]=((uint16_t)Data[2*i]<<8) | Data[2*i+1];
+  return 0;
+}
+
+/**
+*   @brief Read the Coils or Discrete Inputs of a published block from the cache (CAN).
+*
+*   As Modbus_Read_Cache(), for a block of coils or discrete inputs; each one is stored in one byte, as in Modbus_Read_Coils().
+*   @param Slave The slave which publishes the block.
+*   @param Block The block, from 0 to MODBUS_CAN_PUBLISH_BLOCKS - 1.
+*   @param Coils Amount of Coils of the block to be read, up to MODBUS_CAN_PUBLISH_COILS.
+*   @param *Response Pointer to where the coils will be stored
+*   @param Max_Age Oldest value accepted, in cycles since it was received; 0 for any age.
+*   @return 0 Correct read
+*   @return 1 The block is not in the cache, it is older than _Max_Age_ or it is shorter than _Coils_
+*   @sa Modbus_CAN_GetCache
+*/
+unsigned char Modbus_Read_Cache_Coils (unsigned char Slave, unsigned char Block, uint16_t Coils, unsigned char *Response,
+                                       unsigned long Max_Age)
+{
+  unsigned char Data[8], i;
+  unsigned long Age;
+  if(Coils==0 || Coils>MODBUS_CAN_PUBLISH_COILS || 8*Modbus_CAN_GetCache(Slave, Block, Data, &Age)<Coils ||
+     (Max_Age && Age>Max_Age))
+    return 1;
+  for(i=0; i<Coils; i++)
+    Response[i]=(Data[i/8]>>(i%8)) & 1;
+  return 0;
+}
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+
+/**
+*   @brief Start or stop the time-triggered schedule of the periodic data (CAN).
+*
+*   The master broadcasts a reference frame every _Cycle_ cycles, and each slave sends its block in its transmit window
+*   (Modbus_Slave_Schedule()), from where Modbus_Read_Cache() reads it. The requests wait in the Request FIFO until the free
+*   window, which starts _Free_ cycles after the reference and lasts until the next one.
+*   @param Cycle Length of the cycle, in cycles of the system clock; 0 stops the schedule.
+*   @param Free Start of the free window, in cycles from the reference; it has to be shorter than _Cycle_.
+*   @return 0 Correct
+*   @return 1 Wrong parameters
+*   @sa Modbus_CAN_Schedule
+*/
+unsigned char Modbus_Set_Schedule (unsigned long Cycle, unsigned long Free)
+{
+  if(Cycle && Free>=Cycle)
+    return 1;
+  Modbus_CAN_Schedule(Cycle, Free);
+  return 0;
+}
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+
+/**
+*   @brief Set the flow control of the long answers of the slaves (CAN).
+*
+*   After the first chunk of a long answer, the master sends a FLOW control frame to the slave with the chunks which it can send
+*   before the next FLOW frame and the minimum time between them, so a master which can not drain its receive FIFO at the full
+*   bit rate is not overrun. By default both are 0, the answers come back to back.
+*   @param Block_Size Chunks between two FLOW control frames, 0 for all of them.
+*   @param STmin Minimum separation time between chunks: 0x00-0x7F milliseconds, 0xF1-0xF9 100-900 microseconds.
+*   @return 0 Correct
+*   @return 1 Wrong parameters, a reserved separation time
+*   @sa Modbus_CAN_SetFlowControl
+*/
+unsigned char Modbus_Set_Flow_Control (unsigned char Block_Size, unsigned char STmin)
+{
+  if(STmin>0x7F && (STmin<0xF1 || STmin>0xF9))
+    return 1;
+  Modbus_CAN_SetFlowControl(Block_Size, STmin);
+  return 0;
+}
+#endif
+#endif
+
 /**
 *   @brief Write one Coil.
 *
@@ -1191,6 +1593,28 @@ void Modbus_App_Read_Write_M_Registers(void)
   
   Modbus_App_L_Req_pdu=10+Modbus_App_Req_pdu[9];
 }
+
+#if CAN_Mode
+/**
+*   @brief Format of the group poll.
+*
+*   The function code MODBUS_CAN_GROUP and the first and last slaves go before the standard request of the read, eight bytes in all.
+*   @sa Modbus_App_Req_pdu, Modbus_App_L_Req_pdu, struct Modbus_FIFO_Item
+*   @sa Modbus_Read_Group_Registers, Modbus_App_Standard_Request
+*/
+void Modbus_App_Group_Request(void)
+{
+  Modbus_App_Req_pdu[0]=MODBUS_CAN_GROUP;
+  Modbus_App_Req_pdu[1]=Modbus_App_Actual_Req.Data[3].UC;
+  Modbus_App_Req_pdu[2]=Modbus_App_Actual_Req.Data[4].UC;
+  Modbus_App_Req_pdu[3]=Modbus_App_Actual_Req.Function;
+  Modbus_App_Req_pdu[4]=Modbus_App_Actual_Req.Data[0].UI2>>8;
+  Modbus_App_Req_pdu[5]=Modbus_App_Actual_Req.Data[0].UI2;
+  Modbus_App_Req_pdu[6]=Modbus_App_Actual_Req.Data[1].UI2>>8; 
+  Modbus_App_Req_pdu[7]=Modbus_App_Actual_Req.Data[1].UI2;
+  Modbus_App_L_Req_pdu=MODBUS_CAN_GROUP_LENGTH;
+}
+#endif
 //! @}
 
 /**
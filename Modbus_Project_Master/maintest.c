@@ -22,6 +22,7 @@ void printString(char * string);
 void printSimpleData(unsigned char car);
 void printStringSinCarro(char * string);
 void printSimpleDataSinCarro(unsigned char car);
+void printLongData(unsigned long data);
 void printInt(unsigned char string);
 void print(unsigned char string);
 
@@ -80,15 +81,13 @@ SysTickIntHandler(void)
 
 void main(void)
 {
-        static unsigned char * resIn1;
-        //static unsigned char * resOut1;
+        static struct Modbus_CAN_Stats stats;
         static unsigned char data[2000];                          
         static uint16_t data16[125];
         static unsigned char coils_change[2000];   
         static uint16_t registers_change[125];
         static uint16_t registers_change2[125];
         static int i;//DEBUG
-        static unsigned char ant, now, intentos;      
         exitt = 0;        
         //SYSTEM CLOCK PLL-> 400Mhz/2 = 200Mhz / DIV_5= 40 Mhz
         //CAN CLOCK works at 8Mhz always
@@ -154,33 +153,19 @@ void main(void)
         Modbus_Read_H_Registers (1, 0, 74, data16);
         printString("M: Function 10 sent.");
         //wait answer
-        ant = 0;
         printString("///////////////////");   
         while(Modbus_Master_Communication())
         {       
-            now = getbu();
-          //  if(ant != now && now != 0)
-            if(now == 1)
-            {
-              if(getboo() == 1){
-                    ant = 0;                    
-              }
-                  ant++;                   
-                  printSimpleData(ant);                     
-                  resIn1 = getInput();              
-                  for(i =0; i < getIndex();i++)
-                      printSimpleDataSinCarro(resIn1[i]); 
-                  printString(" ");       
-                  setbu();
-                  intentos = getAttempts();
-                  if(intentos > 1)
-                      printString("Temporizador ha saltado");
-            }
         }                
+        Modbus_CAN_GetStats(&stats);
         printString("///////////////////");   
-        printSimpleData(resIn1[1]);
-        printSimpleData(getbu());        
-        if(Debug_Timeout())
+        printStringSinCarro("M: Frames received: ");
+        printLongData(stats.frames_received);
+        printStringSinCarro("M: Answers: ");
+        printLongData(stats.answers);
+        if(stats.retries[1])
+            printString("Temporizador ha saltado");
+        if(stats.timeouts[1])
         {
             printString("M: Timeout activado");   
         }
@@ -242,6 +227,13 @@ void printSimpleData(unsigned char car)
     printString(str);
 }
 
+void printLongData(unsigned long data)
+{
+    static char str[21];
+    sprintf(str, "%lu", data);
+    printString(str);
+}
+
 void printInt(unsigned char string)
 {                
         UARTCharPut(UART0_BASE, (string +'0') );    
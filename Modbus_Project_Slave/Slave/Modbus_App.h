@@ -14,6 +14,9 @@ enum Modbus_Comm_Modes
     MODBUS_CAN_MODE,    //!< CAN communication
     CDEFAULT       //!< Serial communication
 };
+
+//! Size of the buffers of the incoming messages swapped between App and the CAN/OSL layers; a whole RTU frame fits.
+#define MODBUS_APP_MSG_SIZE 256
 //! @}
 
 #if OSL_Mode
@@ -34,12 +37,23 @@ enum Modbus_Comm_Modes
                                 uint16_t N_H_Registers, uint16_t *H_Registers,
                                 uint16_t N_I_Registers, uint16_t *I_Registers,
                                 enum Modbus_CAN_BitRate bit_rate, unsigned char slave);
+#ifdef MODBUS_CAN_PUBLISH
+                unsigned char Modbus_Slave_Publish(unsigned char Block, unsigned char Function, uint16_t Adress, unsigned char Quantity);
+                unsigned char Modbus_Slave_Change_Of_State(unsigned char Block, unsigned char Enable, uint16_t Deadband,
+                                                           unsigned long Heartbeat);
+                void Modbus_Slave_Refresh(void);
+#ifdef MODBUS_CAN_SCHEDULE
+                unsigned char Modbus_Slave_Schedule(unsigned char Block, unsigned char Enable, unsigned long Offset);
+#endif
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+                unsigned char Modbus_Slave_Flow_Control(unsigned char Block_Size, unsigned char STmin);
+#endif
 #endif
 
 void Modbus_Slave_Communication (void);//
 void Modbus_App_Manage_Request (void);
-void Modbus_App_Receive_Char (unsigned char Msg,unsigned char i);
-void Modbus_App_L_Msg_Set(unsigned char Index);
+unsigned char *Modbus_App_Msg_Swap(unsigned char *Buffer, unsigned char Offset, unsigned char Length);
 void Modbus_App_Send(void);
 
 #endif // __Modbus_App_H__
\ No newline at end of file
@@ -12,6 +12,9 @@
 #include "driverlib/sysctl.h"
 #include "driverlib/can.h"
 #include "driverlib/interrupt.h"
+#if defined(MODBUS_CAN_PUBLISH) || defined(MODBUS_CAN_FLOW_CONTROL)
+#include "driverlib/timer.h"
+#endif
 #include "Modbus_App.h"
 #include "Modbus_CAN.h"
 
@@ -21,34 +24,124 @@
 static  enum Modbus_MainState modbus_slave_state;
 //! Variable used to store which slave is this one itself.
 static  unsigned char slave;
-//! Variable used to store if a reception was completed.
+//! Number of complete requests waiting in _modbus_queue_.
 static unsigned char modbus_complete_reception;
 // Variable used to store if a transmission was completed
 //static unsigned char modbus_complete_transmission;
-//! Variable to activate when a Broadcast was received; In this way the response is not built.
+//! Variable to activate when a Broadcast is processed; In this way the response is not built.
 static unsigned char modbus_broadcast;
-//! Variable to save the input length.
-static  unsigned char input_length;
-//!Variable to store the input data.
-static  unsigned char input_pdu[MAX_PDU];
-//! Variable to index the input_pdu.
-static unsigned char modbus_index;
+//! Reassembly contexts of the requests: MODBUS_CAN_UNICAST and MODBUS_CAN_BROADCAST.
+static struct Modbus_CAN_Input modbus_inputs[MODBUS_CAN_STREAMS];
+//! Request which is being reassembled; one of _modbus_inputs_.
+static struct Modbus_CAN_Input *input;
+//! Complete requests waiting to be processed, in order of arrival.
+static struct Modbus_CAN_Request modbus_queue[MODBUS_CAN_QUEUE];
+//! Position in _modbus_queue_ of the oldest complete request.
+static unsigned char modbus_queue_head;
+//! Storage of the buffers of _modbus_queue_; each entry keeps a free one while it is empty.
+static unsigned char modbus_queue_buffer[MODBUS_CAN_QUEUE][MAX_PDU];
 //!Variable to store the buffer input data.
 static unsigned char buffer_input_pdu[MAX_FRAME];
+//! Output data; copy of the PDU which is being sent through the mailboxes.
+static unsigned char output_pdu[MAX_PDU];
+//! Output data length.
+static unsigned char output_length;
+//! Chunks of the output PDU waiting to be loaded into a mailbox, one bit per chunk.
+static uint64_t output_map;
+//! Number of chunks of the output PDU.
+static unsigned char output_chunks;
+//! Sequence counter of the output long frames.
+static unsigned char output_seq;
+//! Variable used to store if there are mailboxes waiting to be sent.
+static unsigned char output_busy;
+//! Variable used to store if the chunks are paced by Modbus_CAN_FixOutput (MODBUS_CAN_TX_DELAYED).
+static unsigned char output_paced;
+//! Transaction ID of the answer being sent; it is the one of the request (extended message IDs).
+static unsigned char output_txn;
+//! Priority of the answer being sent; it is the one of the request (extended message IDs).
+static unsigned char output_priority;
+//! Transaction ID of the request being processed (extended message IDs).
+static unsigned char modbus_txn;
+//! Priority of the request being processed (extended message IDs).
+static unsigned char modbus_priority;
+#ifdef MODBUS_CAN_BROADCAST_ACK
+//! Function code of the request being processed.
+static unsigned char modbus_function;
+#endif
+//! Bus-health counters and state of the CAN controller.
+static struct Modbus_CAN_Health modbus_health;
+//! Frames loaded in the mailboxes since the last TXOK interruption
+static unsigned char output_window;
+//! Data bytes of the frames loaded in the mailboxes since the last TXOK interruption
+static unsigned long output_window_bytes;
+#ifdef MODBUS_CAN_FLOW_CONTROL
+//! Chunks of the answer which can still be loaded before waiting for a FLOW control frame of the master; 0 for all of them.
+static unsigned char output_block;
+//! Block size of the last FLOW control frame of the master, used again for the chunks asked by a NACK.
+static unsigned char output_block_size;
+//! Separation time between chunks asked by the master, in cycles; 0 to send them back to back.
+static unsigned long output_stmin;
+//! 1 while the answer waits for a FLOW control frame of the master.
+static unsigned char output_flow_wait;
+//! Block size asked for the long unicast requests.
+static unsigned char modbus_flow_bs;
+//! Separation time asked for the long unicast requests, coded as in ISO 15765-2.
+static unsigned char modbus_flow_stmin;
+#endif
+//! Traffic counters
+static struct Modbus_CAN_Stats modbus_stats;
+//! Traffic counters as they are after the initialisation
+static const struct Modbus_CAN_Stats modbus_stats_none;
+//! Cycles to wait before initialising again the CAN controller after a bus-off.
+static unsigned long modbus_restart_delay;
 
 //-CAN
 //!Variable used to store the bit rate of the communications.
 static enum  Modbus_CAN_BitRate modbus_bit_rate;
 //! Variable used to store both bit time and rate information.
 static tCANBitClkParms modbus_canbit;
-//! Waiting time in cycles*3 between sendings.
+#ifdef MODBUS_CAN_FD
+//! Bit time of the data phase of the CAN FD frames
+static tCANBitClkParms modbus_canbit_data;
+#endif
+//! Waiting time in cycles*3 between sendings; only used if MODBUS_CAN_TX_DELAYED is defined.
 static unsigned long modbus_delay;
+#ifdef MODBUS_CAN_PUBLISH
+//! Published blocks, kept to set their message objects up again after a restart
+static unsigned char modbus_published[MODBUS_CAN_PUBLISH_BLOCKS][8];
+//! Length of the published blocks, 0 if the block is not published
+static unsigned char modbus_published_length[MODBUS_CAN_PUBLISH_BLOCKS];
+//! Change of state mode of the published blocks
+static struct Modbus_CAN_Push modbus_pushes[MODBUS_CAN_PUBLISH_BLOCKS];
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+//! Transmit window of the time-triggered schedule
+static struct Modbus_CAN_Window modbus_window;
+#endif
 //! Receive Message Object.
 static  tCANMsgObject RxObject;
 //! Transmit Message Object.
 static  tCANMsgObject TxObject;
 //! @}
 
+static void Modbus_CAN_Setup(void);
+static void Modbus_CAN_Lock(void);
+static void Modbus_CAN_Unlock(void);
+static void Modbus_CAN_RxFifo(unsigned char first, unsigned char last, unsigned long id);
+static void Modbus_CAN_Frame(void);
+#ifdef MODBUS_CAN_BROADCAST_ACK
+static void Modbus_CAN_BroadcastDone(void);
+#endif
+static void Modbus_CAN_Queue(void);
+#ifdef MODBUS_CAN_PUBLISH
+static void Modbus_CAN_PublishObject(unsigned char block);
+static unsigned char Modbus_CAN_Changed(unsigned char block);
+static void Modbus_CAN_PushCheck(void);
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+static void Modbus_CAN_FlowSend(void);
+#endif
+
 void Modbus_CAN_IntHandler(void)
 {
     unsigned long can_status, can_sts_status;
@@ -58,59 +151,55 @@ void Modbus_CAN_IntHandler(void)
     {
         //some "errors" occurred
         can_sts_status = CANStatusGet(MODBUS_CAN, CAN_STS_CONTROL);        
-        switch(can_sts_status)
-        {
-                //error processing, resend, etc.
-                case CAN_STATUS_BUS_OFF:
-                case CAN_STATUS_EWARN:
-                case CAN_STATUS_EPASS:
-                                      //RESET SHOULD BE DONE
-                                      Modbus_CAN_Error_Management(110);                                      
-                                      break;
-                case CAN_STATUS_RXOK:  
-                case CAN_STATUS_TXOK:
-                                      //ALL OK
-                                      break;
-                case CAN_STATUS_LEC_MSK:                  
-                case CAN_STATUS_LEC_STUFF:
-                case CAN_STATUS_LEC_FORM:
-                case CAN_STATUS_LEC_BIT1:
-                case CAN_STATUS_LEC_BIT0:                                         
-                case CAN_STATUS_LEC_ACK:
-                case CAN_STATUS_LEC_CRC: /*CAN ERROR FRAME, NO PROBLEM, TIMEOUT WILL BE TRIGGERED*/                                                                      
-                                      break;
-                default:
-                                      break;
-        }            
+        //CAN ERROR FRAMES, NO PROBLEM, TIMEOUT WILL BE TRIGGERED; the bus-off state is recovered
+        Modbus_CAN_BusStatus(can_sts_status);
         CANIntClear(MODBUS_CAN, can_status);
     }
-    else if(can_status >= 1 && can_status <= 16)
+    else if(can_status >= MODBUS_CAN_TX_FIRST_OBJ && can_status <= MODBUS_CAN_TX_LAST_OBJ)
     {
-        //LAST SENDING message object should have the interruption pending, so last data was sent             
-        CANIntClear(MODBUS_CAN, can_status);//clear interruption        
-        // I  notify that I sent the data correctly
-        //modbus_complete_transmission = 1;
+        //LAST LOADED message object should have the interruption pending, so the whole window was sent
+        CANIntClear(MODBUS_CAN, can_status);//clear interruption
+        modbus_stats.frames_sent += output_window;
+        modbus_stats.bytes_sent += output_window_bytes;
+        output_window = 0;
+        output_window_bytes = 0;
+        if(output_map)
+        {
+            //the mailboxes are free again, next window of chunks
+#ifdef MODBUS_CAN_FLOW_CONTROL
+            if(output_stmin && !output_flow_wait)
+            {
+                //the master asked for a separation time, Modbus_CAN_FlowHandler() loads the next chunk
+                TimerLoadSet(MODBUS_CAN_FLOW_TIMER, TIMER_A, output_stmin);
+                TimerEnable(MODBUS_CAN_FLOW_TIMER, TIMER_A);
+            }
+            else
+#endif
+            if(!output_paced)
+                Modbus_CAN_TxRefill(MODBUS_CAN_TX_LAST_OBJ);
+        }
+        else
+        {
+            // I  notify that I sent the data correctly
+            output_busy = 0;
+            //the bus works, the next bus-off starts again with the shortest restart delay
+            modbus_health.backoff = 0;
+            //modbus_complete_transmission = 1;
+        }
     }
-    else if(can_status == 17) // Message 17 gets the unicasts
+    else if(can_status >= MODBUS_CAN_RX_FIFO_FIRST && can_status <= MODBUS_CAN_RX_BROADCAST_LAST) // FIFOs of the unicasts and the broadcasts
     {                    
-        if(!modbus_complete_reception)
+        if(modbus_complete_reception < MODBUS_CAN_QUEUE)
         {
             ledOn();
-            modbus_broadcast = 0;
             Modbus_CAN_CallBack();                     
             ledOff();
         }
-      
-    }
-    else if(can_status == 18) //Message 18 gets the broadcasts
-    {      
-      if(!modbus_complete_reception)
-      {  
-          ledOn();
-          modbus_broadcast = 1;
-          Modbus_CAN_CallBack();               
-          ledOff();
-      }
+        else
+        {
+            //the queue is full, the frames wait in the FIFO until a request is processed
+            CANIntClear(MODBUS_CAN, can_status);
+        }
     }
     else
     {
@@ -120,6 +209,7 @@ void Modbus_CAN_IntHandler(void)
 
 void Modbus_CAN_Init(enum Modbus_CAN_BitRate bit_rate, unsigned char slave_number)
 {
+        unsigned char i;
                 Modbus_SetMainState(MODBUS_INITIAL);     
                 //LED CONFIGURATION
                 SysCtlPeripheralEnable(SYSCTL_PERIPH_GPIOF);
@@ -127,6 +217,50 @@ void Modbus_CAN_Init(enum Modbus_CAN_BitRate bit_rate, unsigned char slave_numbe
                 ledOn();
                 //////////Variables//////////
 		slave = slave_number;      
+                output_length = 0;
+                output_map = 0;
+                output_seq = 0;
+                output_busy = 0;
+                output_paced = 0;
+                output_window = 0;
+                output_window_bytes = 0;
+#ifdef MODBUS_CAN_FLOW_CONTROL
+                output_flow_wait = 0;
+                modbus_flow_bs = 0;
+                modbus_flow_stmin = 0;
+#endif
+                modbus_stats = modbus_stats_none;
+#ifdef MODBUS_CAN_PUBLISH
+                for(i = 0; i < MODBUS_CAN_PUBLISH_BLOCKS; i++)
+                {
+                    modbus_published_length[i] = 0;
+                    modbus_pushes[i].enabled = 0;
+                    modbus_pushes[i].pending = 0;
+                }
+#endif
+                for(i = 0; i < MODBUS_CAN_STREAMS; i++)
+                {
+                    modbus_inputs[i].pdu = modbus_inputs[i].buffer;
+                    modbus_inputs[i].active = 0;
+                }
+                input = &modbus_inputs[MODBUS_CAN_UNICAST];
+                for(i = 0; i < MODBUS_CAN_QUEUE; i++)
+                {
+                    modbus_queue[i].pdu = modbus_queue_buffer[i];
+                }
+                modbus_queue_head = 0;
+                modbus_complete_reception = 0;
+                modbus_health.state = MODBUS_CAN_BUS_ACTIVE;
+                modbus_health.bus_off = 0;
+                modbus_health.passive = 0;
+                modbus_health.warning = 0;
+                modbus_health.frame_errors = 0;
+                modbus_health.restarts = 0;
+                modbus_health.recoveries = 0;
+                modbus_health.replays = 0;
+                modbus_health.last_recovery = 0;
+                modbus_health.max_recovery = 0;
+                modbus_health.backoff = 0;
                 //modbus_complete_transmission = 0;               
                 modbus_bit_rate = bit_rate;
                 //set bit timing, bit rate and delay
@@ -136,12 +270,31 @@ void Modbus_CAN_Init(enum Modbus_CAN_BitRate bit_rate, unsigned char slave_numbe
                 //I enable the pins to be used as CAN pins
                 GPIOPinTypeCAN(GPIO_PORTD_BASE, GPIO_PIN_0 | GPIO_PIN_1);  
                 SysCtlPeripheralEnable(SYSCTL_PERIPH_CAN0);    
-                //Init CAN Module
-                CANInit(MODBUS_CAN);
-                //Set bit timing
-                CANSetBitTiming(MODBUS_CAN, &modbus_canbit);                                       
-                //ENABLING CAN INTERRUPTIONS                
-                CANIntEnable(MODBUS_CAN, CAN_INT_ERROR |CAN_INT_STATUS | CAN_INT_MASTER);        
+                Modbus_CAN_Setup();
+#ifdef MODBUS_CAN_PUBLISH
+                //free running timer of the heartbeats, it is only read
+                SysCtlPeripheralEnable(SYSCTL_PERIPH_TIMER0);
+                TimerConfigure(MODBUS_CAN_PUSH_TIMER, TIMER_CFG_PERIODIC);
+                TimerLoadSet(MODBUS_CAN_PUSH_TIMER, TIMER_A, 0xFFFFFFFF);
+                TimerEnable(MODBUS_CAN_PUSH_TIMER, TIMER_A);
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+                //one-shot timer of the transmit window, started by the reference frames
+                modbus_window.enabled = 0;
+                modbus_window.sent = 0;
+                modbus_window.missed = 0;
+                SysCtlPeripheralEnable(SYSCTL_PERIPH_TIMER1);
+                TimerConfigure(MODBUS_CAN_WINDOW_TIMER, TIMER_CFG_ONE_SHOT);
+                IntEnable(INT_TIMER1A);
+                TimerIntEnable(MODBUS_CAN_WINDOW_TIMER, TIMER_TIMA_TIMEOUT);
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+                //one-shot timer which paces the long answers as the master asks, and waits for its FLOW control frames
+                SysCtlPeripheralEnable(SYSCTL_PERIPH_TIMER2);
+                TimerConfigure(MODBUS_CAN_FLOW_TIMER, TIMER_CFG_ONE_SHOT);
+                IntEnable(INT_TIMER2A);
+                TimerIntEnable(MODBUS_CAN_FLOW_TIMER, TIMER_TIMA_TIMEOUT);
+#endif
                 IntEnable(INT_CAN0);
                 //Enable CAN Module
                 CANEnable(MODBUS_CAN);
@@ -166,193 +319,777 @@ void Modbus_SetMainState(enum Modbus_MainState state)
 
 void Modbus_CAN_SetBitRate(enum Modbus_CAN_BitRate bit_rate)
 {
-      switch(bit_rate)
+      unsigned long kbps = (unsigned long)bit_rate;
+      if(!kbps || !Modbus_CAN_BitTiming(MODBUS_CAN_CLOCK, kbps * 1000, &modbus_canbit))
       {
-            case MODBUS_100KBPS:
-                          modbus_canbit.ulSyncPropPhase1Seg = 5;      //3 *tq; following the example from the microcontroller's pdf
-                          modbus_canbit.ulPhase2Seg = 4;
-                          modbus_canbit.ulSJW = 4;
-                          modbus_canbit.ulQuantumPrescaler = 8;
-                          /*(4000000/3) * 0.07 *10 = 9333333 ("TRANSFER TIME"); 
-                             900000 * 4 = process time
-                          */
-                          modbus_delay = 9333333 + 900000*4; // 10 times slower THAN 1MBPS
-                          break;
-            case MODBUS_1MBPS:
-                          modbus_canbit.ulSyncPropPhase1Seg = 5;      //3 *tq; following the example from the microcontroller's pdf
-                          modbus_canbit.ulPhase2Seg = 2;
-                          modbus_canbit.ulSJW = 2;
-                          modbus_canbit.ulQuantumPrescaler = 1;
-                          /*(4000000/3) * 0.07 = 933333 ("TRANSFER TIME"); 
-                            900000*4 = process time
-                          */
-                          modbus_delay = 933333 + 900000*4; 
-                          break;
-            default : Modbus_CAN_Error_Management(110); break;
+            Modbus_CAN_Error_Management(110);
+            return;
       }
+#ifdef MODBUS_CAN_FD
+      //data phase faster than the nominal bit rate; at the nominal one if the CAN clock does not give it
+      if((kbps >= MODBUS_CAN_FD_DATA_RATE) || 
+         !Modbus_CAN_BitTiming(MODBUS_CAN_CLOCK, MODBUS_CAN_FD_DATA_RATE * 1000UL, &modbus_canbit_data))
+            modbus_canbit_data = modbus_canbit;
+#endif
+      //transfer time of a byte ("TRANSFER TIME", 10 times longer at 100 Kbps than at 1 Mbps) + process time
+      modbus_delay = (MODBUS_CAN_TRANSFER_TIME / kbps) + MODBUS_CAN_PROCESS_TIME;
+}
+
+unsigned char Modbus_CAN_BitTiming(unsigned long can_clock, unsigned long bit_rate, tCANBitClkParms *bit_clk)
+{
+      unsigned long tq, prescaler, phase2, error, sample;
+      unsigned long best_error = 0xFFFFFFFF, best_sample = 0xFFFFFFFF;
+      //from the most time quanta, so the finer timing is kept when two of them are equally good
+      for(tq = MODBUS_CAN_TQ_MAX; tq >= MODBUS_CAN_TQ_MIN; tq--)
+      {
+            //the closest prescaler for this number of time quanta
+            prescaler = (can_clock + ((bit_rate * tq) / 2)) / (bit_rate * tq);
+            if(!prescaler)
+                prescaler = 1;
+            if(prescaler > MODBUS_CAN_PRESCALER_MAX)
+                continue;
+            error = can_clock / (prescaler * tq);
+            error = (error > bit_rate) ? (error - bit_rate) : (bit_rate - error);
+            //Phase2 is what is left after the sample point, Sync + Prop + Phase1 up to 16 time quanta
+            phase2 = tq - (((tq * MODBUS_CAN_SAMPLE_POINT) + 500) / 1000);
+            if(!phase2)
+                phase2 = 1;
+            if((tq - phase2) > 16)
+                phase2 = tq - 16;
+            sample = ((tq - phase2) * 1000) / tq;
+            sample = (sample > MODBUS_CAN_SAMPLE_POINT) ? (sample - MODBUS_CAN_SAMPLE_POINT) : (MODBUS_CAN_SAMPLE_POINT - sample);
+            if((error < best_error) || ((error == best_error) && (sample < best_sample)))
+            {
+                best_error = error;
+                best_sample = sample;
+                bit_clk->ulSyncPropPhase1Seg = tq - phase2;
+                bit_clk->ulPhase2Seg = phase2;
+                bit_clk->ulSJW = (phase2 < 4) ? phase2 : 4;
+                bit_clk->ulQuantumPrescaler = prescaler;
+            }
+      }
+      return best_error <= (((bit_rate / 100) * MODBUS_CAN_BIT_TOLERANCE) / 100);
 }
 
 void Modbus_CAN_FixOutput(unsigned char *mb_req_pdu, unsigned char pdu_length)
 {
-	unsigned char aux_length;
-        unsigned char local_output[MAX_FRAME];
-        int i, iterations, objNumber;
-        uint16_t registerr;                  
-            //init variables
-            objNumber = 1;                     
-            iterations = 0;  
-            aux_length = pdu_length;        
-            //storing in global variables                   
-            //modbus_complete_transmission = 0;                        
+        int i;
+            //the mailboxes must not be refilled while the new output is being prepared
+            Modbus_CAN_Lock();
+#ifdef MODBUS_CAN_FLOW_CONTROL
+            //the flow control timer of the answer before neither paces nor drops the new one
+            TimerDisable(MODBUS_CAN_FLOW_TIMER, TIMER_A);
+            TimerIntClear(MODBUS_CAN_FLOW_TIMER, TIMER_TIMA_TIMEOUT);
+#endif
             //body:
             ledOn();
+            //the PDU is copied, so the APP layer can build the next one while this is still being sent
+            for(i=0; i < pdu_length; i++)
+            {
+                output_pdu[i] = mb_req_pdu[i];
+            }
+            output_length = pdu_length;
+            output_chunks = MODBUS_CAN_INDIVIDUAL(pdu_length) ? 1 : MODBUS_CAN_CHUNKS(pdu_length);
+            output_map = MODBUS_CAN_ALL_CHUNKS(output_chunks);
+            output_seq++;
+            output_txn = modbus_txn;
+            output_priority = modbus_priority;
+#ifdef MODBUS_CAN_TX_DELAYED
+            output_paced = 1;
+            //only one mailbox, waiting a fixed time between chunks
+            Modbus_CAN_TxRefill(MODBUS_CAN_TX_FIRST_OBJ);
+            Modbus_CAN_Unlock();
+            while(output_map)
+            {
+                Modbus_CAN_Delay();
+                Modbus_CAN_Lock();
+                Modbus_CAN_TxRefill(MODBUS_CAN_TX_FIRST_OBJ);
+                Modbus_CAN_Unlock();
+            }
+            output_paced = 0;
+#else
+#ifdef MODBUS_CAN_FLOW_CONTROL
+            //a long answer waits for the FLOW control frame of the master after its first chunk
+            output_flow_wait = 0;
+            output_stmin = 0;
+            output_block_size = 0;
+            output_block = MODBUS_CAN_INDIVIDUAL(pdu_length) ? 0 : 1;
+#endif
+            //first window of chunks, the rest are queued from the TXOK interruption
+            Modbus_CAN_TxRefill(MODBUS_CAN_TX_LAST_OBJ);
+            Modbus_CAN_Unlock();
+#endif
+            ledOff();
+}
+
+void Modbus_CAN_TxRefill(unsigned char last_obj)
+{
+        unsigned char chunk, objNumber, type;
+        unsigned char local_output[MAX_FRAME];
             // 000 + 00000000(slave)= Individual Frame (0)
             // 010 + slave = Beginning Long Frame (1)
             // 100 + slave = Continuation Long Frame (4)
             // 110 + slave = End Long Frame (6)
-            TxObject.ulMsgIDMask = 0x000;//It's not used mask, I send all messages without filtering                                       
-            while(aux_length) // != 0 true
-            {                
-                registerr = 0x000;
-                if(aux_length <= MAX_FRAME)//ONE FRAME OR THE LAST LONG ONE
-                {                             
-                    registerr=0x6; // if I do not enter in the below statement, I mark the frame as End Long Frame
-                    if(pdu_length <= MAX_FRAME) //I send an Individual Frame
-                    {              
-                          registerr = 0x0;                               
-                    }                    
-                    TxObject.ulMsgID = ((registerr << 8) | slave);
-                    TxObject.ulFlags = MSG_OBJ_TX_INT_ENABLE;
-                    TxObject.ulMsgLen = aux_length;      
-                    
-                    for(i=0; i < aux_length; i++)
-                    {
-                        local_output[i] = mb_req_pdu[i + (iterations * MAX_FRAME)];                             
-                    }                    
-                    aux_length -= aux_length;// it should be 0 now                      
-                    ledOff();                    
-                }
-                else //division needed because it's > 8 bits
+            TxObject.ulMsgIDMask = 0x000;//It's not used mask, I send all messages without filtering
+            TxObject.pucMsgData = local_output;
+            objNumber = MODBUS_CAN_TX_FIRST_OBJ;
+#ifdef MODBUS_CAN_FLOW_CONTROL
+            //the master paces the long answer: nothing is loaded until its FLOW control frame, and one chunk at a time if it asked
+            //for a separation time
+            if(output_flow_wait)
+                return;
+            if(output_stmin)
+                last_obj = MODBUS_CAN_TX_FIRST_OBJ;
+#endif
+            while(output_map && (objNumber <= last_obj))
+            {
+                //the lowest chunk still pending goes first
+                for(chunk = 0; !(output_map & ((uint64_t)1 << chunk)); chunk++);
+                output_map &= ~((uint64_t)1 << chunk);
+#ifdef MODBUS_CAN_FLOW_CONTROL
+                if(output_block && !--output_block && output_map)
                 {
-                    //in case is not the first Long Frame, then it's a continuation
-                    registerr = 0x4;
-                    // first Long Frame
-                    if(aux_length == pdu_length)
-                    {
-                        registerr = 0x2;
-                    }
-                    TxObject.ulMsgID = ((registerr << 8) | slave);                    
-                    TxObject.ulFlags = MSG_OBJ_NO_FLAGS;
-                    TxObject.ulMsgLen = MAX_FRAME;
-                    for(i=0; i < MAX_FRAME; i++)
-                    {
-                        local_output[i] = mb_req_pdu[i + (iterations * MAX_FRAME)];                        
-                    }
-                    aux_length -= MAX_FRAME;                    
-                    iterations++;                    
-                }                             
-                TxObject.pucMsgData = local_output;
+                    //end of the block, the last chunk loaded until the master allows the next block
+                    output_flow_wait = 1;
+                    last_obj = objNumber;
+                    TimerLoadSet(MODBUS_CAN_FLOW_TIMER, TIMER_A, MODBUS_CAN_FLOW_TIMEOUT);
+                    TimerEnable(MODBUS_CAN_FLOW_TIMER, TIMER_A);
+                }
+#endif
+                if(MODBUS_CAN_INDIVIDUAL(output_length)) //I send an Individual Frame
+                    type = MODBUS_CAN_INDIVIDUAL_FRAME;
+                else if(chunk == 0) // first Long Frame
+                    type = MODBUS_CAN_BEGIN_FRAME;
+                else if(chunk == (output_chunks - 1)) // last Long Frame
+                    type = MODBUS_CAN_END_FRAME;
+                else //in case is not the first nor the last Long Frame, then it's a continuation
+                    type = MODBUS_CAN_CONTINUATION_FRAME;
+                // the answer goes with the transaction ID and priority of the request
+                TxObject.ulMsgID = MODBUS_CAN_ID(type, 0, output_priority, output_txn, output_pdu[0], slave);
+                TxObject.ulMsgLen = Modbus_CAN_BuildChunk(output_pdu, output_length, output_seq, chunk, local_output);
+                // Lower message objects are sent first, so only the last loaded one needs the TXOK interruption
+                if(!output_map || (objNumber == last_obj))
+                    TxObject.ulFlags = MSG_OBJ_TX_INT_ENABLE | MODBUS_CAN_ID_FLAGS | MODBUS_CAN_FD_FLAGS;
+                else
+                    TxObject.ulFlags = MSG_OBJ_NO_FLAGS | MODBUS_CAN_ID_FLAGS | MODBUS_CAN_FD_FLAGS;
+                //counted when the TXOK interruption of the window arrives
+                output_window++;
+                output_window_bytes += TxObject.ulMsgLen;
                 CANMessageSet(MODBUS_CAN, objNumber, &TxObject, MSG_OBJ_TYPE_TX);
-                // If it is not the last frame
-                if(aux_length)
-                    Modbus_CAN_Delay();
-            }        
+                output_busy = 1;
+                objNumber++;
+            }
+}
+
+unsigned char Modbus_CAN_BuildChunk(unsigned char *pdu, unsigned char length, unsigned char seq, unsigned char chunk, unsigned char *frame)
+{
+        unsigned char i;
+        uint16_t offset;
+            if(MODBUS_CAN_INDIVIDUAL(length)) //Individual Frame, it is sent as it is
+            {
+                for(i=0; i < length; i++)
+                {
+                    frame[i] = pdu[i];
+                }
+                return length;
+            }
+            // chunk byte: 2 low bits of the sequence counter + chunk number
+            frame[0] = ((seq & MODBUS_CAN_TAG_MASK) << MODBUS_CAN_TAG_SHIFT) | chunk;
+            i = MODBUS_CAN_CHUNK_HEADER;
+            if(chunk == 0)
+            {
+                // first chunk: sequence counter + total length
+                frame[1] = seq;
+                frame[2] = length;
+                i = MODBUS_CAN_FIRST_HEADER;
+            }
+            for(offset = MODBUS_CAN_CHUNK_OFFSET(chunk); (i < MAX_FRAME) && (offset < length); i++, offset++)
+            {
+                frame[i] = pdu[offset];
+            }
+            // CAN FD frames have fixed lengths, the rest is padded
+            for(offset = MODBUS_CAN_FRAME_LENGTH(i); i < offset; i++)
+            {
+                frame[i] = 0;
+            }
+            return i;
+}
+
+unsigned char Modbus_CAN_Reassembly(unsigned char header, unsigned char *frame, unsigned char frame_length)
+{
+        unsigned char tag, chunk, i;
+        uint16_t offset;
+            if(frame_length < MODBUS_CAN_CHUNK_HEADER)
+                return MODBUS_CAN_REASSEMBLY_PENDING;
+            tag = frame[0] >> MODBUS_CAN_TAG_SHIFT;
+            chunk = frame[0] & MODBUS_CAN_CHUNK_MASK;
+            if(chunk >= MODBUS_CAN_MAX_CHUNKS)
+                return MODBUS_CAN_REASSEMBLY_PENDING;
+            // a new transfer starts if the tag changes or a first chunk comes with other sequence counter
+            if(!input->active || (tag != input->tag) || ((chunk == 0) && input->total && (frame[1] != input->seq)))
+            {
+                if((input->active == 1) && input->map)
+                    modbus_stats.reassembly_aborts++; //the long frame in course is replaced before being complete
+                input->active = 1;
+                input->tag = tag;
+                input->map = 0;
+                input->total = 0;
+                input->chunks = 0;
+                input->nacks = 0;
+                input->index = 0;
+                // the transaction ID and priority of the transfer, the frames of other streams do not change them
+                input->txn = MODBUS_CAN_ID_TXN(RxObject.ulMsgID);
+                input->priority = MODBUS_CAN_ID_PRIORITY(RxObject.ulMsgID);
+#ifdef MODBUS_CAN_FLOW_CONTROL
+                input->flow = 0;
+                input->flow_pending = 0;
+#endif
+            }
+            else if(input->active == 2)
+            {
+                // chunk sent again of a transfer already completed
+                return MODBUS_CAN_REASSEMBLY_PENDING;
+            }
+            i = MODBUS_CAN_CHUNK_HEADER;
+            if(chunk == 0)
+            {
+                if(frame_length < MODBUS_CAN_FIRST_HEADER)
+                    return MODBUS_CAN_REASSEMBLY_PENDING;
+                input->seq = frame[1];
+                input->total = frame[2];
+                input->chunks = MODBUS_CAN_CHUNKS(input->total);
+                i = MODBUS_CAN_FIRST_HEADER;
+            }
+            else if((header == MODBUS_CAN_END_FRAME) && !input->total)
+            {
+                // first chunk lost, the end one tells how many chunks there are
+                input->chunks = chunk + 1;
+            }
+            offset = MODBUS_CAN_CHUNK_OFFSET(chunk);
+            if((offset + (frame_length - i)) > MAX_PDU)
+            {
+                // it does not fit in the PDU, the transfer is dropped
+                input->active = 0;
+                modbus_stats.reassembly_aborts++;
+                return MODBUS_CAN_REASSEMBLY_PENDING;
+            }
+            if(!(input->map & ((uint64_t)1 << chunk))) //duplicated chunks are ignored
+            {
+                input->index += frame_length - i;
+                for(; i < frame_length; i++)
+                {
+                    input->pdu[offset++] = frame[i];
+                }
+                input->map |= (uint64_t)1 << chunk;
+            }
+            if(input->total && (input->map == MODBUS_CAN_ALL_CHUNKS(input->chunks)))
+            {
+                input->active = 2; //completed, its chunks sent again are ignored
+                input->length = input->total;
+                return MODBUS_CAN_REASSEMBLY_DONE;
+            }
+            if(header == MODBUS_CAN_END_FRAME)
+                return MODBUS_CAN_REASSEMBLY_MISSING;
+            return MODBUS_CAN_REASSEMBLY_PENDING;
+}
+
+void Modbus_CAN_Nack(void)
+{
+        unsigned char i;
+        uint64_t missing;
+        unsigned char ctrl[MODBUS_CAN_NACK_LENGTH];
+            if(++input->nacks > MODBUS_CAN_NACK_RETRIES)
+            {
+                // the transfer is dropped, the timeout will make the request to be sent again
+                input->active = 0;
+                modbus_stats.reassembly_aborts++;
+                return;
+            }
+            missing = MODBUS_CAN_ALL_CHUNKS(input->chunks) & ~input->map;
+            ctrl[0] = MODBUS_CAN_CTRL;
+            ctrl[1] = MODBUS_CAN_CTRL_NACK;
+            ctrl[2] = input->tag;
+            for(i = 0; i < (MODBUS_CAN_NACK_LENGTH - 3); i++)
+            {
+                ctrl[3 + i] = (unsigned char)(missing >> (8 * i));
+            }
+            // 000 + slave, the master is waiting frames from this slave and transaction
+            Modbus_CAN_SendControl(MODBUS_CAN_ID(MODBUS_CAN_INDIVIDUAL_FRAME, 0, input->priority, input->txn, MODBUS_CAN_CTRL, slave), 
+                                   ctrl, MODBUS_CAN_NACK_LENGTH);
+#ifdef MODBUS_CAN_FLOW_CONTROL
+            // the chunks sent again come in blocks too
+            input->flow = 0;
+#endif
+}
+
+void Modbus_CAN_SendControl(unsigned long id, unsigned char *ctrl, unsigned char length)
+{
+        tCANMsgObject CtrlObject;
+            CtrlObject.ulMsgID = id;
+            CtrlObject.ulMsgIDMask = 0x000;
+            CtrlObject.ulFlags = MSG_OBJ_NO_FLAGS | MODBUS_CAN_ID_FLAGS | MODBUS_CAN_FD_FLAGS;
+            CtrlObject.ulMsgLen = length;
+            CtrlObject.pucMsgData = ctrl;
+            CANMessageSet(MODBUS_CAN, MODBUS_CAN_CTRL_OBJ, &CtrlObject, MSG_OBJ_TYPE_TX);
+            //it has no TXOK interruption, it is counted when it is loaded
+            modbus_stats.frames_sent++;
+            modbus_stats.bytes_sent += length;
+}
+
+void Modbus_CAN_Control(unsigned char *ctrl, unsigned char length)
+{
+        unsigned char i;
+        uint64_t missing;
+            if(length < 3)
+                return;
+            switch(ctrl[1])
+            {
+                case MODBUS_CAN_CTRL_NACK:
+                        // only the output long frame which is being sent can be retransmitted
+                        if(MODBUS_CAN_INDIVIDUAL(output_length) || (ctrl[2] != (output_seq & MODBUS_CAN_TAG_MASK)))
+                            break;
+                        missing = 0;
+                        for(i = 3; (i < length) && (i < MODBUS_CAN_NACK_LENGTH); i++)
+                        {
+                            missing |= (uint64_t)ctrl[i] << (8 * (i - 3));
+                        }
+                        // the end chunk is always sent again, so the receiver checks the transfer again
+                        missing |= (uint64_t)1 << (output_chunks - 1);
+                        output_map |= missing & MODBUS_CAN_ALL_CHUNKS(output_chunks);
+#ifdef MODBUS_CAN_FLOW_CONTROL
+                        output_block = output_block_size;
+#endif
+                        if(!output_busy)
+                            Modbus_CAN_TxRefill(MODBUS_CAN_TX_LAST_OBJ);
+                        break;
+#ifdef MODBUS_CAN_FLOW_CONTROL
+                case MODBUS_CAN_CTRL_FLOW:
+                        // only the long answer which waits for it
+                        if(!output_flow_wait || (length < MODBUS_CAN_FLOW_LENGTH) || (ctrl[2] != (output_seq & MODBUS_CAN_TAG_MASK)))
+                            break;
+                        TimerDisable(MODBUS_CAN_FLOW_TIMER, TIMER_A);
+                        TimerIntClear(MODBUS_CAN_FLOW_TIMER, TIMER_TIMA_TIMEOUT);
+                        output_flow_wait = 0;
+                        output_block_size = ctrl[3];
+                        output_block = ctrl[3];
+                        output_stmin = MODBUS_CAN_STMIN_CYCLES(ctrl[4]);
+                        // the first chunk of the block goes at once, the separation time is kept between the next ones
+                        Modbus_CAN_TxRefill(MODBUS_CAN_TX_LAST_OBJ);
+                        break;
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+                case MODBUS_CAN_CTRL_REFERENCE:
+                        // a new cycle: the window is timed from here, a window still waiting of the last cycle is lost
+                        if(!modbus_window.enabled)
+                            break;
+                        TimerDisable(MODBUS_CAN_WINDOW_TIMER, TIMER_A);
+                        TimerLoadSet(MODBUS_CAN_WINDOW_TIMER, TIMER_A, modbus_window.offset);
+                        TimerEnable(MODBUS_CAN_WINDOW_TIMER, TIMER_A);
+                        break;
+#endif
+                default: //unknown control frames are ignored
+                        break;
+            }
 }
 
 void Modbus_CAN_ReceptionConfiguration(void)
 {
+#ifdef MODBUS_CAN_PUBLISH
+        unsigned char block;
+#endif
         // It is required to receive unicast frames from Master (P/R = 1)+slave
         // and broadcast frames from Master (P/R = 1) + 0
-        int objNumber = 17;        
-        modbus_complete_reception = 0;
-       //RECEPTION MESSAGE OBJECT num.17 UNICAST num.18 BROADCAST              
-        RxObject.ulMsgID = (0x1 << 8) | slave; //xx1+ slave
-        RxObject.ulMsgIDMask = 0x1FF;
-        RxObject.ulFlags = MSG_OBJ_USE_ID_FILTER | MSG_OBJ_RX_INT_ENABLE;
-        RxObject.pucMsgData = &buffer_input_pdu[0];
-        CANMessageSet(MODBUS_CAN, objNumber, &RxObject, MSG_OBJ_TYPE_RX);
-        //MESSAGE OBJECT 18
-        objNumber = 18;
-        RxObject.ulMsgID = (0x1 << 8) | 0; //xx1+ slave=0 
-        CANMessageSet(MODBUS_CAN, objNumber, &RxObject, MSG_OBJ_TYPE_RX);
+       //RECEPTION FIFO num.17-24 UNICAST num.25-32 BROADCAST              
+        Modbus_CAN_RxFifo(MODBUS_CAN_RX_FIFO_FIRST, MODBUS_CAN_RX_FIFO_LAST, MODBUS_CAN_ID(0, 1, 0, 0, 0, slave)); //xx1+ slave
+        Modbus_CAN_RxFifo(MODBUS_CAN_RX_BROADCAST_FIRST, MODBUS_CAN_RX_BROADCAST_LAST, MODBUS_CAN_ID(0, 1, 0, 0, 0, 0)); //xx1+ slave=0
+#ifdef MODBUS_CAN_PUBLISH
+        //the auto-answer message objects are cleared too by a restart
+        for(block = 0; block < MODBUS_CAN_PUBLISH_BLOCKS; block++)
+        {
+            if(modbus_published_length[block])
+                Modbus_CAN_PublishObject(block);
+        }
+#endif
+}
+
+#ifdef MODBUS_CAN_PUBLISH
+void Modbus_CAN_Publish(unsigned char block, const unsigned char *data, unsigned char length)
+{
+        unsigned char i, changed;
+            if((block >= MODBUS_CAN_PUBLISH_BLOCKS) || (length > 8))
+                return;
+            changed = (length != modbus_published_length[block]);
+            for(i = 0; i < length; i++)
+            {
+                changed |= (modbus_published[block][i] != data[i]);
+                modbus_published[block][i] = data[i];
+            }
+            modbus_published_length[block] = length;
+            if(!changed)
+                return;
+            // the message objects are loaded from the interruptions too
+            Modbus_CAN_Lock();
+            if(!length)
+                CANMessageClear(MODBUS_CAN, MODBUS_CAN_PUBLISH_FIRST + block);
+            else
+                Modbus_CAN_PublishObject(block);
+            Modbus_CAN_Unlock();
+            if(!length)
+                return;
+            if(modbus_pushes[block].enabled && Modbus_CAN_Changed(block))
+                modbus_pushes[block].pending = 1;
+}
+
+void Modbus_CAN_ChangeOfState(unsigned char block, unsigned char enable, uint16_t deadband, unsigned long heartbeat)
+{
+            if(block >= MODBUS_CAN_PUBLISH_BLOCKS)
+                return;
+            modbus_pushes[block].deadband = deadband;
+            modbus_pushes[block].heartbeat = heartbeat;
+            modbus_pushes[block].pending = enable;
+            modbus_pushes[block].enabled = enable;
+}
+
+//! \brief Function to set the message object of a published block up.
+//!
+//! \param block The block, which has to be published.
+static void Modbus_CAN_PublishObject(unsigned char block)
+{
+        tCANMsgObject PublishObject;
+            // the exact ID, without interruptions: the CAN controller answers the remote frames alone
+            PublishObject.ulMsgID = MODBUS_CAN_PUBLISH_ID(block, slave);
+            PublishObject.ulMsgIDMask = 0;
+            PublishObject.ulFlags = MSG_OBJ_EXTENDED_ID;
+            PublishObject.ulMsgLen = modbus_published_length[block];
+            PublishObject.pucMsgData = modbus_published[block];
+            CANMessageSet(MODBUS_CAN, MODBUS_CAN_PUBLISH_FIRST + block, &PublishObject, MSG_OBJ_TYPE_RXTX_REMOTE);
+}
+
+//! \brief Function to compare a published block with the one sent last time in change of state mode.
+//!
+//! The block is compared by registers, in big endian; a change of the length always counts.
+//! \param block The block.
+//! \return 1 if some register changed more than the deadband of the block.
+static unsigned char Modbus_CAN_Changed(unsigned char block)
+{
+        unsigned char i;
+        uint16_t now, before;
+            for(i = 0; i < modbus_published_length[block]; i += 2)
+            {
+                now = ((uint16_t)modbus_published[block][i] << 8) | 
+                      (((i + 1) < modbus_published_length[block]) ? modbus_published[block][i + 1] : 0);
+                before = ((uint16_t)modbus_pushes[block].data[i] << 8) | modbus_pushes[block].data[i + 1];
+                if(((now > before) ? (now - before) : (before - now)) > modbus_pushes[block].deadband)
+                    return 1;
+            }
+            return 0;
+}
+
+//! \brief Function to send the published blocks in change of state mode.
+//!
+//! The first block which changed, or whose heartbeat expired, is sent through the control message object if it has no frame
+//! waiting; the rest wait for the next call. The interruptions of the CAN layer are disabled meanwhile, as the NACK frames and the
+//! transmit windows are sent from there.
+static void Modbus_CAN_PushCheck(void)
+{
+        unsigned char block, i;
+        unsigned long now = 0xFFFFFFFF - TimerValueGet(MODBUS_CAN_PUSH_TIMER, TIMER_A);
+        struct Modbus_CAN_Push *push;
+            for(block = 0; block < MODBUS_CAN_PUBLISH_BLOCKS; block++)
+            {
+                push = &modbus_pushes[block];
+                if(!push->enabled || !modbus_published_length[block])
+                    continue;
+                if(!push->pending && (!push->heartbeat || ((now - push->sent) < push->heartbeat)))
+                    continue;
+                Modbus_CAN_Lock();
+                if(CANStatusGet(MODBUS_CAN, CAN_STS_TXREQUEST) & (1UL << (MODBUS_CAN_CTRL_OBJ - 1)))
+                {
+                    Modbus_CAN_Unlock();
+                    return;
+                }
+                Modbus_CAN_SendControl(MODBUS_CAN_PUBLISH_ID(block, slave), modbus_published[block], modbus_published_length[block]);
+                Modbus_CAN_Unlock();
+                for(i = 0; i < modbus_published_length[block]; i++)
+                {
+                    push->data[i] = modbus_published[block][i];
+                }
+                push->sent = now;
+                push->pending = 0;
+                return;
+            }
+}
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+void Modbus_CAN_SetWindow(unsigned char block, unsigned char enable, unsigned long offset)
+{
+            if((block >= MODBUS_CAN_PUBLISH_BLOCKS) || (enable && !offset))
+                return;
+            TimerDisable(MODBUS_CAN_WINDOW_TIMER, TIMER_A);
+            modbus_window.block = block;
+            modbus_window.offset = offset;
+            modbus_window.enabled = enable;
+}
+
+void Modbus_CAN_WindowHandler(void)
+{
+        unsigned char block = modbus_window.block;
+            TimerIntClear(MODBUS_CAN_WINDOW_TIMER, TIMER_TIMA_TIMEOUT);
+            if(!modbus_window.enabled || !modbus_published_length[block])
+                return;
+            if(CANStatusGet(MODBUS_CAN, CAN_STS_TXREQUEST) & (1UL << (MODBUS_CAN_CTRL_OBJ - 1)))
+                modbus_window.missed++;
+            else
+            {
+                Modbus_CAN_SendControl(MODBUS_CAN_SCHEDULE_ID(block, slave), modbus_published[block], modbus_published_length[block]);
+                modbus_window.sent++;
+            }
+}
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+void Modbus_CAN_SetFlowControl(unsigned char block_size, unsigned char stmin)
+{
+            modbus_flow_bs = block_size;
+            modbus_flow_stmin = stmin;
+}
+
+void Modbus_CAN_FlowControl(unsigned char chunk)
+{
+            //the first chunk is answered at once, and then each block of chunks
+            if(chunk && (!modbus_flow_bs || (++input->flow < modbus_flow_bs)))
+                return;
+            input->flow = 0;
+            input->flow_pending = 1;
+            Modbus_CAN_FlowSend();
+}
+
+//! \brief Function to send the FLOW control frame of the unicast request, if the control message object is free.
+//!
+//! The control message object can still have a published block or a NACK waiting; then the FLOW frame is left pending for the
+//! next call. It is called from the CAN interruption, or from the main loop with the interruptions of the CAN layer disabled.
+static void Modbus_CAN_FlowSend(void)
+{
+        unsigned char ctrl[MODBUS_CAN_FLOW_LENGTH];
+        struct Modbus_CAN_Input *unicast = &modbus_inputs[MODBUS_CAN_UNICAST];
+            if(unicast->active != 1)
+            {
+                unicast->flow_pending = 0; //the request is not being reassembled anymore
+                return;
+            }
+            if(CANStatusGet(MODBUS_CAN, CAN_STS_TXREQUEST) & (1UL << (MODBUS_CAN_CTRL_OBJ - 1)))
+                return;
+            unicast->flow_pending = 0;
+            ctrl[0] = MODBUS_CAN_CTRL;
+            ctrl[1] = MODBUS_CAN_CTRL_FLOW;
+            ctrl[2] = unicast->tag;
+            ctrl[3] = modbus_flow_bs;
+            ctrl[4] = modbus_flow_stmin;
+            // as a NACK, the master is waiting frames from this slave and transaction
+            Modbus_CAN_SendControl(MODBUS_CAN_ID(MODBUS_CAN_INDIVIDUAL_FRAME, 0, unicast->priority, unicast->txn, MODBUS_CAN_CTRL, slave),
+                                   ctrl, MODBUS_CAN_FLOW_LENGTH);
+}
+
+void Modbus_CAN_FlowHandler(void)
+{
+            TimerIntClear(MODBUS_CAN_FLOW_TIMER, TIMER_TIMA_TIMEOUT);
+            if(output_flow_wait)
+            {
+                //the master did not allow the next block: the answer is dropped, the master will ask again
+                output_flow_wait = 0;
+                output_map = 0;
+                output_busy = 0;
+                modbus_stats.flow_timeouts++;
+            }
+            else if(output_map)
+                Modbus_CAN_TxRefill(MODBUS_CAN_TX_FIRST_OBJ);
 }
+#endif
 
 void Modbus_CAN_CallBack(void)
 {
-// I wait for xx1 | slave because the mask of the message object was 1FF;    
-    int i, numObj;
-    uint32_t new_data, mask;
-    numObj = 17;   
-    mask = 0x10000;
-    new_data = CANStatusGet(MODBUS_CAN, CAN_STS_NEWDAT);
-    if(modbus_broadcast)    
+// I wait for xx1 | slave because the mask of the message objects was 1FF;    
+    unsigned char obj;
+    uint32_t new_data;
+    //The FIFOs are drained in order, from the lowest message object, until no frame is left or the queue is full
+    while((modbus_complete_reception < MODBUS_CAN_QUEUE) && 
+          (new_data = (CANStatusGet(MODBUS_CAN, CAN_STS_NEWDAT) & MODBUS_CAN_RX_FIFO_BITS(MODBUS_CAN_RX_FIFO_FIRST, MODBUS_CAN_RX_BROADCAST_LAST))))
     {
-        numObj = 18;    
-        mask = 0x20000;
-    }
-    if(( (new_data & mask) >> (numObj-1) ) == 1)//is there new data?
-    {              
-        CANMessageGet(MODBUS_CAN, numObj, &RxObject, true);       
-        //header should be 001:
-        if( (RxObject.ulMsgID & 0x700) == 0x100) //Individual Frame
+        for(obj = MODBUS_CAN_RX_FIFO_FIRST; (obj <= MODBUS_CAN_RX_BROADCAST_LAST) && (modbus_complete_reception < MODBUS_CAN_QUEUE); obj++)
         {
-              modbus_complete_reception = 1; 
-              input_length = RxObject.ulMsgLen;
-              modbus_index = input_length;//not needed
-              for(i=0; i < RxObject.ulMsgLen; i++)
-              {
-                    input_pdu[i] = RxObject.pucMsgData[i];
-              }                                                                                          
-        }
-        //header should be 011:
-        else if( (RxObject.ulMsgID & 0x700) == 0x300) // Beginning Long Frame
-        {              
-              for(i=0; i < RxObject.ulMsgLen; i++)
-              {
-                    input_pdu[i] = RxObject.pucMsgData[i];
-              }              
-              modbus_index = RxObject.ulMsgLen;           
+            if(!(new_data & (1UL << (obj - 1))))
+                continue;
+            RxObject.pucMsgData = &buffer_input_pdu[0];
+            CANMessageGet(MODBUS_CAN, obj, &RxObject, true);       
+            modbus_stats.frames_received++;
+            modbus_stats.bytes_received += RxObject.ulMsgLen;
+            if(RxObject.ulFlags & MSG_OBJ_DATA_LOST)
+                modbus_stats.overruns++;
+            //each stream has its own reassembly, so a broadcast can arrive in the middle of a long unicast
+            input = &modbus_inputs[(obj >= MODBUS_CAN_RX_BROADCAST_FIRST) ? MODBUS_CAN_BROADCAST : MODBUS_CAN_UNICAST];
+            Modbus_CAN_Frame();
         }
-        else if( ( (RxObject.ulMsgID & 0x700) == 0x500) || ( (RxObject.ulMsgID & 0x700) == 0x700) )//CONTINUATION OR END OF LONG FRAME
-        {
-              for(i=0; i < RxObject.ulMsgLen; i++)
-              {
-                    input_pdu[modbus_index + i] = RxObject.pucMsgData[i];
-              }              
-              modbus_index += RxObject.ulMsgLen;              
-              if( (RxObject.ulMsgID & 0x700) == 0x700) // END LONG FRAME
-              {                  
-                  modbus_complete_reception = 1;  
-                  input_length = modbus_index;        
-              }
-        }                                  
-        else
-        {     // IT WAS EXPECTED A CONTINUATION OR AN END; IT SHOULD NOT ENTER HERE
-              Modbus_SetMainState(MODBUS_ERROR);
-        }        
     }
+}
+
+//! \brief Function to process a received frame.
+//!
+//! The frame in _RxObject_ is a request of the master; it is processed as it is explained in Modbus_CAN_CallBack().
+static void Modbus_CAN_Frame(void)
+{
+    unsigned int i;
+    //header should be 001:
+    if( (MODBUS_CAN_ID_TYPE(RxObject.ulMsgID) == MODBUS_CAN_INDIVIDUAL_FRAME) && MODBUS_CAN_ID_REQUEST(RxObject.ulMsgID)) //Individual Frame
+    {
+          if((RxObject.ulMsgLen > 1) && (RxObject.pucMsgData[0] == MODBUS_CAN_CTRL))
+          {
+                // function code 0 does not exist, so it is a control frame from the master
+                Modbus_CAN_Control(RxObject.pucMsgData, RxObject.ulMsgLen);
+                return;
+          }
+          // an individual frame ends the long frame in course, its chunk map must not complete it over the buffer swapped with the APP layer
+          if(input->active)
+          {
+                if((input->active == 1) && input->map)
+                    modbus_stats.reassembly_aborts++;
+                input->active = 0;
+                input->map = 0;
+          }
+          input->length = RxObject.ulMsgLen;
+          input->index = input->length;//not needed
+          // the transaction ID and priority are kept to be used in the answer
+          input->txn = MODBUS_CAN_ID_TXN(RxObject.ulMsgID);
+          input->priority = MODBUS_CAN_ID_PRIORITY(RxObject.ulMsgID);
+          for(i=0; i < RxObject.ulMsgLen; i++)
+          {
+                input->pdu[i] = RxObject.pucMsgData[i];
+          }                                                                                          
+          Modbus_CAN_Queue();
+    }
+    //BEGINNING, CONTINUATION OR END OF LONG FRAME
+    else if(MODBUS_CAN_ID_REQUEST(RxObject.ulMsgID))
+    {
+          switch(Modbus_CAN_Reassembly(MODBUS_CAN_ID_TYPE(RxObject.ulMsgID), RxObject.pucMsgData, RxObject.ulMsgLen))
+          {
+              case MODBUS_CAN_REASSEMBLY_DONE:
+                      Modbus_CAN_Queue();
+                      break;
+              case MODBUS_CAN_REASSEMBLY_MISSING:
+                      // END LONG FRAME, but some chunks were lost; broadcasts are never answered
+                      if(input == &modbus_inputs[MODBUS_CAN_UNICAST])
+                          Modbus_CAN_Nack();
+                      break;
+              default:
+#ifdef MODBUS_CAN_FLOW_CONTROL
+                      // a chunk of a long unicast request in course, the master may wait for the next block
+                      if((input == &modbus_inputs[MODBUS_CAN_UNICAST]) && RxObject.ulMsgLen && (input->active == 1))
+                          Modbus_CAN_FlowControl(RxObject.pucMsgData[0] & MODBUS_CAN_CHUNK_MASK);
+#endif
+                      break;
+          }
+    }                                  
     else
-    {   // IT WAS EXPECTED NEW DATA; IT SHOULD NOT ENTER HERE
-        Modbus_SetMainState(MODBUS_ERROR);
-    }    
+    {     // IT WAS EXPECTED A REQUEST; IT SHOULD NOT ENTER HERE
+          Modbus_SetMainState(MODBUS_ERROR);
+    }
+}
+
+//! \brief Function to queue the request of the reassembly context in course.
+//!
+//! The buffer of the request is exchanged with the free one of the queue entry, so the context can receive the next request
+//! meanwhile this one waits to be processed. There must be a free entry.
+static void Modbus_CAN_Queue(void)
+{
+    struct Modbus_CAN_Request *request;
+    unsigned char *pdu;
+        request = &modbus_queue[(modbus_queue_head + modbus_complete_reception) % MODBUS_CAN_QUEUE];
+        pdu = request->pdu;
+        request->pdu = input->pdu;
+        input->pdu = pdu;
+        request->length = input->length;
+        request->txn = input->txn;
+        request->priority = input->priority;
+        request->broadcast = (input == &modbus_inputs[MODBUS_CAN_BROADCAST]);
+        modbus_complete_reception++;
+}
+
+//! \brief Function to set up a receive FIFO.
+//!
+//! The message objects from _first_ to _last_ receive the requests with the ID _id_; all of them but the last one are chained, the
+//! last one is the end of the buffer.
+//! \param first First message object of the FIFO.
+//! \param last Last message object of the FIFO.
+//! \param id ID of the requests.
+static void Modbus_CAN_RxFifo(unsigned char first, unsigned char last, unsigned long id)
+{
+    unsigned char obj;
+        RxObject.ulMsgID = id;
+        RxObject.ulMsgIDMask = MODBUS_CAN_REQUEST_MASK;
+        RxObject.pucMsgData = &buffer_input_pdu[0];
+        for(obj = first; obj <= last; obj++)
+        {
+            RxObject.ulFlags = MSG_OBJ_USE_ID_FILTER | MSG_OBJ_RX_INT_ENABLE | MODBUS_CAN_FILTER_FLAGS;
+            if(obj < last)
+                RxObject.ulFlags |= MSG_OBJ_FIFO;
+            CANMessageSet(MODBUS_CAN, obj, &RxObject, MSG_OBJ_TYPE_RX);
+        }
 }
 
 unsigned char Modbus_CAN_Controller(void)
 {
+  switch(modbus_health.state)
+  {
+    case MODBUS_CAN_BUS_OFF:
+          //restart delay; the slave has nothing else to do while the bus is off
+          SysCtlDelay(modbus_restart_delay / 3);
+          Modbus_CAN_Restart();
+          return 0;
+    case MODBUS_CAN_BUS_RECOVERING:
+          return 0;
+    default:
+          break;
+  }
+#ifdef MODBUS_CAN_PUBLISH
+  Modbus_CAN_PushCheck();
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+  //a FLOW control frame which found the control message object busy
+  if(modbus_inputs[MODBUS_CAN_UNICAST].flow_pending)
+  {
+    Modbus_CAN_Lock();
+    Modbus_CAN_FlowSend();
+    Modbus_CAN_Unlock();
+  }
+#endif
   if(Modbus_GetMainState() == MODBUS_IDLE)
   {
     if(modbus_complete_reception)
     {            
-      Modbus_CAN_to_App();    
-      Modbus_SetMainState(MODBUS_CHECKING);
-      Modbus_App_Manage_Request();    
-      modbus_complete_reception = 0;
-      if(!modbus_broadcast) //it's not a broadcast request
+      if(Modbus_CAN_to_App()) //a group poll to other slaves is only dropped
       {
-        Modbus_SetMainState(MODBUS_REPLY);
-        Modbus_App_Send();
-      }                 
-      Modbus_SetMainState(MODBUS_IDLE);                        
+        Modbus_SetMainState(MODBUS_CHECKING);
+        Modbus_App_Manage_Request();    
+        if(!modbus_broadcast) //it's not a broadcast request
+        {
+          Modbus_SetMainState(MODBUS_REPLY);
+          Modbus_App_Send();
+        }                 
+#ifdef MODBUS_CAN_BROADCAST_ACK
+        else
+        {
+          //the master does not wait the whole turnaround
+          Modbus_CAN_Lock();
+          Modbus_CAN_BroadcastDone();
+          Modbus_CAN_Unlock();
+        }
+#endif
+      }
+      Modbus_SetMainState(MODBUS_IDLE);
+      //the request leaves the queue; the frames which did not fit are waiting in the FIFOs, without interrupt
+      Modbus_CAN_Lock();
+      modbus_queue_head = (modbus_queue_head + 1) % MODBUS_CAN_QUEUE;
+      modbus_complete_reception--;
+      Modbus_CAN_CallBack();
+      Modbus_CAN_Unlock();
       return 1;
     }
   }
@@ -363,6 +1100,21 @@ unsigned char Modbus_CAN_Controller(void)
   return 0;
 }
 
+#ifdef MODBUS_CAN_BROADCAST_ACK
+//! \brief Function to tell the master that a broadcast request was processed.
+//!
+//! The DONE control frame goes with the transaction ID and priority of the request, and its function code.
+static void Modbus_CAN_BroadcastDone(void)
+{
+    unsigned char ctrl[MODBUS_CAN_DONE_LENGTH];
+        ctrl[0] = MODBUS_CAN_CTRL;
+        ctrl[1] = MODBUS_CAN_CTRL_DONE;
+        ctrl[2] = modbus_function;
+        Modbus_CAN_SendControl(MODBUS_CAN_ID(MODBUS_CAN_INDIVIDUAL_FRAME, 0, modbus_priority, modbus_txn, MODBUS_CAN_CTRL, slave), 
+                               ctrl, MODBUS_CAN_DONE_LENGTH);
+}
+#endif
+
 void Modbus_CAN_Delay(void)
 {
     SysCtlDelay(modbus_delay);
@@ -373,63 +1125,179 @@ unsigned char Modbus_CAN_BroadCast_Get(void)
     return modbus_broadcast;
 }
 
-void Modbus_CAN_to_App(void)
+unsigned char Modbus_CAN_to_App(void)
 {	
-	int index;
-	Modbus_App_L_Msg_Set(input_length);
-	for(index = 0; index < input_length; index++)
+    struct Modbus_CAN_Request *request;
+	//the oldest request of the queue; the ISR only fills the entries after it
+	request = &modbus_queue[modbus_queue_head];
+	modbus_broadcast = request->broadcast;
+	modbus_txn = request->txn;
+	modbus_priority = request->priority;
+#ifdef MODBUS_CAN_BROADCAST_ACK
+	modbus_function = request->pdu[0];
+#endif
+	if(request->broadcast && (request->length == MODBUS_CAN_GROUP_LENGTH) && (request->pdu[0] == MODBUS_CAN_GROUP))
 	{
-		Modbus_App_Receive_Char(input_pdu[index], index);			
+	    //group poll: the slaves of the group answer the read inside as an unicast request, the answers are ordered by the arbitration
+	    if((slave < request->pdu[1]) || (slave > request->pdu[2]))
+	        return 0;
+	    modbus_broadcast = 0;
+	    request->pdu = Modbus_App_Msg_Swap(request->pdu, MODBUS_CAN_GROUP_HEADER, request->length - MODBUS_CAN_GROUP_HEADER);
+	    return 1;
 	}
+	//The buffer is handed over to APP, its previous one is kept by the entry for a next request
+	request->pdu = Modbus_App_Msg_Swap(request->pdu, 0, request->length);
+	return 1;
 }
 
-void Modbus_CAN_Error_Management(unsigned char error)
+void Modbus_CAN_BusStatus(unsigned long status)
 {
-      switch(error)
-      {             
-           case 110: while(1){} 
+      switch(modbus_health.state)
+      {
+           case MODBUS_CAN_BUS_OFF:
+                     //the CAN controller is stopped until the restart
+                     return;
+           case MODBUS_CAN_BUS_RECOVERING:
+                     //the recovery sequence also gives bit errors, it is not finished until the bus-off bit is cleared
+                     if(status & CAN_STATUS_BUS_OFF)
+                         return;
+                     modbus_health.recoveries++;
+                     modbus_health.state = MODBUS_CAN_BUS_ACTIVE;
                      break;
-           default: while(1){} 
+           default:
                      break;
       }
+      if(status & CAN_STATUS_BUS_OFF)
+      {
+           modbus_health.state = MODBUS_CAN_BUS_OFF;
+           modbus_health.bus_off++;
+           //the answer and the long requests in course are dropped, the master will ask again; the queued ones are answered after the restart
+           if(output_map || output_busy || (modbus_inputs[MODBUS_CAN_UNICAST].active == 1) || (modbus_inputs[MODBUS_CAN_BROADCAST].active == 1))
+               modbus_health.replays++;
+           output_map = 0;
+           output_busy = 0;
+           output_window = 0;
+           output_window_bytes = 0;
+#ifdef MODBUS_CAN_FLOW_CONTROL
+           output_flow_wait = 0;
+           TimerDisable(MODBUS_CAN_FLOW_TIMER, TIMER_A);
+#endif
+           modbus_inputs[MODBUS_CAN_UNICAST].active = 0;
+           modbus_inputs[MODBUS_CAN_BROADCAST].active = 0;
+           modbus_restart_delay = MODBUS_CAN_RESTART_DELAY << modbus_health.backoff;
+           if(modbus_health.backoff < MODBUS_CAN_BACKOFF_MAX)
+               modbus_health.backoff++;
+           return;
+      }
+      if(((status & CAN_STATUS_LEC_MSK) != CAN_STATUS_LEC_NONE) && ((status & CAN_STATUS_LEC_MSK) != CAN_STATUS_LEC_MSK))
+      {
+           modbus_health.frame_errors++;
+           modbus_stats.lec[status & CAN_STATUS_LEC_MSK]++;
+      }
+      if(status & CAN_STATUS_EPASS)
+      {
+           if(modbus_health.state != MODBUS_CAN_BUS_PASSIVE)
+               modbus_health.passive++;
+           modbus_health.state = MODBUS_CAN_BUS_PASSIVE;
+      }
+      else if(status & CAN_STATUS_EWARN)
+      {
+           if(modbus_health.state != MODBUS_CAN_BUS_WARNING)
+               modbus_health.warning++;
+           modbus_health.state = MODBUS_CAN_BUS_WARNING;
+      }
+      else
+           modbus_health.state = MODBUS_CAN_BUS_ACTIVE;
 }
 
-static inline void ledOn(void)
+void Modbus_CAN_Restart(void)
 {
-     GPIOPinWrite(GPIO_PORTF_BASE, GPIO_PIN_2 , GPIO_PIN_2);
+      modbus_health.restarts++;
+      Modbus_CAN_Lock();
+      Modbus_CAN_Setup();
+      //the recovery sequence starts when it is enabled
+      CANEnable(MODBUS_CAN);
+      //the message objects were cleared
+      Modbus_CAN_ReceptionConfiguration();
+      modbus_health.state = MODBUS_CAN_BUS_RECOVERING;
+      Modbus_CAN_Unlock();
 }
 
-static inline void ledOff(void)
+void Modbus_CAN_GetHealth(struct Modbus_CAN_Health *health)
 {
-    GPIOPinWrite(GPIO_PORTF_BASE, GPIO_PIN_2 , ~GPIO_PIN_2);
+      *health = modbus_health;
 }
 
+void Modbus_CAN_GetStats(struct Modbus_CAN_Stats *stats)
+{
+      Modbus_CAN_Lock();
+      *stats = modbus_stats;
+      Modbus_CAN_Unlock();
+}
 
-/*unsigned char Debug_Reception(void){
-        return modbus_complete_reception;
+//! \brief Function to keep the interruptions of the CAN layer out while the main loop loads message objects.
+//!
+//! The CAN interruption and the timer interruptions which load message objects or count the traffic are disabled: the timer of
+//! the transmit window and the flow control timer. They have the same priority, so they never interrupt each other.
+static void Modbus_CAN_Lock(void)
+{
+        IntDisable(INT_CAN0);
+#ifdef MODBUS_CAN_SCHEDULE
+        IntDisable(INT_TIMER1A);
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+        IntDisable(INT_TIMER2A);
+#endif
 }
 
-void reset_Reception(void){        
-        modbus_complete_reception = 0;        
+//! \brief Function to let the interruptions disabled by Modbus_CAN_Lock() in again.
+static void Modbus_CAN_Unlock(void)
+{
+#ifdef MODBUS_CAN_FLOW_CONTROL
+        IntEnable(INT_TIMER2A);
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+        IntEnable(INT_TIMER1A);
+#endif
+        IntEnable(INT_CAN0);
 }
 
-unsigned char Debug_Transmission(void){
-        return modbus_complete_transmission;
+//! \brief Function to set up the CAN module.
+//!
+//! The CAN module is initialised, so all the message objects are cleared, and the bit timing and the interruptions are set up.
+static void Modbus_CAN_Setup(void)
+{
+      //Init CAN Module
+      CANInit(MODBUS_CAN);
+      //Set bit timing
+      CANSetBitTiming(MODBUS_CAN, &modbus_canbit);                                       
+#ifdef MODBUS_CAN_FD
+      //Set bit timing of the data phase
+      CANDataBitTimingSet(MODBUS_CAN, &modbus_canbit_data);
+#endif
+      //ENABLING CAN INTERRUPTIONS                
+      CANIntEnable(MODBUS_CAN, CAN_INT_ERROR |CAN_INT_STATUS | CAN_INT_MASTER);        
 }
 
-unsigned char * getOutput()
+void Modbus_CAN_Error_Management(unsigned char error)
 {
-    return output_pdu;
+      switch(error)
+      {             
+           case 110: while(1){} 
+                     break;
+           default: while(1){} 
+                     break;
+      }
 }
 
-unsigned char * getInput()
+static inline void ledOn(void)
 {
-    return input_pdu;
+     GPIOPinWrite(GPIO_PORTF_BASE, GPIO_PIN_2 , GPIO_PIN_2);
 }
 
-unsigned char getbu(void)
+static inline void ledOff(void)
 {
-    return buu;
+    GPIOPinWrite(GPIO_PORTF_BASE, GPIO_PIN_2 , ~GPIO_PIN_2);
 }
-*/
+
 #endif
\ No newline at end of file
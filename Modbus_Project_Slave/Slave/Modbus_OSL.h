@@ -11,6 +11,17 @@
 //!Maximum PDU DATA OSL
 #define MAX_PDU 253
 
+#ifdef MODBUS_OSL_TX_INTERRUPT
+//! \brief Caracteres que quedan en la cola FIFO de transmisión de la UART al
+//! saltar su interrupción: 2 con UART_FIFO_TX1_8, ninguno sin cola FIFO
+//! (también con _MODBUS_OSL_RTU_FIFO_ hasta MODBUS_OSL_RTU_FIFO_CHAR_BAUD).
+#ifdef MODBUS_OSL_RTU_FIFO
+#define MODBUS_OSL_TX_LEVEL 2
+#else
+#define MODBUS_OSL_TX_LEVEL 0
+#endif
+#endif
+
 //! Baudrates implementados para las comunicaciones.
 enum Baud
 {
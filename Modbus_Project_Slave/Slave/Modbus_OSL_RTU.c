@@ -17,7 +17,9 @@
 #include "inc/hw_ints.h"
 #include "inc/hw_memmap.h"
 #include "inc/hw_types.h"
+#include "inc/hw_uart.h"
 #include "driverlib/interrupt.h"
+#include "driverlib/sysctl.h"
 #include "driverlib/uart.h"
 #include "driverlib/timer.h"
 #include "Modbus_OSL.h"                   
@@ -63,14 +65,34 @@ static uint16_t Timeout_35[6] = {
 static unsigned char Modbus_OSL_RTU_Msg1[256];
 //! Vector nº2 para almacenar los caracteres recibidos en una trama.
 static unsigned char Modbus_OSL_RTU_Msg2[256];
-//! Puntero para intercalar el vector que almacenará los caracteres recibidos.
+//! Puntero hacia el vector que almacenará los caracteres recibidos.
 static volatile unsigned char *Modbus_OSL_RTU_Msg;
-//! Puntero hacia el vector que contenga una trama completa.
+//! Puntero hacia el vector que contenga una trama completa. Se intercambia 
+//! con _Modbus_OSL_RTU_Msg_ al completar una trama y con el vector de App al
+//! entregársela.
 static volatile unsigned char *Modbus_OSL_RTU_Msg_Complete;
 //! Longitud del Mensaje que contiene una trama completa. Máximo 256 caracteres. 
 static volatile unsigned char Modbus_OSL_RTU_L_Msg;
 //! Indice de Recepción del mensaje entrante.
 static volatile uint16_t Modbus_OSL_RTU_Index;
+//! \brief CRC de los caracteres almacenados del mensaje entrante, que se
+//! calcula al recibirlos.
+static volatile uint16_t Modbus_OSL_RTU_CRC_Rx;
+//! \brief CRC del Mensaje con la trama completa, incluidos sus 2 caracteres
+//! de CRC; es 0 si la trama es correcta.
+static volatile uint16_t Modbus_OSL_RTU_CRC_Complete;
+//! \brief Nº de cuentas de la transmisión de un carácter (11 bits).
+static uint32_t Modbus_OSL_RTU_Timeout_Char;
+#ifdef MODBUS_OSL_RTU_FIFO
+//! \brief Nº de cuentas tras el último carácter recibido hasta que salta la
+//! interrupción por Timeout de recepción de la UART (32 bits).
+static uint32_t Modbus_OSL_RTU_Timeout_RT;
+//! \brief Instante, en cuentas del _Timer 3_, de la llegada del último
+//! carácter conocido del mensaje entrante.
+static uint32_t Modbus_OSL_RTU_Stamp;
+//! Caracteres que quedaron en la cola FIFO de recepción en la última ráfaga.
+static unsigned char Modbus_OSL_RTU_Left;
+#endif
 //! @}
 
 //*****************************************************************************
@@ -80,10 +102,12 @@ static volatile uint16_t Modbus_OSL_RTU_Index;
 //*****************************************************************************
 
 static void Modbus_OSL_RTU_Mount_CRC (unsigned char *mb_pdu,unsigned char L_pdu);
-static void Modbus_OSL_RTU_Check_CRC (volatile unsigned char *mb_pdu,
-                                      unsigned char L_pdu);
+static void Modbus_OSL_RTU_Check_CRC (void);
 static void Modbus_OSL_RTU_Set_Timeout_35 (uint32_t Baudrate);
 static void Modbus_OSL_RTU_Set_Timeout_15 (uint32_t Baudrate);
+#ifdef MODBUS_OSL_RTU_FIFO
+static uint32_t Modbus_OSL_RTU_Time (void);
+#endif
 
 //*****************************************************************************
 //! \defgroup RTU_CRC Tratamiento del CRC 
@@ -93,11 +117,43 @@ static void Modbus_OSL_RTU_Set_Timeout_15 (uint32_t Baudrate);
 //! Las siguientes funciones se encargan de montar el CRC para los mensajes
 //! de Salida y comprobarlo para los mensajes de entrada, siguiendo las  
 //! especificaciones y ejemplo de montaje del CRC de Modbus Over Serial Line.
+//!
+//! El cálculo se elige al compilar: por defecto, carácter a carácter con las
+//! tablas de la especificación (512 bytes en Flash); con
+//! _MODBUS_OSL_RTU_CRC_NIBBLE_, medio carácter por paso con una tabla de 16
+//! valores (32 bytes); con _MODBUS_OSL_RTU_CRC_SLICE4_ o
+//! _MODBUS_OSL_RTU_CRC_SLICE8_, 4 u 8 caracteres por vuelta con tantas tablas
+//! de 256 valores (2 o 4 KB de SRAM), cuyas consultas no dependen unas de
+//! otras salvo las dos primeras. Con _MODBUS_OSL_RTU_CRC_BENCH_ se mide en la
+//! placa el coste por carácter (_Modbus_OSL_RTU_CRC_Cycles_).
 //*****************************************************************************
 //! @{
 
+#if defined(MODBUS_OSL_RTU_CRC_SLICE4) || defined(MODBUS_OSL_RTU_CRC_SLICE8)
+#ifdef MODBUS_OSL_RTU_CRC_SLICE8
+//! Nº de tablas del CRC por rebanadas, y de caracteres tratados por vuelta.
+#define MODBUS_OSL_RTU_CRC_SLICES 8
+#else
+//! Nº de tablas del CRC por rebanadas, y de caracteres tratados por vuelta.
+#define MODBUS_OSL_RTU_CRC_SLICES 4
+#endif
+//! \brief Tablas del CRC por rebanadas.
+//!
+//! _Modbus_OSL_RTU_CRC_Table[k][i]_ es el CRC del carácter _i_ seguido de _k_
+//! caracteres a 0, partiendo de 0. Son demasiado grandes para escribirlas a
+//! mano, así que se calculan en _Modbus_OSL_RTU_CRC_Init_; en la SRAM se leen
+//! en un ciclo, aunque la Flash tenga estados de espera.
+static uint16_t Modbus_OSL_RTU_CRC_Table[MODBUS_OSL_RTU_CRC_SLICES][256];
+#elif defined(MODBUS_OSL_RTU_CRC_NIBBLE)
+//! \brief Tabla del CRC por medios caracteres: CRC de los 4 bits _i_.
+static const uint16_t Modbus_OSL_RTU_CRC_Nibble[16] = {
+0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401, 0xA001, 0x6C00,
+0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400
+};
+#else
+
 //! Tabla con los valores para el MSB del CRC.
-static unsigned char auchCRCHi[ ] = {
+static const unsigned char auchCRCHi[ ] = {
 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01,
@@ -119,7 +175,7 @@ static unsigned char auchCRCHi[ ] = {
 } ;
 
 //! Tabla con los valores para el LSB del CRC.
-static char auchCRCLo[ ] = {
+static const unsigned char auchCRCLo[ ] = {
 0x00, 0xC0, 0xC1, 0x01, 0xC3, 0x03, 0x02, 0xC2, 0xC6, 0x06, 0x07, 0xC7, 0x05, 0xC5, 0xC4,
 0x04, 0xCC, 0x0C, 0x0D, 0xCD, 0x0F, 0xCF, 0xCE, 0x0E, 0x0A, 0xCA, 0xCB, 0x0B, 0xC9, 0x09,
 0x08, 0xC8, 0xD8, 0x18, 0x19, 0xD9, 0x1B, 0xDB, 0xDA, 0x1A, 0x1E, 0xDE, 0xDF, 0x1F, 0xDD,
@@ -139,29 +195,139 @@ static char auchCRCLo[ ] = {
 0x44, 0x84, 0x85, 0x45, 0x87, 0x47, 0x46, 0x86, 0x82, 0x42, 0x43, 0x83, 0x41, 0x81, 0x80,
 0x40
 };
+#endif
 
-//! \brief Monta el CRC de un Vector.
+#ifdef MODBUS_OSL_RTU_CRC_BENCH
+//! Registro DEMCR del Cortex-M3; TRCENA (bit 24) habilita la unidad DWT.
+#define MODBUS_OSL_RTU_DEMCR      (*((volatile unsigned long *)0xE000EDFC))
+//! Registro DWT_CTRL; CYCCNTENA (bit 0) pone en marcha la cuenta de ciclos.
+#define MODBUS_OSL_RTU_DWT_CTRL   (*((volatile unsigned long *)0xE0001000))
+//! Registro DWT_CYCCNT, con los ciclos del procesador.
+#define MODBUS_OSL_RTU_DWT_CYCCNT (*((volatile unsigned long *)0xE0001004))
+#endif
+
+//! \brief Prepara las tablas del CRC.
 //!
-//! Con la ayuda de las tablas de valores _auchCRCLo[ ]_ y _auchCRCHi[ ]_
-//! monta al final de un vector el CRC correspondiente a los caracteres 
-//! del mismo. Basada en el ejemplo propuesto por la especificación.
-//! \param *mb_pdu  Puntero al inicio del vector con el mensaje
-//! \param L_pdu   Longitud del mensaje, sin CRC
-//! \sa auchCRCLo, auchCRCHi
-static void Modbus_OSL_RTU_Mount_CRC (unsigned char *mb_pdu,unsigned char L_pdu)
+//! Con _MODBUS_OSL_RTU_CRC_SLICE4_ o _MODBUS_OSL_RTU_CRC_SLICE8_ calcula bit
+//! a bit la primera tabla, la de un carácter, y de cada tabla la siguiente,
+//! que añade un carácter a 0. Con las demás opciones no hace nada.
+//! \sa Modbus_OSL_RTU_CRC_Table, Modbus_OSL_RTU_CRC
+void Modbus_OSL_RTU_CRC_Init (void)
 {
-  unsigned char uchCRCHi=0xFF, uchCRCLo=0xFF;
+#if defined(MODBUS_OSL_RTU_CRC_SLICE4) || defined(MODBUS_OSL_RTU_CRC_SLICE8)
+  uint16_t i, CRC;
+  unsigned char Bit, k;
+  
+  for (i=0;i<256;i++)
+  {
+    CRC=i;
+    for (Bit=0;Bit<8;Bit++)
+      CRC=(CRC & 0x0001) ? ((CRC>>1)^0xA001) : (CRC>>1);
+    Modbus_OSL_RTU_CRC_Table[0][i]=CRC;
+  }
+  for (k=1;k<MODBUS_OSL_RTU_CRC_SLICES;k++)
+  {
+    for (i=0;i<256;i++)
+    {
+      CRC=Modbus_OSL_RTU_CRC_Table[k-1][i];
+      Modbus_OSL_RTU_CRC_Table[k][i]=(CRC>>8)^
+                                      Modbus_OSL_RTU_CRC_Table[0][CRC & 0xFF];
+    }
+  }
+#endif
+}
+
+//! \brief Calcula el CRC de un Vector.
+//!
+//! Continúa el CRC _CRC_ (0xFFFF al principio de la trama) con los caracteres
+//! del vector, con el cálculo elegido al compilar. El byte bajo del resultado
+//! es el que se envía primero.
+//! \param CRC CRC de los caracteres anteriores
+//! \param *Msg Puntero al primer carácter
+//! \param L Nº de caracteres
+//! \return CRC hasta el último carácter
+//! \sa Modbus_OSL_RTU_CRC_Init, auchCRCLo, auchCRCHi
+uint16_t Modbus_OSL_RTU_CRC (uint16_t CRC, const unsigned char *Msg, uint16_t L)
+{
+#if defined(MODBUS_OSL_RTU_CRC_SLICE4) || defined(MODBUS_OSL_RTU_CRC_SLICE8)
+  const uint16_t (*Table)[256]=Modbus_OSL_RTU_CRC_Table;
+  
+  // Los 2 primeros caracteres se suman al CRC; los demás sólo se desplazan.
+  while (L>=MODBUS_OSL_RTU_CRC_SLICES)
+  {
+    CRC^=Msg[0]|(Msg[1]<<8);
+#ifdef MODBUS_OSL_RTU_CRC_SLICE8
+    CRC=Table[7][CRC & 0xFF]^Table[6][CRC>>8]^Table[5][Msg[2]]^
+        Table[4][Msg[3]]^Table[3][Msg[4]]^Table[2][Msg[5]]^
+        Table[1][Msg[6]]^Table[0][Msg[7]];
+#else
+    CRC=Table[3][CRC & 0xFF]^Table[2][CRC>>8]^Table[1][Msg[2]]^
+        Table[0][Msg[3]];
+#endif
+    Msg+=MODBUS_OSL_RTU_CRC_SLICES;
+    L-=MODBUS_OSL_RTU_CRC_SLICES;
+  }
+  while (L--)
+    CRC=(CRC>>8)^Table[0][(CRC^*Msg++) & 0xFF];
+#elif defined(MODBUS_OSL_RTU_CRC_NIBBLE)
+  while (L--)
+  {
+    CRC^=*Msg++;
+    CRC=(CRC>>4)^Modbus_OSL_RTU_CRC_Nibble[CRC & 0x0F];
+    CRC=(CRC>>4)^Modbus_OSL_RTU_CRC_Nibble[CRC & 0x0F];
+  }
+#else
+  unsigned char uchCRCHi=CRC>>8, uchCRCLo=CRC & 0xFF;
   unsigned uIndex;
   
-  while (L_pdu--) 
+  while (L--) 
   {
-    uIndex = uchCRCLo ^ *mb_pdu++ ; 
+    uIndex = uchCRCLo ^ *Msg++ ; 
     uchCRCLo = uchCRCHi ^ auchCRCHi[uIndex] ;
     uchCRCHi = auchCRCLo[uIndex] ;
   }
+  CRC=(uchCRCHi<<8)|uchCRCLo;
+#endif
+  return CRC;
+}
+
+#ifdef MODBUS_OSL_RTU_CRC_BENCH
+//! \brief Mide en la placa el coste del CRC.
+//!
+//! Calcula con las interrupciones desactivadas el CRC de los 256 caracteres
+//! de _Modbus_OSL_RTU_Msg1_ y cuenta los ciclos con el contador de la unidad
+//! DWT del Cortex-M3, que se pone en marcha si hace falta.
+//! \return Ciclos por carácter, multiplicados por 100
+//! \sa Modbus_OSL_RTU_CRC
+unsigned long Modbus_OSL_RTU_CRC_Cycles (void)
+{
+  volatile uint16_t CRC;
+  unsigned long Start, Cycles;
   
-  mb_pdu[0]=uchCRCLo;
-  mb_pdu[1]=uchCRCHi;
+  MODBUS_OSL_RTU_DEMCR |= 0x01000000;
+  MODBUS_OSL_RTU_DWT_CTRL |= 0x00000001;
+  IntMasterDisable();
+  Start=MODBUS_OSL_RTU_DWT_CYCCNT;
+  CRC=Modbus_OSL_RTU_CRC(0xFFFF,Modbus_OSL_RTU_Msg1,256);
+  Cycles=MODBUS_OSL_RTU_DWT_CYCCNT-Start;
+  IntMasterEnable();
+  return (Cycles*100)/256;
+}
+#endif
+
+//! \brief Monta el CRC de un Vector.
+//!
+//! Con _Modbus_OSL_RTU_CRC_ monta al final de un vector el CRC
+//! correspondiente a los caracteres del mismo, el byte bajo primero.
+//! \param *mb_pdu  Puntero al inicio del vector con el mensaje
+//! \param L_pdu   Longitud del mensaje, sin CRC
+//! \sa Modbus_OSL_RTU_CRC
+static void Modbus_OSL_RTU_Mount_CRC (unsigned char *mb_pdu,unsigned char L_pdu)
+{
+  uint16_t CRC=Modbus_OSL_RTU_CRC(0xFFFF,mb_pdu,L_pdu);
+  
+  mb_pdu[L_pdu]=CRC & 0xFF;
+  mb_pdu[L_pdu+1]=CRC>>8;
 }
 
 //! \brief Función para que el Módulo OSL monte el mensaje.
@@ -186,31 +352,17 @@ void Modbus_OSL_RTU_Mount_ADU (unsigned char *mb_pdu,unsigned char Slave,
   Modbus_OSL_RTU_Mount_CRC (mb_adu,L_pdu+1);
 }
 
-//! \brief Comprueba la corrección del CRC de un Vector.
+//! \brief Comprueba la corrección del CRC del Mensaje Entrante completo.
 //!
-//! Con la ayuda de las tablas de valores _auchCRCLo[ ]_ y _auchCRCHi[ ]_ 
-//! calcula el CRC correspondiente a los caracteres del vector y comprueba 
-//! si se corresponden con el CRC del mensaje entrante completo. En caso 
-//! afirmativo Marca la trama como OK, en caso negativo como NOK.
-//! Basada en el ejemplo propuesto por la especificación.
-//! \param *mb_pdu  Puntero al inicio del vector con el mensaje
-//! \param L_pdu   Longitud del mensaje, sin CRC
-//! \sa auchCRCLo, auchCRCHi, Modbus_OSL_Frame_Set
-static void Modbus_OSL_RTU_Check_CRC (volatile unsigned char *mb_pdu,
-                                      unsigned char L_pdu)
+//! El CRC de la trama se ha ido calculando al recibir sus caracteres, incluidos
+//! los 2 últimos, que son el propio CRC con el byte bajo primero; con ellos el
+//! CRC de una trama correcta es 0, así que basta compararlo, sin recorrer el
+//! mensaje. En caso afirmativo Marca la trama como OK, en caso negativo como
+//! NOK.
+//! \sa Modbus_OSL_RTU_CRC_Complete, Modbus_OSL_Frame_Set
+static void Modbus_OSL_RTU_Check_CRC (void)
 {
-  unsigned char uchCRCHi=0xFF,uchCRCLo=0xFF; 
-  unsigned uIndex;  
-  
-  while (L_pdu--) 
-  {
-    uIndex = uchCRCLo ^ *mb_pdu++ ; 
-    uchCRCLo = uchCRCHi ^ auchCRCHi[uIndex] ;  
-    uchCRCHi = auchCRCLo[uIndex] ;
-  }
-  
-  if(Modbus_OSL_RTU_Msg_Complete[Modbus_OSL_RTU_L_Msg-1]==uchCRCHi &&
-     Modbus_OSL_RTU_Msg_Complete[Modbus_OSL_RTU_L_Msg-2]==uchCRCLo)
+  if(Modbus_OSL_RTU_L_Msg>=2 && Modbus_OSL_RTU_CRC_Complete==0)
         Modbus_OSL_Frame_Set(MODBUS_OSL_Frame_OK);
   else
         Modbus_OSL_Frame_Set(MODBUS_OSL_Frame_NOK);
@@ -225,8 +377,7 @@ static void Modbus_OSL_RTU_Check_CRC (volatile unsigned char *mb_pdu,
 //! \sa Modbus_OSL_RTU_Check_CRC, Modbus_OSL_Frame_Get
 unsigned char Modbus_OSL_RTU_Control_CRC(void)
 {
-  // Modbus_OSL_RTU_L_Msg-2 debido a que los 2 últimos char son el propio CRC.
-  Modbus_OSL_RTU_Check_CRC(Modbus_OSL_RTU_Msg_Complete,Modbus_OSL_RTU_L_Msg-2);
+  Modbus_OSL_RTU_Check_CRC();
   
   if(Modbus_OSL_Frame_Get()==MODBUS_OSL_Frame_OK)
       return 1;
@@ -331,20 +482,25 @@ static void Modbus_OSL_RTU_Set_Timeout_35 (uint32_t Baudrate)
 //! Establece el puntero de mensajes, el estado RTU al estado inicial y el
 //! índice y longitud a 0. Configura dos Timers para habilitar interrupciones,
 //! el _Timer 0_ para 3,5T y el _Timer 1_ para 1,5T. Finalmente activa el
-//! _Timer 0_ para iniciar el diagrama de estados de RTU.
+//! _Timer 0_ para iniciar el diagrama de estados de RTU. Prepara también las
+//! tablas del CRC.
 //! \sa Modbus_OSL_RTU_L_Msg, Modbus_OSL_RTU_Index, Modbus_OSL_RTU_Msg
-//! \sa Modbus_OSL_RTU_Msg1, Modbus_OSL_State
+//! \sa Modbus_OSL_RTU_Msg1, Modbus_OSL_State, Modbus_OSL_RTU_CRC_Init
 void Modbus_OSL_RTU_Init (void) 
 { 
   // Valores iniciales de las variables.
   Modbus_OSL_RTU_L_Msg=0;
   Modbus_OSL_RTU_Index=0;
+  Modbus_OSL_RTU_CRC_Rx=0xFFFF;
   Modbus_OSL_RTU_Msg=Modbus_OSL_RTU_Msg1;
+  Modbus_OSL_RTU_Msg_Complete=Modbus_OSL_RTU_Msg2;
+  Modbus_OSL_RTU_CRC_Init();
     
   // Configura el Estado y las Interrupciones de los Timers.
   Modbus_OSL_State_Set(MODBUS_OSL_RTU_INITIAL); 
   Modbus_OSL_RTU_Set_Timeout_15 (Modbus_OSL_Get_Baudrate());
   Modbus_OSL_RTU_Set_Timeout_35 (Modbus_OSL_Get_Baudrate());
+  Modbus_OSL_RTU_Timeout_Char=11*(SysCtlClockGet()/Modbus_OSL_Get_Baudrate());
     
   // Activa los periféricos correspondientes.
   SysCtlPeripheralEnable(SYSCTL_PERIPH_TIMER0);
@@ -362,10 +518,33 @@ void Modbus_OSL_RTU_Init (void)
   TimerIntEnable(TIMER0_BASE, TIMER_TIMA_TIMEOUT);
   TimerIntEnable(TIMER1_BASE, TIMER_TIMA_TIMEOUT);
    
+#ifdef MODBUS_OSL_RTU_FIFO
+  // Los tiempos se miden desde el final de cada carácter con el _Timer 3_,
+  // que cuenta sin parar, ya que la UART no interrumpe por carácter.
+  Modbus_OSL_RTU_Timeout_RT=32*(SysCtlClockGet()/Modbus_OSL_Get_Baudrate());
+  SysCtlPeripheralEnable(SYSCTL_PERIPH_TIMER3);
+  TimerConfigure(TIMER3_BASE, TIMER_CFG_32_BIT_PER);
+  TimerLoadSet(TIMER3_BASE, TIMER_A, 0xFFFFFFFF);
+  TimerEnable(TIMER3_BASE, TIMER_A);
+#endif
+
   // Activa el timer de 3,5T.
   TimerEnable(TIMER0_BASE, TIMER_A);
 }
 
+#ifdef MODBUS_OSL_RTU_FIFO
+//! \brief Devuelve el instante actual en cuentas del _Timer 3_.
+//!
+//! El _Timer 3_ cuenta hacia abajo desde 0xFFFFFFFF, así que el complemento
+//! de su cuenta crece con el tiempo; las diferencias entre instantes son
+//! correctas aunque la cuenta dé la vuelta.
+//! \return Instante actual
+static uint32_t Modbus_OSL_RTU_Time (void)
+{
+  return ~TimerValueGet(TIMER3_BASE, TIMER_A);
+}
+#endif
+
 //! \brief Función para la interrupción de 1,5T.
 //!
 //! Las interrupciones de 1,5T y 3,5T se utilizan en el diagrama de estados RTU
@@ -380,6 +559,12 @@ void Modbus_OSL_RTU_15T (void)
   switch (Modbus_OSL_State_Get())
   {
     case MODBUS_OSL_RTU_RECEPTION:    
+#ifdef MODBUS_OSL_RTU_FIFO
+      // Los caracteres que esperan en la cola FIFO han llegado antes de 1,5T,
+      // la trama continúa y las interrupciones de la UART los recogerán.
+      if(UARTCharsAvail(UART1_BASE))
+        break;
+#endif
       Modbus_OSL_State_Set (MODBUS_OSL_RTU_CONTROLANDWAITING);
       TimerLoadSet(TIMER1_BASE, TIMER_A, Modbus_OSL_RTU_Timeout_15);
       break;
@@ -402,8 +587,9 @@ void Modbus_OSL_RTU_15T (void)
 //! >     paridad, exceso de caracteres o Timeout de Respuesta (Master), activa
 //! >     el flag de Trama completa mediante _Modbus_OSL_Reception_Complete_ y
 //! >     apunta _Modbus_OSL_RTU_Msg_Complete_ hacia el mensaje; almacenando la
-//! >     longitud en  _Modbus_OSL_RTU_L_Msg_; el puntero _Modbus_OSL_RTU_Msg_
-//! >     cambia el vector al que apunta para recibir nuevos mensajes. En caso
+//! >     longitud en  _Modbus_OSL_RTU_L_Msg_ y su CRC en
+//! >     _Modbus_OSL_RTU_CRC_Complete_; el puntero _Modbus_OSL_RTU_Msg_
+//! >     pasa al vector libre para recibir nuevos mensajes. En caso
 //! >     contrario el mensaje se descarta. Se reinician las variables para 
 //! >     poder recibir un nuevo mensaje, y se vuelve a MODBUS_OSL_RTU_IDLE.
 //! > - __MODBUS_OSL_RTU_EMISSION__: Vuelve a MODBUS_OSL_RTU_IDLE.
@@ -412,6 +598,7 @@ void Modbus_OSL_RTU_15T (void)
 //! \sa Modbus_OSL_State, Modbus_OSL_MainState, Modbus_OSL_Reception_Complete
 void Modbus_OSL_RTU_35T (void) 
 {
+  volatile unsigned char *Modbus_OSL_RTU_Free;
   switch (Modbus_OSL_State_Get())
   {
       
@@ -426,25 +613,32 @@ void Modbus_OSL_RTU_35T (void)
       // Comprobar Trama (paridad, timeout respuesta en master)
       // Configurar/Resetear Variables; Recargar Timer0 y volver a IDLE.
       IntDisable(INT_UART1);
+#ifdef MODBUS_OSL_RTU_FIFO
+      // Caracteres llegados tras 1,5T que aún no han hecho saltar la
+      // interrupción de la UART: se descartan y la trama es NOK.
+      if(UARTCharsAvail(UART1_BASE))
+      {
+        Modbus_OSL_Frame_Set(MODBUS_OSL_Frame_NOK);
+        while(UARTCharsAvail(UART1_BASE))
+          UARTCharGetNonBlocking(UART1_BASE);
+      }
+#endif
       if(Modbus_OSL_Frame_Get()==MODBUS_OSL_Frame_OK  &&
          Modbus_OSL_MainState_Get()!=MODBUS_OSL_ERROR)
       {
-        if(Modbus_OSL_RTU_Msg==Modbus_OSL_RTU_Msg1)
-        {
-          Modbus_OSL_RTU_Msg=Modbus_OSL_RTU_Msg2;
-          Modbus_OSL_RTU_Msg_Complete=Modbus_OSL_RTU_Msg1;     
-        }      
-        else
-        {
-          Modbus_OSL_RTU_Msg=Modbus_OSL_RTU_Msg1;        
-          Modbus_OSL_RTU_Msg_Complete=Modbus_OSL_RTU_Msg2;
-        }
+        // Los vectores pueden haberse intercambiado con App, así que se 
+        // intercambian los punteros en lugar de compararlos con Msg1 y Msg2.
+        Modbus_OSL_RTU_Free=Modbus_OSL_RTU_Msg_Complete;
+        Modbus_OSL_RTU_Msg_Complete=Modbus_OSL_RTU_Msg;     
+        Modbus_OSL_RTU_Msg=Modbus_OSL_RTU_Free;
               
         Modbus_OSL_RTU_L_Msg=Modbus_OSL_RTU_Index;
+        Modbus_OSL_RTU_CRC_Complete=Modbus_OSL_RTU_CRC_Rx;
         Modbus_OSL_Reception_Complete();    
       }  
       Modbus_OSL_Frame_Set(MODBUS_OSL_Frame_OK);
       Modbus_OSL_RTU_Index=0;
+      Modbus_OSL_RTU_CRC_Rx=0xFFFF;
       Modbus_OSL_State_Set (MODBUS_OSL_RTU_IDLE);
       IntEnable(INT_UART1);
       TimerLoadSet(TIMER0_BASE, TIMER_A, Modbus_OSL_RTU_Timeout_35);
@@ -462,6 +656,20 @@ void Modbus_OSL_RTU_35T (void)
   }
 }
 
+//! \brief Arranca 3,5T al final de una Emisión.
+//!
+//! Carga el _Timer 0_ para que desborde 3,5T después del bit de stop del
+//! último carácter enviado, que acabará tras _Chars_ caracteres, y lo activa;
+//! al desbordar, _Modbus_OSL_RTU_35T_ vuelve a MODBUS_OSL_RTU_IDLE.
+//! \param Chars Caracteres que aún están saliendo por la UART.
+//! \sa Modbus_OSL_RTU_Timeout_35, Modbus_OSL_RTU_Timeout_Char
+void Modbus_OSL_RTU_Emission_End (unsigned char Chars)
+{
+  TimerLoadSet(TIMER0_BASE, TIMER_A, Modbus_OSL_RTU_Timeout_35+
+                                     Chars*Modbus_OSL_RTU_Timeout_Char);
+  TimerEnable(TIMER0_BASE, TIMER_A);
+}
+
 //! \brief Función para la interrupción por Recepción en modo RTU.
 //!
 //! Segun el estado en que se encuentre el programa en el momento de recibir
@@ -479,10 +687,15 @@ void Modbus_OSL_RTU_35T (void)
 //! >     la trama como NOK
 //! > - __MODBUS_OSL_RTU_EMISSION__: No se debería recibir en este estado; por 
 //! >     mera cuestión de robustez en la programación se descarta el carácter.
+//!
+//! Cada carácter almacenado se añade al CRC del mensaje entrante, de modo que
+//! al completarse la trama sólo queda compararlo.
 //! \sa Modbus_OSL_RTU_Msg, Modbus_OSL_RTU_Index, Modbus_OSL_State 
-//! \sa Modbus_OSL_Frame_Set, Modbus_OSL_Frame 
+//! \sa Modbus_OSL_Frame_Set, Modbus_OSL_Frame, Modbus_OSL_RTU_CRC_Rx
 void Modbus_OSL_RTU_UART(void)
 {
+  unsigned char Char;
+  
   switch (Modbus_OSL_State_Get())
   {         
     case MODBUS_OSL_RTU_INITIAL:    
@@ -493,7 +706,9 @@ void Modbus_OSL_RTU_UART(void)
                 
     case MODBUS_OSL_RTU_IDLE:
       //Debug_OSL_RTU_Idle++;
-      Modbus_OSL_RTU_Msg[Modbus_OSL_RTU_Index]=UARTCharGetNonBlocking(UART1_BASE);
+      Char=UARTCharGetNonBlocking(UART1_BASE);
+      Modbus_OSL_RTU_Msg[Modbus_OSL_RTU_Index]=Char;
+      Modbus_OSL_RTU_CRC_Rx=Modbus_OSL_RTU_CRC(Modbus_OSL_RTU_CRC_Rx,&Char,1);
       IntDisable(INT_TIMER1A);
       IntDisable(INT_TIMER0A);
       TimerEnable(TIMER1_BASE, TIMER_A);
@@ -508,9 +723,17 @@ void Modbus_OSL_RTU_UART(void)
       //Debug_OSL_RTU_Reception++;
       
       if(Modbus_OSL_RTU_Index>255)
+      {
           Modbus_OSL_Frame_Set(MODBUS_OSL_Frame_NOK);
-  
-      Modbus_OSL_RTU_Msg[Modbus_OSL_RTU_Index]=UARTCharGetNonBlocking(UART1_BASE);
+          UARTCharGetNonBlocking(UART1_BASE);
+      }
+      else
+      {
+          Char=UARTCharGetNonBlocking(UART1_BASE);
+          Modbus_OSL_RTU_Msg[Modbus_OSL_RTU_Index]=Char;
+          Modbus_OSL_RTU_CRC_Rx=Modbus_OSL_RTU_CRC(Modbus_OSL_RTU_CRC_Rx,
+                                                   &Char,1);
+      }
       TimerLoadSet(TIMER0_BASE, TIMER_A, Modbus_OSL_RTU_Timeout_35);
       TimerLoadSet(TIMER1_BASE, TIMER_A, Modbus_OSL_RTU_Timeout_15);
       Modbus_OSL_RTU_Index++;
@@ -528,6 +751,108 @@ void Modbus_OSL_RTU_UART(void)
       break;
   }
 }
+#ifdef MODBUS_OSL_RTU_FIFO
+//! \brief Función para la interrupción de Recepción con la cola FIFO.
+//!
+//! Por encima de MODBUS_OSL_RTU_FIFO_CHAR_BAUD la cola FIFO de la UART está
+//! habilitada y la interrupción no salta por cada carácter, sino al llegar a
+//! 12 caracteres, leyéndose entonces _MODBUS_OSL_RTU_FIFO_BURST_, o por
+//! Timeout de recepción, 32 bits después del último carácter si la cola no
+//! está vacía, leyéndose entera. Como siempre queda un carácter tras una
+//! ráfaga, el final de cada trama se detecta por Timeout de recepción, y desde
+//! él se cuentan el resto de 1,5T y de 3,5T con los _Timer 1_ y _Timer 0_.
+//!
+//! El Timeout de recepción dura menos que 1,5T, así que un silencio de más de
+//! 1,5T siempre acaba la ráfaga y lleva a _MODBUS_OSL_RTU_CONTROLANDWAITING_.
+//! Además, si los caracteres llegados desde la ráfaga anterior tardan más de
+//! (T + 1,5T) cada uno, la trama se marca como NOK. Los caracteres con errores de
+//! paridad, de trama o desbordamiento de la cola también la marcan como NOK.
+//! Los caracteres almacenados de cada ráfaga se añaden de una vez al CRC del
+//! mensaje entrante. Por lo demás se siguen las acciones de
+//! _Modbus_OSL_RTU_UART_ en cada estado.
+//! \param Timeout 1 si la interrupción es por Timeout de recepción
+//! \sa Modbus_OSL_RTU_UART, Modbus_OSL_RTU_Stamp, Modbus_OSL_RTU_Left
+//! \sa Modbus_OSL_RTU_Timeout_RT, Modbus_OSL_RTU_15T, Modbus_OSL_RTU_35T
+void Modbus_OSL_RTU_UART_FIFO(unsigned char Timeout)
+{
+  enum Modbus_OSL_States State=Modbus_OSL_State_Get();
+  uint32_t Arrival;
+  long Char;
+  unsigned char Read=0, Left=Timeout ? 0 : 1;
+  uint16_t First=Modbus_OSL_RTU_Index, Last;
+  int Arrived;
+
+  // Instante de llegada del último carácter de la cola.
+  Arrival=Modbus_OSL_RTU_Time();
+  if(Timeout)
+    Arrival-=Modbus_OSL_RTU_Timeout_RT;
+
+  while((Timeout || Read<MODBUS_OSL_RTU_FIFO_BURST) &&
+        (Char=UARTCharGetNonBlocking(UART1_BASE))!=-1)
+  {
+    Read++;
+    if(State!=MODBUS_OSL_RTU_IDLE && State!=MODBUS_OSL_RTU_RECEPTION)
+      continue;
+    if(Char & (UART_DR_OE | UART_DR_BE | UART_DR_PE | UART_DR_FE))
+      Modbus_OSL_Frame_Set(MODBUS_OSL_Frame_NOK);
+    if(Modbus_OSL_RTU_Index>255)
+      Modbus_OSL_Frame_Set(MODBUS_OSL_Frame_NOK);
+    else
+      Modbus_OSL_RTU_Msg[Modbus_OSL_RTU_Index]=Char;
+    Modbus_OSL_RTU_Index++;
+  }
+  
+  // CRC de los caracteres de la ráfaga que caben en el mensaje.
+  Last=Modbus_OSL_RTU_Index>256 ? 256 : Modbus_OSL_RTU_Index;
+  if(Last>First)
+    Modbus_OSL_RTU_CRC_Rx=Modbus_OSL_RTU_CRC(Modbus_OSL_RTU_CRC_Rx,
+                          (const unsigned char *)&Modbus_OSL_RTU_Msg[First],
+                          Last-First);
+
+  switch (State)
+  {
+    case MODBUS_OSL_RTU_INITIAL:
+      TimerLoadSet(TIMER0_BASE, TIMER_A, Modbus_OSL_RTU_Timeout_35);
+      break;
+
+    case MODBUS_OSL_RTU_IDLE:
+    case MODBUS_OSL_RTU_RECEPTION:
+      TimerDisable(TIMER1_BASE, TIMER_A);
+      TimerDisable(TIMER0_BASE, TIMER_A);
+      Arrived=Read+Left-Modbus_OSL_RTU_Left;
+      if(State==MODBUS_OSL_RTU_RECEPTION && Arrived>0 &&
+         Arrival-Modbus_OSL_RTU_Stamp > Arrived*(Modbus_OSL_RTU_Timeout_Char+
+                                                 Modbus_OSL_RTU_Timeout_15))
+        Modbus_OSL_Frame_Set(MODBUS_OSL_Frame_NOK);
+      Modbus_OSL_RTU_Stamp=Arrival;
+      Modbus_OSL_RTU_Left=Left;
+      Modbus_OSL_State_Set (MODBUS_OSL_RTU_RECEPTION);
+      if(Timeout)
+      {
+        // Fin de la ráfaga: quedan 1,5T y 3,5T menos el Timeout de recepción.
+        if(Modbus_OSL_RTU_Timeout_RT>=Modbus_OSL_RTU_Timeout_15)
+          Modbus_OSL_State_Set (MODBUS_OSL_RTU_CONTROLANDWAITING);
+        else
+        {
+          TimerLoadSet(TIMER1_BASE, TIMER_A,
+                       Modbus_OSL_RTU_Timeout_15-Modbus_OSL_RTU_Timeout_RT);
+          TimerEnable(TIMER1_BASE, TIMER_A);
+        }
+        TimerLoadSet(TIMER0_BASE, TIMER_A,
+                     Modbus_OSL_RTU_Timeout_35-Modbus_OSL_RTU_Timeout_RT);
+        TimerEnable(TIMER0_BASE, TIMER_A);
+      }
+      break;
+
+    case MODBUS_OSL_RTU_CONTROLANDWAITING:
+      Modbus_OSL_Frame_Set(MODBUS_OSL_Frame_NOK);
+      break;
+
+    default:
+      break;
+  }
+}
+#endif
 //! @}
 
 //*****************************************************************************
@@ -574,5 +899,27 @@ unsigned char Modbus_OSL_RTU_L_Msg_Get(void)
 {
   return Modbus_OSL_RTU_L_Msg-2;
 }
+
+//! \brief Devuelve el vector del Mensaje Entrante completo para OSL.
+//!
+//! Permite a OSL entregar a App el mensaje entrante completo sin copiarlo.
+//! \return Modbus_OSL_RTU_Msg_Complete Vector con la Trama entrante completa
+//! \sa Modbus_OSL_RTU_Msg_Complete, Modbus_OSL_RTU_Msg_Set
+unsigned char *Modbus_OSL_RTU_Msg_Get(void)
+{
+  return (unsigned char *)Modbus_OSL_RTU_Msg_Complete;
+}
+
+//! \brief Cambia el vector del Mensaje Entrante completo.
+//!
+//! Permite a OSL devolver el vector que App tenía tras entregarle el mensaje
+//! entrante completo; se utilizará para recibir una de las siguientes tramas.
+//! Debe tener 256 caracteres, como _Modbus_OSL_RTU_Msg1_.
+//! \param Msg Vector que sustituye al de la Trama entrante completa
+//! \sa Modbus_OSL_RTU_Msg_Complete, Modbus_OSL_RTU_Msg_Get
+void Modbus_OSL_RTU_Msg_Set(unsigned char *Msg)
+{
+  Modbus_OSL_RTU_Msg_Complete=Msg;
+}
 //! @}
 #endif
\ No newline at end of file
@@ -55,8 +55,14 @@
 //
 //*****************************************************************************
 
-//! Vector to store the incoming PDUs.
-static unsigned char Modbus_App_Msg[MAX_PDU];
+//! Buffer of App for the incoming PDUs; it is swapped with the ones of the CAN/OSL layers.
+static unsigned char Modbus_App_Msg_Buffer[MODBUS_APP_MSG_SIZE];
+
+//! Buffer which holds the incoming PDU; it is given back in the next swap.
+static unsigned char *Modbus_App_Msg_Base = Modbus_App_Msg_Buffer;
+
+//! Incoming PDU, inside _Modbus_App_Msg_Base_.
+static unsigned char *Modbus_App_Msg = Modbus_App_Msg_Buffer;
 
 //! Incoming message length.
 static unsigned char Modbus_App_L_Msg;
@@ -109,8 +115,19 @@ static uint16_t *Modbus_App_I_Registers;
 //! Modbus communication mode; It is only implemented OSL with RTU codification and CAN.
 static enum Modbus_Comm_Modes Modbus_Comm_Mode;
 
+#if CAN_Mode
 //! Bit rate range.
 enum Modbus_CAN_BitRate bit_rate_range;
+#endif
+#if CAN_Mode && defined(MODBUS_CAN_PUBLISH)
+//! I/O of each published block: the function (1 to 4, 0 if it is not published), the first address and the amount.
+static struct
+{
+  unsigned char Function;
+  uint16_t Adress;
+  unsigned char Quantity;
+} Modbus_App_Published[MODBUS_CAN_PUBLISH_BLOCKS];
+#endif
 //! @}
 
 //*****************************************************************************
@@ -209,7 +226,7 @@ static void Modbus_App_Process_Action(void);
 //! \param Com_Mode Modo de Comunicación de Modbus.
 //! \param Slave  Nº de Identificación del Slave
 //! \param Baudrate  Baudrate de las comunicaciones
-//! \param OSL_Mode  Mode RTU/ASCII de la comunicación Serie.
+//! \param Mode  Mode RTU/ASCII de la comunicación Serie.
 //! \return 1 ERROR: Nº Slave incorrecto o opción de comunicación no Existente 
 //! \return 0 Todo correcto
 //! \sa Modbus_App_N_Coils, Modbus_App_N_D_Inputs, Modbus_App_N_H_Registers
@@ -220,7 +237,7 @@ unsigned char Modbus_Slave_Init(uint16_t N_Coils, unsigned char *Coils,
                                 uint16_t N_I_Registers, uint16_t *I_Registers,
                                 enum Modbus_Comm_Modes Com_Mode, 
                                 unsigned char Slave, enum Baud Baudrate,
-                                enum Modbus_OSL_Modes OSL_Mode)
+                                enum Modbus_OSL_Modes Mode)
 {
   // Cantidades de E/S habilitadas.
   Modbus_App_N_Coils=N_Coils;
@@ -241,7 +258,7 @@ unsigned char Modbus_Slave_Init(uint16_t N_Coils, unsigned char *Coils,
   switch(Modbus_Comm_Mode)
     {
       case (MODBUS_SERIAL):
-        return Modbus_OSL_Init(Slave,Baudrate,OSL_Mode);
+        return Modbus_OSL_Init(Slave,Baudrate,Mode);
         break;
         
       /* Añadir en caso de Implementar otros modos de Comunicación. */
@@ -529,6 +546,12 @@ void Modbus_App_Manage_Request (void)
       /* Correct data. Accion processing. */
       Modbus_SetMainState(MODBUS_PROCESSING);
       Modbus_App_Process_Action();
+#ifdef MODBUS_CAN_PUBLISH
+      // the published blocks follow the writes of Coils and Holding Registers
+      if(Modbus_App_Msg[0]==5 || Modbus_App_Msg[0]==6 || Modbus_App_Msg[0]==15 || Modbus_App_Msg[0]==16 ||
+         Modbus_App_Msg[0]==22 || Modbus_App_Msg[0]==23)
+        Modbus_Slave_Refresh();
+#endif
       break;
     case 1:
       //Type 1 error
@@ -566,6 +589,169 @@ void Modbus_App_Manage_Request (void)
   }
 }
 
+#ifdef MODBUS_CAN_PUBLISH
+/**
+*   @brief Publish some registers or coils (CAN).
+*   @ingroup App_Control
+*
+*   The registers, or the coils or discrete inputs, are put in the block _Block_ of the CAN layer, which the CAN controller sends
+*   alone when the master asks it with Modbus_Read_Snapshot(); the coils are packed as in the answer of a read. The block follows 
+*   the writes of the master to the Coils and Holding Registers; the user program has to call Modbus_Slave_Refresh() after 
+*   changing the I/O itself.
+*   @param Block The block, from 0 to MODBUS_CAN_PUBLISH_BLOCKS - 1.
+*   @param Function 1 for Coils, 2 for Discrete Inputs, 3 for Holding Registers, 4 for Input Registers
+*   @param Adress Initial address of the I/O
+*   @param Quantity Amount of Registers, up to MODBUS_CAN_PUBLISH_REGISTERS, or of Coils or Discrete Inputs, up to 
+*   MODBUS_CAN_PUBLISH_COILS; 0 to stop publishing the block
+*   @return 0 All correct
+*   @return 1 Wrong parameters
+*   @sa Modbus_CAN_Publish
+*/
+unsigned char Modbus_Slave_Publish(unsigned char Block, unsigned char Function, uint16_t Adress, unsigned char Quantity)
+{
+  uint16_t Amount;
+  if(Block>=MODBUS_CAN_PUBLISH_BLOCKS)
+    return 1;
+  if(Quantity)
+  {
+    switch(Function)
+    {
+      case 1: Amount=Modbus_App_N_Coils; break;
+      case 2: Amount=Modbus_App_N_D_Inputs; break;
+      case 3: Amount=Modbus_App_N_H_Registers; break;
+      case 4: Amount=Modbus_App_N_I_Registers; break;
+      default: return 1;
+    }
+    if(Quantity>(Function<3 ? MODBUS_CAN_PUBLISH_COILS : MODBUS_CAN_PUBLISH_REGISTERS) || ((long)Adress+Quantity)>Amount)
+      return 1;
+  }
+  Modbus_App_Published[Block].Function=Quantity ? Function : 0;
+  Modbus_App_Published[Block].Adress=Adress;
+  Modbus_App_Published[Block].Quantity=Quantity;
+  Modbus_Slave_Refresh();
+  return 0;
+}
+
+/**
+*   @brief Send a published block when it changes (CAN).
+*   @ingroup App_Control
+*
+*   In change of state mode, the slave sends the block _Block_ alone when one of its registers changes more than _Deadband_ from 
+*   the value sent last time, or when _Heartbeat_ cycles go by without sending it; the master keeps it in its cache 
+*   (Modbus_Read_Cache()), so it does not have to poll the slave. The changes made by the user program are seen when it calls
+*   Modbus_Slave_Refresh(). A block of coils or discrete inputs is sent at any change.
+*   @param Block The block, which has to be published with Modbus_Slave_Publish().
+*   @param Enable 1 for the change of state mode, 0 to only answer Modbus_Read_Snapshot()
+*   @param Deadband Change of a register which sends the block, more than it; 0 for any change
+*   @param Heartbeat Cycles of the system clock without sending the block after which it is sent anyway; 0 for never
+*   @return 0 All correct
+*   @return 1 Wrong parameters
+*   @sa Modbus_CAN_ChangeOfState
+*/
+unsigned char Modbus_Slave_Change_Of_State(unsigned char Block, unsigned char Enable, uint16_t Deadband, unsigned long Heartbeat)
+{
+  if(Block>=MODBUS_CAN_PUBLISH_BLOCKS || (Enable && !Modbus_App_Published[Block].Function))
+    return 1;
+  // the coils are compared by bytes, so any change counts
+  Modbus_CAN_ChangeOfState(Block, Enable!=0, Modbus_App_Published[Block].Function<3 ? 0 : Deadband, Heartbeat);
+  return 0;
+}
+
+/**
+*   @brief Update the published blocks with the I/O (CAN).
+*   @ingroup App_Control
+*
+*   The registers of each published block are copied again, in big endian, into its message object, or its coils packed in 
+*   bytes; the message objects of the blocks which are not published are cleared. It is called after the writes of the master
+*   to the Coils and Holding Registers.
+*   @sa Modbus_Slave_Publish, Modbus_CAN_Publish
+*/
+void Modbus_Slave_Refresh(void)
+{
+  unsigned char Block, i;
+  unsigned char Data[2*MODBUS_CAN_PUBLISH_REGISTERS];
+  unsigned char *Coils;
+  uint16_t *Registers;
+  for(Block=0; Block<MODBUS_CAN_PUBLISH_BLOCKS; Block++)
+  {
+    switch(Modbus_App_Published[Block].Function)
+    {
+      case 1:
+      case 2:
+        Coils=(Modbus_App_Published[Block].Function==1) ? Modbus_App_Coils : Modbus_App_D_Inputs;
+        for(i=0; i<sizeof(Data); i++)
+          Data[i]=0;
+        for(i=0; i<Modbus_App_Published[Block].Quantity; i++)
+          Data[i/8]|=(Coils[Modbus_App_Published[Block].Adress+i] & 1)<<(i%8);
+        Modbus_CAN_Publish(Block, Data, (Modbus_App_Published[Block].Quantity+7)/8);
+        break;
+      case 3:
+      case 4:
+        Registers=(Modbus_App_Published[Block].Function==3) ? Modbus_App_H_Registers : Modbus_App_I_Registers;
+        for(i=0; i<Modbus_App_Published[Block].Quantity; i++)
+        {
+          Data[2*i]=Registers[Modbus_App_Published[Block].Adress+i]>>8;
+          Data[2*i+1]=Registers[Modbus_App_Published[Block].Adress+i] & 0xFF;
+        }
+        Modbus_CAN_Publish(Block, Data, 2*Modbus_App_Published[Block].Quantity);
+        break;
+      default:
+        Modbus_CAN_Publish(Block, Data, 0);
+        break;
+    }
+  }
+}
+#ifdef MODBUS_CAN_SCHEDULE
+
+/**
+*   @brief Send a published block in a transmit window of the time-triggered schedule (CAN).
+*   @ingroup App_Control
+*
+*   The master starts each cycle with a reference frame (Modbus_Set_Schedule()); _Offset_ cycles after it, the slave sends the
+*   block _Block_ with the highest priority, and the master keeps it in its cache (Modbus_Read_Cache()). Each slave needs its own
+*   window, so the offsets of the slaves have to be apart by one frame at least, and they all have to end before the free window
+*   of the master. The changes made by the user program are seen when it calls Modbus_Slave_Refresh().
+*   @param Block The block, which has to be published with Modbus_Slave_Publish().
+*   @param Enable 1 to send the block in the window, 0 to stop it
+*   @param Offset Start of the window, in cycles of the system clock from the reference frame
+*   @return 0 All correct
+*   @return 1 Wrong parameters
+*   @sa Modbus_CAN_SetWindow
+*/
+unsigned char Modbus_Slave_Schedule(unsigned char Block, unsigned char Enable, unsigned long Offset)
+{
+  if(Block>=MODBUS_CAN_PUBLISH_BLOCKS || (Enable && (!Modbus_App_Published[Block].Function || !Offset)))
+    return 1;
+  Modbus_CAN_SetWindow(Block, Enable!=0, Offset);
+  return 0;
+}
+#endif
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+
+/**
+*   @brief Set the flow control of the long requests of the master (CAN).
+*   @ingroup App_Control
+*
+*   After the first chunk of a long unicast request, the slave sends a FLOW control frame to the master with the chunks which it
+*   can send before the next FLOW frame and the minimum time between them. A slave which can not drain its receive FIFO as fast
+*   as the chunks arrive at the full bit rate asks for blocks no longer than its FIFO (8 message objects), or for a separation
+*   time. By default both are 0, the requests come back to back.
+*   @param Block_Size Chunks between two FLOW control frames, 0 for all of them
+*   @param STmin Minimum separation time between chunks: 0x00-0x7F milliseconds, 0xF1-0xF9 100-900 microseconds
+*   @return 0 All correct
+*   @return 1 Wrong parameters, a reserved separation time
+*   @sa Modbus_CAN_SetFlowControl
+*/
+unsigned char Modbus_Slave_Flow_Control(unsigned char Block_Size, unsigned char STmin)
+{
+  if(STmin>0x7F && (STmin<0xF1 || STmin>0xF9))
+    return 1;
+  Modbus_CAN_SetFlowControl(Block_Size, STmin);
+  return 0;
+}
+#endif
+
 /**
 *   @brief Function to check the request data.
 *   @ingroup App_Control
@@ -711,39 +897,35 @@ static void Modbus_App_Process_Action(void)
       Modbus_App_Read_Write_M_Registers();
       break;
     default:
+#if CAN_Mode
       Modbus_CAN_Error_Management(20);
+#else
+      Modbus_Fatal_Error(20);
+#endif
       break;  
   }
 }
 
 /**
-*   @brief It receives a char from another module.
-*   @ingroup App_Exchange
-*
-*   It stores chars en some position of the vector _Modbus_App_Msg_; It is used in _Modbus_OSL_RTU_to_App() (which it uses also 
-*   _Modbus_OSL_RTU_Char_Get()_) or in _Modbus_CAN_to_App()_ to transfer the messages from these modules to App without linking both modules
-*   neither making a copy of the CAN/OSL message.
-*   @param Msg Char value to store in _Modbus_App_Msg_
-*   @param i Vector index where the char will be placed
-*   @sa Modbus_App_Msg, Modbus_OSL_RTU_to_App, Modbus_OSL_RTU_Char_Get
-*/
-void Modbus_App_Receive_Char (unsigned char Msg, unsigned char i)
-{
-    Modbus_App_Msg[i]=Msg;
-  
-}
-
-/**
-*   @brief Recibe la Longitud del Mensaje.
+*   @brief It receives an incoming PDU from another module.
 *   @ingroup App_Exchange
 *
-*   It is used in _Modbus_OSL_RTU_to_App()_ or _Modbus_CAN_to_App()_ to send from CAN/OSL layer to App layer the incoming message length.
-*   @param Index Length message value
-*   @sa Modbus_App_Msg, Modbus_App_L_Msg, Modbus_OSL_RTU_to_App
+*   It is used in _Modbus_OSL_RTU_to_App_ and in _Modbus_CAN_to_App_ to hand over a complete incoming message without copying it:
+*   the buffer where the CAN/OSL layer received it becomes _Modbus_App_Msg_, and the buffer which App had is given back to be used
+*   in the next reception. All the buffers swapped have MODBUS_APP_MSG_SIZE bytes.
+*   @param Buffer Buffer with the incoming message
+*   @param Offset Position of the PDU in _Buffer_ (the RTU frames start with the slave number)
+*   @param Length Length of the PDU
+*   @return The previous buffer of App, which now belongs to the caller
+*   @sa Modbus_App_Msg, Modbus_App_L_Msg, Modbus_OSL_RTU_to_App, Modbus_CAN_to_App
 */
-void Modbus_App_L_Msg_Set(unsigned char Index)
+unsigned char *Modbus_App_Msg_Swap(unsigned char *Buffer, unsigned char Offset, unsigned char Length)
 {
-  Modbus_App_L_Msg=Index;
+  unsigned char *Previous = Modbus_App_Msg_Base;
+  Modbus_App_Msg_Base = Buffer;
+  Modbus_App_Msg = Buffer + Offset;
+  Modbus_App_L_Msg = Length;
+  return Previous;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,1142 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+/**
+*   @defgroup Bench Benchmark
+*   @ingroup VCAN
+*   @brief Throughput and latency of the Modbus CAN master and slaves on the virtual CAN bus.
+*
+*   @author Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+*
+*   The real master (Modbus_Project_Master) is the foreground node and the slaves (Modbus_Project_Slave) are linked several
+*   times, see the Makefile. For each bit rate and each function code:
+*
+*       -Latency: the requests are sent one by one, round robin over the slaves; the time from the call of the request function
+*        to the end of Modbus_Master_Communication() is measured, and the data of the reads is checked against the tables of
+*        Modbus_Sim_Slave.c.
+*       -Throughput: the requests are enqueued in batches of the queue depth, and the bus runs until all of them are answered.
+*
+*   Then, for each bit rate, a mixed load: the queue is kept full of reads of 125 registers to all the slaves but the last one,
+*   while a read of 1 register is sent to the last slave (the highest number) now and then; the time until its answer is measured
+*   with the normal and with the urgent priority class (Modbus_Set_Priority()).
+*
+*   Then, for each bit rate, error storms: every frame is corrupted for a while after a read is sent, so the master goes to
+*   bus-off; the bus-health counters of the master, its recovery times (Modbus_CAN_GetHealth()) and the time from the end of the
+*   storm to the end of the read are shown.
+*
+*   At last, for each bit rate, a poll of a few registers of all the slaves with one read per slave against the same poll made with
+*   one group poll (Modbus_Read_Group_Registers()).
+*
+*   If MODBUS_CAN_PUBLISH is defined, a read of 4 registers of each slave, one by one, is compared with the read of the same registers
+*   published by the slaves (Modbus_Read_Snapshot()), with the frames and the interruptions of all the nodes per read. Then, a
+*   process value which changes every 100 ms in each slave is scanned every 10 ms: by polling the slaves, and by reading the cache
+*   of the master (Modbus_Read_Cache()) which the slaves in change of state mode keep up to date; the traffic and the reads whose
+*   value is not the current one are compared.
+*
+*   If MODBUS_CAN_SCHEDULE is defined too, the periodic data of each slave, the block 1, is taken every 10 ms, or a multiple of it
+*   at the bit rates whose windows do not fit, while a read of 125 registers is always in course: with urgent reads of the same
+*   registers sent by the master at the start of each cycle, and with the time-triggered schedule (Modbus_Set_Schedule(),
+*   Modbus_Slave_Schedule()). The phase of the arrival of the data at the master from the start of the cycle is measured for each
+*   slave; its jitter is the maximum phase less the minimum one.
+*
+*   If MODBUS_CAN_FLOW_CONTROL is defined, the last slave is made slow (BENCH_SLOW_ISR_BITS) and the writes of 123 registers to it
+*   are sent with the chunks back to back, so the chunks lost by the overruns of its receive FIFO are asked again with NACKs, and
+*   paced by the FLOW control frames of the slaves (Modbus_Slave_Flow_Control()), in blocks of its receive FIFO; the same writes to
+*   the first slave, a fast one, show the cost of the pacing.
+*
+*   If MODBUS_CAN_BROADCAST_ACK is defined, the broadcast writes are also measured: all the slaves acknowledge them, so the
+*   turnaround finishes before the broadcast timeout, which is shown to compare.
+*
+*   Before all of them, the goodput: writes of 123 registers and reads of 125 registers, one at a time, with the data of the registers carried
+*   per second. The chunks of the long frames are streamed through the mailboxes, or, if MODBUS_CAN_TX_DELAYED is defined (the
+*   delayed variant), sent through one mailbox with Modbus_CAN_Delay() between them; with the fixed delay a long frame lasts
+*   seconds, so the delayed variant only measures the goodput, with the maximum unicast timeout raised to let it finish.
+*
+*   The bit rates are 1 Mbps, 500 Kbps and 100 Kbps, whose bit timing is solved from the CAN clock by the nodes; -b runs only the
+*   bit rate given, in Kbps.
+*
+*   Usage: modbus_bench [-n slaves] [-r requests] [-q queue depth] [-e error rate] [-s seed] [-c CAN clock]
+*   [-b bit rate] [-l loop cycles] [-w work cycles]
+*/
+/** @{ */
+//includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stdint.h"
+#include "inc/hw_ints.h"
+#include "inc/hw_types.h"
+#include "inc/hw_memmap.h"
+#include "driverlib/timer.h"
+#include "Master/Modbus_App.h"
+#include "Modbus_VCAN.h"
+
+//! System clock of the boards, 40 MHz (PLL / 5).
+#define BENCH_CPU_CLOCK 40000000UL
+//! Clock of the CAN controllers, 8 MHz.
+#define BENCH_CAN_CLOCK 8000000UL
+#ifdef MODBUS_CAN_TX_DELAYED
+//! Virtual time without progress after which the benchmark is stopped without errors in the bus, in picoseconds (10 min): a long
+//! frame sent with the fixed delay between its chunks lasts up to a minute at 100 Kbps. See Bench_Stuck().
+#define BENCH_STUCK (600 * MODBUS_VCAN_SECOND)
+//! Transmit path of the long frames, in the titles.
+#define BENCH_TX_PATH "delayed"
+#else
+//! Virtual time without progress after which the benchmark is stopped without errors in the bus, in picoseconds (10 s). See
+//! Bench_Stuck().
+#define BENCH_STUCK (10 * MODBUS_VCAN_SECOND)
+//! Transmit path of the long frames, in the titles.
+#define BENCH_TX_PATH "streamed"
+#endif
+//! Transfers of each direction measured by the goodput.
+#define BENCH_GOODPUT_TRANSFERS 2
+//! Longest scale of BENCH_STUCK with the error rate.
+#define BENCH_STUCK_SCALE 100
+//! Bit times of each error storm, in which every frame is corrupted (20 ms at 1 Mbps): enough for the master to go to bus-off at
+//! every bit rate.
+#define BENCH_STORM_BITS 20000
+//! Time between an answer of the mixed load and the next urgent request, in picoseconds (1 ms).
+#define BENCH_MIXED_GAP (MODBUS_VCAN_SECOND / 1000)
+//! Registers read from each slave by the polls, the most which fit in one classic CAN frame.
+#define BENCH_POLL_REGISTERS 3
+#ifdef MODBUS_CAN_PUBLISH
+//! Registers published by the slaves in the block 0, from the address 7, see Modbus_Sim_Slave.c.
+#define BENCH_SNAPSHOT_REGISTERS 4
+//! Period of the scans of the process value, in picoseconds (10 ms).
+#define BENCH_SCAN (MODBUS_VCAN_SECOND / 100)
+//! Period of the changes of the process value of the slaves, in picoseconds (100 ms), see Modbus_Sim_Slave.c.
+#define BENCH_PROCESS_PERIOD (MODBUS_VCAN_SECOND / 10)
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+//! Cycle of the periodic data of the slaves (10 ms).
+#define BENCH_CYCLE (MODBUS_VCAN_SECOND / 100)
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+//! Bit times of each interruption of the slow slave, about one chunk and a half in the bus: it can not drain its receive FIFO
+//! when the chunks come back to back.
+#define BENCH_SLOW_ISR_BITS 200
+#endif
+
+//! Function code benchmarked.
+struct Bench_Workload
+{
+      const char *name;                                 //!< Name in the table
+      unsigned char (*request)(unsigned char slave);    //!< Sends a request, returns what the request function returned
+      unsigned char (*check)(void);                     //!< Checks the data read, returns 1 if it is right; NULL for the writes
+};
+
+//-DATA OF THE REQUESTS
+static unsigned char bench_bits[2000];
+static uint16_t bench_registers[125];
+static unsigned char bench_coils[2000];
+static uint16_t bench_values[125];
+//! Register read by the requests measured in the mixed load
+static uint16_t bench_urgent;
+//! Registers read from all the slaves by the polls
+static uint16_t bench_poll[MODBUS_CAN_GROUP_MAX * BENCH_POLL_REGISTERS];
+//! Numbers of the slaves
+static unsigned char bench_numbers[247];
+//! Number of slaves
+static unsigned char bench_slaves;
+//! Latencies of a workload, in picoseconds
+static uint64_t *bench_latency;
+//! Parameters of the simulation
+static struct Modbus_VCAN_Config bench_config;
+//! @}
+
+static void Bench_Master_Init(unsigned char number, unsigned long bit_rate);
+
+//! Board of the master; it is the foreground node.
+static struct Modbus_VCAN_Board bench_master =
+{
+    .name = "master",
+    .init = Bench_Master_Init,
+    .loop = NULL,
+    .vectors = { [INT_CAN0] = Modbus_CAN_IntHandler,
+#ifdef MODBUS_CAN_FLOW_CONTROL
+                 [INT_TIMER0A] = Modbus_CAN_FlowHandler,
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+                 [INT_TIMER3A] = Modbus_CAN_CycleHandler,
+#endif
+                 [INT_TIMER1A] = Modbus_CAN_UnicastTimeoutHandler,
+                 [INT_TIMER2A] = Modbus_CAN_BroadcastTimeoutHandler }
+};
+
+//! \brief Function to initialise the master, as the init() of maintest.c.
+static void Bench_Master_Init(unsigned char number, unsigned long bit_rate)
+{
+        Modbus_Master_Init((enum Modbus_CAN_BitRate)bit_rate, 3);
+#ifdef MODBUS_CAN_TX_DELAYED
+        //the guessed timeouts are longer than the long frames sent with the fixed delay, but not the default maximum
+        Modbus_CAN_SetTimeoutLimits(MODBUS_CAN_RTO_MIN, 0xFFFFFFFF);
+#endif
+#ifdef MODBUS_CAN_BROADCAST_ACK
+        Modbus_CAN_SetBroadcastSlaves(bench_numbers, bench_slaves);
+#endif
+}
+
+static unsigned char Bench_FC01(unsigned char slave) { return Modbus_Read_Coils(slave, 0, 2000, bench_bits); }
+static unsigned char Bench_FC02(unsigned char slave) { return Modbus_Read_D_Inputs(slave, 0, 2000, bench_bits); }
+static unsigned char Bench_FC03(unsigned char slave) { return Modbus_Read_H_Registers(slave, 0, 125, bench_registers); }
+static unsigned char Bench_FC03_1(unsigned char slave) { return Modbus_Read_H_Registers(slave, 7, 1, bench_registers); }
+static unsigned char Bench_FC04(unsigned char slave) { return Modbus_Read_I_Registers(slave, 0, 125, bench_registers); }
+static unsigned char Bench_FC05(unsigned char slave) { return Modbus_Write_Coil(slave, 10, 1); }
+static unsigned char Bench_FC06(unsigned char slave) { return Modbus_Write_Register(slave, 10, 10); }
+static unsigned char Bench_FC15(unsigned char slave) { return Modbus_Write_M_Coils(slave, 0, 1968, bench_coils); }
+static unsigned char Bench_FC16(unsigned char slave) { return Modbus_Write_M_Registers(slave, 0, 123, bench_values); }
+static unsigned char Bench_FC22(unsigned char slave) { return Modbus_Mask_Write_Register(slave, 73, 0xFFFF, 0x0000); }
+#ifdef MODBUS_CAN_BROADCAST_ACK
+static unsigned char Bench_FC06_All(unsigned char slave) { return Modbus_Write_Register(0, 10, 10); }
+static unsigned char Bench_FC16_All(unsigned char slave) { return Modbus_Write_M_Registers(0, 0, 123, bench_values); }
+#endif
+static unsigned char Bench_FC23(unsigned char slave)
+{
+        return Modbus_Read_Write_M_Registers(slave, 0, 125, bench_registers, 0, 121, bench_values);
+}
+
+//! \brief Function to check the coils read: all of them are 1, the writes of the benchmark keep it.
+static unsigned char Bench_Check_Coils(void)
+{
+        uint16_t i;
+            for(i = 0; i < 2000; i++)
+            {
+                if(bench_bits[i] != 1)
+                    return 0;
+            }
+            return 1;
+}
+
+//! \brief Function to check the discrete inputs read: 0, 1, 0, 1... and 1, 0, 1, 0... from the 1000th.
+static unsigned char Bench_Check_Inputs(void)
+{
+        uint16_t i;
+            for(i = 0; i < 2000; i++)
+            {
+                if(bench_bits[i] != ((i < 1000) ? (i & 1) : !(i & 1)))
+                    return 0;
+            }
+            return 1;
+}
+
+//! \brief Function to check the registers read: the register i is i, the writes of the benchmark keep it.
+static unsigned char Bench_Check_Registers(void)
+{
+        uint16_t i;
+            for(i = 0; i < 125; i++)
+            {
+                if(bench_registers[i] != i)
+                    return 0;
+            }
+            return 1;
+}
+
+//! \brief Function to check the register 7 read alone.
+static unsigned char Bench_Check_Register(void)
+{
+        return bench_registers[0] == 7;
+}
+
+//! Function codes benchmarked, the ones of maintest.c and the single ones.
+static const struct Bench_Workload bench_workloads[] =
+{
+    { "01 read 2000 coils",      Bench_FC01,   Bench_Check_Coils },
+    { "02 read 2000 inputs",     Bench_FC02,   Bench_Check_Inputs },
+    { "03 read 125 registers",   Bench_FC03,   Bench_Check_Registers },
+    { "03 read 1 register",      Bench_FC03_1, Bench_Check_Register },
+    { "04 read 125 inputs",      Bench_FC04,   Bench_Check_Registers },
+    { "05 write coil",           Bench_FC05,   NULL },
+    { "06 write register",       Bench_FC06,   NULL },
+    { "15 write 1968 coils",     Bench_FC15,   NULL },
+    { "16 write 123 registers",  Bench_FC16,   NULL },
+    { "22 mask write",           Bench_FC22,   NULL },
+    { "23 read 125/write 121",   Bench_FC23,   Bench_Check_Registers },
+};
+
+#ifdef MODBUS_CAN_BROADCAST_ACK
+//! Broadcast writes benchmarked, all the slaves acknowledge them.
+static const struct Bench_Workload bench_broadcasts[] =
+{
+    { "06 write register",       Bench_FC06_All, NULL },
+    { "16 write 123 registers",  Bench_FC16_All, NULL },
+};
+#endif
+
+//! \brief Function to count the requests which failed, from the Error FIFO of the master.
+static unsigned long Bench_Errors(void)
+{
+        struct Modbus_FIFO_E_Item error;
+        unsigned long errors = 0;
+            while(Modbus_Get_Error(&error))
+                errors++;
+            return errors;
+}
+
+//! \brief Function to get the virtual time without progress after which the benchmark is stopped.
+//!
+//! With an error rate _e_ the frames are sent again and again, the long frames need NACKs and the master may go to bus-off and wait
+//! for its recovery, so BENCH_STUCK is divided by (1 - _e_) squared, up to BENCH_STUCK_SCALE times.
+//! \return The time, in picoseconds.
+static uint64_t Bench_Stuck(void)
+{
+        double left = 1.0 - bench_config.error_rate;
+            if((left * left * BENCH_STUCK_SCALE) <= 1.0)
+                return (uint64_t)BENCH_STUCK * BENCH_STUCK_SCALE;
+            return (uint64_t)(BENCH_STUCK / (left * left));
+}
+
+//! \brief Function to get the answers received by the master, to see if it makes progress.
+static unsigned long Bench_Answers(void)
+{
+        struct Modbus_CAN_Stats counters;
+            Modbus_CAN_GetStats(&counters);
+            return counters.answers;
+}
+
+//! \brief Function to run the master until it has no request left.
+//!
+//! The master is stopped if it neither receives an answer nor gives up a request in Bench_Stuck(), so a slow master under a high
+//! error rate is not taken as a stuck one.
+//! \param errors Where the failed requests are added.
+static void Bench_Drain(unsigned long *errors)
+{
+        uint64_t start = Modbus_VCAN_Now(), stuck = Bench_Stuck();
+        unsigned long answers = Bench_Answers(), failed;
+            while(Modbus_Master_Communication())
+            {
+                failed = Bench_Errors();
+                *errors += failed;
+                Modbus_VCAN_Idle(bench_config.loop_cycles);
+                if(failed)
+                    start = Modbus_VCAN_Now();
+                else if((Modbus_VCAN_Now() - start) > stuck)
+                {
+                    if(Bench_Answers() == answers)
+                    {
+                        fprintf(stderr, "bench: the master did not finish its requests\n");
+                        exit(1);
+                    }
+                    answers = Bench_Answers();
+                    start = Modbus_VCAN_Now();
+                }
+            }
+            *errors += Bench_Errors();
+}
+
+//! \brief Function to compare two latencies, for qsort().
+static int Bench_Compare(const void *a, const void *b)
+{
+        uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+            return (x > y) - (x < y);
+}
+
+//! \brief Function to benchmark a function code at a bit rate.
+//!
+//! \param workload The function code.
+//! \param bit_rate The bit rate (enum Modbus_CAN_BitRate).
+//! \param slaves Number of slaves.
+//! \param requests Number of requests of each phase.
+//! \param depth Requests enqueued at once in the throughput phase.
+static void Bench_Run(const struct Bench_Workload *workload, unsigned long bit_rate, unsigned char slaves,
+                      unsigned long requests, unsigned long depth)
+{
+        struct Modbus_VCAN_Stats stats;
+        struct Modbus_CAN_Stats counters;
+        unsigned long i, j, bad = 0, sent, retries = 0;
+        unsigned char master;
+        uint64_t start, elapsed;
+        double seconds;
+            Modbus_VCAN_Setup(&bench_config);
+            for(i = 0; i < slaves; i++)
+                Modbus_VCAN_PowerOn(Modbus_VCAN_GetBoard(i), i + 1, bit_rate);
+            master = Modbus_VCAN_PowerOn(&bench_master, 0, bit_rate);
+            //latency, one request at a time
+            for(i = 0; i < requests; i++)
+            {
+                memset(bench_bits, 0xFF, sizeof(bench_bits));
+                memset(bench_registers, 0xFF, sizeof(bench_registers));
+                start = Modbus_VCAN_Now();
+                workload->request((i % slaves) + 1);
+                j = 0;
+                Bench_Drain(&j);
+                bench_latency[i] = Modbus_VCAN_Now() - start;
+                if(j || (workload->check && !workload->check()))
+                    bad++;
+            }
+            qsort(bench_latency, requests, sizeof(uint64_t), Bench_Compare);
+            //throughput, queue of requests
+            Modbus_VCAN_Setup(&bench_config);
+            for(i = 0; i < slaves; i++)
+                Modbus_VCAN_PowerOn(Modbus_VCAN_GetBoard(i), i + 1, bit_rate);
+            master = Modbus_VCAN_PowerOn(&bench_master, 0, bit_rate);
+            start = Modbus_VCAN_Now();
+            for(sent = 0; sent < requests; )
+            {
+                for(j = 0; (j < depth) && (sent < requests); j++, sent++)
+                    workload->request((sent % slaves) + 1);
+                Bench_Drain(&bad);
+            }
+            elapsed = Modbus_VCAN_Now() - start;
+            Modbus_VCAN_GetStats(&stats);
+            Modbus_CAN_GetStats(&counters);
+            for(i = 0; i < MODBUS_CAN_STATS_SLAVES; i++)
+                retries += counters.retries[i];
+            seconds = (double)elapsed / MODBUS_VCAN_SECOND;
+            printf("%6.0f kbit/s  %-24s %6lu %5lu %7lu %9.0f %9.1f %6.1f %9.1f %9.1f %9.1f %9.1f\n",
+                   (double)MODBUS_VCAN_SECOND / Modbus_VCAN_BitTime(master, 0) / 1000.0, workload->name,
+                   requests, bad, retries, stats.frames / seconds, requests / seconds, 100.0 * stats.busy / elapsed,
+                   bench_latency[requests / 2] / 1e6, bench_latency[(requests * 9) / 10] / 1e6,
+                   bench_latency[(requests * 99) / 100] / 1e6, bench_latency[requests - 1] / 1e6);
+}
+
+//! \brief Function to measure the requests to the last slave under the mixed load, with a priority class.
+//!
+//! \param priority The class of the requests measured; the reads of 125 registers are normal.
+//! \param bit_rate The bit rate (enum Modbus_CAN_BitRate).
+//! \param slaves Number of slaves, at least 2.
+//! \param samples Number of requests measured.
+//! \param depth Reads of 125 registers waiting or in flight.
+//! \param result Where the median, the 99th percentile and the maximum latency are stored, in microseconds.
+//! \return The node of the master.
+static unsigned char Bench_Mixed_Pass(enum Modbus_Priority priority, unsigned long bit_rate, unsigned char slaves,
+                                      unsigned long samples, unsigned long depth, double *result)
+{
+        struct Modbus_CAN_Stats counters;
+        unsigned long done = 0, polls = 0, failed = 0;
+        unsigned char waiting = 0;
+        unsigned char master;
+        uint64_t start = 0, next = 0, progress;
+            Modbus_VCAN_Setup(&bench_config);
+            for(done = 0; done < slaves; done++)
+                Modbus_VCAN_PowerOn(Modbus_VCAN_GetBoard(done), done + 1, bit_rate);
+            master = Modbus_VCAN_PowerOn(&bench_master, 0, bit_rate);
+            done = 0;
+            progress = Modbus_VCAN_Now();
+            while(done < samples)
+            {
+                //the polls answered or failed are replaced, so there are always _depth_ of them
+                Modbus_CAN_GetStats(&counters);
+                failed += Bench_Errors();
+                while((polls - (counters.answers - done) - failed) < depth)
+                {
+                    if(Modbus_Read_H_Registers((polls % (slaves - 1)) + 1, 0, 125, bench_registers))
+                        break;
+                    polls++;
+                }
+                if(!waiting && (Modbus_VCAN_Now() >= next))
+                {
+                    bench_urgent = 0xFFFF;
+                    Modbus_Set_Priority(priority);
+                    Modbus_Read_H_Registers(slaves, 7, 1, &bench_urgent);
+                    Modbus_Set_Priority(MODBUS_PRIORITY_NORMAL);
+                    start = Modbus_VCAN_Now();
+                    waiting = 1;
+                }
+                Modbus_Master_Communication();
+                Modbus_VCAN_Idle(bench_config.loop_cycles);
+                if(waiting && (bench_urgent == 7))
+                {
+                    bench_latency[done++] = Modbus_VCAN_Now() - start;
+                    progress = Modbus_VCAN_Now();
+                    next = progress + BENCH_MIXED_GAP;
+                    waiting = 0;
+                }
+                if((Modbus_VCAN_Now() - progress) > Bench_Stuck())
+                {
+                    fprintf(stderr, "bench: the requests of the mixed load are not answered\n");
+                    exit(1);
+                }
+            }
+            Bench_Drain(&failed);
+            qsort(bench_latency, samples, sizeof(uint64_t), Bench_Compare);
+            result[0] = bench_latency[samples / 2] / 1e6;
+            result[1] = bench_latency[(samples * 99) / 100] / 1e6;
+            result[2] = bench_latency[samples - 1] / 1e6;
+            return master;
+}
+
+#ifdef MODBUS_CAN_BROADCAST_ACK
+//! \brief Function to benchmark a broadcast write at a bit rate.
+//!
+//! \param workload The broadcast write.
+//! \param bit_rate The bit rate (enum Modbus_CAN_BitRate).
+//! \param slaves Number of slaves, all of them acknowledge the broadcasts.
+//! \param requests Number of requests.
+static void Bench_Broadcast(const struct Bench_Workload *workload, unsigned long bit_rate, unsigned char slaves,
+                            unsigned long requests)
+{
+        unsigned long i, bad = 0;
+        unsigned char master;
+        uint64_t start;
+            Modbus_VCAN_Setup(&bench_config);
+            for(i = 0; i < slaves; i++)
+                Modbus_VCAN_PowerOn(Modbus_VCAN_GetBoard(i), i + 1, bit_rate);
+            master = Modbus_VCAN_PowerOn(&bench_master, 0, bit_rate);
+            for(i = 0; i < requests; i++)
+            {
+                start = Modbus_VCAN_Now();
+                workload->request(0);
+                Bench_Drain(&bad);
+                bench_latency[i] = Modbus_VCAN_Now() - start;
+            }
+            qsort(bench_latency, requests, sizeof(uint64_t), Bench_Compare);
+            printf("%6.0f kbit/s  %-24s %6lu %5lu %9.1f %9.1f %12.1f\n",
+                   (double)MODBUS_VCAN_SECOND / Modbus_VCAN_BitTime(master, 0) / 1000.0, workload->name, requests, bad,
+                   bench_latency[requests / 2] / 1e6, bench_latency[requests - 1] / 1e6,
+                   TimerLoadGet(TIMER2_BASE, TIMER_A) * 1e6 / bench_config.cpu_clock);
+}
+#endif
+
+//! \brief Function to measure a poll of all the slaves.
+//!
+//! \param group 1 to make the poll with one group poll, 0 to make it with one read per slave.
+//! \param bit_rate The bit rate (enum Modbus_CAN_BitRate).
+//! \param slaves Number of slaves, up to MODBUS_CAN_GROUP_MAX.
+//! \param polls Number of polls.
+//! \param result Where the median and the maximum time of a poll, in microseconds, the frames per poll and the polls with wrong or
+//! missing registers are stored.
+//! \return The node of the master.
+static unsigned char Bench_Poll_Pass(unsigned char group, unsigned long bit_rate, unsigned char slaves, unsigned long polls,
+                                     double *result)
+{
+        struct Modbus_VCAN_Stats stats;
+        unsigned long i, j, errors, bad = 0;
+        unsigned char master;
+        uint64_t start;
+            Modbus_VCAN_Setup(&bench_config);
+            for(i = 0; i < slaves; i++)
+                Modbus_VCAN_PowerOn(Modbus_VCAN_GetBoard(i), i + 1, bit_rate);
+            master = Modbus_VCAN_PowerOn(&bench_master, 0, bit_rate);
+            for(i = 0; i < polls; i++)
+            {
+                memset(bench_poll, 0xFF, sizeof(bench_poll));
+                start = Modbus_VCAN_Now();
+                if(group)
+                    Modbus_Read_Group_Registers(1, slaves, 3, 7, BENCH_POLL_REGISTERS, bench_poll);
+                else
+                {
+                    for(j = 0; j < slaves; j++)
+                        Modbus_Read_H_Registers(j + 1, 7, BENCH_POLL_REGISTERS, &bench_poll[j * BENCH_POLL_REGISTERS]);
+                }
+                errors = 0;
+                Bench_Drain(&errors);
+                bench_latency[i] = Modbus_VCAN_Now() - start;
+                for(j = 0; j < (unsigned long)slaves * BENCH_POLL_REGISTERS; j++)
+                {
+                    if(bench_poll[j] != 7 + (j % BENCH_POLL_REGISTERS))
+                        errors++;
+                }
+                if(errors)
+                    bad++;
+            }
+            Modbus_VCAN_GetStats(&stats);
+            qsort(bench_latency, polls, sizeof(uint64_t), Bench_Compare);
+            result[0] = bench_latency[polls / 2] / 1e6;
+            result[1] = bench_latency[polls - 1] / 1e6;
+            result[2] = (double)stats.frames / polls;
+            result[3] = bad;
+            return master;
+}
+
+//! \brief Function to benchmark the group poll against one read per slave at a bit rate.
+//!
+//! \param bit_rate The bit rate (enum Modbus_CAN_BitRate).
+//! \param slaves Number of slaves, up to MODBUS_CAN_GROUP_MAX.
+//! \param polls Number of polls of each kind.
+static void Bench_Poll(unsigned long bit_rate, unsigned char slaves, unsigned long polls)
+{
+        double unicast[4], group[4];
+        unsigned char master;
+            Bench_Poll_Pass(0, bit_rate, slaves, polls, unicast);
+            master = Bench_Poll_Pass(1, bit_rate, slaves, polls, group);
+            printf("%6.0f kbit/s  %9.1f %9.1f %7.1f %5.0f %9.1f %9.1f %7.1f %5.0f\n",
+                   (double)MODBUS_VCAN_SECOND / Modbus_VCAN_BitTime(master, 0) / 1000.0,
+                   unicast[0], unicast[1], unicast[2], unicast[3], group[0], group[1], group[2], group[3]);
+}
+
+#ifdef MODBUS_CAN_PUBLISH
+//! \brief Function to measure the reads of the registers published by the slaves.
+//!
+//! \param snapshot 1 to read the block 0 with Modbus_Read_Snapshot(), 0 to read the same registers with Modbus_Read_H_Registers().
+//! \param bit_rate The bit rate (enum Modbus_CAN_BitRate).
+//! \param slaves Number of slaves.
+//! \param reads Number of reads, round robin over the slaves.
+//! \param result Where the median and the maximum time of a read, in microseconds, the frames and the interruptions per read and
+//! the reads with wrong or missing registers are stored.
+//! \return The node of the master.
+static unsigned char Bench_Snapshot_Pass(unsigned char snapshot, unsigned long bit_rate, unsigned char slaves, unsigned long reads,
+                                         double *result)
+{
+        struct Modbus_VCAN_Stats stats;
+        unsigned long i, j, errors, bad = 0;
+        unsigned char master, slave;
+        uint64_t start;
+            Modbus_VCAN_Setup(&bench_config);
+            for(i = 0; i < slaves; i++)
+                Modbus_VCAN_PowerOn(Modbus_VCAN_GetBoard(i), i + 1, bit_rate);
+            master = Modbus_VCAN_PowerOn(&bench_master, 0, bit_rate);
+            for(i = 0; i < reads; i++)
+            {
+                slave = bench_numbers[i % slaves];
+                memset(bench_poll, 0xFF, sizeof(bench_poll));
+                start = Modbus_VCAN_Now();
+                if(snapshot)
+                    errors = Modbus_Read_Snapshot(slave, 0, BENCH_SNAPSHOT_REGISTERS, bench_poll);
+                else
+                    errors = Modbus_Read_H_Registers(slave, 7, BENCH_SNAPSHOT_REGISTERS, bench_poll);
+                Bench_Drain(&errors);
+                bench_latency[i] = Modbus_VCAN_Now() - start;
+                for(j = 0; j < BENCH_SNAPSHOT_REGISTERS; j++)
+                {
+                    if(bench_poll[j] != 7 + j)
+                        errors++;
+                }
+                if(errors)
+                    bad++;
+            }
+            Modbus_VCAN_GetStats(&stats);
+            qsort(bench_latency, reads, sizeof(uint64_t), Bench_Compare);
+            result[0] = bench_latency[reads / 2] / 1e6;
+            result[1] = bench_latency[reads - 1] / 1e6;
+            result[2] = (double)stats.frames / reads;
+            result[3] = (double)stats.interrupts / reads;
+            result[4] = bad;
+            return master;
+}
+
+//! \brief Function to benchmark the reads of the published registers against the normal reads at a bit rate.
+//!
+//! \param bit_rate The bit rate (enum Modbus_CAN_BitRate).
+//! \param slaves Number of slaves.
+//! \param reads Number of reads of each kind.
+static void Bench_Snapshot(unsigned long bit_rate, unsigned char slaves, unsigned long reads)
+{
+        double normal[5], snapshot[5];
+        unsigned char master;
+            Bench_Snapshot_Pass(0, bit_rate, slaves, reads, normal);
+            master = Bench_Snapshot_Pass(1, bit_rate, slaves, reads, snapshot);
+            printf("%6.0f kbit/s  %9.1f %9.1f %7.1f %6.1f %5.0f %9.1f %9.1f %7.1f %6.1f %5.0f\n",
+                   (double)MODBUS_VCAN_SECOND / Modbus_VCAN_BitTime(master, 0) / 1000.0,
+                   normal[0], normal[1], normal[2], normal[3], normal[4],
+                   snapshot[0], snapshot[1], snapshot[2], snapshot[3], snapshot[4]);
+}
+#endif
+
+#ifdef MODBUS_CAN_PUBLISH
+//! \brief Function to measure the scans of the process value of the slaves.
+//!
+//! The input registers 122-125 of every slave are read every BENCH_SCAN; the register 125 is the process value.
+//! \param cache 1 to read them from the cache of the master, with the slaves in change of state mode, 0 to poll them with
+//! Modbus_Read_I_Registers().
+//! \param bit_rate The bit rate (enum Modbus_CAN_BitRate).
+//! \param slaves Number of slaves.
+//! \param scans Number of scans.
+//! \param result Where the frames and the interruptions of all the nodes per second, the median time of a scan in microseconds and
+//! the percentage of process values read which were not the current one are stored.
+//! \return The node of the master.
+static unsigned char Bench_Cos_Pass(unsigned char cache, unsigned long bit_rate, unsigned char slaves, unsigned long scans,
+                                    double *result)
+{
+        struct Modbus_VCAN_Stats stats;
+        unsigned long i, j, errors, stale = 0;
+        unsigned char master;
+        uint64_t start, scan;
+            bench_config.board_option = cache ? MODBUS_VCAN_OPTION_COS : 0;
+            Modbus_VCAN_Setup(&bench_config);
+            bench_config.board_option = 0;
+            for(i = 0; i < slaves; i++)
+                Modbus_VCAN_PowerOn(Modbus_VCAN_GetBoard(i), i + 1, bit_rate);
+            master = Modbus_VCAN_PowerOn(&bench_master, 0, bit_rate);
+            start = Modbus_VCAN_Now();
+            for(i = 0; i < scans; i++)
+            {
+                //the master works until the next scan, half a period after the changes of the process value
+                while(Modbus_VCAN_Now() < start + (i * BENCH_SCAN) + (BENCH_SCAN / 2))
+                {
+                    Modbus_Master_Communication();
+                    Bench_Errors();
+                    Modbus_VCAN_Idle(bench_config.loop_cycles);
+                }
+                scan = Modbus_VCAN_Now();
+                errors = 0;
+                memset(bench_poll, 0xFF, sizeof(bench_poll));
+                for(j = 0; j < slaves; j++)
+                {
+                    if(cache)
+                        errors += Modbus_Read_Cache(j + 1, 1, BENCH_SNAPSHOT_REGISTERS, &bench_poll[j * BENCH_SNAPSHOT_REGISTERS], 0);
+                    else
+                        errors += Modbus_Read_I_Registers(j + 1, 122, BENCH_SNAPSHOT_REGISTERS, &bench_poll[j * BENCH_SNAPSHOT_REGISTERS]);
+                }
+                Bench_Drain(&errors);
+                bench_latency[i] = Modbus_VCAN_Now() - scan;
+                for(j = 0; j < slaves; j++)
+                {
+                    if(bench_poll[(j * BENCH_SNAPSHOT_REGISTERS) + 3] != (uint16_t)(Modbus_VCAN_Now() / BENCH_PROCESS_PERIOD))
+                        stale++;
+                }
+            }
+            Modbus_VCAN_GetStats(&stats);
+            qsort(bench_latency, scans, sizeof(uint64_t), Bench_Compare);
+            result[0] = stats.frames / ((double)(Modbus_VCAN_Now() - start) / MODBUS_VCAN_SECOND);
+            result[1] = stats.interrupts / ((double)(Modbus_VCAN_Now() - start) / MODBUS_VCAN_SECOND);
+            result[2] = bench_latency[scans / 2] / 1e6;
+            result[3] = 100.0 * stale / (scans * slaves);
+            return master;
+}
+
+//! \brief Function to benchmark the cache of the master against polling at a bit rate.
+//!
+//! \param bit_rate The bit rate (enum Modbus_CAN_BitRate).
+//! \param slaves Number of slaves.
+//! \param scans Number of scans of each kind.
+static void Bench_Cos(unsigned long bit_rate, unsigned char slaves, unsigned long scans)
+{
+        double poll[4], cache[4];
+        unsigned char master;
+            Bench_Cos_Pass(0, bit_rate, slaves, scans, poll);
+            master = Bench_Cos_Pass(1, bit_rate, slaves, scans, cache);
+            printf("%6.0f kbit/s  %9.0f %9.0f %9.1f %7.1f %9.0f %9.0f %9.1f %7.1f\n",
+                   (double)MODBUS_VCAN_SECOND / Modbus_VCAN_BitTime(master, 0) / 1000.0,
+                   poll[0], poll[1], poll[2], poll[3], cache[0], cache[1], cache[2], cache[3]);
+}
+#endif
+
+#ifdef MODBUS_CAN_SCHEDULE
+//! \brief Function to measure the phase of the periodic data of the slaves under a load of reads of 125 registers.
+//!
+//! \param schedule 1 for the time-triggered schedule, 0 for urgent reads of the input registers 122-125 sent at each cycle.
+//! \param bit_rate The bit rate (enum Modbus_CAN_BitRate).
+//! \param slaves Number of slaves.
+//! \param period Length of the cycle, in picoseconds.
+//! \param cycles Number of cycles.
+//! \param result Where the minimum and the maximum phase, in microseconds, and the cycles without data of each slave are stored,
+//! three per slave.
+//! \return The node of the master.
+static unsigned char Bench_Schedule_Pass(unsigned char schedule, unsigned long bit_rate, unsigned char slaves, uint64_t period,
+                                         unsigned long cycles, double *result)
+{
+        unsigned long i, j, age, arrivals[MODBUS_VCAN_NODES];
+        unsigned char master, data[8], waiting[MODBUS_VCAN_NODES], busy = 0;
+        uint64_t start, cycle, now, arrival, last[MODBUS_VCAN_NODES], low[MODBUS_VCAN_NODES], high[MODBUS_VCAN_NODES];
+        uint64_t tick = MODBUS_VCAN_SECOND / bench_config.cpu_clock;
+        unsigned long window = (bench_config.cpu_clock / (bit_rate * 1000)) * MODBUS_VCAN_WINDOW_BITS;
+            bench_config.board_option = schedule ? MODBUS_VCAN_OPTION_SCHEDULE : 0;
+            Modbus_VCAN_Setup(&bench_config);
+            bench_config.board_option = 0;
+            for(i = 0; i < slaves; i++)
+                Modbus_VCAN_PowerOn(Modbus_VCAN_GetBoard(i), i + 1, bit_rate);
+            master = Modbus_VCAN_PowerOn(&bench_master, 0, bit_rate);
+            for(j = 0; j < slaves; j++)
+            {
+                arrivals[j] = 0;
+                waiting[j] = 0;
+                last[j] = 0;
+                low[j] = ~(uint64_t)0;
+                high[j] = 0;
+            }
+            start = Modbus_VCAN_Now();
+            //the reference frame, the windows of the slaves one after the other, one frame more which can delay them, and then
+            //the free window
+            if(schedule)
+                Modbus_Set_Schedule(period / tick, (slaves + 2) * window);
+            for(i = 0; i < cycles; i++)
+            {
+                cycle = start + (i * period);
+                if(!schedule)
+                {
+                    Modbus_Set_Priority(MODBUS_PRIORITY_URGENT);
+                    for(j = 0; j < slaves; j++)
+                    {
+                        //a read still waiting for its answer loses the cycle
+                        if(waiting[j])
+                            continue;
+                        bench_poll[(j * BENCH_SNAPSHOT_REGISTERS) + 3] = 0xFFFF;
+                        waiting[j] = !Modbus_Read_I_Registers(j + 1, 122, BENCH_SNAPSHOT_REGISTERS, &bench_poll[j * BENCH_SNAPSHOT_REGISTERS]);
+                        last[j] = cycle;
+                    }
+                    Modbus_Set_Priority(MODBUS_PRIORITY_NORMAL);
+                }
+                while((now = Modbus_VCAN_Now()) < cycle + period)
+                {
+                    //the load, a read of 125 registers in course all the time
+                    if(busy && (bench_registers[124] != 0xFFFF))
+                        busy = 0;
+                    if(!busy)
+                    {
+                        bench_registers[124] = 0xFFFF;
+                        busy = !Modbus_Read_I_Registers(bench_numbers[i % slaves], 0, 125, bench_registers);
+                    }
+                    Modbus_Master_Communication();
+                    Bench_Errors();
+                    for(j = 0; j < slaves; j++)
+                    {
+                        if(schedule)
+                        {
+                            if(Modbus_CAN_GetCache(j + 1, 1, data, &age) < 2 * BENCH_SNAPSHOT_REGISTERS)
+                                continue;
+                            arrival = now - (age * tick);
+                            //a block taken in the last pass is seen again, a bit older
+                            if(arrivals[j] && (arrival < last[j] + (period / 2)))
+                                continue;
+                            last[j] = arrival;
+                            arrival = (arrival - start) % period;
+                        }
+                        else
+                        {
+                            if(!waiting[j] || (bench_poll[(j * BENCH_SNAPSHOT_REGISTERS) + 3] == 0xFFFF))
+                                continue;
+                            waiting[j] = 0;
+                            arrival = now - last[j];
+                        }
+                        arrivals[j]++;
+                        if(arrival < low[j])
+                            low[j] = arrival;
+                        if(arrival > high[j])
+                            high[j] = arrival;
+                    }
+                    Modbus_VCAN_Idle(bench_config.loop_cycles);
+                }
+            }
+            if(schedule)
+                Modbus_Set_Schedule(0, 0);
+            for(j = 0; j < slaves; j++)
+            {
+                result[3 * j] = arrivals[j] ? low[j] / 1e6 : 0;
+                result[(3 * j) + 1] = high[j] / 1e6;
+                result[(3 * j) + 2] = (cycles > arrivals[j]) ? (cycles - arrivals[j]) : 0;
+            }
+            return master;
+}
+
+//! \brief Function to benchmark the time-triggered schedule against the urgent reads at each cycle at a bit rate.
+//!
+//! The cycle is BENCH_CYCLE, or the first multiple of it which has room for the reference frame, the windows of the slaves, one
+//! frame which delays them and a free window as long as a transmit window.
+//! \param bit_rate The bit rate (enum Modbus_CAN_BitRate).
+//! \param slaves Number of slaves.
+//! \param cycles Number of cycles of each kind.
+static void Bench_Schedule(unsigned long bit_rate, unsigned char slaves, unsigned long cycles)
+{
+        double poll[3 * MODBUS_VCAN_NODES], schedule[3 * MODBUS_VCAN_NODES];
+        unsigned long window = (bench_config.cpu_clock / (bit_rate * 1000)) * MODBUS_VCAN_WINDOW_BITS;
+        uint64_t period = BENCH_CYCLE;
+        unsigned char master, j;
+            while((uint64_t)(slaves + 3) * window * (MODBUS_VCAN_SECOND / bench_config.cpu_clock) >= period)
+                period += BENCH_CYCLE;
+            Bench_Schedule_Pass(0, bit_rate, slaves, period, cycles, poll);
+            master = Bench_Schedule_Pass(1, bit_rate, slaves, period, cycles, schedule);
+            for(j = 0; j < slaves; j++)
+            {
+                printf("%6.0f kbit/s  %5.0f %5u %9.1f %9.1f %9.1f %6.0f %9.1f %9.1f %9.1f %6.0f\n",
+                       (double)MODBUS_VCAN_SECOND / Modbus_VCAN_BitTime(master, 0) / 1000.0, period / 1e9, j + 1,
+                       poll[3 * j], poll[(3 * j) + 1], poll[(3 * j) + 1] - poll[3 * j], poll[(3 * j) + 2],
+                       schedule[3 * j], schedule[(3 * j) + 1], schedule[(3 * j) + 1] - schedule[3 * j], schedule[(3 * j) + 2]);
+            }
+}
+#endif
+
+#ifdef MODBUS_CAN_FLOW_CONTROL
+//! \brief Function to measure the writes of 123 registers to a slave, with or without the flow control of the slaves.
+//!
+//! \param flow 1 if the slaves ask for blocks of MODBUS_VCAN_FLOW_BLOCK chunks, 0 for the chunks back to back.
+//! \param slave The slave written; the last one is the slow slave.
+//! \param bit_rate The bit rate (enum Modbus_CAN_BitRate).
+//! \param slaves Number of slaves.
+//! \param writes Number of writes.
+//! \param result Where the median and the maximum time of a write in microseconds, the failed writes, the frames per write, the
+//! frames lost by the overrun of a receive FIFO and the long frames dropped without FLOW control frame are stored.
+//! \return The node of the master.
+static unsigned char Bench_Flow_Pass(unsigned char flow, unsigned char slave, unsigned long bit_rate, unsigned char slaves,
+                                     unsigned long writes, double *result)
+{
+        struct Modbus_VCAN_Stats stats;
+        struct Modbus_CAN_Stats counters;
+        unsigned long i, errors, bad = 0;
+        unsigned char master, node;
+            bench_config.board_option = flow ? MODBUS_VCAN_OPTION_FLOW : 0;
+            Modbus_VCAN_Setup(&bench_config);
+            bench_config.board_option = 0;
+            for(i = 0; i < slaves; i++)
+            {
+                node = Modbus_VCAN_PowerOn(Modbus_VCAN_GetBoard(i), i + 1, bit_rate);
+                if(i == slaves - 1)
+                    Modbus_VCAN_SetIsrCycles(node, (bench_config.cpu_clock / (bit_rate * 1000)) * BENCH_SLOW_ISR_BITS);
+            }
+            master = Modbus_VCAN_PowerOn(&bench_master, 0, bit_rate);
+            Modbus_CAN_GetStats(&counters);
+            result[5] = -(double)counters.flow_timeouts;
+            for(i = 0; i < writes; i++)
+            {
+                bench_latency[i] = Modbus_VCAN_Now();
+                errors = Bench_FC16(slave);
+                Bench_Drain(&errors);
+                bench_latency[i] = Modbus_VCAN_Now() - bench_latency[i];
+                if(errors)
+                    bad++;
+            }
+            Modbus_VCAN_GetStats(&stats);
+            Modbus_CAN_GetStats(&counters);
+            qsort(bench_latency, writes, sizeof(uint64_t), Bench_Compare);
+            result[0] = bench_latency[writes / 2] / 1e6;
+            result[1] = bench_latency[writes - 1] / 1e6;
+            result[2] = bad;
+            result[3] = (double)stats.frames / writes;
+            result[4] = stats.overruns;
+            result[5] += counters.flow_timeouts;
+            return master;
+}
+
+//! \brief Function to benchmark the flow control of the slaves at a bit rate, with the first and the last (slow) slave.
+//!
+//! \param bit_rate The bit rate (enum Modbus_CAN_BitRate).
+//! \param slaves Number of slaves.
+//! \param writes Number of writes of each kind.
+static void Bench_Flow(unsigned long bit_rate, unsigned char slaves, unsigned long writes)
+{
+        double none[6], flow[6];
+        unsigned char master, slave;
+            for(slave = 1; slave <= slaves; slave += (slaves > 1) ? slaves - 1 : 1)
+            {
+                Bench_Flow_Pass(0, slave, bit_rate, slaves, writes, none);
+                master = Bench_Flow_Pass(1, slave, bit_rate, slaves, writes, flow);
+                printf("%6.0f kbit/s  %-5s %9.1f %9.1f %5.0f %7.1f %8.0f %9.1f %9.1f %5.0f %7.1f %8.0f %8.0f\n",
+                       (double)MODBUS_VCAN_SECOND / Modbus_VCAN_BitTime(master, 0) / 1000.0, (slave == slaves) ? "slow" : "fast",
+                       none[0], none[1], none[2], none[3], none[4], flow[0], flow[1], flow[2], flow[3], flow[4], flow[5]);
+            }
+}
+#endif
+
+//! \brief Function to measure the goodput at a bit rate.
+//!
+//! The writes of 123 registers to the first slave and the reads of 125 registers from it are sent one at a time; each one carries
+//! a long frame in one direction, with the transmit path of the variant.
+//! \param bit_rate The bit rate (enum Modbus_CAN_BitRate).
+//! \param slaves Number of slaves.
+//! \param transfers Number of transfers of each direction.
+static void Bench_Goodput(unsigned long bit_rate, unsigned char slaves, unsigned long transfers)
+{
+        double kbps[2];
+        unsigned long i, errors, bad = 0;
+        unsigned char master, read;
+        uint64_t start;
+            Modbus_VCAN_Setup(&bench_config);
+            for(i = 0; i < slaves; i++)
+                Modbus_VCAN_PowerOn(Modbus_VCAN_GetBoard(i), i + 1, bit_rate);
+            master = Modbus_VCAN_PowerOn(&bench_master, 0, bit_rate);
+            for(read = 0; read < 2; read++)
+            {
+                start = Modbus_VCAN_Now();
+                for(i = 0; i < transfers; i++)
+                {
+                    memset(bench_registers, 0xFF, sizeof(bench_registers));
+                    errors = read ? Bench_FC03(1) : Bench_FC16(1);
+                    Bench_Drain(&errors);
+                    if(errors || (read && !Bench_Check_Registers()))
+                        bad++;
+                }
+                //data of the registers, 2 bytes each
+                kbps[read] = (8.0 * 2 * (read ? 125 : 123) * transfers) /
+                             ((double)(Modbus_VCAN_Now() - start) / MODBUS_VCAN_SECOND) / 1000.0;
+            }
+            printf("%6.0f kbit/s  %-8s %11.2f %7.2f %11.2f %7.2f %5lu\n",
+                   (double)MODBUS_VCAN_SECOND / Modbus_VCAN_BitTime(master, 0) / 1000.0, BENCH_TX_PATH, kbps[0],
+                   100.0 * kbps[0] * Modbus_VCAN_BitTime(master, 0) * 1000.0 / MODBUS_VCAN_SECOND, kbps[1],
+                   100.0 * kbps[1] * Modbus_VCAN_BitTime(master, 0) * 1000.0 / MODBUS_VCAN_SECOND, bad);
+}
+
+//! \brief Function to benchmark the recovery of the master from error storms at a bit rate.
+//!
+//! Reads of 1 register are sent one at a time, round robin over the slaves. Every frame is corrupted for BENCH_STORM_BITS after each
+//! read is sent, which takes the master to bus-off; then the error rate of the benchmark is restored, and the time from the end of
+//! the storm to the end of the read is measured. The bus-health counters of the master (Modbus_CAN_GetHealth()) are shown with it.
+//! \param bit_rate The bit rate (enum Modbus_CAN_BitRate).
+//! \param slaves Number of slaves.
+//! \param storms Number of storms.
+static void Bench_Storm(unsigned long bit_rate, unsigned char slaves, unsigned long storms)
+{
+        struct Modbus_CAN_Health health;
+        unsigned long i, errors, bad = 0;
+        unsigned char master;
+        uint64_t end;
+            Modbus_VCAN_Setup(&bench_config);
+            for(i = 0; i < slaves; i++)
+                Modbus_VCAN_PowerOn(Modbus_VCAN_GetBoard(i), i + 1, bit_rate);
+            master = Modbus_VCAN_PowerOn(&bench_master, 0, bit_rate);
+            for(i = 0; i < storms; i++)
+            {
+                memset(bench_registers, 0xFF, sizeof(bench_registers));
+                Modbus_VCAN_SetErrorRate(1);
+                errors = Bench_FC03_1((i % slaves) + 1);
+                end = Modbus_VCAN_Now() + (BENCH_STORM_BITS * Modbus_VCAN_BitTime(master, 0));
+                while(Modbus_VCAN_Now() < end)
+                {
+                    Modbus_Master_Communication();
+                    errors += Bench_Errors();
+                    Modbus_VCAN_Idle(bench_config.loop_cycles);
+                }
+                Modbus_VCAN_SetErrorRate(bench_config.error_rate);
+                Bench_Drain(&errors);
+                bench_latency[i] = Modbus_VCAN_Now() - end;
+                if(errors || !Bench_Check_Register())
+                    bad++;
+            }
+            Modbus_CAN_GetHealth(&health);
+            qsort(bench_latency, storms, sizeof(uint64_t), Bench_Compare);
+            printf("%6.0f kbit/s  %6lu %5lu %8lu %8lu %10lu %7lu %11.1f %11.1f %9.1f %9.1f\n",
+                   (double)MODBUS_VCAN_SECOND / Modbus_VCAN_BitTime(master, 0) / 1000.0, storms, bad, health.bus_off,
+                   health.restarts, health.recoveries, health.replays, health.last_recovery * 1e6 / bench_config.cpu_clock,
+                   health.max_recovery * 1e6 / bench_config.cpu_clock, bench_latency[storms / 2] / 1e6,
+                   bench_latency[storms - 1] / 1e6);
+}
+
+//! \brief Function to benchmark the priority classes under the mixed load at a bit rate.
+//!
+//! \param bit_rate The bit rate (enum Modbus_CAN_BitRate).
+//! \param slaves Number of slaves, at least 2.
+//! \param samples Number of requests measured with each class.
+//! \param depth Reads of 125 registers waiting or in flight.
+static void Bench_Mixed(unsigned long bit_rate, unsigned char slaves, unsigned long samples, unsigned long depth)
+{
+        double normal[3], urgent[3];
+        unsigned char master;
+            Bench_Mixed_Pass(MODBUS_PRIORITY_NORMAL, bit_rate, slaves, samples, depth, normal);
+            master = Bench_Mixed_Pass(MODBUS_PRIORITY_URGENT, bit_rate, slaves, samples, depth, urgent);
+            printf("%6.0f kbit/s  %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+                   (double)MODBUS_VCAN_SECOND / Modbus_VCAN_BitTime(master, 0) / 1000.0,
+                   normal[0], normal[1], normal[2], urgent[0], urgent[1], urgent[2]);
+}
+
+int main(int argc, char **argv)
+{
+        unsigned long bit_rates[] = { MODBUS_1MBPS, MODBUS_500KBPS, MODBUS_100KBPS };
+        unsigned long rates = sizeof(bit_rates) / sizeof(bit_rates[0]);
+        unsigned long requests = 200, depth = 64, boards = 0, slaves = 4, i, b;
+        int opt;
+            bench_config.cpu_clock = BENCH_CPU_CLOCK;
+            bench_config.can_clock = BENCH_CAN_CLOCK;
+            bench_config.loop_cycles = 200;
+            bench_config.work_cycles = 20000;
+            bench_config.isr_cycles = 300;
+            bench_config.error_rate = 0;
+            bench_config.seed = 1;
+            while(Modbus_VCAN_GetBoard(boards))
+                boards++;
+            for(opt = 1; opt < argc; opt++)
+            {
+                if((argv[opt][0] != '-') || (opt + 1 >= argc))
+                    goto usage;
+                switch(argv[opt][1])
+                {
+                    case 'n': slaves = strtoul(argv[++opt], NULL, 0); break;
+                    case 'r': requests = strtoul(argv[++opt], NULL, 0); break;
+                    case 'q': depth = strtoul(argv[++opt], NULL, 0); break;
+                    case 'e': bench_config.error_rate = strtod(argv[++opt], NULL); break;
+                    case 's': bench_config.seed = strtoul(argv[++opt], NULL, 0); break;
+                    case 'c': bench_config.can_clock = strtoul(argv[++opt], NULL, 0); break;
+                    case 'b': bit_rates[0] = strtoul(argv[++opt], NULL, 0); rates = 1; break;
+                    case 'l': bench_config.loop_cycles = strtoul(argv[++opt], NULL, 0); break;
+                    case 'w': bench_config.work_cycles = strtoul(argv[++opt], NULL, 0); break;
+                    default: goto usage;
+                }
+            }
+            if(!slaves || (slaves > boards) || !requests || !depth || (depth > 250) || !bit_rates[0] || (bit_rates[0] > 1000))
+                goto usage;
+            bench_latency = malloc(requests * sizeof(uint64_t));
+            if(!bench_latency)
+                return 1;
+            for(i = 0; i < 125; i++)
+                bench_values[i] = i;
+            for(i = 0; i < 2000; i++)
+                bench_coils[i] = 1;
+            for(i = 0; i < slaves; i++)
+                bench_numbers[i] = i + 1;
+            bench_slaves = slaves;
+            printf("%lu slaves, %lu requests, queue depth %lu, error rate %g, CAN clock %lu Hz, %s long frames\n",
+                   slaves, requests, depth, bench_config.error_rate, bench_config.can_clock, BENCH_TX_PATH);
+            printf("goodput, %d transfers of each direction one at a time: data of the registers per second\n",
+                   BENCH_GOODPUT_TRANSFERS);
+            printf("%13s  %-8s %19s %19s\n", "", "", "write 123 registers", "read 125 registers");
+            printf("%13s  %-8s %11s %7s %11s %7s %5s\n", "bit rate", "path", "kbit/s", "% rate", "kbit/s", "% rate", "bad");
+            for(b = 0; b < rates; b++)
+                Bench_Goodput(bit_rates[b], slaves, BENCH_GOODPUT_TRANSFERS);
+#ifdef MODBUS_CAN_TX_DELAYED
+            //a long frame lasts seconds with the fixed delay, so the rest would last hours
+            free(bench_latency);
+            return 0;
+#endif
+            printf("%13s  %-24s %6s %5s %7s %9s %9s %6s %9s %9s %9s %9s\n", "bit rate", "function", "PDUs", "bad", "retries",
+                   "frames/s", "PDUs/s", "util%", "p50 us", "p90 us", "p99 us", "max us");
+            for(b = 0; b < rates; b++)
+            {
+                for(i = 0; i < sizeof(bench_workloads) / sizeof(bench_workloads[0]); i++)
+                    Bench_Run(&bench_workloads[i], bit_rates[b], slaves, requests, depth);
+            }
+            if(slaves >= 2)
+            {
+                printf("mixed load: read of 1 register to slave %lu while %lu reads of 125 registers to the rest are waiting\n",
+                       slaves, depth);
+                printf("%13s  %29s %29s\n", "", "normal class (us)", "urgent class (us)");
+                printf("%13s  %9s %9s %9s %9s %9s %9s\n", "bit rate", "p50", "p99", "max", "p50", "p99", "max");
+                for(b = 0; b < rates; b++)
+                    Bench_Mixed(bit_rates[b], slaves, (requests + 9) / 10, depth);
+            }
+            printf("error storms: every frame corrupted for %d bit times after a read of 1 register, then error rate %g\n",
+                   BENCH_STORM_BITS, bench_config.error_rate);
+            printf("%13s  %6s %5s %8s %8s %10s %7s %11s %11s %9s %9s\n", "bit rate", "storms", "bad", "bus-offs", "restarts",
+                   "recoveries", "replays", "last rec us", "max rec us", "p50 us", "max us");
+            for(b = 0; b < rates; b++)
+                Bench_Storm(bit_rates[b], slaves, (requests + 19) / 20);
+            if(slaves <= MODBUS_CAN_GROUP_MAX)
+            {
+                printf("poll of %d registers of the %lu slaves\n", BENCH_POLL_REGISTERS, slaves);
+                printf("%13s  %33s %33s\n", "", "one read per slave", "one group poll");
+                printf("%13s  %9s %9s %7s %5s %9s %9s %7s %5s\n", "bit rate", "p50 us", "max us", "frames", "bad",
+                       "p50 us", "max us", "frames", "bad");
+                for(b = 0; b < rates; b++)
+                    Bench_Poll(bit_rates[b], slaves, requests);
+            }
+#ifdef MODBUS_CAN_PUBLISH
+            printf("read of %d registers, one slave at a time\n", BENCH_SNAPSHOT_REGISTERS);
+            printf("%13s  %40s %40s\n", "", "read of holding registers", "read of the published block");
+            printf("%13s  %9s %9s %7s %6s %5s %9s %9s %7s %6s %5s\n", "bit rate", "p50 us", "max us", "frames", "ints", "bad",
+                   "p50 us", "max us", "frames", "ints", "bad");
+            for(b = 0; b < rates; b++)
+                Bench_Snapshot(bit_rates[b], slaves, requests);
+            printf("scan of a process value which changes every 100 ms, every 10 ms in the %lu slaves\n", slaves);
+            printf("%13s  %37s %37s\n", "", "polling", "cache and change of state");
+            printf("%13s  %9s %9s %9s %7s %9s %9s %9s %7s\n", "bit rate", "frames/s", "ints/s", "p50 us", "stale%",
+                   "frames/s", "ints/s", "p50 us", "stale%");
+            for(b = 0; b < rates; b++)
+                Bench_Cos(bit_rates[b], slaves, requests);
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+            printf("periodic data of the %lu slaves at each cycle, while a read of 125 registers is always in course\n", slaves);
+            printf("%13s  %5s %5s %36s %36s\n", "", "", "", "urgent read at each cycle (us)", "time-triggered schedule (us)");
+            printf("%13s  %5s %5s %9s %9s %9s %6s %9s %9s %9s %6s\n", "bit rate", "ms", "slave", "min", "max", "jitter", "lost",
+                   "min", "max", "jitter", "lost");
+            for(b = 0; b < rates; b++)
+                Bench_Schedule(bit_rates[b], slaves, requests);
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+            printf("writes of 123 registers, slave %lu takes %d bit times in each interruption\n", slaves, BENCH_SLOW_ISR_BITS);
+            printf("%13s  %5s %42s %51s\n", "", "", "chunks back to back", "flow control, blocks of the receive FIFO");
+            printf("%13s  %5s %9s %9s %5s %7s %8s %9s %9s %5s %7s %8s %8s\n", "bit rate", "slave", "p50 us", "max us", "bad",
+                   "frames", "overruns", "p50 us", "max us", "bad", "frames", "overruns", "timeouts");
+            for(b = 0; b < rates; b++)
+                Bench_Flow(bit_rates[b], slaves, (requests + 19) / 20);
+#endif
+#ifdef MODBUS_CAN_BROADCAST_ACK
+            printf("broadcasts acknowledged by the %lu slaves\n", slaves);
+            printf("%13s  %-24s %6s %5s %9s %9s %12s\n", "bit rate", "function", "PDUs", "bad", "p50 us", "max us", "timeout us");
+            for(b = 0; b < rates; b++)
+            {
+                for(i = 0; i < sizeof(bench_broadcasts) / sizeof(bench_broadcasts[0]); i++)
+                    Bench_Broadcast(&bench_broadcasts[i], bit_rates[b], slaves, requests);
+            }
+#endif
+            free(bench_latency);
+            return 0;
+        usage:
+            fprintf(stderr, "usage: %s [-n slaves (1-%lu)] [-r requests] [-q queue depth (1-250)] [-e error rate]"
+                            " [-s seed] [-c CAN clock] [-b bit rate in Kbps (1-1000)] [-l loop cycles]"
+                            " [-w work cycles]\n", argv[0], boards);
+            return 2;
+}
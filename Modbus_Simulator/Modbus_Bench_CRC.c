@@ -0,0 +1,279 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+/**
+*   @defgroup Bench_CRC Benchmark of the CRC
+*   @ingroup VCAN
+*   @brief Checks and times the CRC-16 of the Modbus RTU frames, Modbus_OSL_RTU_CRC(), on the Linux host.
+*
+*   @author Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+*
+*   The master sources are built once for each way of computing the CRC which can be chosen at compile time: the two tables of
+*   256 characters of the specification (crc_table), a table of 16 words indexed by nibbles (MODBUS_OSL_RTU_CRC_NIBBLE,
+*   crc_nibble), and 4 or 8 tables of 256 words which take 4 or 8 characters in each step (MODBUS_OSL_RTU_CRC_SLICE4 and
+*   MODBUS_OSL_RTU_CRC_SLICE8, crc_slice4 and crc_slice8).
+*
+*   First, the CRC is checked: the check value of "123456789" (0x4B37), the CRC of every length from 0 to 256 characters at
+*   every alignment against both CRC16() of the specification, with the bench's own copies of its tables, and the CRC computed
+*   bit by bit, the CRC of a frame continued in two calls cut at every character, and the last 2 characters of the frames
+*   built by Modbus_OSL_RTU_Mount_ADU(). So crc_table is checked directly against the lookup of the specification, and the
+*   new ways against it too.
+*
+*   Then, for 1, 8, 11, 64 and 256 characters, the time of the CRC per character is reported in ns and, on x86, in cycles of
+*   the time stamp counter. The receive interruption adds each character to the CRC of the frame (1) or, with the UART FIFO, each
+*   burst (11), so that only a compare is left at the end of the frame, where the whole frame (up to 256) was gone through
+*   before. These are the figures of the host; on the board, Modbus_OSL_RTU_CRC_Cycles() (built with
+*   MODBUS_OSL_RTU_CRC_BENCH) counts the cycles with the DWT unit of the Cortex-M3.
+*
+*   Usage: modbus_bench_crc [-m millions of characters per length]
+*/
+/** @{ */
+//includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stdint.h"
+#include "Master/Modbus_OSL_RTU.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+//! Characters of the longest frame checked.
+#define BENCH_CRC_MAX 256
+//! Alignments checked for each length.
+#define BENCH_CRC_ALIGN 8
+
+#if defined(MODBUS_OSL_RTU_CRC_SLICE8)
+#define BENCH_CRC_NAME "slicing-by-8"
+#define BENCH_CRC_TABLES (8 * 256 * 2)
+#elif defined(MODBUS_OSL_RTU_CRC_SLICE4)
+#define BENCH_CRC_NAME "slicing-by-4"
+#define BENCH_CRC_TABLES (4 * 256 * 2)
+#elif defined(MODBUS_OSL_RTU_CRC_NIBBLE)
+#define BENCH_CRC_NAME "nibble"
+#define BENCH_CRC_TABLES (16 * 2)
+#else
+#define BENCH_CRC_NAME "tables of the spec"
+#define BENCH_CRC_TABLES (2 * 256)
+#endif
+
+//! Characters of the checks and of the timings
+static unsigned char bench_data[BENCH_CRC_MAX + BENCH_CRC_ALIGN];
+//! Result of the timings, so the compiler keeps them
+static volatile uint16_t bench_sink;
+//! @}
+
+//! Table of the specification for the byte sent first, uchCRCHi; a copy of its own, not the one of Modbus_OSL_RTU.c.
+static const unsigned char bench_auchCRCHi[] = {
+0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
+0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
+0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01,
+0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41,
+0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81,
+0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0,
+0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01,
+0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40,
+0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
+0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
+0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01,
+0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
+0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
+0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
+0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01,
+0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41,
+0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
+0x40
+};
+
+//! Table of the specification for the byte sent last, uchCRCLo; a copy of its own too.
+static const unsigned char bench_auchCRCLo[] = {
+0x00, 0xC0, 0xC1, 0x01, 0xC3, 0x03, 0x02, 0xC2, 0xC6, 0x06, 0x07, 0xC7, 0x05, 0xC5, 0xC4,
+0x04, 0xCC, 0x0C, 0x0D, 0xCD, 0x0F, 0xCF, 0xCE, 0x0E, 0x0A, 0xCA, 0xCB, 0x0B, 0xC9, 0x09,
+0x08, 0xC8, 0xD8, 0x18, 0x19, 0xD9, 0x1B, 0xDB, 0xDA, 0x1A, 0x1E, 0xDE, 0xDF, 0x1F, 0xDD,
+0x1D, 0x1C, 0xDC, 0x14, 0xD4, 0xD5, 0x15, 0xD7, 0x17, 0x16, 0xD6, 0xD2, 0x12, 0x13, 0xD3,
+0x11, 0xD1, 0xD0, 0x10, 0xF0, 0x30, 0x31, 0xF1, 0x33, 0xF3, 0xF2, 0x32, 0x36, 0xF6, 0xF7,
+0x37, 0xF5, 0x35, 0x34, 0xF4, 0x3C, 0xFC, 0xFD, 0x3D, 0xFF, 0x3F, 0x3E, 0xFE, 0xFA, 0x3A,
+0x3B, 0xFB, 0x39, 0xF9, 0xF8, 0x38, 0x28, 0xE8, 0xE9, 0x29, 0xEB, 0x2B, 0x2A, 0xEA, 0xEE,
+0x2E, 0x2F, 0xEF, 0x2D, 0xED, 0xEC, 0x2C, 0xE4, 0x24, 0x25, 0xE5, 0x27, 0xE7, 0xE6, 0x26,
+0x22, 0xE2, 0xE3, 0x23, 0xE1, 0x21, 0x20, 0xE0, 0xA0, 0x60, 0x61, 0xA1, 0x63, 0xA3, 0xA2,
+0x62, 0x66, 0xA6, 0xA7, 0x67, 0xA5, 0x65, 0x64, 0xA4, 0x6C, 0xAC, 0xAD, 0x6D, 0xAF, 0x6F,
+0x6E, 0xAE, 0xAA, 0x6A, 0x6B, 0xAB, 0x69, 0xA9, 0xA8, 0x68, 0x78, 0xB8, 0xB9, 0x79, 0xBB,
+0x7B, 0x7A, 0xBA, 0xBE, 0x7E, 0x7F, 0xBF, 0x7D, 0xBD, 0xBC, 0x7C, 0xB4, 0x74, 0x75, 0xB5,
+0x77, 0xB7, 0xB6, 0x76, 0x72, 0xB2, 0xB3, 0x73, 0xB1, 0x71, 0x70, 0xB0, 0x50, 0x90, 0x91,
+0x51, 0x93, 0x53, 0x52, 0x92, 0x96, 0x56, 0x57, 0x97, 0x55, 0x95, 0x94, 0x54, 0x9C, 0x5C,
+0x5D, 0x9D, 0x5F, 0x9F, 0x9E, 0x5E, 0x5A, 0x9A, 0x9B, 0x5B, 0x99, 0x59, 0x58, 0x98, 0x88,
+0x48, 0x49, 0x89, 0x4B, 0x8B, 0x8A, 0x4A, 0x4E, 0x8E, 0x8F, 0x4F, 0x8D, 0x4D, 0x4C, 0x8C,
+0x44, 0x84, 0x85, 0x45, 0x87, 0x47, 0x46, 0x86, 0x82, 0x42, 0x43, 0x83, 0x41, 0x81, 0x80,
+0x40
+};
+
+
+//! \brief CRC-16 of Modbus computed bit by bit, the reference of the checks.
+//! \param crc CRC of the previous characters, 0xFFFF at the start of the frame
+//! \param data first character
+//! \param length number of characters
+//! \return CRC up to the last character
+static uint16_t Bench_CRC_Bitwise(uint16_t crc, const unsigned char *data, unsigned long length)
+{
+        unsigned char bit;
+            while(length--)
+            {
+                crc ^= *data++;
+                for(bit = 0; bit < 8; bit++)
+                    crc = (crc & 1) ? ((crc >> 1) ^ 0xA001) : (crc >> 1);
+            }
+            return crc;
+}
+
+//! \brief CRC16() of the specification, with its own copies of the tables.
+//! \param puchMsg first character
+//! \param usDataLen number of characters
+//! \return CRC with the byte sent first in the high byte, as the specification returns it
+static uint16_t Bench_CRC_Spec(const unsigned char *puchMsg, unsigned long usDataLen)
+{
+        unsigned char uchCRCHi = 0xFF, uchCRCLo = 0xFF;
+        unsigned uIndex;
+            while(usDataLen--)
+            {
+                uIndex = uchCRCHi ^ *puchMsg++;
+                uchCRCHi = uchCRCLo ^ bench_auchCRCHi[uIndex];
+                uchCRCLo = bench_auchCRCLo[uIndex];
+            }
+            return (uchCRCHi << 8) | uchCRCLo;
+}
+
+//! \brief Checks Modbus_OSL_RTU_CRC() against Bench_CRC_Spec() and Bench_CRC_Bitwise(), and Modbus_OSL_RTU_Mount_ADU()
+//! against Bench_CRC_Bitwise().
+//! \return number of CRC checked, 0 if any of them is wrong
+static unsigned long Bench_CRC_Check(void)
+{
+        unsigned char pdu[BENCH_CRC_MAX], adu[BENCH_CRC_MAX + 3];
+        unsigned long length, align, cut, checks = 0;
+        uint16_t crc, expected;
+            if(Modbus_OSL_RTU_CRC(0xFFFF, (const unsigned char *)"123456789", 9) != 0x4B37)
+            {
+                printf("check value of \"123456789\" is 0x%04X, not 0x4B37\n",
+                       Modbus_OSL_RTU_CRC(0xFFFF, (const unsigned char *)"123456789", 9));
+                return 0;
+            }
+            checks++;
+            for(length = 0; length <= BENCH_CRC_MAX; length++)
+            {
+                for(align = 0; align < BENCH_CRC_ALIGN; align++)
+                {
+                    crc = Modbus_OSL_RTU_CRC(0xFFFF, bench_data + align, length);
+                    expected = Bench_CRC_Spec(bench_data + align, length);
+                    expected = (expected >> 8) | ((expected & 0xFF) << 8);
+                    if(crc != expected)
+                    {
+                        printf("%lu characters at +%lu: 0x%04X, not 0x%04X of the specification\n", length, align,
+                               crc, expected);
+                        return 0;
+                    }
+                    checks++;
+                    expected = Bench_CRC_Bitwise(0xFFFF, bench_data + align, length);
+                    if(crc != expected)
+                    {
+                        printf("%lu characters at +%lu: 0x%04X, not 0x%04X\n", length, align, crc, expected);
+                        return 0;
+                    }
+                    checks++;
+                }
+            }
+            expected = Bench_CRC_Bitwise(0xFFFF, bench_data, BENCH_CRC_MAX);
+            for(cut = 0; cut <= BENCH_CRC_MAX; cut++)
+            {
+                crc = Modbus_OSL_RTU_CRC(0xFFFF, bench_data, cut);
+                crc = Modbus_OSL_RTU_CRC(crc, bench_data + cut, BENCH_CRC_MAX - cut);
+                if(crc != expected)
+                {
+                    printf("frame cut at %lu: 0x%04X, not 0x%04X\n", cut, crc, expected);
+                    return 0;
+                }
+                checks++;
+            }
+            for(length = 1; length <= BENCH_CRC_MAX - 3; length++)
+            {
+                memcpy(pdu, bench_data + length % BENCH_CRC_ALIGN, length);
+                Modbus_OSL_RTU_Mount_ADU(pdu, 17, length, adu);
+                expected = Bench_CRC_Bitwise(0xFFFF, adu, length + 1);
+                if((adu[length + 1] != (expected & 0xFF)) || (adu[length + 2] != (expected >> 8)))
+                {
+                    printf("frame of %lu characters built with CRC %02X %02X, not %02X %02X\n", length + 1,
+                           adu[length + 1], adu[length + 2], expected & 0xFF, expected >> 8);
+                    return 0;
+                }
+                checks++;
+            }
+            return checks;
+}
+
+//! \brief Times the CRC of frames of a length.
+//! \param length characters of each frame
+//! \param characters characters to go through in all
+//! \param[out] cycles cycles of the time stamp counter per character, negative if there is no counter
+//! \return ns per character
+static double Bench_CRC_Time(unsigned long length, unsigned long characters, double *cycles)
+{
+        unsigned long frames = characters / length, i;
+        struct timespec start, end;
+        uint16_t crc = 0;
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned long long tsc;
+#endif
+            clock_gettime(CLOCK_MONOTONIC, &start);
+#if defined(__x86_64__) || defined(__i386__)
+            tsc = __rdtsc();
+#endif
+            for(i = 0; i < frames; i++)
+                crc ^= Modbus_OSL_RTU_CRC(0xFFFF, bench_data + (i & 1), length);
+#if defined(__x86_64__) || defined(__i386__)
+            *cycles = (double)(__rdtsc() - tsc) / ((double)frames * length);
+#else
+            *cycles = -1;
+#endif
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            bench_sink = crc;
+            return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / ((double)frames * length);
+}
+
+int main(int argc, char **argv)
+{
+        unsigned long lengths[] = { 1, 8, 11, 64, 256 };
+        unsigned long characters = 50000000, checks, i;
+        double ns, cycles;
+        int opt;
+            for(opt = 1; opt < argc; opt++)
+            {
+                if((argv[opt][0] != '-') || (opt + 1 >= argc))
+                    goto usage;
+                switch(argv[opt][1])
+                {
+                    case 'm': characters = strtoul(argv[++opt], NULL, 0) * 1000000UL; break;
+                    default: goto usage;
+                }
+            }
+            if(!characters)
+                goto usage;
+            srand(1);
+            for(i = 0; i < sizeof(bench_data); i++)
+                bench_data[i] = rand() >> 7;
+            Modbus_OSL_RTU_CRC_Init();
+            checks = Bench_CRC_Check();
+            if(!checks)
+                return 1;
+            printf("%s, %d bytes of tables, %lu CRC equal to the specification and bitwise ones\n", BENCH_CRC_NAME,
+                   BENCH_CRC_TABLES, checks);
+            printf("%6s %8s %12s\n", "chars", "ns/char", "cycles/char");
+            for(i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+            {
+                ns = Bench_CRC_Time(lengths[i], characters, &cycles);
+                if(cycles < 0)
+                    printf("%6lu %8.2f %12s\n", lengths[i], ns, "-");
+                else
+                    printf("%6lu %8.2f %12.2f\n", lengths[i], ns, cycles);
+            }
+            return 0;
+    usage:
+            fprintf(stderr, "usage: %s [-m millions of characters per length]\n", argv[0]);
+            return 2;
+}
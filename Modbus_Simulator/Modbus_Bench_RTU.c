@@ -0,0 +1,374 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+/**
+*   @defgroup Bench_RTU Benchmark of the serial line
+*   @ingroup VCAN
+*   @brief Transactions and interruptions of the Modbus RTU master and slaves on the virtual serial line.
+*
+*   @author Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+*
+*   The real serial master (Modbus_Project_Master built with OSL_Mode) is the foreground node and the serial slaves are linked
+*   several times, as in the CAN benchmark; all of them share the line, 8 data bits, even parity and 1 stop bit. For each baud
+*   rate and request, the requests are sent one by one, round robin over the slaves, and the transactions per second, the
+*   characters of each transaction and the interruption handlers run by the slaves and by the master are reported. The slaves
+*   hear every character of the line, so their interruptions per character are counted over the characters of the line and the
+*   slaves. The longest call to the request functions or to Modbus_Master_Communication() and the longest pass of the main loop of the slaves, in ms, show
+*   how long the sending of a frame keeps the program from doing anything else.
+*
+*   Then a read of 4 registers is sent to the slave 1 character by character, with a silence of 1, 2 and 3 characters after the
+*   third one, with a parity error in the fifth one, and with a wrong CRC, and whether the slave answers it is shown: the frame is
+*   discarded if the time between the receive interruptions of two characters is longer than T1.5 (1.5 characters, fixed to 750 us
+*   above 19200 bps), a character has a parity error or the CRC computed by the slave while the characters arrive is not the one of
+*   the frame. The interruption of a character comes at its stop bit, so that time is the silence plus the next character, and the
+*   longest silence allowed (the limit column) is T1.5 minus one character: half a character up to 19200 bps, so the silence of
+*   1 character is already discarded there.
+*
+*   The baud rates are 9600, 19200, 38400 and 115200; -b runs only the one given.
+*
+*   Usage: modbus_bench_rtu [-n slaves] [-r requests] [-b baud rate] [-l loop cycles] [-w work cycles]
+*/
+/** @{ */
+//includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stdint.h"
+#include "inc/hw_ints.h"
+#include "inc/hw_types.h"
+#include "inc/hw_memmap.h"
+#include "driverlib/uart.h"
+#include "Master/Modbus_App.h"
+#include "Modbus_VCAN.h"
+
+//! System clock of the boards, 40 MHz (PLL / 5).
+#define BENCH_CPU_CLOCK 40000000UL
+//! Virtual time without progress after which the benchmark is stopped, in picoseconds (10 s).
+#define BENCH_STUCK (10 * MODBUS_VCAN_SECOND)
+//! Cycles given to the nodes after the power on to leave their initial state (10 ms).
+#define BENCH_START (BENCH_CPU_CLOCK / 100)
+//! Bits of each character in the line: start, 8 data bits, parity and stop.
+#define BENCH_CHAR_BITS 11
+//! Characters of the read sent by hand to test the silences.
+#define BENCH_GAP_FRAME 8
+//! Character after which the silence is made.
+#define BENCH_GAP_AT 3
+
+//! Request benchmarked.
+struct Bench_Workload
+{
+      const char *name;                                 //!< Name in the table
+      unsigned char (*request)(unsigned char slave);    //!< Sends a request, returns what the request function returned
+      unsigned char (*check)(void);                     //!< Checks the data read, returns 1 if it is right; NULL for the writes
+};
+
+//-DATA OF THE REQUESTS
+static uint16_t bench_registers[125];
+static uint16_t bench_values[125];
+//! Parameters of the simulation
+static struct Modbus_VCAN_Config bench_config;
+//! Longest call to Modbus_Master_Communication(), in picoseconds
+static uint64_t bench_master_loop;
+//! @}
+
+//handlers of the serial master, in its startup file on the board
+void UART1IntHandler(void);
+void Timer0IntHandler(void);
+void Timer1IntHandler(void);
+void Timer2IntHandler(void);
+
+static void Bench_Master_Init(unsigned char number, unsigned long baud_rate);
+
+//! Board of the master; it is the foreground node.
+static struct Modbus_VCAN_Board bench_master =
+{
+    .name = "master",
+    .init = Bench_Master_Init,
+    .loop = NULL,
+    .vectors = { [INT_UART1] = UART1IntHandler,
+                 [INT_TIMER0A] = Timer0IntHandler,
+                 [INT_TIMER1A] = Timer1IntHandler,
+                 [INT_TIMER2A] = Timer2IntHandler }
+};
+
+//! \brief Function to initialise the master, as the init() of maintest.c in serial mode.
+static void Bench_Master_Init(unsigned char number, unsigned long baud_rate)
+{
+        Modbus_Master_Init(MODBUS_SERIAL, (enum Baud)baud_rate, 3, MODBUS_OSL_MODE_RTU);
+}
+
+static unsigned char Bench_FC03(unsigned char slave) { return Modbus_Read_H_Registers(slave, 0, 125, bench_registers); }
+static unsigned char Bench_FC03_4(unsigned char slave) { return Modbus_Read_H_Registers(slave, 7, 4, bench_registers); }
+static unsigned char Bench_FC16(unsigned char slave) { return Modbus_Write_M_Registers(slave, 0, 123, bench_values); }
+
+//! \brief Function to check the registers read: the register i is i, the writes of the benchmark keep it.
+static unsigned char Bench_Check_Registers(void)
+{
+        uint16_t i;
+            for(i = 0; i < 125; i++)
+            {
+                if(bench_registers[i] != i)
+                    return 0;
+            }
+            return 1;
+}
+
+//! \brief Function to check the registers 7 to 10.
+static unsigned char Bench_Check_Block(void)
+{
+        uint16_t i;
+            for(i = 0; i < 4; i++)
+            {
+                if(bench_registers[i] != i + 7)
+                    return 0;
+            }
+            return 1;
+}
+
+//! Requests benchmarked: the longest frames of each direction and a short poll.
+static const struct Bench_Workload bench_workloads[] =
+{
+    { "03 read 125 registers",   Bench_FC03,   Bench_Check_Registers },
+    { "16 write 123 registers",  Bench_FC16,   NULL },
+    { "03 read 4 registers",     Bench_FC03_4, Bench_Check_Block },
+};
+
+//! \brief Function to count the requests which failed, from the Error FIFO of the master.
+static unsigned long Bench_Errors(void)
+{
+        struct Modbus_FIFO_E_Item error;
+        unsigned long errors = 0;
+            while(Modbus_Get_Error(&error))
+                errors++;
+            return errors;
+}
+
+//! \brief Function to run the master until it has no request left.
+//!
+//! \param errors Where the failed requests are added.
+static void Bench_Drain(unsigned long *errors)
+{
+        uint64_t start = Modbus_VCAN_Now(), call;
+        unsigned char more;
+            for(;;)
+            {
+                call = Modbus_VCAN_Now();
+                more = Modbus_Master_Communication();
+                if((Modbus_VCAN_Now() - call) > bench_master_loop)
+                    bench_master_loop = Modbus_VCAN_Now() - call;
+                if(!more)
+                    break;
+                *errors += Bench_Errors();
+                Modbus_VCAN_Idle(bench_config.loop_cycles);
+                if((Modbus_VCAN_Now() - start) > BENCH_STUCK)
+                {
+                    fprintf(stderr, "bench: the master did not finish its requests\n");
+                    exit(1);
+                }
+            }
+            *errors += Bench_Errors();
+}
+
+//! \brief Function to power on the slaves and the master, and let them leave their initial state.
+//!
+//! \param baud_rate The baud rate.
+//! \param slaves Number of slaves; they are the nodes 0 to _slaves_ - 1.
+//! \return The node of the master.
+static unsigned char Bench_PowerOn(unsigned long baud_rate, unsigned char slaves)
+{
+        unsigned char i, master;
+            Modbus_VCAN_Setup(&bench_config);
+            for(i = 0; i < slaves; i++)
+                Modbus_VCAN_PowerOn(Modbus_VCAN_GetBoard(i), i + 1, baud_rate);
+            master = Modbus_VCAN_PowerOn(&bench_master, 0, baud_rate);
+            Modbus_VCAN_Idle(BENCH_START);
+            return master;
+}
+
+//! \brief Function to count the interruption handlers run by the slaves.
+//!
+//! \param slaves Number of slaves.
+static uint64_t Bench_Slave_Interrupts(unsigned char slaves)
+{
+        uint64_t count = 0;
+        unsigned char i;
+            for(i = 0; i < slaves; i++)
+                count += Modbus_VCAN_GetInterrupts(i, 0);
+            return count;
+}
+
+//! \brief Function to benchmark a request at a baud rate.
+//!
+//! \param workload The request.
+//! \param baud_rate The baud rate.
+//! \param slaves Number of slaves.
+//! \param requests Number of requests.
+static void Bench_Run(const struct Bench_Workload *workload, unsigned long baud_rate, unsigned char slaves,
+                      unsigned long requests)
+{
+        struct Modbus_VCAN_Stats stats;
+        unsigned long i, j, bad = 0;
+        unsigned char master;
+        uint64_t start, elapsed, slave_ints, master_ints, chars, slave_chars = 0, slave_loop = 0, loop, call;
+        double seconds;
+            master = Bench_PowerOn(baud_rate, slaves);
+            Modbus_VCAN_GetStats(&stats);
+            chars = stats.uart_chars;
+            slave_ints = Bench_Slave_Interrupts(slaves);
+            master_ints = Modbus_VCAN_GetInterrupts(master, 0);
+            for(j = 0; j < slaves; j++)
+            {
+                slave_chars -= Modbus_VCAN_UartChars(j);
+                Modbus_VCAN_LongestLoop(j);
+            }
+            bench_master_loop = 0;
+            start = Modbus_VCAN_Now();
+            for(i = 0; i < requests; i++)
+            {
+                memset(bench_registers, 0xFF, sizeof(bench_registers));
+                call = Modbus_VCAN_Now();
+                workload->request((i % slaves) + 1);
+                if((Modbus_VCAN_Now() - call) > bench_master_loop)
+                    bench_master_loop = Modbus_VCAN_Now() - call;
+                j = 0;
+                Bench_Drain(&j);
+                if(j || (workload->check && !workload->check()))
+                    bad++;
+            }
+            elapsed = Modbus_VCAN_Now() - start;
+            Modbus_VCAN_GetStats(&stats);
+            chars = stats.uart_chars - chars;
+            slave_ints = Bench_Slave_Interrupts(slaves) - slave_ints;
+            master_ints = Modbus_VCAN_GetInterrupts(master, 0) - master_ints;
+            for(j = 0; j < slaves; j++)
+            {
+                slave_chars += Modbus_VCAN_UartChars(j);
+                loop = Modbus_VCAN_LongestLoop(j);
+                if(loop > slave_loop)
+                    slave_loop = loop;
+            }
+            //a slave does not hear its own characters
+            slave_chars = (chars * slaves) - slave_chars;
+            seconds = (double)elapsed / MODBUS_VCAN_SECOND;
+            printf("%8lu  %-24s %6lu %5lu %9.1f %7.1f %10.1f %9.3f %11.1f %11.2f %10.2f %6llu\n", baud_rate, workload->name,
+                   requests, bad, requests / seconds, (double)chars / requests, (double)slave_ints / requests,
+                   (double)slave_ints / slave_chars, (double)master_ints / requests,
+                   (double)bench_master_loop * 1000 / MODBUS_VCAN_SECOND, (double)slave_loop * 1000 / MODBUS_VCAN_SECOND,
+                   (unsigned long long)(stats.uart_errors + stats.uart_overruns));
+}
+
+//! \brief Function to get the CRC of a frame, bit by bit.
+//!
+//! \param frame The frame.
+//! \param length Its characters.
+//! \return The CRC, the low byte goes first in the line.
+static uint16_t Bench_CRC(const unsigned char *frame, unsigned char length)
+{
+        uint16_t crc = 0xFFFF;
+        unsigned char i, bit;
+            for(i = 0; i < length; i++)
+            {
+                crc ^= frame[i];
+                for(bit = 0; bit < 8; bit++)
+                    crc = (crc & 1) ? ((crc >> 1) ^ 0xA001) : (crc >> 1);
+            }
+            return crc;
+}
+
+//! \brief Function to send a read of 4 registers to the slave 1 by hand, and tell whether it answers.
+//!
+//! \param baud_rate The baud rate.
+//! \param silence Characters of silence after the character BENCH_GAP_AT.
+//! \param corrupt 1 to send the character after the silence with a parity error, 2 to send a wrong CRC.
+//! \return 1 if the slave answered.
+static unsigned char Bench_Gap(unsigned long baud_rate, unsigned char silence, unsigned char corrupt)
+{
+        unsigned char frame[BENCH_GAP_FRAME] = { 1, 3, 0, 7, 0, 4 }, i;
+        uint16_t crc = Bench_CRC(frame, BENCH_GAP_FRAME - 2);
+        uint64_t answer;
+            frame[BENCH_GAP_FRAME - 2] = crc & 0xFF;
+            frame[BENCH_GAP_FRAME - 1] = crc >> 8;
+            if(corrupt == 2)
+                frame[BENCH_GAP_FRAME - 1] ^= 0x01;
+            Bench_PowerOn(baud_rate, 1);
+            answer = Modbus_VCAN_UartChars(0);
+            for(i = 0; i < BENCH_GAP_FRAME; i++)
+            {
+                if(i == BENCH_GAP_AT)
+                {
+                    //the characters before go out, then the line is silent
+                    while(UARTBusy(UART1_BASE))
+                    {
+                    }
+                    Modbus_VCAN_Idle((unsigned long)(((double)silence * BENCH_CHAR_BITS * BENCH_CPU_CLOCK) / baud_rate));
+                    if(corrupt == 1)
+                        Modbus_VCAN_UartCorrupt(1);
+                }
+                UARTCharPut(UART1_BASE, frame[i]);
+            }
+            while(UARTBusy(UART1_BASE))
+            {
+            }
+            //time for the slave to answer the 8 characters of the read (13 characters) and more
+            Modbus_VCAN_Idle((unsigned long)((50.0 * BENCH_CHAR_BITS * BENCH_CPU_CLOCK) / baud_rate) + BENCH_CPU_CLOCK / 100);
+            return Modbus_VCAN_UartChars(0) != answer;
+}
+
+int main(int argc, char **argv)
+{
+        unsigned long baud_rates[] = { B9600, B19200, B38400, B115200 };
+        unsigned long rates = sizeof(baud_rates) / sizeof(baud_rates[0]);
+        unsigned long requests = 50, boards = 0, slaves = 4, i, b;
+        double t15;
+        int opt;
+            bench_config.cpu_clock = BENCH_CPU_CLOCK;
+            bench_config.can_clock = BENCH_CPU_CLOCK;
+            bench_config.loop_cycles = 200;
+            bench_config.work_cycles = 20000;
+            bench_config.isr_cycles = 300;
+            bench_config.error_rate = 0;
+            bench_config.seed = 1;
+            while(Modbus_VCAN_GetBoard(boards))
+                boards++;
+            for(opt = 1; opt < argc; opt++)
+            {
+                if((argv[opt][0] != '-') || (opt + 1 >= argc))
+                    goto usage;
+                switch(argv[opt][1])
+                {
+                    case 'n': slaves = strtoul(argv[++opt], NULL, 0); break;
+                    case 'r': requests = strtoul(argv[++opt], NULL, 0); break;
+                    case 'b': baud_rates[0] = strtoul(argv[++opt], NULL, 0); rates = 1; break;
+                    case 'l': bench_config.loop_cycles = strtoul(argv[++opt], NULL, 0); break;
+                    case 'w': bench_config.work_cycles = strtoul(argv[++opt], NULL, 0); break;
+                    default: goto usage;
+                }
+            }
+            if(!slaves || (slaves > boards) || !requests || (baud_rates[0] < 1200) || (baud_rates[0] > 115200))
+                goto usage;
+            for(i = 0; i < 125; i++)
+                bench_values[i] = i;
+            printf("%lu slaves, %lu requests, 8E1\n", slaves, requests);
+            printf("%8s  %-24s %6s %5s %9s %7s %10s %9s %11s %11s %10s %6s\n", "baud", "function", "trans", "bad", "trans/s",
+                   "chars", "slave ints", "ints/char", "master ints", "master loop", "slave loop", "errors");
+            for(b = 0; b < rates; b++)
+            {
+                for(i = 0; i < sizeof(bench_workloads) / sizeof(bench_workloads[0]); i++)
+                    Bench_Run(&bench_workloads[i], baud_rates[b], slaves, requests);
+            }
+            printf("read of 4 registers with a silence after the character %d, with a parity error or with a wrong CRC\n",
+                   BENCH_GAP_AT);
+            printf("%8s  %9s %9s %9s %9s %9s %9s %9s\n", "baud", "T1.5", "limit", "1 char", "2 chars", "3 chars", "parity", "CRC");
+            for(b = 0; b < rates; b++)
+            {
+                t15 = (baud_rates[b] > B19200) ? (750e-6 * baud_rates[b] / BENCH_CHAR_BITS) : 1.5;
+                printf("%8lu  %9.2f %9.2f", baud_rates[b], t15, t15 - 1);
+                for(i = 1; i <= 3; i++)
+                    printf(" %9s", Bench_Gap(baud_rates[b], i, 0) ? "answered" : "discarded");
+                printf(" %9s", Bench_Gap(baud_rates[b], 0, 1) ? "answered" : "discarded");
+                printf(" %9s\n", Bench_Gap(baud_rates[b], 0, 2) ? "answered" : "discarded");
+            }
+            return 0;
+        usage:
+            fprintf(stderr, "usage: %s [-n slaves (1-%lu)] [-r requests] [-b baud rate (1200-115200)] [-l loop cycles]"
+                            " [-w work cycles]\n", argv[0], boards);
+            return 2;
+}
@@ -0,0 +1,148 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+//! \addtogroup VCAN
+//! @{
+//includes
+#include "stdint.h"
+#include "inc/hw_ints.h"
+#include "inc/hw_types.h"
+#include "driverlib/sysctl.h"
+#include "Slave/Modbus_App.h"
+#include "Modbus_VCAN.h"
+
+//! Coils of the slave.
+#define SIM_COILS 2000
+//! Discrete inputs of the slave.
+#define SIM_D_INPUTS 2000
+//! Holding registers of the slave.
+#define SIM_H_REGISTERS 125
+#ifdef MODBUS_CAN_PUBLISH
+//! Input registers of the slave, the last one is the process value.
+#define SIM_I_REGISTERS 126
+//! Input register which follows the process value, after the ones read by the benchmark; it is in the published block 1.
+#define SIM_PROCESS_REGISTER 125
+//! Period of the changes of the process value, in picoseconds (100 ms).
+#define SIM_PROCESS_PERIOD (MODBUS_VCAN_SECOND / 10)
+#else
+//! Input registers of the slave.
+#define SIM_I_REGISTERS 125
+#endif
+
+//-TABLES, the same as the ones of maintest_slave.c
+static unsigned char sim_coils[SIM_COILS];
+static unsigned char sim_d_inputs[SIM_D_INPUTS];
+static uint16_t sim_h_registers[SIM_H_REGISTERS];
+static uint16_t sim_i_registers[SIM_I_REGISTERS];
+//! @}
+
+static void Modbus_Sim_Slave_Init(unsigned char number, unsigned long bit_rate);
+static unsigned char Modbus_Sim_Slave_Loop(void);
+#if OSL_Mode
+//handlers of the serial slave, in its startup file on the board
+void UART1IntHandler(void);
+void Timer0IntHandler(void);
+void Timer1IntHandler(void);
+#endif
+
+//! Board of the slave. The Makefile links this file with the slave sources several times, one per slave.
+static struct Modbus_VCAN_Board sim_slave =
+{
+    .name = "slave",
+    .init = Modbus_Sim_Slave_Init,
+    .loop = Modbus_Sim_Slave_Loop,
+    .vectors = {
+#if OSL_Mode
+                 [INT_UART1] = UART1IntHandler,
+                 [INT_TIMER0A] = Timer0IntHandler,
+                 [INT_TIMER1A] = Timer1IntHandler }
+#else
+#ifdef MODBUS_CAN_SCHEDULE
+                 [INT_TIMER1A] = Modbus_CAN_WindowHandler,
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+                 [INT_TIMER2A] = Modbus_CAN_FlowHandler,
+#endif
+                 [INT_CAN0] = Modbus_CAN_IntHandler }
+#endif
+};
+
+//! \brief Function to register the board before main().
+static void __attribute__((constructor)) Modbus_Sim_Slave_Register(void)
+{
+        Modbus_VCAN_Register(&sim_slave);
+}
+
+//! \brief Function to initialise the slave, as the init() of maintest_slave.c.
+//!
+//! \param number The slave number.
+//! \param bit_rate The bit rate (enum Modbus_CAN_BitRate), or the baud rate (enum Baud) of the serial slave.
+static void Modbus_Sim_Slave_Init(unsigned char number, unsigned long bit_rate)
+{
+        unsigned char num;
+        uint16_t i;
+            for(i = 0; i < SIM_COILS; i++)
+                sim_coils[i] = 1;
+            num = 0;
+            for(i = 0; i < SIM_D_INPUTS; i++)
+            {
+                sim_d_inputs[i] = num;
+                num += 1;
+                num = num % 2;
+                if(i == 999)
+                    num = 1;
+            }
+            for(i = 0; i < SIM_H_REGISTERS; i++)
+                sim_h_registers[i] = i;
+            for(i = 0; i < SIM_I_REGISTERS; i++)
+                sim_i_registers[i] = i;
+#if OSL_Mode
+            Modbus_Slave_Init(SIM_COILS, sim_coils, SIM_D_INPUTS, sim_d_inputs,
+                              SIM_H_REGISTERS, sim_h_registers, SIM_I_REGISTERS, sim_i_registers,
+                              MODBUS_SERIAL, number, (enum Baud)bit_rate, MODBUS_OSL_MODE_RTU);
+#else
+            Modbus_Slave_Init(SIM_COILS, sim_coils, SIM_D_INPUTS, sim_d_inputs,
+                              SIM_H_REGISTERS, sim_h_registers, SIM_I_REGISTERS, sim_i_registers,
+                              (enum Modbus_CAN_BitRate)bit_rate, number);
+#endif
+#ifdef MODBUS_CAN_PUBLISH
+            //the registers 7-10 in the block 0, read by the benchmark
+            Modbus_Slave_Publish(0, 3, 7, 4);
+            //the input registers 122-125 in the block 1, sent at each change of the process value and every second if the
+            //benchmark asks for the change of state mode
+            Modbus_Slave_Publish(1, 4, SIM_PROCESS_REGISTER - 3, 4);
+            if(Modbus_VCAN_BoardOption() & MODBUS_VCAN_OPTION_COS)
+                Modbus_Slave_Change_Of_State(1, 1, 0, SysCtlClockGet());
+#endif
+#ifdef MODBUS_CAN_SCHEDULE
+            //or in its transmit window, the windows of the slaves one after the other from the reception of the reference frame on
+            if(Modbus_VCAN_BoardOption() & MODBUS_VCAN_OPTION_SCHEDULE)
+                Modbus_Slave_Schedule(1, 1, 1 + ((number - 1) * (SysCtlClockGet() / (bit_rate * 1000)) * MODBUS_VCAN_WINDOW_BITS));
+#endif
+#ifdef MODBUS_CAN_FLOW_CONTROL
+            //the long requests in blocks of the message objects of the receive FIFO
+            if(Modbus_VCAN_BoardOption() & MODBUS_VCAN_OPTION_FLOW)
+                Modbus_Slave_Flow_Control(MODBUS_VCAN_FLOW_BLOCK, 0);
+#endif
+}
+
+//! \brief Function to run one pass of the main loop of the slave.
+//!
+//! \return 1 if a request was processed.
+static unsigned char Modbus_Sim_Slave_Loop(void)
+{
+#ifdef MODBUS_CAN_PUBLISH
+        uint16_t value = Modbus_VCAN_Now() / SIM_PROCESS_PERIOD;
+            //the process value changes, as the application of the slave would see it
+            if(sim_i_registers[SIM_PROCESS_REGISTER] != value)
+            {
+                sim_i_registers[SIM_PROCESS_REGISTER] = value;
+                Modbus_Slave_Refresh();
+            }
+#endif
+#if OSL_Mode
+        //the serial slave sends its answer within the call, so its time is already spent in the line
+        Modbus_Slave_Communication();
+        return 0;
+#else
+        return Modbus_CAN_Controller();
+#endif
+}
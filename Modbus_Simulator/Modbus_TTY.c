@@ -0,0 +1,987 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+//! \addtogroup TTY
+//! @{
+//includes
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/timerfd.h>
+#include "inc/hw_types.h"
+#include "inc/hw_ints.h"
+#include "inc/hw_memmap.h"
+#include "inc/hw_uart.h"
+#include "driverlib/gpio.h"
+#include "driverlib/interrupt.h"
+#include "driverlib/sysctl.h"
+#include "driverlib/timer.h"
+#include "driverlib/uart.h"
+#include "Modbus_TTY.h"
+
+//! Timers, from TIMER0_BASE to TIMER3_BASE.
+#define TTY_TIMERS 4
+//! Depth of the receive and transmit FIFOs of the UART.
+#define TTY_UART_FIFO 16
+//! Bit times without characters after which the receive timeout interruption is raised, if the receive FIFO is not empty.
+#define TTY_UART_TIMEOUT_BITS 32
+//! Characters read from the tty which can wait for room in the receive FIFO.
+#define TTY_INPUT 1024
+//! Interruption handlers run in a row with their line still asserted which are taken as an interruption which is never cleared.
+#define TTY_STORM 100000
+//! Characters put in the transmit FIFO which wait to be written to the tty together.
+#define TTY_OUTPUT 64
+//! First major of the other ends of the pseudo terminals (UNIX98_PTY_SLAVE_MAJOR), which are opened as devices.
+#define TTY_PTS_MAJOR_FIRST 136
+//! Last major of the other ends of the pseudo terminals.
+#define TTY_PTS_MAJOR_LAST 143
+//! Time which a pseudo terminal holds the first character after a silence, in nanoseconds (10 ms): the rest of the frame may be
+//! passed that late by the kernel without a silence.
+#define TTY_PSEUDO_DELAY 10000000ULL
+//! Nanoseconds in a second, the unit of the time.
+#define TTY_SECOND 1000000000ULL
+//! Time which is never reached.
+#define TTY_NEVER UINT64_MAX
+
+//! General purpose timer, in full-width mode.
+struct Modbus_TTY_Timer
+{
+      unsigned char periodic;           //!< Periodic (1) or one shot (0)
+      unsigned char enabled;            //!< If the timer is counting
+      unsigned long raw;                //!< Raw interruption status
+      unsigned long mask;               //!< Interruptions enabled
+      unsigned long load;               //!< Load value, in cycles
+      uint64_t start;                   //!< Time when the timer was loaded
+      int fd;                           //!< timerfd armed at its timeout
+      uint64_t armed;                   //!< Time at which _fd_ is armed, 0 if it is not
+};
+
+//! UART1, on the tty.
+struct Modbus_TTY_Uart
+{
+      unsigned char enabled;            //!< If it was configured (UARTConfigSetExpClk) and not disabled
+      unsigned char fifo;               //!< FIFOs of 16 characters enabled; otherwise each one is a holding register
+      unsigned char rx_level;           //!< Characters in the receive FIFO which raise the receive interruption
+      unsigned char tx_level;           //!< Characters in the transmit FIFO at or below which the transmit interruption is raised
+      unsigned char bits;               //!< Bits of each character: start, data, parity and stop bits
+      uint64_t bit_time;                //!< Bit time, in nanoseconds
+      uint16_t input[TTY_INPUT];        //!< Characters read from the tty, with UART_DR_PE if the tty marked them
+      uint64_t input_time[TTY_INPUT];   //!< Time of arrival of each one
+      uint64_t input_last;              //!< Time of arrival of the last character read
+      uint16_t input_first;             //!< Oldest character of _input_
+      uint16_t input_count;             //!< Characters in _input_
+      unsigned char mark;               //!< Bytes of a PARMRK mark read: 1 after \377, 2 after \377 \0
+      uint16_t rx[TTY_UART_FIFO];       //!< Receive FIFO, with the error bits of UARTDR
+      unsigned char rx_first;           //!< Oldest character of the receive FIFO
+      unsigned char rx_count;           //!< Characters in the receive FIFO
+      unsigned char tx[TTY_UART_FIFO];  //!< Transmit FIFO
+      unsigned char tx_first;           //!< Oldest character of the transmit FIFO
+      unsigned char tx_count;           //!< Characters in the transmit FIFO
+      unsigned char shifting;           //!< If a character is being sent
+      uint64_t tx_end;                  //!< Time when the stop bit of the character being sent finishes
+      uint64_t rx_timeout;              //!< Time of the receive timeout interruption, 0 if it is not armed
+      unsigned long raw;                //!< Raw interruption status
+      unsigned long mask;               //!< Interruptions enabled
+      int fd;                           //!< timerfd armed at the next of _tx_end_, _rx_timeout_ and the next arrival
+      uint64_t armed;                   //!< Time at which _fd_ is armed, 0 if it is not
+};
+
+//-PORT
+//! File descriptor of the tty, or of the master side of the pseudo terminal
+static int tty_fd = -1;
+//! The other end of the pseudo terminal, kept open so the master side does not see a hang up
+static int tty_peer = -1;
+//! epoll instance which waits for the tty and the timerfds
+static int tty_epoll = -1;
+//! Name of the tty for the other program
+static char tty_name[128];
+//! If the tty is the master side of a pseudo terminal created by Modbus_TTY_Open(); its termios are the ones of the other end
+static unsigned char tty_pty;
+//! If the tty is any end of a pseudo terminal, which has no line
+static unsigned char tty_pseudo;
+//! If the tty marks the characters with errors (PARMRK), so the marks are taken out of the characters read
+static unsigned char tty_parmrk;
+//! If the tty is in the epoll set; it is taken out while the characters read can not wait anywhere
+static unsigned char tty_reading;
+//! Characters to write to the tty
+static unsigned char tty_output[TTY_OUTPUT];
+//! Characters in _tty_output_
+static unsigned char tty_output_count;
+//-NODE
+//! Vector table
+static void (*const *tty_vectors)(void);
+//! Timers TIMER0 to TIMER3
+static struct Modbus_TTY_Timer tty_timers[TTY_TIMERS];
+//! UART1
+static struct Modbus_TTY_Uart tty_uart;
+//! Interruptions enabled in the interruption controller
+static unsigned char tty_enabled[MODBUS_TTY_VECTORS];
+//! All interruptions masked (IntMasterDisable)
+static unsigned char tty_masked;
+//! If an interruption handler is running
+static unsigned char tty_in_isr;
+//! Handlers run in a row whose line was still asserted after them
+static unsigned long tty_storm;
+//! Interruption handlers run, by interruption number
+static uint64_t tty_interrupts[MODBUS_TTY_VECTORS];
+//-TIME
+//! If an event is being processed: the time stands at _tty_event_
+static unsigned char tty_in_event;
+//! Time of the event being processed, or of the last one
+static uint64_t tty_event;
+
+//! Interruption lines which the peripherals can assert, in order of priority
+static const unsigned char tty_lines[] = { INT_UART1, INT_TIMER0A, INT_TIMER1A, INT_TIMER2A, INT_TIMER3A };
+//! Levels of the FIFO interruptions, in characters, by UART_FIFO_TX*_8 or UART_FIFO_RX*_8 >> 3
+static const unsigned char tty_uart_levels[] = { 2, 4, 8, 12, 14 };
+
+//! Registers written by the serial nodes for their LED, see inc/lm3s8962.h; the name is the one of the virtual serial line
+volatile unsigned long Modbus_VCAN_Registers[4];
+//! @}
+
+static uint64_t Modbus_TTY_Clock(void);
+static uint64_t Modbus_TTY_Cycles(uint64_t cycles);
+static void Modbus_TTY_Run(uint64_t until);
+static void Modbus_TTY_Interrupts(void);
+static unsigned char Modbus_TTY_Pending(void);
+static unsigned char Modbus_TTY_Line(unsigned char vector);
+static void Modbus_TTY_Read(uint64_t now);
+static void Modbus_TTY_Receive(void);
+static void Modbus_TTY_Shift(void);
+static void Modbus_TTY_Flush(void);
+static void Modbus_TTY_Arm(int fd, uint64_t *armed, uint64_t when);
+static void Modbus_TTY_ArmAll(void);
+static uint64_t Modbus_TTY_Timeout(const struct Modbus_TTY_Timer *timer);
+static struct Modbus_TTY_Timer *Modbus_TTY_GetTimer(unsigned long base);
+static struct Modbus_TTY_Uart *Modbus_TTY_GetUart(unsigned long base);
+static void Modbus_TTY_Fail(const char *what);
+
+unsigned char Modbus_TTY_Open(const char *device, void (*const vectors[MODBUS_TTY_VECTORS])(void))
+{
+        struct epoll_event event;
+        struct termios termios;
+        struct stat st;
+        unsigned char i;
+            tty_vectors = vectors;
+            if(!strcmp(device, "pty"))
+            {
+                tty_fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+                if((tty_fd < 0) || grantpt(tty_fd) || unlockpt(tty_fd) || ptsname_r(tty_fd, tty_name, sizeof(tty_name)))
+                    return 0;
+                tty_peer = open(tty_name, O_RDWR | O_NOCTTY);
+                if(tty_peer < 0)
+                    return 0;
+                //the other end is raw until the other program sets its own termios
+                tcgetattr(tty_peer, &termios);
+                cfmakeraw(&termios);
+                tcsetattr(tty_peer, TCSANOW, &termios);
+                tty_pty = 1;
+                tty_pseudo = 1;
+            }
+            else
+            {
+                tty_fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+                if(tty_fd < 0)
+                    return 0;
+                if(tcgetattr(tty_fd, &termios) || fstat(tty_fd, &st))
+                    return 0;
+                tty_pseudo = (major(st.st_rdev) >= TTY_PTS_MAJOR_FIRST) && (major(st.st_rdev) <= TTY_PTS_MAJOR_LAST);
+                snprintf(tty_name, sizeof(tty_name), "%s", device);
+            }
+            tty_epoll = epoll_create1(0);
+            if(tty_epoll < 0)
+                return 0;
+            memset(&event, 0, sizeof(event));
+            event.events = EPOLLIN;
+            event.data.fd = tty_fd;
+            if(epoll_ctl(tty_epoll, EPOLL_CTL_ADD, tty_fd, &event))
+                return 0;
+            tty_reading = 1;
+            tty_uart.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+            event.data.fd = tty_uart.fd;
+            if((tty_uart.fd < 0) || epoll_ctl(tty_epoll, EPOLL_CTL_ADD, tty_uart.fd, &event))
+                return 0;
+            for(i = 0; i < TTY_TIMERS; i++)
+            {
+                tty_timers[i].fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+                event.data.fd = tty_timers[i].fd;
+                if((tty_timers[i].fd < 0) || epoll_ctl(tty_epoll, EPOLL_CTL_ADD, tty_timers[i].fd, &event))
+                    return 0;
+            }
+            tty_event = Modbus_TTY_Clock();
+            return 1;
+}
+
+const char *Modbus_TTY_Name(void)
+{
+        return tty_name;
+}
+
+void Modbus_TTY_Wait(int timeout)
+{
+        struct epoll_event events[TTY_TIMERS + 2];
+        unsigned char in_event = tty_in_event;
+        uint64_t event = tty_event, expirations;
+        int i, n;
+            //the interruptions left pending by the main loop, as IntEnable() would let them in
+            tty_in_event = 0;
+            if(!tty_in_isr && !tty_masked && Modbus_TTY_Pending())
+            {
+                Modbus_TTY_Interrupts();
+                timeout = 0;
+            }
+            Modbus_TTY_Flush();
+            n = epoll_wait(tty_epoll, events, sizeof(events) / sizeof(events[0]), timeout);
+            if((n < 0) && (errno != EINTR))
+                Modbus_TTY_Fail("epoll_wait");
+            for(i = 0; i < n; i++)
+            {
+                if(events[i].data.fd == tty_fd)
+                    Modbus_TTY_Read(Modbus_TTY_Clock());
+                else if((read(events[i].data.fd, &expirations, sizeof(expirations)) < 0) && (errno != EAGAIN))
+                    Modbus_TTY_Fail("timerfd");
+            }
+            Modbus_TTY_Run(Modbus_TTY_Clock());
+            tty_in_event = in_event;
+            if(in_event)
+                tty_event = event;
+}
+
+uint64_t Modbus_TTY_Now(void)
+{
+        return tty_in_event ? tty_event : Modbus_TTY_Clock();
+}
+
+uint64_t Modbus_TTY_GetInterrupts(unsigned char vector)
+{
+        uint64_t count = 0;
+        unsigned char i;
+            if(vector)
+                return (vector < MODBUS_TTY_VECTORS) ? tty_interrupts[vector] : 0;
+            for(i = 0; i < MODBUS_TTY_VECTORS; i++)
+                count += tty_interrupts[i];
+            return count;
+}
+
+//! \brief Function to read CLOCK_MONOTONIC.
+//!
+//! \return The time, in nanoseconds.
+static uint64_t Modbus_TTY_Clock(void)
+{
+        struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            return ((uint64_t)now.tv_sec * TTY_SECOND) + now.tv_nsec;
+}
+
+//! \brief Function to convert cycles of the system clock to time.
+//!
+//! \param cycles The cycles.
+//! \return The time, in nanoseconds.
+static uint64_t Modbus_TTY_Cycles(uint64_t cycles)
+{
+        return (cycles * TTY_SECOND) / MODBUS_TTY_CLOCK;
+}
+
+//! \brief Function to process the events up to a time.
+//!
+//! The events are processed in order of time: timeouts of the timers, ends of the characters sent, receive timeouts and
+//! characters read from the tty which have room in the receive FIFO. The time stands at each event while the interruptions which
+//! it raises are attended; a character which waited for room in the FIFO goes in at the time of the event which made it.
+//! \param until The time to stop.
+static void Modbus_TTY_Run(uint64_t until)
+{
+        enum { NONE, TIMER, SENT, TIMEOUT, RECEIVED } kind;
+        struct Modbus_TTY_Uart *uart = &tty_uart;
+        unsigned char i, timer = 0;
+        uint64_t when, time;
+            for(;;)
+            {
+                kind = NONE;
+                when = TTY_NEVER;
+                for(i = 0; i < TTY_TIMERS; i++)
+                {
+                    time = Modbus_TTY_Timeout(&tty_timers[i]);
+                    if(time < when)
+                    {
+                        when = time;
+                        kind = TIMER;
+                        timer = i;
+                    }
+                }
+                if(uart->shifting && (uart->tx_end < when))
+                {
+                    when = uart->tx_end;
+                    kind = SENT;
+                }
+                if(uart->rx_timeout && (uart->rx_timeout < when))
+                {
+                    when = uart->rx_timeout;
+                    kind = TIMEOUT;
+                }
+                if(uart->input_count && (uart->rx_count < (uart->fifo ? TTY_UART_FIFO : 1)) &&
+                   (uart->input_time[uart->input_first] < when))
+                {
+                    when = uart->input_time[uart->input_first];
+                    kind = RECEIVED;
+                }
+                if((kind == NONE) || (when > until))
+                    break;
+                //the time does not go back for a character which waited for room in the FIFO
+                if(when > tty_event)
+                    tty_event = when;
+                tty_in_event = 1;
+                switch(kind)
+                {
+                    case TIMER:
+                            tty_timers[timer].raw |= TIMER_TIMA_TIMEOUT;
+                            if(tty_timers[timer].periodic)
+                                tty_timers[timer].start += Modbus_TTY_Cycles(tty_timers[timer].load);
+                            else
+                                tty_timers[timer].enabled = 0;
+                            break;
+                    case SENT:
+                            uart->shifting = 0;
+                            Modbus_TTY_Shift();
+                            break;
+                    case TIMEOUT:
+                            uart->rx_timeout = 0;
+                            if(uart->rx_count)
+                                uart->raw |= UART_INT_RT;
+                            break;
+                    default:
+                            Modbus_TTY_Receive();
+                            break;
+                }
+                Modbus_TTY_Interrupts();
+                Modbus_TTY_Flush();
+                tty_in_event = 0;
+            }
+            if(!tty_reading && (uart->input_count < TTY_INPUT))
+            {
+                //there is room again for the characters of the tty
+                struct epoll_event event = { .events = EPOLLIN, .data.fd = tty_fd };
+                if(!epoll_ctl(tty_epoll, EPOLL_CTL_ADD, tty_fd, &event))
+                    tty_reading = 1;
+            }
+            Modbus_TTY_ArmAll();
+}
+
+//! \brief Function to attend the pending interruptions.
+//!
+//! The handlers are run one after the other, the lowest interruption number first, as long as some line is asserted and enabled.
+//! An interruption handler is not interrupted by other one.
+static void Modbus_TTY_Interrupts(void)
+{
+        unsigned char vector;
+            while(!tty_in_isr && !tty_masked && (vector = Modbus_TTY_Pending()))
+            {
+                tty_in_isr = 1;
+                tty_vectors[vector]();
+                tty_in_isr = 0;
+                tty_interrupts[vector]++;
+                if(!Modbus_TTY_Line(vector))
+                    tty_storm = 0;
+                else if(++tty_storm > TTY_STORM)
+                {
+                    fprintf(stderr, "tty: interruption %u is never cleared\n", vector);
+                    exit(1);
+                }
+            }
+}
+
+//! \brief Function to find the interruption which is attended next.
+//!
+//! \return The lowest interruption number whose line is asserted and enabled and which has a handler, or 0 if there is none.
+static unsigned char Modbus_TTY_Pending(void)
+{
+        unsigned char i, vector;
+            for(i = 0; i < sizeof(tty_lines); i++)
+            {
+                vector = tty_lines[i];
+                if(tty_enabled[vector] && tty_vectors[vector] && Modbus_TTY_Line(vector))
+                    return vector;
+            }
+            return 0;
+}
+
+//! \brief Function to know if an interruption line is asserted.
+//!
+//! \param vector The interruption number.
+//! \return 1 if it is asserted.
+static unsigned char Modbus_TTY_Line(unsigned char vector)
+{
+            switch(vector)
+            {
+                case INT_UART1:
+                        return (tty_uart.raw & tty_uart.mask) != 0;
+                case INT_TIMER0A:
+                        return (tty_timers[0].raw & tty_timers[0].mask) != 0;
+                case INT_TIMER1A:
+                        return (tty_timers[1].raw & tty_timers[1].mask) != 0;
+                case INT_TIMER2A:
+                        return (tty_timers[2].raw & tty_timers[2].mask) != 0;
+                case INT_TIMER3A:
+                        return (tty_timers[3].raw & tty_timers[3].mask) != 0;
+                default:
+                        return 0;
+            }
+}
+
+//! \brief Function to read the characters of the tty.
+//!
+//! They wait in _input_ for room in the receive FIFO. A character arrives at the time of the reading, but not before the end
+//! of the previous one, so the characters read together, as the ones of a pseudo terminal which come at once, arrive at the baud
+//! rate. A pseudo terminal has no line, and the kernel may pass the characters some ms late, which would be a silence inside the
+//! frame: there, the first character after a silence arrives TTY_PSEUDO_DELAY after its reading, and the ones read before the
+//! end of the previous one follow it. With PARMRK, a character with a parity or framing error
+//! comes after \377 \0 and a \377 is doubled. If _input_ is full, the tty is taken out of the epoll set, and the rest of the
+//! characters wait in it.
+//! \param now The time of the reading.
+static void Modbus_TTY_Read(uint64_t now)
+{
+        struct Modbus_TTY_Uart *uart = &tty_uart;
+        unsigned char buffer[256];
+        uint16_t data, first = uart->input_count, j;
+        uint64_t time, line;
+        ssize_t length, i;
+            while(uart->input_count < TTY_INPUT - 2)
+            {
+                //a mark of PARMRK gives 1 character out of 3 bytes, so the bytes read always fit
+                length = TTY_INPUT - 2 - uart->input_count;
+                if(length > (ssize_t)sizeof(buffer))
+                    length = sizeof(buffer);
+                length = read(tty_fd, buffer, length);
+                if(length < 0)
+                {
+                    if((errno == EAGAIN) || (errno == EINTR))
+                        break;
+                    Modbus_TTY_Fail("read");
+                }
+                if(!length)
+                {
+                    fprintf(stderr, "tty: %s was closed\n", tty_name);
+                    exit(1);
+                }
+                for(i = 0; i < length; i++)
+                {
+                    data = buffer[i];
+                    if(tty_parmrk)
+                    {
+                        if(uart->mark == 2)
+                            data |= UART_DR_PE;
+                        else if(uart->mark == 1)
+                        {
+                            uart->mark = (data == 0) ? 2 : 0;
+                            if(uart->mark)
+                                continue;
+                        }
+                        else if(data == 0xFF)
+                        {
+                            uart->mark = 1;
+                            continue;
+                        }
+                        uart->mark = 0;
+                    }
+                    uart->input[(uart->input_first + uart->input_count) % TTY_INPUT] = data;
+                    uart->input_count++;
+                }
+            }
+            for(j = first; j < uart->input_count; j++)
+            {
+                line = uart->input_last + (uart->bits * uart->bit_time);
+                time = (now < line) ? line : now + (tty_pseudo ? TTY_PSEUDO_DELAY : 0);
+                uart->input_time[(uart->input_first + j) % TTY_INPUT] = time;
+                uart->input_last = time;
+            }
+            if((uart->input_count >= TTY_INPUT - 2) && !epoll_ctl(tty_epoll, EPOLL_CTL_DEL, tty_fd, NULL))
+                tty_reading = 0;
+}
+
+//! \brief Function to take a character read from the tty into the receive FIFO.
+//!
+//! The receive interruption is raised when the FIFO reaches its level (at each character, without FIFOs), and the receive
+//! timeout interruption is armed, as in Modbus_VCAN.c.
+static void Modbus_TTY_Receive(void)
+{
+        struct Modbus_TTY_Uart *uart = &tty_uart;
+        uint16_t data = uart->input[uart->input_first];
+            uart->input_first = (uart->input_first + 1) % TTY_INPUT;
+            uart->input_count--;
+            if(!uart->enabled)
+                return;
+            uart->rx[(uart->rx_first + uart->rx_count++) % TTY_UART_FIFO] = data;
+            if(data & UART_DR_PE)
+                uart->raw |= UART_INT_PE;
+            if(uart->rx_count >= (uart->fifo ? uart->rx_level : 1))
+                uart->raw |= UART_INT_RX;
+            uart->rx_timeout = tty_event + (TTY_UART_TIMEOUT_BITS * uart->bit_time);
+}
+
+//! \brief Function to start sending the next character of the transmit FIFO.
+//!
+//! The character leaves the FIFO for the shift register, which raises the transmit interruption if the FIFO goes down to its
+//! level (or the holding register is emptied, without FIFOs). It was written to the tty when it went into the FIFO.
+static void Modbus_TTY_Shift(void)
+{
+        struct Modbus_TTY_Uart *uart = &tty_uart;
+        unsigned char level = uart->fifo ? uart->tx_level : 0;
+            if(uart->shifting || !uart->tx_count)
+                return;
+            uart->tx_first = (uart->tx_first + 1) % TTY_UART_FIFO;
+            if(uart->tx_count-- > level && uart->tx_count <= level)
+                uart->raw |= UART_INT_TX;
+            uart->shifting = 1;
+            uart->tx_end = Modbus_TTY_Now() + (uart->bits * uart->bit_time);
+}
+
+//! \brief Function to write to the tty the characters put in the transmit FIFO.
+//!
+//! The characters are written as they go into the transmit FIFO, so the driver of the tty sends them back to back even if the
+//! process is late for the end of a character; the ones put by the handlers of an event or by a pass of the main loop are
+//! written together, so that the process is not preempted between them.
+static void Modbus_TTY_Flush(void)
+{
+        struct pollfd output = { .fd = tty_fd, .events = POLLOUT };
+        unsigned char written = 0;
+        ssize_t length;
+            while(written < tty_output_count)
+            {
+                length = write(tty_fd, tty_output + written, tty_output_count - written);
+                if(length > 0)
+                    written += length;
+                else if((errno != EAGAIN) && (errno != EINTR))
+                    Modbus_TTY_Fail("write");
+                else
+                {
+                    //the output buffer of the tty is full: the characters go out slower than the baud rate
+                    poll(&output, 1, 100);
+                }
+            }
+            tty_output_count = 0;
+}
+
+//! \brief Function to arm a timerfd.
+//!
+//! \param fd The timerfd.
+//! \param armed The time at which it is armed, updated.
+//! \param when The time of the timeout, TTY_NEVER to disarm it.
+static void Modbus_TTY_Arm(int fd, uint64_t *armed, uint64_t when)
+{
+        struct itimerspec spec;
+            if(when == TTY_NEVER)
+                when = 0;
+            if(when == *armed)
+                return;
+            memset(&spec, 0, sizeof(spec));
+            //a time in the past expires at once; 0 would disarm it
+            if(when)
+            {
+                spec.it_value.tv_sec = when / TTY_SECOND;
+                spec.it_value.tv_nsec = (when % TTY_SECOND) ? (when % TTY_SECOND) : (spec.it_value.tv_sec ? 0 : 1);
+            }
+            if(timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, NULL))
+                Modbus_TTY_Fail("timerfd_settime");
+            *armed = when;
+}
+
+//! \brief Function to arm the timerfds at the next events of the timers and the UART.
+//!
+//! The timerfd of the UART takes the end of the character sent, the receive timeout and the arrival of the next character read
+//! from the tty, if there is room for it in the receive FIFO.
+static void Modbus_TTY_ArmAll(void)
+{
+        struct Modbus_TTY_Uart *uart = &tty_uart;
+        uint64_t when = TTY_NEVER;
+        unsigned char i;
+            if(tty_epoll < 0)
+                return;
+            for(i = 0; i < TTY_TIMERS; i++)
+                Modbus_TTY_Arm(tty_timers[i].fd, &tty_timers[i].armed, Modbus_TTY_Timeout(&tty_timers[i]));
+            if(uart->shifting)
+                when = uart->tx_end;
+            if(uart->rx_timeout && (uart->rx_timeout < when))
+                when = uart->rx_timeout;
+            if(uart->input_count && (uart->rx_count < (uart->fifo ? TTY_UART_FIFO : 1)) &&
+               (uart->input_time[uart->input_first] < when))
+                when = uart->input_time[uart->input_first];
+            Modbus_TTY_Arm(uart->fd, &uart->armed, when);
+}
+
+//! \brief Function to get the time of the next timeout of a timer.
+//!
+//! \param timer The timer.
+//! \return The time, or TTY_NEVER if it is not counting.
+static uint64_t Modbus_TTY_Timeout(const struct Modbus_TTY_Timer *timer)
+{
+        return timer->enabled ? timer->start + Modbus_TTY_Cycles(timer->load) : TTY_NEVER;
+}
+
+//! \brief Function to get a timer.
+//!
+//! \param base The base address of the timer, TIMER0_BASE to TIMER3_BASE.
+//! \return The timer.
+static struct Modbus_TTY_Timer *Modbus_TTY_GetTimer(unsigned long base)
+{
+        unsigned long index = (base - TIMER0_BASE) / (TIMER1_BASE - TIMER0_BASE);
+            if(index >= TTY_TIMERS)
+            {
+                fprintf(stderr, "tty: unknown timer 0x%08lx\n", base);
+                exit(1);
+            }
+            return &tty_timers[index];
+}
+
+//! \brief Function to get the UART.
+//!
+//! \param base The base address of the UART; only UART1_BASE is on the tty.
+//! \return The UART.
+static struct Modbus_TTY_Uart *Modbus_TTY_GetUart(unsigned long base)
+{
+            if(base != UART1_BASE)
+            {
+                fprintf(stderr, "tty: unknown UART 0x%08lx\n", base);
+                exit(1);
+            }
+            return &tty_uart;
+}
+
+//! \brief Function to stop the program after a failed system call.
+//!
+//! \param what The system call.
+static void Modbus_TTY_Fail(const char *what)
+{
+        fprintf(stderr, "tty: %s: %s: %s\n", tty_name, what, strerror(errno));
+        exit(1);
+}
+
+void TimerConfigure(unsigned long ulBase, unsigned long ulConfig)
+{
+        struct Modbus_TTY_Timer *timer = Modbus_TTY_GetTimer(ulBase);
+            timer->enabled = 0;
+            timer->periodic = ((ulConfig & 0xF) == TIMER_CFG_32_BIT_PER);
+            Modbus_TTY_ArmAll();
+}
+
+void TimerEnable(unsigned long ulBase, unsigned long ulTimer)
+{
+        struct Modbus_TTY_Timer *timer = Modbus_TTY_GetTimer(ulBase);
+            timer->enabled = 1;
+            timer->start = Modbus_TTY_Now();
+            Modbus_TTY_ArmAll();
+}
+
+void TimerDisable(unsigned long ulBase, unsigned long ulTimer)
+{
+        Modbus_TTY_GetTimer(ulBase)->enabled = 0;
+        Modbus_TTY_ArmAll();
+}
+
+void TimerLoadSet(unsigned long ulBase, unsigned long ulTimer, unsigned long ulValue)
+{
+        struct Modbus_TTY_Timer *timer = Modbus_TTY_GetTimer(ulBase);
+            //the counter is loaded at once
+            timer->load = ulValue;
+            timer->start = Modbus_TTY_Now();
+            Modbus_TTY_ArmAll();
+}
+
+unsigned long TimerLoadGet(unsigned long ulBase, unsigned long ulTimer)
+{
+        return Modbus_TTY_GetTimer(ulBase)->load;
+}
+
+unsigned long TimerValueGet(unsigned long ulBase, unsigned long ulTimer)
+{
+        struct Modbus_TTY_Timer *timer = Modbus_TTY_GetTimer(ulBase);
+        uint64_t elapsed;
+            if(!timer->enabled)
+                return timer->load;
+            elapsed = ((Modbus_TTY_Now() - timer->start) * MODBUS_TTY_CLOCK) / TTY_SECOND;
+            if(timer->periodic && timer->load)
+                elapsed %= timer->load;
+            return (elapsed < timer->load) ? (unsigned long)(timer->load - elapsed) : 0;
+}
+
+void TimerIntEnable(unsigned long ulBase, unsigned long ulIntFlags)
+{
+        Modbus_TTY_GetTimer(ulBase)->mask |= ulIntFlags;
+}
+
+void TimerIntDisable(unsigned long ulBase, unsigned long ulIntFlags)
+{
+        Modbus_TTY_GetTimer(ulBase)->mask &= ~ulIntFlags;
+}
+
+unsigned long TimerIntStatus(unsigned long ulBase, tBoolean bMasked)
+{
+        struct Modbus_TTY_Timer *timer = Modbus_TTY_GetTimer(ulBase);
+            return bMasked ? (timer->raw & timer->mask) : timer->raw;
+}
+
+void TimerIntClear(unsigned long ulBase, unsigned long ulIntFlags)
+{
+        Modbus_TTY_GetTimer(ulBase)->raw &= ~ulIntFlags;
+}
+
+tBoolean IntMasterEnable(void)
+{
+        tBoolean masked = tty_masked;
+            tty_masked = 0;
+            return masked;
+}
+
+tBoolean IntMasterDisable(void)
+{
+        tBoolean masked = tty_masked;
+            tty_masked = 1;
+            return masked;
+}
+
+void IntEnable(unsigned long ulInterrupt)
+{
+        if(ulInterrupt < MODBUS_TTY_VECTORS)
+            tty_enabled[ulInterrupt] = 1;
+}
+
+void IntDisable(unsigned long ulInterrupt)
+{
+        if(ulInterrupt < MODBUS_TTY_VECTORS)
+            tty_enabled[ulInterrupt] = 0;
+}
+
+void SysCtlPeripheralEnable(unsigned long ulPeripheral)
+{
+}
+
+void SysCtlClockSet(unsigned long ulConfig)
+{
+}
+
+unsigned long SysCtlClockGet(void)
+{
+        return MODBUS_TTY_CLOCK;
+}
+
+void SysCtlDelay(unsigned long ulCount)
+{
+        //3 cycles per loop, as the one of the driver library; the interruptions are attended meanwhile
+        uint64_t until = Modbus_TTY_Clock() + Modbus_TTY_Cycles(3 * (uint64_t)ulCount), now;
+            while((now = Modbus_TTY_Clock()) < until)
+                Modbus_TTY_Wait((int)((until - now + 999999) / 1000000));
+}
+
+void UARTConfigSetExpClk(unsigned long ulBase, unsigned long ulUARTClk, unsigned long ulBaud, unsigned long ulConfig)
+{
+        static const struct { unsigned long baud; speed_t speed; } speeds[] =
+        {
+            { 1200, B1200 }, { 2400, B2400 }, { 4800, B4800 }, { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 },
+            { 57600, B57600 }, { 115200, B115200 }
+        };
+        struct Modbus_TTY_Uart *uart = Modbus_TTY_GetUart(ulBase);
+        struct termios termios;
+        unsigned char length = 5 + ((ulConfig & UART_CONFIG_WLEN_MASK) >> 5), i;
+        unsigned char parity = (ulConfig & UART_CONFIG_PAR_MASK) != UART_CONFIG_PAR_NONE;
+            uart->bits = 1 + length + parity + ((ulConfig & UART_CONFIG_STOP_TWO) ? 2 : 1);
+            uart->bit_time = TTY_SECOND / ulBaud;
+            if(!uart->rx_level)
+            {
+                //FIFO levels after reset, 1/2
+                uart->rx_level = 8;
+                uart->tx_level = 8;
+            }
+            //the termios of a pseudo terminal created here are the ones of the other end, which the other program sets
+            if(!tty_pty)
+            {
+                for(i = 0; (i < sizeof(speeds) / sizeof(speeds[0])) && (speeds[i].baud != ulBaud); i++)
+                {
+                }
+                if((i == sizeof(speeds) / sizeof(speeds[0])) || tcgetattr(tty_fd, &termios))
+                {
+                    fprintf(stderr, "tty: %s: %lu bauds can not be set\n", tty_name, ulBaud);
+                    exit(1);
+                }
+                cfmakeraw(&termios);
+                termios.c_cflag &= ~(CSIZE | CSTOPB | PARENB | PARODD);
+                termios.c_cflag |= CLOCAL | CREAD | ((length == 8) ? CS8 : (length == 7) ? CS7 : (length == 6) ? CS6 : CS5);
+                if(ulConfig & UART_CONFIG_STOP_TWO)
+                    termios.c_cflag |= CSTOPB;
+                if(parity)
+                {
+                    termios.c_cflag |= PARENB;
+                    if((ulConfig & UART_CONFIG_PAR_MASK) == UART_CONFIG_PAR_ODD)
+                        termios.c_cflag |= PARODD;
+                    //the characters with errors are marked, as the error bits of UARTDR
+                    termios.c_iflag |= INPCK | PARMRK;
+                    termios.c_iflag &= ~(IGNPAR | ISTRIP);
+                }
+                termios.c_cc[VMIN] = 1;
+                termios.c_cc[VTIME] = 0;
+                cfsetispeed(&termios, speeds[i].speed);
+                cfsetospeed(&termios, speeds[i].speed);
+                if(tcsetattr(tty_fd, TCSANOW, &termios))
+                    Modbus_TTY_Fail("tcsetattr");
+                tcflush(tty_fd, TCIOFLUSH);
+                tty_parmrk = parity;
+            }
+            //UARTEnable() enables the FIFOs too, as in the driver library
+            UARTEnable(ulBase);
+}
+
+void UARTEnable(unsigned long ulBase)
+{
+        struct Modbus_TTY_Uart *uart = Modbus_TTY_GetUart(ulBase);
+            uart->enabled = 1;
+            uart->fifo = 1;
+}
+
+void UARTDisable(unsigned long ulBase)
+{
+        Modbus_TTY_GetUart(ulBase)->enabled = 0;
+}
+
+void UARTFIFOEnable(unsigned long ulBase)
+{
+        Modbus_TTY_GetUart(ulBase)->fifo = 1;
+}
+
+void UARTFIFODisable(unsigned long ulBase)
+{
+        Modbus_TTY_GetUart(ulBase)->fifo = 0;
+}
+
+void UARTFIFOLevelSet(unsigned long ulBase, unsigned long ulTxLevel, unsigned long ulRxLevel)
+{
+        struct Modbus_TTY_Uart *uart = Modbus_TTY_GetUart(ulBase);
+            //the transmit interruption is raised when the FIFO goes down to 2 characters for UART_FIFO_TX1_8, 4 for TX2_8...
+            uart->tx_level = tty_uart_levels[ulTxLevel & 0x7];
+            uart->rx_level = tty_uart_levels[(ulRxLevel >> 3) & 0x7];
+}
+
+tBoolean UARTCharsAvail(unsigned long ulBase)
+{
+        return Modbus_TTY_GetUart(ulBase)->rx_count != 0;
+}
+
+tBoolean UARTSpaceAvail(unsigned long ulBase)
+{
+        struct Modbus_TTY_Uart *uart = Modbus_TTY_GetUart(ulBase);
+            return uart->tx_count < (uart->fifo ? TTY_UART_FIFO : 1);
+}
+
+long UARTCharGetNonBlocking(unsigned long ulBase)
+{
+        struct Modbus_TTY_Uart *uart = Modbus_TTY_GetUart(ulBase);
+        long data;
+            if(!uart->rx_count)
+                return -1;
+            data = uart->rx[uart->rx_first];
+            uart->rx_first = (uart->rx_first + 1) % TTY_UART_FIFO;
+            uart->rx_count--;
+            if(!uart->fifo || (uart->rx_count < uart->rx_level))
+                uart->raw &= ~UART_INT_RX;
+            if(!uart->rx_count)
+            {
+                uart->raw &= ~UART_INT_RT;
+                uart->rx_timeout = 0;
+            }
+            //the next character read from the tty may go in now
+            Modbus_TTY_ArmAll();
+            return data;
+}
+
+long UARTCharGet(unsigned long ulBase)
+{
+        struct Modbus_TTY_Uart *uart = Modbus_TTY_GetUart(ulBase);
+            while(!uart->rx_count)
+                Modbus_TTY_Wait(-1);
+            return UARTCharGetNonBlocking(ulBase);
+}
+
+tBoolean UARTCharPutNonBlocking(unsigned long ulBase, unsigned char ucData)
+{
+        struct Modbus_TTY_Uart *uart = Modbus_TTY_GetUart(ulBase);
+            if(!UARTSpaceAvail(ulBase))
+                return false;
+            uart->tx[(uart->tx_first + uart->tx_count++) % TTY_UART_FIFO] = ucData;
+            if(uart->tx_count > (uart->fifo ? uart->tx_level : 0))
+                uart->raw &= ~UART_INT_TX;
+            if(uart->enabled)
+            {
+                if(tty_output_count == TTY_OUTPUT)
+                    Modbus_TTY_Flush();
+                tty_output[tty_output_count++] = ucData;
+                Modbus_TTY_Shift();
+            }
+            Modbus_TTY_ArmAll();
+            return true;
+}
+
+void UARTCharPut(unsigned long ulBase, unsigned char ucData)
+{
+            //the program waits for room in the FIFO while the characters go out
+            while(!UARTCharPutNonBlocking(ulBase, ucData))
+                Modbus_TTY_Wait(-1);
+}
+
+tBoolean UARTBusy(unsigned long ulBase)
+{
+        struct Modbus_TTY_Uart *uart = Modbus_TTY_GetUart(ulBase);
+            //the program polls it until the line is free, so it waits until the character in course ends
+            if(uart->shifting)
+                Modbus_TTY_Wait(-1);
+            return uart->shifting || uart->tx_count;
+}
+
+void UARTIntEnable(unsigned long ulBase, unsigned long ulIntFlags)
+{
+        Modbus_TTY_GetUart(ulBase)->mask |= ulIntFlags;
+}
+
+void UARTIntDisable(unsigned long ulBase, unsigned long ulIntFlags)
+{
+        Modbus_TTY_GetUart(ulBase)->mask &= ~ulIntFlags;
+}
+
+unsigned long UARTIntStatus(unsigned long ulBase, tBoolean bMasked)
+{
+        struct Modbus_TTY_Uart *uart = Modbus_TTY_GetUart(ulBase);
+            return bMasked ? (uart->raw & uart->mask) : uart->raw;
+}
+
+void UARTIntClear(unsigned long ulBase, unsigned long ulIntFlags)
+{
+        Modbus_TTY_GetUart(ulBase)->raw &= ~ulIntFlags;
+}
+
+void GPIOPinTypeUART(unsigned long ulPort, unsigned char ucPins)
+{
+}
+
+void GPIOPinTypeGPIOInput(unsigned long ulPort, unsigned char ucPins)
+{
+}
+
+void GPIOPinTypeGPIOOutput(unsigned long ulPort, unsigned char ucPins)
+{
+}
+
+void GPIOPadConfigSet(unsigned long ulPort, unsigned char ucPins, unsigned long ulStrength, unsigned long ulPadType)
+{
+}
+
+long GPIOPinRead(unsigned long ulPort, unsigned char ucPins)
+{
+        return 0;
+}
+
+void GPIOPinWrite(unsigned long ulPort, unsigned char ucPins, unsigned char ucVal)
+{
+}
@@ -0,0 +1,89 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+#ifndef MODBUS_TTY_H_
+#define MODBUS_TTY_H_
+
+/**
+*   @defgroup TTY Serial port of Linux
+*   @brief UART1 and timers of the boards on a serial port of a Linux host, to run the Modbus RTU master or a slave on it.
+*
+*   @author Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+*
+*   This module stands in for the same functions of the driver library as Modbus_VCAN.c (UART*, Timer*, Int*, SysCtl*, GPIO*),
+*   but for one node, the program itself, and in real time: the sources of the serial master or slave (OSL_Mode) run unchanged,
+*   their UART1 is a tty (termios) and their interruption handlers are called from Modbus_TTY_Wait(), which waits for the tty and
+*   the timers with epoll:
+*
+*       -The time is the one of CLOCK_MONOTONIC, in cycles of a system clock of MODBUS_TTY_CLOCK. TIMER0 to TIMER2 (T3.5, T1.5
+*        and the response and broadcast timeouts of the master) are timerfds armed at the time of their timeout, and TIMER3, the
+*        free-running one of MODBUS_OSL_RTU_FIFO, is read from the clock.
+*       -Inside a handler the time stands at the time of its event: the reading of the characters from the tty, or the timeout of
+*        the timer; so the timers started by the handler, and the times of arrival taken from TIMER3, count from the event and
+*        not from the moment the process got the processor.
+*       -The characters read from the tty wait in the program until there is room in the receive FIFO (16 characters, or 1
+*        without FIFOs), so there are no overruns. Each one arrives at the time of its reading, but not before the end of the
+*        previous one, and they are attended in order of time with the timers. They raise the receive interruption at the FIFO
+*        level and, 32 bit times after the last one, the receive timeout interruption. With parity, the characters with a parity
+*        or framing error are marked by the tty (PARMRK) and have UART_DR_PE.
+*       -The transmit FIFO sends its characters one per character time at the baud rate, so the transmit interruption and
+*        UARTBusy() follow the times of the characters; they are written to the tty as they go into the FIFO, so the driver sends
+*        them back to back.
+*
+*   The device "pty" creates a pseudo terminal instead, whose other end (Modbus_TTY_Name()) is given to the other program, so
+*   the master and a slave can be tested over it. A pseudo terminal has no baud rate nor parity: the characters written come at
+*   once, and the receiver spaces them at its baud rate. Since the kernel may pass them some ms late, the first character after a
+*   silence is held 10 ms, so a frame arrives whole and 10 ms later than on a line.
+*
+*   On a real port, the T1.5 checks depend on how fast the characters get to the process (the latency of USB adapters, the load
+*   of the host); T3.5 and the timeouts are as accurate as the wake up of the process.
+*/
+/** @{ */
+#include "stdint.h"
+
+//! Entries of the vector table, as the ones of Modbus_VCAN.h.
+#define MODBUS_TTY_VECTORS 64
+//! System clock seen by the node, in Hz (SysCtlClockGet): the 40 MHz of the boards.
+#define MODBUS_TTY_CLOCK 40000000UL
+
+/**
+*    @brief Function to open the serial port.
+*
+*    It must be called before the initialisation of the master or the slave, which configures it (UARTConfigSetExpClk()).
+*    @param device The path of the tty, or "pty" to create a pseudo terminal.
+*    @param vectors The vector table, by interruption number (INT_UART1, INT_TIMER0A...).
+*    @return 1 if it was opened, 0 if not (errno tells why).
+*/
+unsigned char Modbus_TTY_Open(const char *device, void (*const vectors[MODBUS_TTY_VECTORS])(void));
+
+/**
+*    @brief Function to get the name of the tty for the other program.
+*
+*    @return The path of the other end of the pseudo terminal, or the device given to Modbus_TTY_Open().
+*/
+const char *Modbus_TTY_Name(void);
+
+/**
+*    @brief Function to wait for the tty and the timers, and attend the interruptions.
+*
+*    The pending interruptions are attended first; then, if there were none, the program sleeps until a character arrives or a
+*    timer, the receive timeout or the end of a character sent expires, at most _timeout_ ms, and the interruptions which they
+*    raise are attended. The main loop calls it between passes.
+*    @param timeout The longest sleep, in ms; -1 to sleep until something happens.
+*/
+void Modbus_TTY_Wait(int timeout);
+
+/**
+*    @brief Function to get the time.
+*
+*    @return The time of CLOCK_MONOTONIC, in nanoseconds; inside a handler, the time of its event.
+*/
+uint64_t Modbus_TTY_Now(void);
+
+/**
+*    @brief Function to get the interruption handlers run.
+*
+*    @param vector The interruption number, as INT_UART1, or 0 for all of them.
+*    @return The handlers run.
+*/
+uint64_t Modbus_TTY_GetInterrupts(unsigned char vector);
+/** @} */
+#endif
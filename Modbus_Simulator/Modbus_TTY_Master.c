@@ -0,0 +1,200 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+/**
+*   @defgroup TTY_Master Serial master on Linux
+*   @ingroup TTY
+*   @brief The serial master (Modbus_Project_Master built with OSL_Mode) on a serial port of the Linux host.
+*
+*   @author Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+*
+*   The master sends the requests of the serial benchmark to one slave, one by one: reads of 125 registers, writes of 123
+*   registers and reads of 4 registers, and checks the registers read against the tables of modbus_rtu_slave. For each request
+*   it reports the transactions, the ones which failed or read wrong registers, the transactions per second, the mean and the
+*   longest time of a transaction in ms and the interruption handlers run by the master per transaction. It ends with 1 if any
+*   transaction failed, so `make tty-test` runs it against modbus_rtu_slave over a pseudo terminal.
+*
+*   Usage: modbus_rtu_master -d device [-s slave] [-b baud rate] [-r requests]
+*/
+/** @{ */
+//includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stdint.h"
+#include "inc/hw_ints.h"
+#include "Master/Modbus_App.h"
+#include "Modbus_TTY.h"
+
+//! Time given to the master to leave its initial state, in ns (10 ms).
+#define TTY_MASTER_START 10000000ULL
+//! Longest sleep between two passes of the master, in ms: it goes to the next request in a pass without an interruption.
+#define TTY_MASTER_POLL 1
+//! Time after which the master is taken as stuck in a transaction, in ns (10 s): longer than its attempts.
+#define TTY_MASTER_STUCK 10000000000ULL
+
+//! A request of the master, and the check of what it read.
+struct TTY_Master_Workload
+{
+      const char *name;                                 //!< Function code and what it does
+      unsigned char (*request)(unsigned char slave);    //!< Sends the request to a slave
+      unsigned char (*check)(void);                     //!< Checks the registers read, NULL if it reads nothing
+};
+
+//! Registers read
+static uint16_t tty_registers[125];
+//! Values written, the ones of the slave
+static uint16_t tty_values[125];
+
+//handlers of the serial master, in its startup file on the board
+void UART1IntHandler(void);
+void Timer0IntHandler(void);
+void Timer1IntHandler(void);
+void Timer2IntHandler(void);
+
+//! Vector table of the master.
+static void (*const tty_master_vectors[MODBUS_TTY_VECTORS])(void) =
+{
+    [INT_UART1] = UART1IntHandler,
+    [INT_TIMER0A] = Timer0IntHandler,
+    [INT_TIMER1A] = Timer1IntHandler,
+    [INT_TIMER2A] = Timer2IntHandler
+};
+//! @}
+
+static unsigned char TTY_Master_FC03(unsigned char slave) { return Modbus_Read_H_Registers(slave, 0, 125, tty_registers); }
+static unsigned char TTY_Master_FC03_4(unsigned char slave) { return Modbus_Read_H_Registers(slave, 7, 4, tty_registers); }
+static unsigned char TTY_Master_FC16(unsigned char slave) { return Modbus_Write_M_Registers(slave, 0, 123, tty_values); }
+
+//! \brief Function to check the registers read: the register i is i, the writes keep it.
+static unsigned char TTY_Master_Check_Registers(void)
+{
+        uint16_t i;
+            for(i = 0; i < 125; i++)
+            {
+                if(tty_registers[i] != i)
+                    return 0;
+            }
+            return 1;
+}
+
+//! \brief Function to check the registers 7 to 10.
+static unsigned char TTY_Master_Check_Block(void)
+{
+        uint16_t i;
+            for(i = 0; i < 4; i++)
+            {
+                if(tty_registers[i] != i + 7)
+                    return 0;
+            }
+            return 1;
+}
+
+//! Requests sent: the longest frames of each direction and a short poll, as the ones of the serial benchmark.
+static const struct TTY_Master_Workload tty_workloads[] =
+{
+    { "03 read 125 registers",   TTY_Master_FC03,   TTY_Master_Check_Registers },
+    { "16 write 123 registers",  TTY_Master_FC16,   NULL },
+    { "03 read 4 registers",     TTY_Master_FC03_4, TTY_Master_Check_Block },
+};
+
+//! \brief Function to count the requests which failed, from the Error FIFO of the master.
+static unsigned long TTY_Master_Errors(void)
+{
+        struct Modbus_FIFO_E_Item error;
+        unsigned long errors = 0;
+            while(Modbus_Get_Error(&error))
+                errors++;
+            return errors;
+}
+
+//! \brief Function to run the master until it has no request left.
+//!
+//! \return The requests which failed.
+static unsigned long TTY_Master_Drain(void)
+{
+        uint64_t start = Modbus_TTY_Now();
+        unsigned long errors = 0;
+            while(Modbus_Master_Communication())
+            {
+                errors += TTY_Master_Errors();
+                Modbus_TTY_Wait(TTY_MASTER_POLL);
+                if((Modbus_TTY_Now() - start) > TTY_MASTER_STUCK)
+                {
+                    fprintf(stderr, "tty: the master did not finish its requests\n");
+                    exit(1);
+                }
+            }
+            return errors + TTY_Master_Errors();
+}
+
+//! \brief Function to send the requests of a workload.
+//!
+//! \param workload The request.
+//! \param slave The slave.
+//! \param baud_rate The baud rate.
+//! \param requests Number of requests.
+//! \return The transactions which failed or read wrong registers.
+static unsigned long TTY_Master_Run(const struct TTY_Master_Workload *workload, unsigned char slave, unsigned long baud_rate,
+                                    unsigned long requests)
+{
+        unsigned long i, bad = 0;
+        uint64_t start, call, elapsed, longest = 0, interrupts = Modbus_TTY_GetInterrupts(0);
+            start = Modbus_TTY_Now();
+            for(i = 0; i < requests; i++)
+            {
+                memset(tty_registers, 0xFF, sizeof(tty_registers));
+                call = Modbus_TTY_Now();
+                workload->request(slave);
+                if(TTY_Master_Drain() || (workload->check && !workload->check()))
+                    bad++;
+                if((Modbus_TTY_Now() - call) > longest)
+                    longest = Modbus_TTY_Now() - call;
+            }
+            elapsed = Modbus_TTY_Now() - start;
+            printf("%8lu  %-24s %6lu %5lu %9.1f %9.2f %9.2f %11.1f\n", baud_rate, workload->name, requests, bad,
+                   requests * 1e9 / elapsed, elapsed / 1e6 / requests, longest / 1e6,
+                   (double)(Modbus_TTY_GetInterrupts(0) - interrupts) / requests);
+            return bad;
+}
+
+int main(int argc, char **argv)
+{
+        const char *device = NULL;
+        unsigned long slave = 1, baud_rate = B9600, requests = 20, bad = 0, i;
+        uint64_t start;
+        int opt;
+            for(opt = 1; opt < argc; opt++)
+            {
+                if((argv[opt][0] != '-') || (opt + 1 >= argc))
+                    goto usage;
+                switch(argv[opt][1])
+                {
+                    case 'd': device = argv[++opt]; break;
+                    case 's': slave = strtoul(argv[++opt], NULL, 0); break;
+                    case 'b': baud_rate = strtoul(argv[++opt], NULL, 0); break;
+                    case 'r': requests = strtoul(argv[++opt], NULL, 0); break;
+                    default: goto usage;
+                }
+            }
+            if(!device || !slave || (slave > 247) || !requests || (baud_rate < 1200) || (baud_rate > 115200))
+                goto usage;
+            for(i = 0; i < 125; i++)
+                tty_values[i] = i;
+            if(!Modbus_TTY_Open(device, tty_master_vectors))
+            {
+                perror(device);
+                return 1;
+            }
+            Modbus_Master_Init(MODBUS_SERIAL, (enum Baud)baud_rate, 3, MODBUS_OSL_MODE_RTU);
+            start = Modbus_TTY_Now();
+            while((Modbus_TTY_Now() - start) < TTY_MASTER_START)
+                Modbus_TTY_Wait(TTY_MASTER_POLL);
+            printf("%s, slave %lu, %lu requests, 8E1\n", device, slave, requests);
+            printf("%8s  %-24s %6s %5s %9s %9s %9s %11s\n", "baud", "function", "trans", "bad", "trans/s", "mean ms", "max ms",
+                   "master ints");
+            for(i = 0; i < sizeof(tty_workloads) / sizeof(tty_workloads[0]); i++)
+                bad += TTY_Master_Run(&tty_workloads[i], slave, baud_rate, requests);
+            return bad ? 1 : 0;
+        usage:
+            fprintf(stderr, "usage: %s -d device [-s slave (1-247)] [-b baud rate (1200-115200)] [-r requests]\n", argv[0]);
+            return 2;
+}
@@ -0,0 +1,108 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+/**
+*   @defgroup TTY_Slave Serial slave on Linux
+*   @ingroup TTY
+*   @brief The serial slave (Modbus_Project_Slave built with OSL_Mode) on a serial port of the Linux host.
+*
+*   @author Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+*
+*   The slave has the tables of maintest_slave.c, as the ones of the simulator, and answers on the tty until it is killed. With
+*   the device "pty" it creates a pseudo terminal and prints the name of its other end, for the master.
+*
+*   Usage: modbus_rtu_slave -d device|pty [-n slave] [-b baud rate]
+*/
+/** @{ */
+//includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stdint.h"
+#include "inc/hw_ints.h"
+#include "Slave/Modbus_App.h"
+#include "Modbus_TTY.h"
+
+//! Coils of the slave.
+#define TTY_SLAVE_COILS 2000
+//! Discrete inputs of the slave.
+#define TTY_SLAVE_D_INPUTS 2000
+//! Holding registers of the slave.
+#define TTY_SLAVE_H_REGISTERS 125
+//! Input registers of the slave.
+#define TTY_SLAVE_I_REGISTERS 125
+
+//-TABLES, the same as the ones of maintest_slave.c
+static unsigned char tty_coils[TTY_SLAVE_COILS];
+static unsigned char tty_d_inputs[TTY_SLAVE_D_INPUTS];
+static uint16_t tty_h_registers[TTY_SLAVE_H_REGISTERS];
+static uint16_t tty_i_registers[TTY_SLAVE_I_REGISTERS];
+
+//handlers of the serial slave, in its startup file on the board
+void UART1IntHandler(void);
+void Timer0IntHandler(void);
+void Timer1IntHandler(void);
+
+//! Vector table of the slave.
+static void (*const tty_slave_vectors[MODBUS_TTY_VECTORS])(void) =
+{
+    [INT_UART1] = UART1IntHandler,
+    [INT_TIMER0A] = Timer0IntHandler,
+    [INT_TIMER1A] = Timer1IntHandler
+};
+//! @}
+
+int main(int argc, char **argv)
+{
+        const char *device = NULL;
+        unsigned long slave = 1, baud_rate = B9600;
+        unsigned char num;
+        uint16_t i;
+        int opt;
+            for(opt = 1; opt < argc; opt++)
+            {
+                if((argv[opt][0] != '-') || (opt + 1 >= argc))
+                    goto usage;
+                switch(argv[opt][1])
+                {
+                    case 'd': device = argv[++opt]; break;
+                    case 'n': slave = strtoul(argv[++opt], NULL, 0); break;
+                    case 'b': baud_rate = strtoul(argv[++opt], NULL, 0); break;
+                    default: goto usage;
+                }
+            }
+            if(!device || !slave || (slave > 247) || (baud_rate < 1200) || (baud_rate > 115200))
+                goto usage;
+            for(i = 0; i < TTY_SLAVE_COILS; i++)
+                tty_coils[i] = 1;
+            num = 0;
+            for(i = 0; i < TTY_SLAVE_D_INPUTS; i++)
+            {
+                tty_d_inputs[i] = num;
+                num += 1;
+                num = num % 2;
+                if(i == 999)
+                    num = 1;
+            }
+            for(i = 0; i < TTY_SLAVE_H_REGISTERS; i++)
+                tty_h_registers[i] = i;
+            for(i = 0; i < TTY_SLAVE_I_REGISTERS; i++)
+                tty_i_registers[i] = i;
+            if(!Modbus_TTY_Open(device, tty_slave_vectors))
+            {
+                perror(device);
+                return 1;
+            }
+            Modbus_Slave_Init(TTY_SLAVE_COILS, tty_coils, TTY_SLAVE_D_INPUTS, tty_d_inputs,
+                              TTY_SLAVE_H_REGISTERS, tty_h_registers, TTY_SLAVE_I_REGISTERS, tty_i_registers,
+                              MODBUS_SERIAL, slave, (enum Baud)baud_rate, MODBUS_OSL_MODE_RTU);
+            printf("%s\n", Modbus_TTY_Name());
+            fflush(stdout);
+            for(;;)
+            {
+                Modbus_Slave_Communication();
+                //the frames are finished by the interruptions, so the slave sleeps until the next one
+                Modbus_TTY_Wait(-1);
+            }
+        usage:
+            fprintf(stderr, "usage: %s -d device|pty [-n slave (1-247)] [-b baud rate (1200-115200)]\n", argv[0]);
+            return 2;
+}
@@ -0,0 +1,1682 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+//! \addtogroup VCAN
+//! @{
+//includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "inc/hw_types.h"
+#include "inc/hw_ints.h"
+#include "inc/hw_memmap.h"
+#include "inc/hw_can.h"
+#include "inc/hw_uart.h"
+#include "driverlib/can.h"
+#include "driverlib/gpio.h"
+#include "driverlib/interrupt.h"
+#include "driverlib/sysctl.h"
+#include "driverlib/timer.h"
+#include "driverlib/uart.h"
+#include "Modbus_VCAN.h"
+
+//! Timers of each node, from TIMER0_BASE to TIMER3_BASE.
+#define VCAN_TIMERS 4
+//! Bits of the longest frame before the bit stuffing (CAN FD, 29-bits identifier and 64 bytes).
+#define VCAN_MAX_BITS 600
+//! Bits after the CRC field: CRC delimiter, ACK slot, ACK delimiter and end of frame.
+#define VCAN_TRAILER_BITS 10
+//! Bits of the end of frame; an error is detected before it, at the ACK delimiter.
+#define VCAN_EOF_BITS 7
+//! Bits of the interframe space.
+#define VCAN_IFS_BITS 3
+//! Bits of an error frame: error flag and error delimiter.
+#define VCAN_ERROR_FRAME_BITS (6 + 8)
+//! Bits of the suspend transmission of an error passive transmitter.
+#define VCAN_SUSPEND_BITS 8
+//! Bits of the bus-off recovery: 128 sequences of 11 recessive bits.
+#define VCAN_RECOVERY_BITS (128 * 11)
+//! Mask of the 29-bits identifiers.
+#define VCAN_ID_MASK 0x1FFFFFFFUL
+//! Interruption handlers run in a row with their line still asserted which are taken as an interruption which is never cleared.
+#define VCAN_STORM 100000
+//! Depth of the receive and transmit FIFOs of the UARTs.
+#define VCAN_UART_FIFO 16
+//! Bit times without characters after which the receive timeout interruption is raised, if the receive FIFO is not empty.
+#define VCAN_UART_TIMEOUT_BITS 32
+
+//! Message object of a virtual CAN controller.
+struct Modbus_VCAN_Object
+{
+      unsigned char valid;              //!< MSGVAL: the message object is used
+      unsigned char tx;                 //!< Direction: it sends data frames (1) or receives them (0)
+      unsigned char remote_enable;      //!< A remote frame received sets the transmission request (MSG_OBJ_TYPE_RXTX_REMOTE)
+      unsigned char newdat;             //!< NEWDAT: a frame was received and not read yet
+      unsigned char lost;               //!< MSGLST: a frame with new data was overwritten
+      unsigned long flags;              //!< Flags given to CANMessageSet()
+      unsigned long id;                 //!< Identifier, the one received in the receive message objects
+      unsigned long mask;               //!< Mask of the filter
+      unsigned char extended;           //!< If the identifier of the last frame received has 29 bits
+      unsigned char length;             //!< Data length
+      unsigned char data[64];           //!< Data
+};
+
+//! General purpose timer, in full-width mode.
+struct Modbus_VCAN_Timer
+{
+      unsigned char periodic;           //!< Periodic (1) or one shot (0)
+      unsigned char enabled;            //!< If the timer is counting
+      unsigned long raw;                //!< Raw interruption status
+      unsigned long mask;               //!< Interruptions enabled
+      unsigned long load;               //!< Load value, in cycles
+      uint64_t start;                   //!< Time when the timer was loaded
+};
+
+//! UART1 of a node, joined to the serial line.
+struct Modbus_VCAN_Uart
+{
+      unsigned char enabled;            //!< If it was configured (UARTConfigSetExpClk) and not disabled
+      unsigned char fifo;               //!< FIFOs of 16 characters enabled; otherwise each one is a holding register
+      unsigned char rx_level;           //!< Characters in the receive FIFO which raise the receive interruption
+      unsigned char tx_level;           //!< Characters in the transmit FIFO at or below which the transmit interruption is raised
+      unsigned char length;             //!< Data bits of each character
+      unsigned char bits;               //!< Bits of each character: start, data, parity and stop bits
+      unsigned char parity;             //!< If the characters have a parity bit
+      uint64_t bit_time;                //!< Bit time, in picoseconds
+      uint16_t rx[VCAN_UART_FIFO];      //!< Receive FIFO, with the error bits of UARTDR
+      unsigned char rx_first;           //!< Oldest character of the receive FIFO
+      unsigned char rx_count;           //!< Characters in the receive FIFO
+      uint16_t overrun;                 //!< UART_DR_OE if a character was lost; it goes with the next one stored
+      unsigned char tx[VCAN_UART_FIFO]; //!< Transmit FIFO
+      unsigned char tx_first;           //!< Oldest character of the transmit FIFO
+      unsigned char tx_count;           //!< Characters in the transmit FIFO
+      unsigned char shifting;           //!< If a character is being sent
+      uint16_t shift;                   //!< Character being sent, with UART_DR_PE if it is corrupted
+      unsigned char collided;           //!< If other node was sending at the same time
+      unsigned long corrupt;            //!< Characters still to send with a parity error, see Modbus_VCAN_UartCorrupt()
+      uint64_t tx_end;                  //!< Time when the stop bit of the character being sent finishes
+      uint64_t rx_timeout;              //!< Time of the receive timeout interruption, 0 if it is not armed
+      unsigned long raw;                //!< Raw interruption status
+      unsigned long mask;               //!< Interruptions enabled
+      uint64_t sent;                    //!< Characters sent
+};
+
+//! Node of the bus: a board with its CAN controller, its timers and its interruption controller.
+struct Modbus_VCAN_Node
+{
+      struct Modbus_VCAN_Board *board;                          //!< Board of the node
+      struct Modbus_VCAN_Object objects[MODBUS_VCAN_OBJECTS];   //!< Message objects, the object 1 is _objects[0]_
+      unsigned char init;               //!< Init bit: the controller does not take part in the bus
+      unsigned long status;             //!< Status register (CAN_STATUS_*)
+      unsigned char status_pending;     //!< If the status interruption is pending
+      unsigned long txrqst;             //!< TXRQST, a bit per message object (bit 0 is the object 1): a frame is waiting to be sent; a remote frame if it is a receive message object
+      unsigned long intpnd;             //!< INTPND, a bit per message object: its interruption is pending
+      unsigned long int_enable;         //!< Interruptions enabled (CAN_INT_*)
+      unsigned long tec;                //!< Transmit error counter
+      unsigned long rec;                //!< Receive error counter
+      unsigned char auto_retry;         //!< If the frames are sent again after an error
+      unsigned char recovering;         //!< If the bus-off recovery is running
+      uint64_t recovery_end;            //!< Time when the bus-off recovery finishes
+      uint64_t tx_allowed;              //!< Time since the node can start a frame (suspend transmission)
+      tCANBitClkParms bit_clk;          //!< Nominal bit timing
+      tCANBitClkParms data_bit_clk;     //!< Bit timing of the data phase of the CAN FD frames
+      uint64_t bit_time;                //!< Nominal bit time, in picoseconds
+      uint64_t data_bit_time;           //!< Bit time of the data phase, in picoseconds
+      struct Modbus_VCAN_Timer timers[VCAN_TIMERS]; //!< Timers TIMER0 to TIMER3
+      struct Modbus_VCAN_Uart uart;     //!< UART1, on the serial line
+      unsigned char enabled[MODBUS_VCAN_VECTORS];   //!< Interruptions enabled in the interruption controller
+      unsigned char masked;             //!< All interruptions masked (IntMasterDisable)
+      unsigned char in_isr;             //!< If an interruption handler is running
+      unsigned long isr_cycles;         //!< Cycles of each interruption of the node, see Modbus_VCAN_SetIsrCycles()
+      uint64_t isr_end;                 //!< Time when the last interruption handler finishes; the next one does not start before
+      unsigned long storm;              //!< Handlers run in a row whose line was still asserted after them
+      uint64_t interrupts[MODBUS_VCAN_VECTORS]; //!< Interruption handlers run, by interruption number
+      unsigned char in_loop;            //!< If the main loop is running, or the node is the foreground one
+      uint64_t next_loop;               //!< Time of the next pass of the main loop
+      uint64_t loop_max;                //!< Longest pass of the main loop, see Modbus_VCAN_LongestLoop()
+};
+
+//! Frame in the bus.
+struct Modbus_VCAN_Frame
+{
+      unsigned char node;               //!< Index of the transmitter node
+      unsigned char object;             //!< Message object of the transmitter
+      unsigned long id;                 //!< Identifier
+      unsigned char extended;           //!< 29-bits identifier
+      unsigned char remote;             //!< Remote frame
+      unsigned char fd;                 //!< CAN FD frame
+      unsigned char brs;                //!< CAN FD frame with the data phase at the fast bit rate
+      unsigned char length;             //!< Data length
+      unsigned char data[64];           //!< Data
+      unsigned long error;              //!< Last error code of the transmitter, CAN_STATUS_LEC_NONE if it is sent correctly
+      uint64_t duration;                //!< Time in the bus, interframe space included
+};
+
+//-SIMULATION
+//! Boards registered
+static struct Modbus_VCAN_Board *vcan_boards[MODBUS_VCAN_NODES];
+//! Number of boards registered
+static unsigned char vcan_board_count;
+//! Nodes switched on
+static struct Modbus_VCAN_Node vcan_nodes[MODBUS_VCAN_NODES];
+//! Number of nodes switched on
+static unsigned char vcan_node_count;
+//! Node whose code is running; the calls to the driver library go to its peripherals
+static struct Modbus_VCAN_Node *vcan_current;
+//! Parameters of the simulation
+static struct Modbus_VCAN_Config vcan_config;
+//! Virtual time, in picoseconds
+static uint64_t vcan_now;
+//! Duration of a cycle of the system clock, in picoseconds
+static uint64_t vcan_cycle;
+//! State of the generator of corruptions
+static uint64_t vcan_random;
+//! Counters of the bus
+static struct Modbus_VCAN_Stats vcan_stats;
+
+//! Interruption lines which the peripherals of a node can assert, in order of priority
+static const unsigned char vcan_lines[] = { INT_UART1, INT_TIMER0A, INT_TIMER1A, INT_TIMER2A, INT_TIMER3A, INT_CAN0 };
+//! Levels of the FIFO interruptions, in characters, by UART_FIFO_TX*_8 or UART_FIFO_RX*_8 >> 3
+static const unsigned char vcan_uart_levels[] = { 2, 4, 8, 12, 14 };
+
+//! Registers written by the serial nodes for their LED, see inc/lm3s8962.h
+volatile unsigned long Modbus_VCAN_Registers[4];
+
+//-BUS
+//! If there is a frame in the bus
+static unsigned char bus_busy;
+//! Frame in the bus
+static struct Modbus_VCAN_Frame bus_frame;
+//! Time when the frame in the bus finishes (end of frame or error delimiter)
+static uint64_t bus_end;
+//! Time since the bus is idle, after the interframe space
+static uint64_t bus_idle;
+//! @}
+
+static struct Modbus_VCAN_Node *Modbus_VCAN_Current(const char *function);
+static void Modbus_VCAN_Run(uint64_t until);
+static void Modbus_VCAN_Interrupts(struct Modbus_VCAN_Node *node);
+static unsigned char Modbus_VCAN_Line(struct Modbus_VCAN_Node *node, unsigned char vector);
+static unsigned char Modbus_VCAN_Pending(struct Modbus_VCAN_Node *node);
+static struct Modbus_VCAN_Object *Modbus_VCAN_TxObject(struct Modbus_VCAN_Node *node, unsigned char *number);
+static unsigned char Modbus_VCAN_OnBus(struct Modbus_VCAN_Node *node);
+static unsigned char Modbus_VCAN_Wins(const struct Modbus_VCAN_Frame *frame, const struct Modbus_VCAN_Frame *other);
+static unsigned int Modbus_VCAN_Arbitration(const struct Modbus_VCAN_Frame *frame, unsigned char *bits);
+static unsigned int Modbus_VCAN_Bits(const struct Modbus_VCAN_Frame *frame, unsigned int *fast, unsigned int *stuff);
+static void Modbus_VCAN_Start(void);
+static void Modbus_VCAN_End(void);
+static void Modbus_VCAN_Store(struct Modbus_VCAN_Node *node, const struct Modbus_VCAN_Frame *frame);
+static unsigned char Modbus_VCAN_Accepts(const struct Modbus_VCAN_Object *object, const struct Modbus_VCAN_Frame *frame);
+static void Modbus_VCAN_ErrorState(struct Modbus_VCAN_Node *node);
+static void Modbus_VCAN_Recovered(struct Modbus_VCAN_Node *node);
+static void Modbus_VCAN_Expire(struct Modbus_VCAN_Node *node, unsigned char timer);
+static struct Modbus_VCAN_Timer *Modbus_VCAN_GetTimer(unsigned long base);
+static uint64_t Modbus_VCAN_BitClk(const tCANBitClkParms *clk);
+static unsigned char Modbus_VCAN_Length(unsigned long length, unsigned char fd);
+static struct Modbus_VCAN_Uart *Modbus_VCAN_GetUart(unsigned long base);
+static void Modbus_VCAN_UartShift(struct Modbus_VCAN_Node *node);
+static void Modbus_VCAN_UartSent(struct Modbus_VCAN_Node *node);
+static void Modbus_VCAN_UartReceive(struct Modbus_VCAN_Node *node, const struct Modbus_VCAN_Uart *tx, uint16_t data);
+
+void Modbus_VCAN_Register(struct Modbus_VCAN_Board *board)
+{
+        if(vcan_board_count < MODBUS_VCAN_NODES)
+            vcan_boards[vcan_board_count++] = board;
+}
+
+struct Modbus_VCAN_Board *Modbus_VCAN_GetBoard(unsigned char index)
+{
+        return (index < vcan_board_count) ? vcan_boards[index] : NULL;
+}
+
+void Modbus_VCAN_Setup(const struct Modbus_VCAN_Config *config)
+{
+        vcan_config = *config;
+        vcan_cycle = MODBUS_VCAN_SECOND / vcan_config.cpu_clock;
+        vcan_random = vcan_config.seed ? vcan_config.seed : 1;
+        vcan_now = 0;
+        vcan_node_count = 0;
+        vcan_current = NULL;
+        memset(vcan_nodes, 0, sizeof(vcan_nodes));
+        memset(&vcan_stats, 0, sizeof(vcan_stats));
+        bus_busy = 0;
+        bus_idle = 0;
+}
+
+unsigned char Modbus_VCAN_PowerOn(struct Modbus_VCAN_Board *board, unsigned char number, unsigned long bit_rate)
+{
+        struct Modbus_VCAN_Node *node, *previous;
+            if(vcan_node_count >= MODBUS_VCAN_NODES)
+            {
+                fprintf(stderr, "vcan: too many nodes\n");
+                exit(1);
+            }
+            node = &vcan_nodes[vcan_node_count];
+            memset(node, 0, sizeof(*node));
+            node->board = board;
+            //after the reset the CAN controller is in init mode, it has to be enabled
+            node->init = 1;
+            node->auto_retry = 1;
+            node->status = CAN_STATUS_LEC_NONE;
+            node->next_loop = vcan_now;
+            node->isr_cycles = vcan_config.isr_cycles;
+            //the foreground node has no main loop, its code is the one of the program
+            node->in_loop = (board->loop == NULL);
+            previous = vcan_current;
+            vcan_current = node;
+            if(board->init)
+                board->init(number, bit_rate);
+            if(board->loop)
+                vcan_current = previous;
+            return vcan_node_count++;
+}
+
+void Modbus_VCAN_Idle(unsigned long cycles)
+{
+        Modbus_VCAN_Run(vcan_now + (cycles * vcan_cycle));
+}
+
+uint64_t Modbus_VCAN_Now(void)
+{
+        return vcan_now;
+}
+
+unsigned long Modbus_VCAN_BoardOption(void)
+{
+        return vcan_config.board_option;
+}
+
+void Modbus_VCAN_SetIsrCycles(unsigned char node, unsigned long cycles)
+{
+        if(node < vcan_node_count)
+            vcan_nodes[node].isr_cycles = cycles;
+}
+
+void Modbus_VCAN_SetErrorRate(double error_rate)
+{
+        vcan_config.error_rate = error_rate;
+}
+
+uint64_t Modbus_VCAN_BitTime(unsigned char node, unsigned char fast)
+{
+        if(node >= vcan_node_count)
+            return 0;
+        return fast ? vcan_nodes[node].data_bit_time : vcan_nodes[node].bit_time;
+}
+
+void Modbus_VCAN_GetStats(struct Modbus_VCAN_Stats *stats)
+{
+        *stats = vcan_stats;
+}
+
+uint64_t Modbus_VCAN_GetInterrupts(unsigned char node, unsigned char vector)
+{
+        uint64_t count = 0;
+        unsigned char i;
+            if(node >= vcan_node_count)
+                return 0;
+            if(vector)
+                return (vector < MODBUS_VCAN_VECTORS) ? vcan_nodes[node].interrupts[vector] : 0;
+            for(i = 0; i < MODBUS_VCAN_VECTORS; i++)
+                count += vcan_nodes[node].interrupts[i];
+            return count;
+}
+
+uint64_t Modbus_VCAN_LongestLoop(unsigned char node)
+{
+        uint64_t longest;
+            if(node >= vcan_node_count)
+                return 0;
+            longest = vcan_nodes[node].loop_max;
+            vcan_nodes[node].loop_max = 0;
+            return longest;
+}
+
+uint64_t Modbus_VCAN_UartChars(unsigned char node)
+{
+        return (node < vcan_node_count) ? vcan_nodes[node].uart.sent : 0;
+}
+
+void Modbus_VCAN_UartCorrupt(unsigned long characters)
+{
+        Modbus_VCAN_Current("Modbus_VCAN_UartCorrupt")->uart.corrupt = characters;
+}
+
+//! \brief Function to get the node whose code is running.
+//!
+//! \param function Name of the function of the driver library, for the message if there is no node.
+//! \return The current node.
+static struct Modbus_VCAN_Node *Modbus_VCAN_Current(const char *function)
+{
+        if(!vcan_current)
+        {
+            fprintf(stderr, "vcan: %s called out of a node\n", function);
+            exit(1);
+        }
+        return vcan_current;
+}
+
+//! \brief Function to run the simulation until a time.
+//!
+//! The events are processed in order of time: end and start of frames, bus-off recoveries, timers, ends of interruption handlers
+//! with other interruption waiting, and passes of the main loops. After each one, the pending interruptions of all nodes are
+//! attended. It can be called again from inside a node
+//! (SysCtlDelay()); that node does not run its main loop meanwhile, but its interruptions are attended.
+//! \param until The time to stop; the events at that time are left for the next call.
+static void Modbus_VCAN_Run(uint64_t until)
+{
+        enum { VCAN_NONE, VCAN_END, VCAN_START, VCAN_RECOVERY, VCAN_TIMER, VCAN_UART_TX, VCAN_UART_RT, VCAN_ISR, VCAN_LOOP } event;
+        struct Modbus_VCAN_Node *node, *previous;
+        unsigned char i, t, target = 0, timer = 0, number, work;
+        uint64_t next, start;
+            for(;;)
+            {
+                for(i = 0; i < vcan_node_count; i++)
+                {
+                    Modbus_VCAN_Interrupts(&vcan_nodes[i]);
+                }
+                next = until;
+                event = VCAN_NONE;
+                if(bus_busy)
+                {
+                    if(bus_end < next)
+                    {
+                        next = bus_end;
+                        event = VCAN_END;
+                    }
+                }
+                else
+                {
+                    //the bus is idle, the first node allowed to send starts a frame
+                    for(i = 0; i < vcan_node_count; i++)
+                    {
+                        node = &vcan_nodes[i];
+                        if(!Modbus_VCAN_OnBus(node) || !Modbus_VCAN_TxObject(node, &number))
+                            continue;
+                        start = (node->tx_allowed > bus_idle) ? node->tx_allowed : bus_idle;
+                        if(start < vcan_now)
+                            start = vcan_now;
+                        if(start < next)
+                        {
+                            next = start;
+                            event = VCAN_START;
+                        }
+                    }
+                }
+                for(i = 0; i < vcan_node_count; i++)
+                {
+                    node = &vcan_nodes[i];
+                    if(node->recovering && (node->recovery_end < next))
+                    {
+                        next = node->recovery_end;
+                        event = VCAN_RECOVERY;
+                        target = i;
+                    }
+                    for(t = 0; t < VCAN_TIMERS; t++)
+                    {
+                        if(node->timers[t].enabled && node->timers[t].load &&
+                           ((node->timers[t].start + (node->timers[t].load * vcan_cycle)) < next))
+                        {
+                            next = node->timers[t].start + (node->timers[t].load * vcan_cycle);
+                            event = VCAN_TIMER;
+                            target = i;
+                            timer = t;
+                        }
+                    }
+                    if(node->uart.shifting && (node->uart.tx_end < next))
+                    {
+                        next = node->uart.tx_end;
+                        event = VCAN_UART_TX;
+                        target = i;
+                    }
+                    if(node->uart.rx_timeout && (node->uart.rx_timeout < next))
+                    {
+                        next = node->uart.rx_timeout;
+                        event = VCAN_UART_RT;
+                        target = i;
+                    }
+                    if((node->isr_end > vcan_now) && (node->isr_end < next) && Modbus_VCAN_Pending(node))
+                    {
+                        next = node->isr_end;
+                        event = VCAN_ISR;
+                        target = i;
+                    }
+                    if(!node->in_loop && (node->next_loop < next))
+                    {
+                        next = (node->next_loop > vcan_now) ? node->next_loop : vcan_now;
+                        event = VCAN_LOOP;
+                        target = i;
+                    }
+                }
+                if(event == VCAN_NONE)
+                    break;
+                vcan_now = next;
+                node = &vcan_nodes[target];
+                switch(event)
+                {
+                    case VCAN_END:
+                            Modbus_VCAN_End();
+                            break;
+                    case VCAN_START:
+                            Modbus_VCAN_Start();
+                            break;
+                    case VCAN_RECOVERY:
+                            Modbus_VCAN_Recovered(node);
+                            break;
+                    case VCAN_TIMER:
+                            Modbus_VCAN_Expire(node, timer);
+                            break;
+                    case VCAN_UART_TX:
+                            Modbus_VCAN_UartSent(node);
+                            break;
+                    case VCAN_UART_RT:
+                            //the receive FIFO was not read for 32 bit times
+                            node->uart.rx_timeout = 0;
+                            if(node->uart.rx_count)
+                                node->uart.raw |= UART_INT_RT;
+                            break;
+                    case VCAN_ISR: //the interruption waiting is attended below
+                            break;
+                    case VCAN_LOOP:
+                            previous = vcan_current;
+                            vcan_current = node;
+                            node->in_loop = 1;
+                            start = vcan_now;
+                            work = node->board->loop();
+                            if((vcan_now - start) > node->loop_max)
+                                node->loop_max = vcan_now - start;
+                            node->in_loop = 0;
+                            vcan_current = previous;
+                            node->next_loop = vcan_now + ((work ? vcan_config.work_cycles : vcan_config.loop_cycles) * vcan_cycle);
+                            break;
+                    default:
+                            break;
+                }
+            }
+            if(until > vcan_now)
+                vcan_now = until;
+}
+
+//! \brief Function to attend the pending interruptions of a node.
+//!
+//! The handlers are run one after the other, the lowest interruption number first, as long as some line is asserted and enabled.
+//! An interruption handler is not interrupted by other one. Each handler takes the cycles of the node, in which its main loop
+//! does not run and no other handler starts; Modbus_VCAN_Run() comes back when they have passed.
+//! \param node The node.
+static void Modbus_VCAN_Interrupts(struct Modbus_VCAN_Node *node)
+{
+        struct Modbus_VCAN_Node *previous;
+        unsigned char vector;
+            while(!node->in_isr && !node->masked && (node->isr_end <= vcan_now) && (vector = Modbus_VCAN_Pending(node)))
+            {
+                previous = vcan_current;
+                vcan_current = node;
+                node->in_isr = 1;
+                node->board->vectors[vector]();
+                node->in_isr = 0;
+                vcan_current = previous;
+                vcan_stats.interrupts++;
+                node->interrupts[vector]++;
+                node->next_loop += node->isr_cycles * vcan_cycle;
+                node->isr_end = vcan_now + (node->isr_cycles * vcan_cycle);
+                if(!Modbus_VCAN_Line(node, vector))
+                    node->storm = 0;
+                else if(++node->storm > VCAN_STORM)
+                {
+                    fprintf(stderr, "vcan: %s: interruption %u is never cleared\n", node->board->name, vector);
+                    exit(1);
+                }
+            }
+}
+
+//! \brief Function to find the interruption which a node attends next.
+//!
+//! \param node The node.
+//! \return The lowest interruption number whose line is asserted and enabled and which has a handler, or 0 if there is none.
+static unsigned char Modbus_VCAN_Pending(struct Modbus_VCAN_Node *node)
+{
+        unsigned char i, vector;
+            for(i = 0; i < sizeof(vcan_lines); i++)
+            {
+                vector = vcan_lines[i];
+                if(node->enabled[vector] && node->board->vectors[vector] && Modbus_VCAN_Line(node, vector))
+                    return vector;
+            }
+            return 0;
+}
+
+//! \brief Function to know if an interruption line of a node is asserted.
+//!
+//! \param node The node.
+//! \param vector The interruption number.
+//! \return 1 if it is asserted.
+static unsigned char Modbus_VCAN_Line(struct Modbus_VCAN_Node *node, unsigned char vector)
+{
+            switch(vector)
+            {
+                case INT_CAN0:
+                        if(!(node->int_enable & CAN_INT_MASTER))
+                            return 0;
+                        return node->status_pending || node->intpnd;
+                case INT_UART1:
+                        return (node->uart.raw & node->uart.mask) != 0;
+                case INT_TIMER0A:
+                        return (node->timers[0].raw & node->timers[0].mask) != 0;
+                case INT_TIMER1A:
+                        return (node->timers[1].raw & node->timers[1].mask) != 0;
+                case INT_TIMER2A:
+                        return (node->timers[2].raw & node->timers[2].mask) != 0;
+                case INT_TIMER3A:
+                        return (node->timers[3].raw & node->timers[3].mask) != 0;
+                default:
+                        return 0;
+            }
+}
+
+//! \brief Function to know if a node takes part in the bus.
+//!
+//! \param node The node.
+//! \return 1 if its CAN controller is enabled and not in the bus-off state.
+static unsigned char Modbus_VCAN_OnBus(struct Modbus_VCAN_Node *node)
+{
+        return node->board && !node->init && !(node->status & CAN_STATUS_BUS_OFF) && node->bit_time;
+}
+
+//! \brief Function to find the message object which a node sends next.
+//!
+//! As in the controller, the lowest message object with a transmission request goes first, whatever its identifier.
+//! \param node The node.
+//! \param number Where the number of the message object is stored.
+//! \return The message object, or NULL if there is nothing to send.
+static struct Modbus_VCAN_Object *Modbus_VCAN_TxObject(struct Modbus_VCAN_Node *node, unsigned char *number)
+{
+        unsigned char obj;
+            if(!node->txrqst)
+                return NULL;
+            obj = __builtin_ctzl(node->txrqst);
+            *number = obj + 1;
+            return &node->objects[obj];
+}
+
+//! \brief Function to build the arbitration field of a frame.
+//!
+//! Base identifier and RTR (or RRS), IDE and, with 29-bits identifiers, SRR, IDE, extended identifier and RTR (or RRS).
+//! \param frame The frame.
+//! \param bits Where the bits are stored, 0 is dominant.
+//! \return The number of bits.
+static unsigned int Modbus_VCAN_Arbitration(const struct Modbus_VCAN_Frame *frame, unsigned char *bits)
+{
+        unsigned int n = 0;
+        int i;
+        unsigned char rtr = frame->remote && !frame->fd;
+            if(frame->extended)
+            {
+                for(i = 28; i >= 18; i--)
+                    bits[n++] = (frame->id >> i) & 1;
+                bits[n++] = 1; //SRR
+                bits[n++] = 1; //IDE
+                for(i = 17; i >= 0; i--)
+                    bits[n++] = (frame->id >> i) & 1;
+                bits[n++] = rtr;
+            }
+            else
+            {
+                for(i = 10; i >= 0; i--)
+                    bits[n++] = (frame->id >> i) & 1;
+                bits[n++] = rtr;
+                bits[n++] = 0; //IDE
+            }
+            return n;
+}
+
+//! \brief Function to know which frame wins the arbitration.
+//!
+//! The arbitration fields are compared bit by bit; the first dominant bit against a recessive one wins.
+//! \param frame The frame.
+//! \param other The other frame.
+//! \return 1 if _frame_ wins; if the fields are equal, the frame already in the bus (_other_) keeps it.
+static unsigned char Modbus_VCAN_Wins(const struct Modbus_VCAN_Frame *frame, const struct Modbus_VCAN_Frame *other)
+{
+        unsigned char a[40], b[40];
+        unsigned int na, nb, i;
+            na = Modbus_VCAN_Arbitration(frame, a);
+            nb = Modbus_VCAN_Arbitration(other, b);
+            for(i = 0; (i < na) && (i < nb); i++)
+            {
+                if(a[i] != b[i])
+                    return a[i] < b[i];
+            }
+            return 0;
+}
+
+//! \brief Function to count the bits of a frame in the bus.
+//!
+//! The frame is built from the start of frame to the end of the data, with the CRC-15 in the classic frames; the bit stuffing
+//! inserts a bit of opposite value after 5 equal bits. In the CAN FD frames, the stuff count and the CRC-17 (up to 16 bytes) or
+//! CRC-21 have fixed stuff bits, so their length does not depend on the data. The bits from the ESI bit to the CRC field go at
+//! the fast bit rate if the bit rate is switched.
+//! \param frame The frame.
+//! \param fast Where the number of bits at the fast bit rate is stored.
+//! \param stuff Where the number of stuff bits is stored.
+//! \return The number of bits at the nominal bit rate, until the end of frame, without the interframe space.
+static unsigned int Modbus_VCAN_Bits(const struct Modbus_VCAN_Frame *frame, unsigned int *fast, unsigned int *stuff)
+{
+        unsigned char bits[VCAN_MAX_BITS];
+        unsigned int n, i, brs_at = VCAN_MAX_BITS, nominal = 0, fast_bits = 0, stuff_bits = 0, run = 0;
+        unsigned char dlc, last = 2, speed;
+        unsigned short crc = 0;
+        int b;
+            bits[0] = 0; //SOF
+            n = 1 + Modbus_VCAN_Arbitration(frame, &bits[1]);
+            if(frame->fd)
+            {
+                if(frame->extended)
+                    n--; //RRS instead of RTR, and IDE was already sent
+                else
+                    n -= 2;
+                bits[n++] = 0; //RRS
+                if(!frame->extended)
+                    bits[n++] = 0; //IDE
+                bits[n++] = 1; //FDF
+                bits[n++] = 0; //res
+                bits[n++] = frame->brs;
+                brs_at = n;
+                bits[n++] = 0; //ESI
+            }
+            else if(frame->extended)
+            {
+                bits[n++] = 0; //r1
+                bits[n++] = 0; //r0
+            }
+            else
+            {
+                bits[n++] = 0; //r0
+            }
+            //DLC
+            if(frame->length <= 8)
+                dlc = frame->length;
+            else if(frame->length <= 24)
+                dlc = 9 + ((frame->length - 12) / 4);
+            else
+                dlc = (frame->length == 32) ? 13 : (frame->length == 48) ? 14 : 15;
+            for(b = 3; b >= 0; b--)
+                bits[n++] = (dlc >> b) & 1;
+            if(!frame->remote)
+            {
+                for(i = 0; i < frame->length; i++)
+                {
+                    for(b = 7; b >= 0; b--)
+                        bits[n++] = (frame->data[i] >> b) & 1;
+                }
+            }
+            if(!frame->fd)
+            {
+                //CRC-15, x^15 + x^14 + x^10 + x^8 + x^7 + x^4 + x^3 + 1
+                for(i = 0; i < n; i++)
+                {
+                    b = bits[i] ^ ((crc >> 14) & 1);
+                    crc = (crc << 1) & 0x7FFF;
+                    if(b)
+                        crc ^= 0x4599;
+                }
+                for(b = 14; b >= 0; b--)
+                    bits[n++] = (crc >> b) & 1;
+            }
+            //bit stuffing: after 5 equal bits, one of opposite value; the stuff bit also starts the next run
+            for(i = 0; i < n; i++)
+            {
+                speed = frame->fd && frame->brs && (i >= brs_at);
+                if(speed)
+                    fast_bits++;
+                else
+                    nominal++;
+                if(bits[i] == last)
+                    run++;
+                else
+                {
+                    last = bits[i];
+                    run = 1;
+                }
+                if(run == 5)
+                {
+                    stuff_bits++;
+                    if(speed)
+                        fast_bits++;
+                    else
+                        nominal++;
+                    last = !last;
+                    run = 1;
+                }
+            }
+            if(frame->fd)
+            {
+                //stuff count (4 bits) and CRC-17 or CRC-21, with a fixed stuff bit before them and every 4 bits
+                i = (frame->length <= 16) ? (4 + 17 + 6) : (4 + 21 + 7);
+                stuff_bits += (frame->length <= 16) ? 6 : 7;
+                if(frame->brs)
+                    fast_bits += i;
+                else
+                    nominal += i;
+            }
+            *fast = fast_bits;
+            *stuff = stuff_bits;
+            return nominal + VCAN_TRAILER_BITS;
+}
+
+//! \brief Function to start a frame in the bus.
+//!
+//! The nodes with a frame to send take part in the arbitration, and the frame of the winner is put in the bus. The frame is
+//! acknowledged if some other node is on the bus; otherwise, or if it is chosen to be corrupted, it ends with an error frame.
+static void Modbus_VCAN_Start(void)
+{
+        struct Modbus_VCAN_Node *node, *tx;
+        struct Modbus_VCAN_Object *object;
+        struct Modbus_VCAN_Frame frame;
+        unsigned char i, number, contenders = 0, acked = 0;
+        unsigned int nominal, fast, stuff;
+            for(i = 0; i < vcan_node_count; i++)
+            {
+                node = &vcan_nodes[i];
+                if(!Modbus_VCAN_OnBus(node) || (node->tx_allowed > vcan_now))
+                    continue;
+                object = Modbus_VCAN_TxObject(node, &number);
+                if(!object)
+                    continue;
+                frame.node = i;
+                frame.object = number;
+                frame.id = object->id;
+                frame.extended = (object->flags & MSG_OBJ_EXTENDED_ID) != 0;
+                //a transmission request in a receive message object sends a remote frame
+                frame.remote = !object->tx;
+                frame.fd = (object->flags & MSG_OBJ_FD_FORMAT) != 0;
+                frame.brs = frame.fd && (object->flags & MSG_OBJ_BIT_RATE_SWITCH);
+                frame.length = object->length;
+                memcpy(frame.data, object->data, object->length);
+                if(!contenders++ || Modbus_VCAN_Wins(&frame, &bus_frame))
+                    bus_frame = frame;
+            }
+            if(!contenders)
+                return;
+            if(contenders > 1)
+            {
+                vcan_stats.arbitrations++;
+                vcan_stats.arbitration_lost += contenders - 1;
+            }
+            tx = &vcan_nodes[bus_frame.node];
+            for(i = 0; i < vcan_node_count; i++)
+            {
+                if((i != bus_frame.node) && Modbus_VCAN_OnBus(&vcan_nodes[i]))
+                    acked = 1;
+            }
+            nominal = Modbus_VCAN_Bits(&bus_frame, &fast, &stuff);
+            bus_frame.error = CAN_STATUS_LEC_NONE;
+            if(!acked)
+                bus_frame.error = CAN_STATUS_LEC_ACK;
+            else if((vcan_config.error_rate > 0) && (vcan_config.error_rate >= 1 ||
+                    ((double)((vcan_random = (vcan_random * 6364136223846793005ULL) + 1442695040888963407ULL) >> 11) /
+                     (double)(1ULL << 53)) < vcan_config.error_rate))
+                bus_frame.error = CAN_STATUS_LEC_CRC;
+            if(bus_frame.error != CAN_STATUS_LEC_NONE)
+            {
+                //the error is seen at the ACK delimiter, the error frame takes the place of the end of frame
+                nominal += VCAN_ERROR_FRAME_BITS - VCAN_EOF_BITS;
+                vcan_stats.error_frames++;
+            }
+            bus_frame.duration = ((nominal + VCAN_IFS_BITS) * tx->bit_time) + (fast * tx->data_bit_time);
+            vcan_stats.bits += nominal + VCAN_IFS_BITS + fast;
+            vcan_stats.stuff_bits += stuff;
+            vcan_stats.busy += bus_frame.duration - (VCAN_IFS_BITS * tx->bit_time);
+            bus_busy = 1;
+            bus_end = vcan_now + bus_frame.duration - (VCAN_IFS_BITS * tx->bit_time);
+            //a node recovering from bus-off only sees one sequence of 11 recessive bits in the whole frame
+            for(i = 0; i < vcan_node_count; i++)
+            {
+                node = &vcan_nodes[i];
+                if(node->recovering && (bus_frame.duration > (11 * node->bit_time)))
+                    node->recovery_end += bus_frame.duration - (11 * node->bit_time);
+            }
+}
+
+//! \brief Function to finish the frame in the bus.
+//!
+//! If it was sent correctly, the transmitter clears its transmission request and the rest of nodes on the bus store it in their
+//! message objects. Otherwise, the error counters are increased and the frame is sent again later. The status register of every
+//! node involved is updated, which raises the status interruption.
+static void Modbus_VCAN_End(void)
+{
+        struct Modbus_VCAN_Node *node, *tx = &vcan_nodes[bus_frame.node];
+        struct Modbus_VCAN_Object *object = &tx->objects[bus_frame.object - 1];
+        unsigned char i;
+            bus_busy = 0;
+            bus_idle = bus_end + (VCAN_IFS_BITS * tx->bit_time);
+            if(bus_frame.error == CAN_STATUS_LEC_NONE)
+            {
+                vcan_stats.frames++;
+                if(bus_frame.fd)
+                    vcan_stats.fd_frames++;
+                if(!bus_frame.remote)
+                    vcan_stats.data_bytes += bus_frame.length;
+                tx->txrqst &= ~(1UL << (bus_frame.object - 1));
+                if(object->flags & MSG_OBJ_TX_INT_ENABLE)
+                    tx->intpnd |= 1UL << (bus_frame.object - 1);
+                tx->status = (tx->status & ~CAN_STATUS_LEC_MSK) | CAN_STATUS_TXOK | CAN_STATUS_LEC_NONE;
+                if(tx->tec)
+                    tx->tec--;
+            }
+            else
+            {
+                //an error passive transmitter does not increase its counter for an ACK error
+                if(!((bus_frame.error == CAN_STATUS_LEC_ACK) && (tx->status & CAN_STATUS_EPASS)))
+                    tx->tec += 8;
+                tx->status = (tx->status & ~CAN_STATUS_LEC_MSK) | bus_frame.error;
+                if(!tx->auto_retry)
+                    tx->txrqst &= ~(1UL << (bus_frame.object - 1));
+            }
+            if(tx->int_enable & CAN_INT_STATUS)
+                tx->status_pending = 1;
+            //an error passive transmitter waits before sending again
+            if(tx->status & CAN_STATUS_EPASS)
+                tx->tx_allowed = bus_idle + (VCAN_SUSPEND_BITS * tx->bit_time);
+            Modbus_VCAN_ErrorState(tx);
+            for(i = 0; i < vcan_node_count; i++)
+            {
+                node = &vcan_nodes[i];
+                if((i == bus_frame.node) || !Modbus_VCAN_OnBus(node))
+                    continue;
+                if(bus_frame.error == CAN_STATUS_LEC_NONE)
+                {
+                    if(node->rec > 127)
+                        node->rec = 120;
+                    else if(node->rec)
+                        node->rec--;
+                    node->status = (node->status & ~CAN_STATUS_LEC_MSK) | CAN_STATUS_RXOK | CAN_STATUS_LEC_NONE;
+                    Modbus_VCAN_Store(node, &bus_frame);
+                }
+                else
+                {
+                    node->rec++;
+                    node->status = (node->status & ~CAN_STATUS_LEC_MSK) | CAN_STATUS_LEC_CRC;
+                }
+                if(node->int_enable & CAN_INT_STATUS)
+                    node->status_pending = 1;
+                Modbus_VCAN_ErrorState(node);
+            }
+}
+
+//! \brief Function to store a received frame in the message objects of a node.
+//!
+//! The frame goes to the first message object which accepts it and has not new data. A message object chained with the next one
+//! (MSG_OBJ_FIFO) with new data is skipped; one at the end of a buffer is overwritten, and its data lost flag is set.
+//! A remote frame sets the transmission request of a message object of type MSG_OBJ_TYPE_RXTX_REMOTE.
+//! \param node The node.
+//! \param frame The frame.
+static void Modbus_VCAN_Store(struct Modbus_VCAN_Node *node, const struct Modbus_VCAN_Frame *frame)
+{
+        struct Modbus_VCAN_Object *object;
+        unsigned char obj;
+            for(obj = 0; obj < MODBUS_VCAN_OBJECTS; obj++)
+            {
+                object = &node->objects[obj];
+                if(!object->valid || !Modbus_VCAN_Accepts(object, frame))
+                    continue;
+                if(object->newdat && (object->flags & MSG_OBJ_FIFO))
+                    continue;
+                if(frame->remote && object->remote_enable)
+                {
+                    //it is answered with the data of the message object
+                    node->txrqst |= 1UL << obj;
+                    return;
+                }
+                if(object->newdat)
+                {
+                    object->lost = 1;
+                    vcan_stats.overruns++;
+                }
+                object->id = frame->id;
+                object->extended = frame->extended;
+                object->length = frame->length;
+                if(!frame->remote)
+                    memcpy(object->data, frame->data, frame->length);
+                object->newdat = 1;
+                if(object->flags & MSG_OBJ_RX_INT_ENABLE)
+                    node->intpnd |= 1UL << obj;
+                return;
+            }
+}
+
+//! \brief Function to check the filter of a message object.
+//!
+//! The data frames go to the receive message objects and the remote frames to the transmit ones. The identifiers are compared
+//! with the mask if MSG_OBJ_USE_ID_FILTER is set, and the kind of identifier (11 or 29 bits) if MSG_OBJ_USE_EXT_FILTER is set;
+//! without the filter, the identifier has to be the same. The 11-bits identifiers are compared as the 11 upper bits of 29.
+//! \param object The message object.
+//! \param frame The frame.
+//! \return 1 if the frame is accepted.
+static unsigned char Modbus_VCAN_Accepts(const struct Modbus_VCAN_Object *object, const struct Modbus_VCAN_Frame *frame)
+{
+        unsigned long id, own, mask;
+        unsigned char extended = (object->flags & MSG_OBJ_EXTENDED_ID) != 0;
+            if(frame->remote ? !object->tx : object->tx)
+                return 0;
+            id = frame->extended ? (frame->id & VCAN_ID_MASK) : ((frame->id & 0x7FF) << 18);
+            own = extended ? (object->id & VCAN_ID_MASK) : ((object->id & 0x7FF) << 18);
+            if(object->flags & MSG_OBJ_USE_ID_FILTER)
+            {
+                mask = extended ? (object->mask & VCAN_ID_MASK) : ((object->mask & 0x7FF) << 18);
+                if((object->flags & (MSG_OBJ_USE_EXT_FILTER & ~MSG_OBJ_USE_ID_FILTER)) && (frame->extended != extended))
+                    return 0;
+            }
+            else
+            {
+                mask = VCAN_ID_MASK;
+                if(frame->extended != extended)
+                    return 0;
+            }
+            return (id & mask) == (own & mask);
+}
+
+//! \brief Function to update the error state of a node from its error counters.
+//!
+//! The warning level is 96 and the error passive one 128; if the transmit error counter passes 255, the node enters the
+//! bus-off state and its controller goes to init mode. With CAN_INT_ERROR, the changes of the warning and bus-off bits raise
+//! the status interruption.
+//! \param node The node.
+static void Modbus_VCAN_ErrorState(struct Modbus_VCAN_Node *node)
+{
+        unsigned long before = node->status;
+            if(node->tec > 255)
+            {
+                node->status |= CAN_STATUS_BUS_OFF | CAN_STATUS_EPASS | CAN_STATUS_EWARN;
+                node->init = 1;
+            }
+            else
+            {
+                node->status &= ~(CAN_STATUS_EPASS | CAN_STATUS_EWARN);
+                if((node->tec >= 128) || (node->rec >= 128))
+                    node->status |= CAN_STATUS_EPASS;
+                if((node->tec >= 96) || (node->rec >= 96))
+                    node->status |= CAN_STATUS_EWARN;
+            }
+            if(((before ^ node->status) & (CAN_STATUS_BUS_OFF | CAN_STATUS_EWARN)) && (node->int_enable & CAN_INT_ERROR))
+                node->status_pending = 1;
+}
+
+//! \brief Function to finish the bus-off recovery of a node.
+//!
+//! The error counters are cleared and the node takes part in the bus again.
+//! \param node The node.
+static void Modbus_VCAN_Recovered(struct Modbus_VCAN_Node *node)
+{
+        node->recovering = 0;
+        node->tec = 0;
+        node->rec = 0;
+        node->status &= ~(CAN_STATUS_BUS_OFF | CAN_STATUS_EPASS | CAN_STATUS_EWARN);
+        if(node->int_enable & CAN_INT_ERROR)
+            node->status_pending = 1;
+}
+
+//! \brief Function to handle the timeout of a timer.
+//!
+//! The interruption status is set; a periodic timer is loaded again and a one shot timer is stopped.
+//! \param node The node.
+//! \param timer The timer, 0 to 3.
+static void Modbus_VCAN_Expire(struct Modbus_VCAN_Node *node, unsigned char timer)
+{
+        struct Modbus_VCAN_Timer *t = &node->timers[timer];
+            t->raw |= TIMER_TIMA_TIMEOUT;
+            if(t->periodic)
+                t->start += t->load * vcan_cycle;
+            else
+                t->enabled = 0;
+}
+
+//! \brief Function to get a timer of the current node.
+//!
+//! \param base The base address of the timer, TIMER0_BASE to TIMER3_BASE.
+//! \return The timer.
+static struct Modbus_VCAN_Timer *Modbus_VCAN_GetTimer(unsigned long base)
+{
+        unsigned long index = (base - TIMER0_BASE) / (TIMER1_BASE - TIMER0_BASE);
+            if(index >= VCAN_TIMERS)
+            {
+                fprintf(stderr, "vcan: unknown timer 0x%08lx\n", base);
+                exit(1);
+            }
+            return &Modbus_VCAN_Current("Timer")->timers[index];
+}
+
+//! \brief Function to get the UART of the current node.
+//!
+//! \param base The base address of the UART; only UART1_BASE is simulated.
+//! \return The UART.
+static struct Modbus_VCAN_Uart *Modbus_VCAN_GetUart(unsigned long base)
+{
+            if(base != UART1_BASE)
+            {
+                fprintf(stderr, "vcan: unknown UART 0x%08lx\n", base);
+                exit(1);
+            }
+            return &Modbus_VCAN_Current("UART")->uart;
+}
+
+//! \brief Function to start sending the next character of the transmit FIFO of a node.
+//!
+//! The character leaves the FIFO for the shift register, which raises the transmit interruption if the FIFO goes down to its
+//! level (or the holding register is emptied, without FIFOs). If other node is sending too, both characters are garbled.
+//! \param node The node.
+static void Modbus_VCAN_UartShift(struct Modbus_VCAN_Node *node)
+{
+        struct Modbus_VCAN_Uart *uart = &node->uart;
+        unsigned char i, level = uart->fifo ? uart->tx_level : 0;
+            if(uart->shifting || !uart->tx_count)
+                return;
+            uart->shift = uart->tx[uart->tx_first];
+            uart->tx_first = (uart->tx_first + 1) % VCAN_UART_FIFO;
+            if(uart->tx_count-- > level && uart->tx_count <= level)
+                uart->raw |= UART_INT_TX;
+            if(uart->corrupt)
+            {
+                //one bit flipped, the parity does not match
+                uart->shift ^= 0x01;
+                uart->shift |= UART_DR_PE;
+                uart->corrupt--;
+            }
+            uart->shifting = 1;
+            uart->collided = 0;
+            uart->tx_end = vcan_now + (uart->bits * uart->bit_time);
+            for(i = 0; i < vcan_node_count; i++)
+            {
+                if((&vcan_nodes[i] != node) && vcan_nodes[i].uart.shifting)
+                {
+                    vcan_nodes[i].uart.collided = 1;
+                    uart->collided = 1;
+                }
+                //the start bit restarts the receive timeout, it is armed again at the end of the character
+                if((&vcan_nodes[i] != node) && vcan_nodes[i].uart.enabled)
+                    vcan_nodes[i].uart.rx_timeout = 0;
+            }
+}
+
+//! \brief Function to finish the character which a node is sending.
+//!
+//! At the end of its stop bit, the character is received by the UARTs of the rest of nodes, and the next one starts.
+//! \param node The node.
+static void Modbus_VCAN_UartSent(struct Modbus_VCAN_Node *node)
+{
+        unsigned char i;
+            node->uart.shifting = 0;
+            node->uart.sent++;
+            vcan_stats.uart_chars++;
+            for(i = 0; i < vcan_node_count; i++)
+            {
+                if((&vcan_nodes[i] != node) && vcan_nodes[i].uart.enabled)
+                    Modbus_VCAN_UartReceive(&vcan_nodes[i], &node->uart, node->uart.shift);
+            }
+            Modbus_VCAN_UartShift(node);
+}
+
+//! \brief Function to store a character of the serial line in the receive FIFO of a node.
+//!
+//! A character of a collision or sent with other bit time or frame has a framing error, and one corrupted by the transmitter a
+//! parity error if the receiver checks the parity. If the FIFO is full the character is lost, and the next one stored has the
+//! overrun error. The receive interruption is raised when the FIFO reaches its level (at each character, without FIFOs), and the
+//! receive timeout interruption is armed.
+//! \param node The receiver.
+//! \param tx The UART of the transmitter.
+//! \param data The character sent, with UART_DR_PE if it is corrupted.
+static void Modbus_VCAN_UartReceive(struct Modbus_VCAN_Node *node, const struct Modbus_VCAN_Uart *tx, uint16_t data)
+{
+        struct Modbus_VCAN_Uart *uart = &node->uart;
+        uint64_t difference = (tx->bit_time > uart->bit_time) ? tx->bit_time - uart->bit_time : uart->bit_time - tx->bit_time;
+            //the data bits beyond the word length of the receiver are lost
+            data &= (0xFF >> (8 - uart->length)) | UART_DR_PE;
+            if(tx->collided || (difference * 50 > uart->bit_time) || (tx->bits != uart->bits) || (tx->parity != uart->parity))
+                data |= UART_DR_FE;
+            if(!uart->parity)
+                data &= ~UART_DR_PE;
+            if(uart->rx_count == (uart->fifo ? VCAN_UART_FIFO : 1))
+            {
+                uart->overrun = UART_DR_OE;
+                uart->raw |= UART_INT_OE;
+                vcan_stats.uart_overruns++;
+                return;
+            }
+            data |= uart->overrun;
+            uart->overrun = 0;
+            uart->rx[(uart->rx_first + uart->rx_count++) % VCAN_UART_FIFO] = data;
+            if(data & (UART_DR_FE | UART_DR_PE))
+                vcan_stats.uart_errors++;
+            if(data & UART_DR_FE)
+                uart->raw |= UART_INT_FE;
+            if(data & UART_DR_PE)
+                uart->raw |= UART_INT_PE;
+            if(uart->rx_count >= (uart->fifo ? uart->rx_level : 1))
+                uart->raw |= UART_INT_RX;
+            uart->rx_timeout = vcan_now + (VCAN_UART_TIMEOUT_BITS * uart->bit_time);
+}
+
+//! \brief Function to get the bit time of a bit timing.
+//!
+//! \param clk The bit timing: the bit has ulSyncPropPhase1Seg + ulPhase2Seg time quanta of ulQuantumPrescaler CAN clocks.
+//! \return The bit time, in picoseconds.
+static uint64_t Modbus_VCAN_BitClk(const tCANBitClkParms *clk)
+{
+        return ((uint64_t)(clk->ulSyncPropPhase1Seg + clk->ulPhase2Seg) * clk->ulQuantumPrescaler * MODBUS_VCAN_SECOND) /
+               vcan_config.can_clock;
+}
+
+//! \brief Function to get the length of the frame which carries some data.
+//!
+//! \param length The data length asked.
+//! \param fd 1 if it is a CAN FD frame.
+//! \return The length of the frame: up to 8 bytes in a classic frame; 0-8, 12, 16, 20, 24, 32, 48 or 64 in a CAN FD one.
+static unsigned char Modbus_VCAN_Length(unsigned long length, unsigned char fd)
+{
+        if(length <= 8)
+            return (unsigned char)length;
+        if(!fd)
+            return 8;
+        if(length <= 24)
+            return (unsigned char)(((length + 3) / 4) * 4);
+        return (length <= 32) ? 32 : (length <= 48) ? 48 : 64;
+}
+
+//////////////////////////////////////////////////DRIVER LIBRARY/////////////////////////////////////////////////////////////////
+
+void CANInit(unsigned long ulBase)
+{
+        struct Modbus_VCAN_Node *node = Modbus_VCAN_Current("CANInit");
+            //init mode, and all the message objects are cleared
+            node->init = 1;
+            node->recovering = 0;
+            memset(node->objects, 0, sizeof(node->objects));
+            node->txrqst = 0;
+            node->intpnd = 0;
+}
+
+void CANEnable(unsigned long ulBase)
+{
+        struct Modbus_VCAN_Node *node = Modbus_VCAN_Current("CANEnable");
+            node->init = 0;
+            if((node->status & CAN_STATUS_BUS_OFF) && !node->recovering)
+            {
+                //the bus-off recovery starts when the init mode is left
+                node->recovering = 1;
+                node->recovery_end = vcan_now + (VCAN_RECOVERY_BITS * node->bit_time);
+            }
+}
+
+void CANDisable(unsigned long ulBase)
+{
+        Modbus_VCAN_Current("CANDisable")->init = 1;
+}
+
+void CANBitTimingSet(unsigned long ulBase, tCANBitClkParms *pClkParms)
+{
+        struct Modbus_VCAN_Node *node = Modbus_VCAN_Current("CANBitTimingSet");
+            node->bit_clk = *pClkParms;
+            node->bit_time = Modbus_VCAN_BitClk(pClkParms);
+            if(!node->data_bit_time)
+                node->data_bit_time = node->bit_time;
+}
+
+void CANSetBitTiming(unsigned long ulBase, tCANBitClkParms *pClkParms)
+{
+        CANBitTimingSet(ulBase, pClkParms);
+}
+
+void CANBitTimingGet(unsigned long ulBase, tCANBitClkParms *pClkParms)
+{
+        *pClkParms = Modbus_VCAN_Current("CANBitTimingGet")->bit_clk;
+}
+
+void CANDataBitTimingSet(unsigned long ulBase, tCANBitClkParms *pClkParms)
+{
+        struct Modbus_VCAN_Node *node = Modbus_VCAN_Current("CANDataBitTimingSet");
+            node->data_bit_clk = *pClkParms;
+            node->data_bit_time = Modbus_VCAN_BitClk(pClkParms);
+}
+
+unsigned long Modbus_VCAN_CanClock(void)
+{
+        return vcan_config.can_clock;
+}
+
+tBoolean CANErrCntrGet(unsigned long ulBase, unsigned long *pulRxCount, unsigned long *pulTxCount)
+{
+        struct Modbus_VCAN_Node *node = Modbus_VCAN_Current("CANErrCntrGet");
+            *pulRxCount = (node->rec > 127) ? 127 : node->rec;
+            *pulTxCount = (node->tec > 255) ? 255 : node->tec;
+            return node->rec >= 128;
+}
+
+void CANIntEnable(unsigned long ulBase, unsigned long ulIntFlags)
+{
+        Modbus_VCAN_Current("CANIntEnable")->int_enable |= ulIntFlags;
+}
+
+void CANIntDisable(unsigned long ulBase, unsigned long ulIntFlags)
+{
+        Modbus_VCAN_Current("CANIntDisable")->int_enable &= ~ulIntFlags;
+}
+
+unsigned long CANIntStatus(unsigned long ulBase, tCANIntStsReg eIntStsReg)
+{
+        struct Modbus_VCAN_Node *node = Modbus_VCAN_Current("CANIntStatus");
+            if(eIntStsReg == CAN_INT_STS_CAUSE)
+            {
+                //the status interruption goes first, then the lowest message object
+                if(node->status_pending)
+                    return CAN_INT_INTID_STATUS;
+                return node->intpnd ? (unsigned long)__builtin_ctzl(node->intpnd) + 1 : CAN_INT_INTID_NONE;
+            }
+            return node->intpnd;
+}
+
+void CANIntClear(unsigned long ulBase, unsigned long ulIntClr)
+{
+        struct Modbus_VCAN_Node *node = Modbus_VCAN_Current("CANIntClear");
+            if(ulIntClr == CAN_INT_INTID_STATUS)
+                node->status_pending = 0; //reading the status register clears it
+            else if((ulIntClr >= 1) && (ulIntClr <= MODBUS_VCAN_OBJECTS))
+                node->intpnd &= ~(1UL << (ulIntClr - 1));
+}
+
+unsigned long CANStatusGet(unsigned long ulBase, tCANStsReg eStatusReg)
+{
+        struct Modbus_VCAN_Node *node = Modbus_VCAN_Current("CANStatusGet");
+        unsigned long result = 0;
+        unsigned char obj;
+            switch(eStatusReg)
+            {
+                case CAN_STS_CONTROL:
+                        //as the driver library, TXOK, RXOK and the last error code are cleared after reading them
+                        result = node->status;
+                        node->status &= ~(CAN_STATUS_RXOK | CAN_STATUS_TXOK | CAN_STATUS_LEC_MSK);
+                        node->status_pending = 0;
+                        return result;
+                case CAN_STS_TXREQUEST:
+                        return node->txrqst;
+                case CAN_STS_NEWDAT:
+                        for(obj = 0; obj < MODBUS_VCAN_OBJECTS; obj++)
+                            result |= (unsigned long)node->objects[obj].newdat << obj;
+                        return result;
+                case CAN_STS_MSGVAL:
+                        for(obj = 0; obj < MODBUS_VCAN_OBJECTS; obj++)
+                            result |= (unsigned long)node->objects[obj].valid << obj;
+                        return result;
+                default:
+                        return 0;
+            }
+}
+
+void CANMessageSet(unsigned long ulBase, unsigned long ulObjID, tCANMsgObject *pMsgObject, tMsgObjType eMsgType)
+{
+        struct Modbus_VCAN_Node *node = Modbus_VCAN_Current("CANMessageSet");
+        struct Modbus_VCAN_Object *object;
+        unsigned char fd = (pMsgObject->ulFlags & MSG_OBJ_FD_FORMAT) != 0;
+            if((ulObjID < 1) || (ulObjID > MODBUS_VCAN_OBJECTS))
+                return;
+            object = &node->objects[ulObjID - 1];
+            memset(object, 0, sizeof(*object));
+            node->txrqst &= ~(1UL << (ulObjID - 1));
+            node->intpnd &= ~(1UL << (ulObjID - 1));
+            object->valid = 1;
+            object->flags = pMsgObject->ulFlags;
+            object->id = pMsgObject->ulMsgID;
+            object->mask = pMsgObject->ulMsgIDMask;
+            object->extended = (pMsgObject->ulFlags & MSG_OBJ_EXTENDED_ID) != 0;
+            switch(eMsgType)
+            {
+                case MSG_OBJ_TYPE_TX:
+                        object->tx = 1;
+                        node->txrqst |= 1UL << (ulObjID - 1);
+                        break;
+                case MSG_OBJ_TYPE_TX_REMOTE:
+                        //remote frame, the answer is received in the same message object
+                        node->txrqst |= 1UL << (ulObjID - 1);
+                        break;
+                case MSG_OBJ_TYPE_RX_REMOTE:
+                        object->tx = 1;
+                        break;
+                case MSG_OBJ_TYPE_RXTX_REMOTE:
+                        object->tx = 1;
+                        object->remote_enable = 1;
+                        break;
+                default:
+                        break;
+            }
+            if(object->tx || (eMsgType == MSG_OBJ_TYPE_TX_REMOTE))
+            {
+                //the frames longer than 8 bytes are padded to a length of CAN FD
+                object->length = Modbus_VCAN_Length(pMsgObject->ulMsgLen, fd);
+                if(pMsgObject->pucMsgData)
+                    memcpy(object->data, pMsgObject->pucMsgData, (pMsgObject->ulMsgLen < object->length) ? pMsgObject->ulMsgLen : object->length);
+            }
+}
+
+void CANMessageGet(unsigned long ulBase, unsigned long ulObjID, tCANMsgObject *pMsgObject, tBoolean bClrPendingInt)
+{
+        struct Modbus_VCAN_Node *node = Modbus_VCAN_Current("CANMessageGet");
+        struct Modbus_VCAN_Object *object;
+            if((ulObjID < 1) || (ulObjID > MODBUS_VCAN_OBJECTS))
+                return;
+            object = &node->objects[ulObjID - 1];
+            pMsgObject->ulMsgID = object->extended ? (object->id & VCAN_ID_MASK) : (object->id & 0x7FF);
+            pMsgObject->ulMsgIDMask = object->mask;
+            pMsgObject->ulFlags = object->flags & ~(MSG_OBJ_EXTENDED_ID | MSG_OBJ_NEW_DATA | MSG_OBJ_DATA_LOST);
+            if(object->extended)
+                pMsgObject->ulFlags |= MSG_OBJ_EXTENDED_ID;
+            if(object->lost)
+            {
+                pMsgObject->ulFlags |= MSG_OBJ_DATA_LOST;
+                object->lost = 0;
+            }
+            if(object->newdat)
+            {
+                //as the driver library, the data is only read if there is new data, and then NEWDAT is cleared
+                pMsgObject->ulMsgLen = object->length;
+                if(pMsgObject->pucMsgData)
+                    memcpy(pMsgObject->pucMsgData, object->data, object->length);
+                pMsgObject->ulFlags |= MSG_OBJ_NEW_DATA;
+                object->newdat = 0;
+            }
+            else
+                pMsgObject->ulMsgLen = 0;
+            if(bClrPendingInt)
+                node->intpnd &= ~(1UL << (ulObjID - 1));
+}
+
+void CANMessageClear(unsigned long ulBase, unsigned long ulObjID)
+{
+        struct Modbus_VCAN_Node *node = Modbus_VCAN_Current("CANMessageClear");
+            if((ulObjID >= 1) && (ulObjID <= MODBUS_VCAN_OBJECTS))
+            {
+                memset(&node->objects[ulObjID - 1], 0, sizeof(node->objects[0]));
+                node->txrqst &= ~(1UL << (ulObjID - 1));
+                node->intpnd &= ~(1UL << (ulObjID - 1));
+            }
+}
+
+tBoolean CANRetryGet(unsigned long ulBase)
+{
+        return Modbus_VCAN_Current("CANRetryGet")->auto_retry;
+}
+
+void CANRetrySet(unsigned long ulBase, tBoolean bAutoRetry)
+{
+        Modbus_VCAN_Current("CANRetrySet")->auto_retry = bAutoRetry ? 1 : 0;
+}
+
+void TimerConfigure(unsigned long ulBase, unsigned long ulConfig)
+{
+        struct Modbus_VCAN_Timer *timer = Modbus_VCAN_GetTimer(ulBase);
+            timer->enabled = 0;
+            timer->periodic = ((ulConfig & 0xF) == TIMER_CFG_32_BIT_PER);
+}
+
+void TimerEnable(unsigned long ulBase, unsigned long ulTimer)
+{
+        struct Modbus_VCAN_Timer *timer = Modbus_VCAN_GetTimer(ulBase);
+            timer->enabled = 1;
+            timer->start = vcan_now;
+}
+
+void TimerDisable(unsigned long ulBase, unsigned long ulTimer)
+{
+        Modbus_VCAN_GetTimer(ulBase)->enabled = 0;
+}
+
+void TimerLoadSet(unsigned long ulBase, unsigned long ulTimer, unsigned long ulValue)
+{
+        struct Modbus_VCAN_Timer *timer = Modbus_VCAN_GetTimer(ulBase);
+            //the counter is loaded at once
+            timer->load = ulValue;
+            timer->start = vcan_now;
+}
+
+unsigned long TimerLoadGet(unsigned long ulBase, unsigned long ulTimer)
+{
+        return Modbus_VCAN_GetTimer(ulBase)->load;
+}
+
+unsigned long TimerValueGet(unsigned long ulBase, unsigned long ulTimer)
+{
+        struct Modbus_VCAN_Timer *timer = Modbus_VCAN_GetTimer(ulBase);
+        uint64_t elapsed;
+            if(!timer->enabled)
+                return timer->load;
+            elapsed = (vcan_now - timer->start) / vcan_cycle;
+            return (elapsed < timer->load) ? (unsigned long)(timer->load - elapsed) : 0;
+}
+
+void TimerIntEnable(unsigned long ulBase, unsigned long ulIntFlags)
+{
+        Modbus_VCAN_GetTimer(ulBase)->mask |= ulIntFlags;
+}
+
+void TimerIntDisable(unsigned long ulBase, unsigned long ulIntFlags)
+{
+        Modbus_VCAN_GetTimer(ulBase)->mask &= ~ulIntFlags;
+}
+
+unsigned long TimerIntStatus(unsigned long ulBase, tBoolean bMasked)
+{
+        struct Modbus_VCAN_Timer *timer = Modbus_VCAN_GetTimer(ulBase);
+            return bMasked ? (timer->raw & timer->mask) : timer->raw;
+}
+
+void TimerIntClear(unsigned long ulBase, unsigned long ulIntFlags)
+{
+        Modbus_VCAN_GetTimer(ulBase)->raw &= ~ulIntFlags;
+}
+
+tBoolean IntMasterEnable(void)
+{
+        struct Modbus_VCAN_Node *node = Modbus_VCAN_Current("IntMasterEnable");
+        tBoolean masked = node->masked;
+            node->masked = 0;
+            return masked;
+}
+
+tBoolean IntMasterDisable(void)
+{
+        struct Modbus_VCAN_Node *node = Modbus_VCAN_Current("IntMasterDisable");
+        tBoolean masked = node->masked;
+            node->masked = 1;
+            return masked;
+}
+
+void IntEnable(unsigned long ulInterrupt)
+{
+        if(ulInterrupt < MODBUS_VCAN_VECTORS)
+            Modbus_VCAN_Current("IntEnable")->enabled[ulInterrupt] = 1;
+}
+
+void IntDisable(unsigned long ulInterrupt)
+{
+        if(ulInterrupt < MODBUS_VCAN_VECTORS)
+            Modbus_VCAN_Current("IntDisable")->enabled[ulInterrupt] = 0;
+}
+
+void SysCtlPeripheralEnable(unsigned long ulPeripheral)
+{
+}
+
+void SysCtlClockSet(unsigned long ulConfig)
+{
+}
+
+unsigned long SysCtlClockGet(void)
+{
+        return vcan_config.cpu_clock;
+}
+
+void SysCtlDelay(unsigned long ulCount)
+{
+        //3 cycles per loop, as the one of the driver library
+        Modbus_VCAN_Idle(3 * ulCount);
+}
+
+void UARTConfigSetExpClk(unsigned long ulBase, unsigned long ulUARTClk, unsigned long ulBaud, unsigned long ulConfig)
+{
+        struct Modbus_VCAN_Uart *uart = Modbus_VCAN_GetUart(ulBase);
+            uart->length = 5 + ((ulConfig & UART_CONFIG_WLEN_MASK) >> 5);
+            uart->parity = (ulConfig & UART_CONFIG_PAR_MASK) != UART_CONFIG_PAR_NONE;
+            uart->bits = 1 + uart->length + uart->parity + ((ulConfig & UART_CONFIG_STOP_TWO) ? 2 : 1);
+            uart->bit_time = MODBUS_VCAN_SECOND / ulBaud;
+            if(!uart->rx_level)
+            {
+                //FIFO levels after reset, 1/2
+                uart->rx_level = 8;
+                uart->tx_level = 8;
+            }
+            //UARTEnable() enables the FIFOs too, as in the driver library
+            UARTEnable(ulBase);
+}
+
+void UARTEnable(unsigned long ulBase)
+{
+        struct Modbus_VCAN_Uart *uart = Modbus_VCAN_GetUart(ulBase);
+            uart->enabled = 1;
+            uart->fifo = 1;
+}
+
+void UARTDisable(unsigned long ulBase)
+{
+        Modbus_VCAN_GetUart(ulBase)->enabled = 0;
+}
+
+void UARTFIFOEnable(unsigned long ulBase)
+{
+        Modbus_VCAN_GetUart(ulBase)->fifo = 1;
+}
+
+void UARTFIFODisable(unsigned long ulBase)
+{
+        Modbus_VCAN_GetUart(ulBase)->fifo = 0;
+}
+
+void UARTFIFOLevelSet(unsigned long ulBase, unsigned long ulTxLevel, unsigned long ulRxLevel)
+{
+        struct Modbus_VCAN_Uart *uart = Modbus_VCAN_GetUart(ulBase);
+            //the transmit interruption is raised when the FIFO goes down to 2 characters for UART_FIFO_TX1_8, 4 for TX2_8...
+            uart->tx_level = vcan_uart_levels[ulTxLevel & 0x7];
+            uart->rx_level = vcan_uart_levels[(ulRxLevel >> 3) & 0x7];
+}
+
+tBoolean UARTCharsAvail(unsigned long ulBase)
+{
+        return Modbus_VCAN_GetUart(ulBase)->rx_count != 0;
+}
+
+tBoolean UARTSpaceAvail(unsigned long ulBase)
+{
+        struct Modbus_VCAN_Uart *uart = Modbus_VCAN_GetUart(ulBase);
+            return uart->tx_count < (uart->fifo ? VCAN_UART_FIFO : 1);
+}
+
+long UARTCharGetNonBlocking(unsigned long ulBase)
+{
+        struct Modbus_VCAN_Uart *uart = Modbus_VCAN_GetUart(ulBase);
+        long data;
+            if(!uart->rx_count)
+                return -1;
+            data = uart->rx[uart->rx_first];
+            uart->rx_first = (uart->rx_first + 1) % VCAN_UART_FIFO;
+            uart->rx_count--;
+            if(!uart->fifo || (uart->rx_count < uart->rx_level))
+                uart->raw &= ~UART_INT_RX;
+            if(!uart->rx_count)
+            {
+                uart->raw &= ~UART_INT_RT;
+                uart->rx_timeout = 0;
+            }
+            return data;
+}
+
+long UARTCharGet(unsigned long ulBase)
+{
+        struct Modbus_VCAN_Uart *uart = Modbus_VCAN_GetUart(ulBase);
+            while(!uart->rx_count)
+                Modbus_VCAN_Run(vcan_now + uart->bit_time);
+            return UARTCharGetNonBlocking(ulBase);
+}
+
+tBoolean UARTCharPutNonBlocking(unsigned long ulBase, unsigned char ucData)
+{
+        struct Modbus_VCAN_Uart *uart = Modbus_VCAN_GetUart(ulBase);
+            if(!UARTSpaceAvail(ulBase))
+                return false;
+            uart->tx[(uart->tx_first + uart->tx_count++) % VCAN_UART_FIFO] = ucData;
+            if(uart->tx_count > (uart->fifo ? uart->tx_level : 0))
+                uart->raw &= ~UART_INT_TX;
+            if(uart->enabled)
+                Modbus_VCAN_UartShift(vcan_current);
+            return true;
+}
+
+void UARTCharPut(unsigned long ulBase, unsigned char ucData)
+{
+        struct Modbus_VCAN_Uart *uart = Modbus_VCAN_GetUart(ulBase);
+            //the node waits for room in the FIFO while the line runs
+            while(!UARTCharPutNonBlocking(ulBase, ucData))
+                Modbus_VCAN_Run(uart->tx_end + 1);
+}
+
+tBoolean UARTBusy(unsigned long ulBase)
+{
+        struct Modbus_VCAN_Uart *uart = Modbus_VCAN_GetUart(ulBase);
+            //the node polls it until the line is free, so the line runs until the character in course ends
+            if(uart->shifting)
+                Modbus_VCAN_Run(uart->tx_end + 1);
+            return uart->shifting || uart->tx_count;
+}
+
+void UARTIntEnable(unsigned long ulBase, unsigned long ulIntFlags)
+{
+        Modbus_VCAN_GetUart(ulBase)->mask |= ulIntFlags;
+}
+
+void UARTIntDisable(unsigned long ulBase, unsigned long ulIntFlags)
+{
+        Modbus_VCAN_GetUart(ulBase)->mask &= ~ulIntFlags;
+}
+
+unsigned long UARTIntStatus(unsigned long ulBase, tBoolean bMasked)
+{
+        struct Modbus_VCAN_Uart *uart = Modbus_VCAN_GetUart(ulBase);
+            return bMasked ? (uart->raw & uart->mask) : uart->raw;
+}
+
+void UARTIntClear(unsigned long ulBase, unsigned long ulIntFlags)
+{
+        Modbus_VCAN_GetUart(ulBase)->raw &= ~ulIntFlags;
+}
+
+void GPIOPinTypeCAN(unsigned long ulPort, unsigned char ucPins)
+{
+}
+
+void GPIOPinTypeUART(unsigned long ulPort, unsigned char ucPins)
+{
+}
+
+void GPIOPinTypeGPIOInput(unsigned long ulPort, unsigned char ucPins)
+{
+}
+
+void GPIOPinTypeGPIOOutput(unsigned long ulPort, unsigned char ucPins)
+{
+}
+
+void GPIOPadConfigSet(unsigned long ulPort, unsigned char ucPins, unsigned long ulStrength, unsigned long ulPadType)
+{
+}
+
+long GPIOPinRead(unsigned long ulPort, unsigned char ucPins)
+{
+        return 0;
+}
+
+void GPIOPinWrite(unsigned long ulPort, unsigned char ucPins, unsigned char ucVal)
+{
+}
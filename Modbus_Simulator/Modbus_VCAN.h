@@ -0,0 +1,240 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+#ifndef MODBUS_VCAN_H_
+#define MODBUS_VCAN_H_
+
+/**
+*   @defgroup VCAN Virtual CAN
+*   @brief Virtual CAN controller, timers and bus to run the Modbus CAN nodes on a Linux host.
+*
+*   @author Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+*
+*   This module stands in for the functions of the Texas Instruments driver library used by the master and the slaves
+*   (CANMessageSet, CANMessageGet, CANIntStatus, CANStatusGet, the timers, the interruptions...), so the real sources of the
+*   Modbus_Project_Master and Modbus_Project_Slave folders run without the LM3S8962 and LM3S2110 boards. Several nodes share one
+*   process: each node is a board (struct Modbus_VCAN_Board) with its own CAN controller, timers and vector table.
+*
+*   Everything happens in virtual time, in picoseconds, so the results do not depend on the host:
+*
+*       -The frames are built bit by bit (SOF, identifier, control field, data, CRC) with the bit stuffing of the CAN standard, so
+*        their length in the bus is exact. A CAN FD frame (MSG_OBJ_FD_FORMAT) has the stuff count and the fixed stuff bits, and its
+*        data phase goes at the bit rate of CANDataBitTimingSet() if MSG_OBJ_BIT_RATE_SWITCH is set. The bit time is the one of
+*        CANSetBitTiming() and the CAN clock of struct Modbus_VCAN_Config.
+*       -When the bus is idle, every node offers its lowest message object with a transmission request; the lowest identifier wins
+*        the arbitration bit by bit (dominant bits win), as in the bus.
+*       -The frame is acknowledged by every node which is on the bus and it is stored in the first receive message object whose
+*        filter accepts it and has not new data (NEWDAT); if the one at the end of the buffer has new data, it is overwritten and
+*        the data lost flag is set. In this way, the FIFOs of chained message objects (MSG_OBJ_FIFO) work as in the controller.
+*       -The interruption causes are the ones of CANIntStatus(): the status interruption (TXOK, RXOK, last error code and, with
+*        CAN_INT_ERROR, the warning and bus-off changes) goes first, and then the lowest message object with its interruption pending.
+*       -Optionally, frames are corrupted with a probability (error frames, error counters, error passive and bus-off, and the
+*        recovery after 128 sequences of 11 recessive bits).
+*
+*   The nodes built for the serial line use the UART1 instead: the characters are sent bit time by bit time (start, data, parity
+*   and stop bits) from the transmit FIFO, received at the end of their stop bit into the receive FIFO of every other node and, as in
+*   the UART of the LM3S8962, raise the receive interruption at the FIFO level and the receive timeout interruption after 32 bit
+*   times without characters, the transmit interruption when the transmit FIFO goes down to its level, and the error bits of
+*   UARTDR (a character sent while other node sends, or with another baud rate, has a framing error).
+*
+*   A board is given its CPU time with a simple model: each pass of its main loop costs some cycles, more if it did some work,
+*   and each interruption handler costs some cycles, in which no other handler of the node starts; a slow node, which can not
+*   drain its receive FIFO as fast as the frames arrive, is made with Modbus_VCAN_SetIsrCycles().
+*   SysCtlDelay() and Modbus_VCAN_Idle() make the rest of the world run meanwhile, so the interruptions of the node are
+*   attended during them. The node which drives the simulation (the foreground one, normally the master with the benchmark)
+*   has no main loop: its time only passes through those functions.
+*
+*   The nodes of other boards are built as objects whose symbols are local (see the Makefile), so a slave can be linked several
+*   times in the same program; each copy registers itself with Modbus_VCAN_Register() before main().
+*/
+/** @{ */
+#include "stdint.h"
+
+//! Maximum number of nodes in the bus.
+#define MODBUS_VCAN_NODES 16
+//! Message objects of each CAN controller.
+#define MODBUS_VCAN_OBJECTS 32
+//! Entries of the vector table of each node.
+#define MODBUS_VCAN_VECTORS 64
+//! Picoseconds in a second, the unit of the virtual time.
+#define MODBUS_VCAN_SECOND 1000000000000ULL
+//! Option of the slaves of the benchmark: the published block 1 in change of state mode.
+#define MODBUS_VCAN_OPTION_COS 0x01
+//! Option of the slaves of the benchmark: the published block 1 in the transmit window of the slave, in the schedule.
+#define MODBUS_VCAN_OPTION_SCHEDULE 0x02
+//! Option of the slaves of the benchmark: the long requests of the master paced by the flow control of the slave.
+#define MODBUS_VCAN_OPTION_FLOW 0x04
+//! Block size asked by the slaves with MODBUS_VCAN_OPTION_FLOW: the message objects of their unicast receive FIFO.
+#define MODBUS_VCAN_FLOW_BLOCK 8
+//! Bit times of each transmit window of the schedule: a frame of 8 bytes with a 29-bits ID, its worst stuffing and the interframe space.
+#define MODBUS_VCAN_WINDOW_BITS 160
+
+//! Board which can be plugged into the bus.
+struct Modbus_VCAN_Board
+{
+      const char *name;                                        //!< Name of the board, for the messages
+      void (*init)(unsigned char number, unsigned long bit_rate); //!< Initialisation, as the main() of the board; _number_ is the node number
+      unsigned char (*loop)(void);                             //!< One pass of the main loop; it returns 1 if it did some work. NULL if it is the foreground node
+      void (*vectors[MODBUS_VCAN_VECTORS])(void);              //!< Vector table, by interruption number (INT_CAN0, INT_TIMER1A...)
+};
+
+//! Parameters of the simulation.
+struct Modbus_VCAN_Config
+{
+      unsigned long cpu_clock;          //!< System clock of the nodes, in Hz (SysCtlClockGet)
+      unsigned long can_clock;          //!< Clock of the CAN controllers, in Hz; the time quantum is prescaler / can_clock
+      unsigned long loop_cycles;        //!< Cycles of a pass of the main loop without work
+      unsigned long work_cycles;        //!< Cycles of a pass of the main loop which did some work (a request processed)
+      unsigned long isr_cycles;         //!< Cycles of each interruption, added to the main loop of the node; the next one waits for them
+      double error_rate;                //!< Probability of a frame being corrupted, from 0 to 1
+      unsigned long seed;               //!< Seed of the corruptions
+      unsigned long board_option;       //!< Option for the boards, which they read with Modbus_VCAN_BoardOption()
+};
+
+//! Counters of the bus; they are reset by Modbus_VCAN_Setup().
+struct Modbus_VCAN_Stats
+{
+      uint64_t frames;                  //!< Frames sent without errors
+      uint64_t fd_frames;               //!< CAN FD frames among _frames_
+      uint64_t error_frames;            //!< Frames ended by an error frame (corruption or no acknowledge)
+      uint64_t bits;                    //!< Bits of the frames in the bus, stuff bits and interframe space included
+      uint64_t stuff_bits;              //!< Stuff bits among _bits_
+      uint64_t data_bytes;              //!< Data bytes of the frames sent without errors
+      uint64_t arbitrations;            //!< Arbitrations with more than one node
+      uint64_t arbitration_lost;        //!< Frames which lost an arbitration
+      uint64_t overruns;                //!< Frames which overwrote new data (data lost)
+      uint64_t interrupts;              //!< Interruption handlers run, all nodes
+      uint64_t busy;                    //!< Time of the bus with frames (error frames included, interframe spaces not), in picoseconds
+      uint64_t uart_chars;              //!< Characters sent in the serial line
+      uint64_t uart_errors;             //!< Characters received with a framing or parity error
+      uint64_t uart_overruns;           //!< Characters lost because a receive FIFO was full
+};
+
+/**
+*    @brief Function to register a board.
+*
+*    It is called before main() by each board built into the program (the slaves use a constructor).
+*    @param board The board.
+*/
+void Modbus_VCAN_Register(struct Modbus_VCAN_Board *board);
+
+/**
+*    @brief Function to get a registered board.
+*
+*    @param index The position of the board, in order of registration.
+*    @return The board, or NULL if there are not so many.
+*/
+struct Modbus_VCAN_Board *Modbus_VCAN_GetBoard(unsigned char index);
+
+/**
+*    @brief Function to start a simulation.
+*
+*    All the nodes are switched off, the bus is idle and the time and the counters are set to 0.
+*    @param config The parameters of the simulation.
+*/
+void Modbus_VCAN_Setup(const struct Modbus_VCAN_Config *config);
+
+/**
+*    @brief Function to switch on a node.
+*
+*    A new node is plugged into the bus with the board, and the init function of the board is called in its context. If the
+*    board has no main loop, it is the foreground node: it is the current node when this function returns, and the calls of the
+*    program go to its controller and timers.
+*    @param board The board of the node.
+*    @param number The node number given to the init function (the slave number).
+*    @param bit_rate The bit rate given to the init function (enum Modbus_CAN_BitRate).
+*    @return The index of the node.
+*/
+unsigned char Modbus_VCAN_PowerOn(struct Modbus_VCAN_Board *board, unsigned char number, unsigned long bit_rate);
+
+/**
+*    @brief Function to let the current node spend time.
+*
+*    The bus and the other nodes run during _cycles_ cycles of the system clock, and the interruptions of the current node are
+*    attended. SysCtlDelay() uses it.
+*    @param cycles The cycles spent.
+*/
+void Modbus_VCAN_Idle(unsigned long cycles);
+
+/**
+*    @brief Function to get the virtual time.
+*
+*    @return The time since Modbus_VCAN_Setup(), in picoseconds.
+*/
+uint64_t Modbus_VCAN_Now(void);
+
+/**
+*    @brief Function to get the option of the boards.
+*
+*    It lets the benchmark choose how the boards are set up, for example a mode of the slaves, from their init function.
+*    @return The option of struct Modbus_VCAN_Config.
+*/
+unsigned long Modbus_VCAN_BoardOption(void);
+
+/**
+*    @brief Function to change the cycles of the interruptions of a node.
+*
+*    Each interruption handler of the node takes _cycles_ cycles instead of the ones of struct Modbus_VCAN_Config: its main loop
+*    is delayed and the next handler waits for them, so the frames which arrive meanwhile wait in the receive message objects.
+*    @param node The index of the node.
+*    @param cycles The cycles of each interruption.
+*/
+void Modbus_VCAN_SetIsrCycles(unsigned char node, unsigned long cycles);
+
+/**
+*    @brief Function to change the probability of a frame being corrupted.
+*
+*    The frames which start from now on are corrupted with the new probability, so a storm of errors can be made in the middle of a
+*    simulation and stopped; the counters and the sequence of the corruptions go on.
+*    @param error_rate The probability, from 0 to 1; 1 corrupts every frame.
+*/
+void Modbus_VCAN_SetErrorRate(double error_rate);
+
+/**
+*    @brief Function to get the bit time of a node.
+*
+*    @param node The index of the node.
+*    @param fast 1 for the data phase of the CAN FD frames, 0 for the nominal bit time.
+*    @return The bit time in picoseconds, as set by CANSetBitTiming() or CANDataBitTimingSet().
+*/
+uint64_t Modbus_VCAN_BitTime(unsigned char node, unsigned char fast);
+
+/**
+*    @brief Function to inspect the counters of the bus.
+*
+*    @param stats Where the counters are copied.
+*/
+void Modbus_VCAN_GetStats(struct Modbus_VCAN_Stats *stats);
+
+/**
+*    @brief Function to get the interruption handlers run by a node.
+*
+*    @param node The number of the node.
+*    @param vector The interruption number, as INT_UART1, or 0 for all of them.
+*    @return The handlers run.
+*/
+uint64_t Modbus_VCAN_GetInterrupts(unsigned char node, unsigned char vector);
+
+/**
+*    @brief Function to get the longest pass of the main loop of a node since the last call, blocking calls included.
+*
+*    @param node The number of the node.
+*    @return The virtual time of the pass, in picoseconds.
+*/
+uint64_t Modbus_VCAN_LongestLoop(unsigned char node);
+
+/**
+*    @brief Function to get the characters sent by a node in the serial line.
+*
+*    @param node The number of the node.
+*    @return The characters sent.
+*/
+uint64_t Modbus_VCAN_UartChars(unsigned char node);
+
+/**
+*    @brief Function to corrupt the next characters sent by the current node in the serial line.
+*
+*    They are received with a parity error (UART_DR_PE) by the nodes which check the parity.
+*    @param characters The characters corrupted.
+*/
+void Modbus_VCAN_UartCorrupt(unsigned long characters);
+/** @} */
+#endif
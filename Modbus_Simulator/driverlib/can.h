@@ -0,0 +1,114 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+// Host stand-in of the StellarisWare CAN driver; the functions are implemented by the virtual CAN controller (Modbus_VCAN.c).
+// The names and values are the ones of the driver library, plus the CAN FD flags of the virtual controller.
+#ifndef __CAN_H__
+#define __CAN_H__
+
+#include "inc/hw_types.h"
+
+//! Interrupt sources of the CAN controller (CANIntEnable).
+#define CAN_INT_ERROR           0x00000008
+#define CAN_INT_STATUS          0x00000004
+#define CAN_INT_MASTER          0x00000002
+
+//! Flags of the message objects (tCANMsgObject.ulFlags).
+#define MSG_OBJ_NO_FLAGS        0x00000000
+#define MSG_OBJ_TX_INT_ENABLE   0x00000001
+#define MSG_OBJ_RX_INT_ENABLE   0x00000002
+#define MSG_OBJ_EXTENDED_ID     0x00000004
+#define MSG_OBJ_USE_ID_FILTER   0x00000008
+#define MSG_OBJ_USE_DIR_FILTER  (0x00000010 | MSG_OBJ_USE_ID_FILTER)
+#define MSG_OBJ_USE_EXT_FILTER  (0x00000020 | MSG_OBJ_USE_ID_FILTER)
+#define MSG_OBJ_REMOTE_FRAME    0x00000040
+#define MSG_OBJ_NEW_DATA        0x00000080
+#define MSG_OBJ_DATA_LOST       0x00000100
+#define MSG_OBJ_FIFO            0x00000200
+//! CAN FD frame; only the virtual controller has it.
+#define MSG_OBJ_FD_FORMAT       0x00000400
+//! CAN FD frame with the data phase at the bit rate of CANDataBitTimingSet; only the virtual controller has it.
+#define MSG_OBJ_BIT_RATE_SWITCH 0x00000800
+
+//! Bits of the status register (CANStatusGet with CAN_STS_CONTROL).
+#define CAN_STATUS_BUS_OFF      0x00000080
+#define CAN_STATUS_EWARN        0x00000040
+#define CAN_STATUS_EPASS        0x00000020
+#define CAN_STATUS_RXOK         0x00000010
+#define CAN_STATUS_TXOK         0x00000008
+#define CAN_STATUS_LEC_MSK      0x00000007
+#define CAN_STATUS_LEC_NONE     0x00000000
+#define CAN_STATUS_LEC_STUFF    0x00000001
+#define CAN_STATUS_LEC_FORM     0x00000002
+#define CAN_STATUS_LEC_ACK      0x00000003
+#define CAN_STATUS_LEC_BIT1     0x00000004
+#define CAN_STATUS_LEC_BIT0     0x00000005
+#define CAN_STATUS_LEC_CRC      0x00000006
+#define CAN_STATUS_LEC_MASK     0x00000007
+
+//! Message object, as it is given to CANMessageSet and returned by CANMessageGet.
+typedef struct
+{
+    unsigned long ulMsgID;
+    unsigned long ulMsgIDMask;
+    unsigned long ulFlags;
+    unsigned long ulMsgLen;
+    unsigned char *pucMsgData;
+} tCANMsgObject;
+
+//! Bit time, in time quanta of the CAN clock.
+typedef struct
+{
+    unsigned long ulSyncPropPhase1Seg;
+    unsigned long ulPhase2Seg;
+    unsigned long ulSJW;
+    unsigned long ulQuantumPrescaler;
+} tCANBitClkParms;
+
+//! Interrupt registers read by CANIntStatus.
+typedef enum
+{
+    CAN_INT_STS_CAUSE,
+    CAN_INT_STS_OBJECT
+} tCANIntStsReg;
+
+//! Status registers read by CANStatusGet.
+typedef enum
+{
+    CAN_STS_CONTROL,
+    CAN_STS_TXREQUEST,
+    CAN_STS_NEWDAT,
+    CAN_STS_MSGVAL
+} tCANStsReg;
+
+//! Types of message objects.
+typedef enum
+{
+    MSG_OBJ_TYPE_TX,
+    MSG_OBJ_TYPE_TX_REMOTE,
+    MSG_OBJ_TYPE_RX,
+    MSG_OBJ_TYPE_RX_REMOTE,
+    MSG_OBJ_TYPE_RXTX_REMOTE
+} tMsgObjType;
+
+extern void CANBitTimingGet(unsigned long ulBase, tCANBitClkParms *pClkParms);
+extern void CANBitTimingSet(unsigned long ulBase, tCANBitClkParms *pClkParms);
+extern void CANSetBitTiming(unsigned long ulBase, tCANBitClkParms *pClkParms);
+extern void CANDataBitTimingSet(unsigned long ulBase, tCANBitClkParms *pClkParms);
+extern void CANDisable(unsigned long ulBase);
+extern void CANEnable(unsigned long ulBase);
+extern tBoolean CANErrCntrGet(unsigned long ulBase, unsigned long *pulRxCount, unsigned long *pulTxCount);
+extern void CANInit(unsigned long ulBase);
+extern void CANIntClear(unsigned long ulBase, unsigned long ulIntClr);
+extern void CANIntDisable(unsigned long ulBase, unsigned long ulIntFlags);
+extern void CANIntEnable(unsigned long ulBase, unsigned long ulIntFlags);
+extern unsigned long CANIntStatus(unsigned long ulBase, tCANIntStsReg eIntStsReg);
+extern void CANMessageClear(unsigned long ulBase, unsigned long ulObjID);
+extern void CANMessageGet(unsigned long ulBase, unsigned long ulObjID, tCANMsgObject *pMsgObject, tBoolean bClrPendingInt);
+extern void CANMessageSet(unsigned long ulBase, unsigned long ulObjID, tCANMsgObject *pMsgObject, tMsgObjType eMsgType);
+extern tBoolean CANRetryGet(unsigned long ulBase);
+extern void CANRetrySet(unsigned long ulBase, tBoolean bAutoRetry);
+extern unsigned long CANStatusGet(unsigned long ulBase, tCANStsReg eStatusReg);
+
+//! Clock of the CAN controllers of the virtual bus, in Hz; not in the driver library, the host build takes it as MODBUS_CAN_CLOCK.
+extern unsigned long Modbus_VCAN_CanClock(void);
+
+#endif // __CAN_H__
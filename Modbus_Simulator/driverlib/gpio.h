@@ -0,0 +1,26 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+// Host stand-in of the StellarisWare GPIO driver; the pins only keep their value (Modbus_VCAN.c).
+#ifndef __GPIO_H__
+#define __GPIO_H__
+
+#define GPIO_PIN_0              0x00000001
+#define GPIO_PIN_1              0x00000002
+#define GPIO_PIN_2              0x00000004
+#define GPIO_PIN_3              0x00000008
+#define GPIO_PIN_4              0x00000010
+#define GPIO_PIN_5              0x00000020
+#define GPIO_PIN_6              0x00000040
+#define GPIO_PIN_7              0x00000080
+
+#define GPIO_STRENGTH_2MA       0x00000001
+#define GPIO_PIN_TYPE_STD_WPU   0x0000000A
+
+extern void GPIOPinTypeCAN(unsigned long ulPort, unsigned char ucPins);
+extern void GPIOPinTypeUART(unsigned long ulPort, unsigned char ucPins);
+extern void GPIOPinTypeGPIOInput(unsigned long ulPort, unsigned char ucPins);
+extern void GPIOPinTypeGPIOOutput(unsigned long ulPort, unsigned char ucPins);
+extern void GPIOPadConfigSet(unsigned long ulPort, unsigned char ucPins, unsigned long ulStrength, unsigned long ulPadType);
+extern long GPIOPinRead(unsigned long ulPort, unsigned char ucPins);
+extern void GPIOPinWrite(unsigned long ulPort, unsigned char ucPins, unsigned char ucVal);
+
+#endif // __GPIO_H__
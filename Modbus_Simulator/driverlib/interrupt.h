@@ -0,0 +1,13 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+// Host stand-in of the StellarisWare interrupt driver; the vector table of each node is given to Modbus_VCAN.c.
+#ifndef __INTERRUPT_H__
+#define __INTERRUPT_H__
+
+#include "inc/hw_types.h"
+
+extern tBoolean IntMasterEnable(void);
+extern tBoolean IntMasterDisable(void);
+extern void IntEnable(unsigned long ulInterrupt);
+extern void IntDisable(unsigned long ulInterrupt);
+
+#endif // __INTERRUPT_H__
@@ -0,0 +1,29 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+// Host stand-in of the StellarisWare system control driver; SysCtlDelay spends virtual time (Modbus_VCAN.c).
+#ifndef __SYSCTL_H__
+#define __SYSCTL_H__
+
+#define SYSCTL_PERIPH_CAN0      0x00100001
+#define SYSCTL_PERIPH_UART0     0x10000001
+#define SYSCTL_PERIPH_UART1     0x10000002
+#define SYSCTL_PERIPH_TIMER0    0x10100001
+#define SYSCTL_PERIPH_TIMER1    0x10100002
+#define SYSCTL_PERIPH_TIMER2    0x10100004
+#define SYSCTL_PERIPH_TIMER3    0x10100008
+#define SYSCTL_PERIPH_GPIOA     0x20000001
+#define SYSCTL_PERIPH_GPIOB     0x20000002
+#define SYSCTL_PERIPH_GPIOC     0x20000004
+#define SYSCTL_PERIPH_GPIOD     0x20000008
+#define SYSCTL_PERIPH_GPIOF     0x20000020
+
+#define SYSCTL_SYSDIV_5         0x02400000
+#define SYSCTL_USE_PLL          0x00000000
+#define SYSCTL_XTAL_8MHZ        0x00000380
+#define SYSCTL_OSC_MAIN         0x00000000
+
+extern void SysCtlPeripheralEnable(unsigned long ulPeripheral);
+extern void SysCtlClockSet(unsigned long ulConfig);
+extern unsigned long SysCtlClockGet(void);
+extern void SysCtlDelay(unsigned long ulCount);
+
+#endif // __SYSCTL_H__
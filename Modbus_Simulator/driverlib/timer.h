@@ -0,0 +1,33 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+// Host stand-in of the StellarisWare timer driver; the timers are simulated by Modbus_VCAN.c in cycles of the system clock.
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include "inc/hw_types.h"
+
+//! Configurations of the timers (TimerConfigure); only the full-width ones are simulated.
+#define TIMER_CFG_32_BIT_OS     0x00000001
+#define TIMER_CFG_32_BIT_PER    0x00000002
+#define TIMER_CFG_ONE_SHOT      TIMER_CFG_32_BIT_OS
+#define TIMER_CFG_PERIODIC      TIMER_CFG_32_BIT_PER
+
+//! Halves of a timer.
+#define TIMER_A                 0x000000ff
+#define TIMER_B                 0x0000ff00
+#define TIMER_BOTH              0x0000ffff
+
+//! Interrupt sources of the timers.
+#define TIMER_TIMA_TIMEOUT      0x00000001
+
+extern void TimerConfigure(unsigned long ulBase, unsigned long ulConfig);
+extern void TimerEnable(unsigned long ulBase, unsigned long ulTimer);
+extern void TimerDisable(unsigned long ulBase, unsigned long ulTimer);
+extern void TimerLoadSet(unsigned long ulBase, unsigned long ulTimer, unsigned long ulValue);
+extern unsigned long TimerLoadGet(unsigned long ulBase, unsigned long ulTimer);
+extern unsigned long TimerValueGet(unsigned long ulBase, unsigned long ulTimer);
+extern void TimerIntEnable(unsigned long ulBase, unsigned long ulIntFlags);
+extern void TimerIntDisable(unsigned long ulBase, unsigned long ulIntFlags);
+extern unsigned long TimerIntStatus(unsigned long ulBase, tBoolean bMasked);
+extern void TimerIntClear(unsigned long ulBase, unsigned long ulIntFlags);
+
+#endif // __TIMER_H__
@@ -0,0 +1,62 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+// Host stand-in of the StellarisWare UART driver; the UART1 of each node is simulated by Modbus_VCAN.c, on one serial line.
+#ifndef __UART_H__
+#define __UART_H__
+
+#include "inc/hw_types.h"
+
+//! Interrupt sources of the UART (UARTIntEnable).
+#define UART_INT_OE             0x400       // Overrun Error Interrupt Mask
+#define UART_INT_BE             0x200       // Break Error Interrupt Mask
+#define UART_INT_PE             0x100       // Parity Error Interrupt Mask
+#define UART_INT_FE             0x080       // Framing Error Interrupt Mask
+#define UART_INT_RT             0x040       // Receive Timeout Interrupt Mask
+#define UART_INT_TX             0x020       // Transmit Interrupt Mask
+#define UART_INT_RX             0x010       // Receive Interrupt Mask
+
+//! Frame of the characters (UARTConfigSetExpClk).
+#define UART_CONFIG_WLEN_MASK   0x00000060
+#define UART_CONFIG_WLEN_8      0x00000060
+#define UART_CONFIG_WLEN_7      0x00000040
+#define UART_CONFIG_WLEN_6      0x00000020
+#define UART_CONFIG_WLEN_5      0x00000000
+#define UART_CONFIG_STOP_MASK   0x00000008
+#define UART_CONFIG_STOP_ONE    0x00000000
+#define UART_CONFIG_STOP_TWO    0x00000008
+#define UART_CONFIG_PAR_MASK    0x00000086
+#define UART_CONFIG_PAR_NONE    0x00000000
+#define UART_CONFIG_PAR_EVEN    0x00000006
+#define UART_CONFIG_PAR_ODD     0x00000002
+
+//! Levels of the FIFO interruptions (UARTFIFOLevelSet): the transmit one at or below 2, 4, 8, 12 or 14 characters, the receive
+//! one at or above them.
+#define UART_FIFO_TX1_8         0x00000000
+#define UART_FIFO_TX2_8         0x00000001
+#define UART_FIFO_TX4_8         0x00000002
+#define UART_FIFO_TX6_8         0x00000003
+#define UART_FIFO_TX7_8         0x00000004
+#define UART_FIFO_RX1_8         0x00000000
+#define UART_FIFO_RX2_8         0x00000008
+#define UART_FIFO_RX4_8         0x00000010
+#define UART_FIFO_RX6_8         0x00000018
+#define UART_FIFO_RX7_8         0x00000020
+
+extern void UARTConfigSetExpClk(unsigned long ulBase, unsigned long ulUARTClk, unsigned long ulBaud, unsigned long ulConfig);
+extern void UARTEnable(unsigned long ulBase);
+extern void UARTDisable(unsigned long ulBase);
+extern void UARTFIFOEnable(unsigned long ulBase);
+extern void UARTFIFODisable(unsigned long ulBase);
+extern void UARTFIFOLevelSet(unsigned long ulBase, unsigned long ulTxLevel, unsigned long ulRxLevel);
+extern tBoolean UARTCharsAvail(unsigned long ulBase);
+extern tBoolean UARTSpaceAvail(unsigned long ulBase);
+extern long UARTCharGetNonBlocking(unsigned long ulBase);
+extern long UARTCharGet(unsigned long ulBase);
+extern tBoolean UARTCharPutNonBlocking(unsigned long ulBase, unsigned char ucData);
+extern void UARTCharPut(unsigned long ulBase, unsigned char ucData);
+extern tBoolean UARTBusy(unsigned long ulBase);
+extern void UARTIntEnable(unsigned long ulBase, unsigned long ulIntFlags);
+extern void UARTIntDisable(unsigned long ulBase, unsigned long ulIntFlags);
+extern unsigned long UARTIntStatus(unsigned long ulBase, tBoolean bMasked);
+extern void UARTIntClear(unsigned long ulBase, unsigned long ulIntFlags);
+
+#endif // __UART_H__
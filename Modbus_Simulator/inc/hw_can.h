@@ -0,0 +1,11 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+// Host stand-in of the StellarisWare header, for the virtual CAN bus (Modbus_VCAN.h).
+#ifndef __HW_CAN_H__
+#define __HW_CAN_H__
+
+//! Value of the interrupt identifier (CANINT) when the status interrupt is pending.
+#define CAN_INT_INTID_STATUS    0x00008000
+//! Interrupt identifier (CANINT) when no interrupt is pending.
+#define CAN_INT_INTID_NONE      0x00000000
+
+#endif // __HW_CAN_H__
@@ -0,0 +1,24 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+// Host stand-in of the StellarisWare header, for the virtual CAN bus and serial line (Modbus_VCAN.h).
+// The interrupt numbers are the ones of the vector table of the LM3S8962 and LM3S2110.
+#ifndef __HW_INTS_H__
+#define __HW_INTS_H__
+
+#define INT_GPIOA               16          // GPIO Port A
+#define INT_GPIOF               46          // GPIO Port F
+#define INT_UART0               21          // UART0 Rx and Tx
+#define INT_UART1               22          // UART1 Rx and Tx
+#define INT_TIMER0A             35          // Timer 0 subtimer A
+#define INT_TIMER0B             36          // Timer 0 subtimer B
+#define INT_TIMER1A             37          // Timer 1 subtimer A
+#define INT_TIMER1B             38          // Timer 1 subtimer B
+#define INT_TIMER2A             39          // Timer 2 subtimer A
+#define INT_TIMER2B             40          // Timer 2 subtimer B
+#define INT_TIMER3A             51          // Timer 3 subtimer A
+#define INT_TIMER3B             52          // Timer 3 subtimer B
+#define INT_CAN0                55          // CAN0
+
+//! Number of entries of the vector table.
+#define NUM_INTERRUPTS          64
+
+#endif // __HW_INTS_H__
@@ -0,0 +1,17 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+// Host stand-in of the StellarisWare header, for the virtual CAN bus (Modbus_VCAN.h).
+#ifndef __HW_TYPES_H__
+#define __HW_TYPES_H__
+
+//! Boolean type of the driver library.
+typedef unsigned char tBoolean;
+
+#ifndef true
+#define true 1
+#endif
+
+#ifndef false
+#define false 0
+#endif
+
+#endif // __HW_TYPES_H__
@@ -0,0 +1,13 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+// Host stand-in of the StellarisWare header, for the virtual serial line (Modbus_VCAN.h).
+#ifndef __HW_UART_H__
+#define __HW_UART_H__
+
+//! Bits of UARTDR, the data register: the error flags come with each character read.
+#define UART_DR_OE              0x00000800  // UART Overrun Error
+#define UART_DR_BE              0x00000400  // UART Break Error
+#define UART_DR_PE              0x00000200  // UART Parity Error
+#define UART_DR_FE              0x00000100  // UART Framing Error
+#define UART_DR_DATA_M          0x000000FF  // Data Transmitted or Received
+
+#endif // __HW_UART_H__
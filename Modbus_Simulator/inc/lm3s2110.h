@@ -0,0 +1,5 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+// Host stand-in of the StellarisWare header, for the virtual CAN bus (Modbus_VCAN.h); the registers are not mapped.
+#ifndef __LM3S2110_H__
+#define __LM3S2110_H__
+#endif // __LM3S2110_H__
@@ -0,0 +1,17 @@
+// Author: Francisco Javier Guzman Jimenez, <dejavits@gmail.com>
+// Host stand-in of the StellarisWare header, for the virtual CAN bus and serial line (Modbus_VCAN.h); the registers are not
+// mapped, but the ones which the serial nodes write for their LED are plain variables of Modbus_VCAN.c.
+#ifndef __LM3S8962_H__
+#define __LM3S8962_H__
+
+//! Registers written by the serial nodes: the clock gating of the GPIO ports and the port F of the LED.
+extern volatile unsigned long Modbus_VCAN_Registers[4];
+
+#define SYSCTL_RCGC2_R          (Modbus_VCAN_Registers[0])
+#define GPIO_PORTF_DIR_R        (Modbus_VCAN_Registers[1])
+#define GPIO_PORTF_DEN_R        (Modbus_VCAN_Registers[2])
+#define GPIO_PORTF_DATA_R       (Modbus_VCAN_Registers[3])
+
+#define SYSCTL_RCGC2_GPIOF      0x00000020  // Port F Clock Gating Control
+
+#endif // __LM3S8962_H__